@@ -1,9 +1,12 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <fstream>
+#include <functional>
 #include "tensor.hpp"
 #include "transform.hpp"
 #include "canvas.hpp"
+#include "image_writer.hpp"
 #include "shapes.hpp"
 #include "ray.hpp"
 #include "intersection.hpp"
@@ -12,6 +15,11 @@
 #include "world.hpp"
 #include "camera.hpp"
 #include "patterns.hpp"
+#include "model_parser.hpp"
+#include "scene_parser.hpp"
+#include "world_snapshot.hpp"
+#include "geometry_proxy.hpp"
+#include "thread_pool.hpp"
 
 using namespace std;
 
@@ -42,6 +50,20 @@ projectile tick( const projectile& proj, const environment& env )
     return projectile( position, velocity );
 }
 
+#if DEVELOPMENT
+void print_trace_stats( const string& scene, const ls::world_ptr& w )
+{
+    const auto& stats = w->stats();
+    auto skipped = stats.light_samples - stats.shadow_rays;
+    auto saved = stats.light_samples > 0 ? 100.0 * skipped / stats.light_samples : 0.0;
+    cout << "[" << scene << "]: " << stats.shadow_rays << " shadow rays cast for " << stats.light_samples
+         << " light samples (" << saved << "% saved)" << endl;
+}
+#else
+void print_trace_stats( const string&, const ls::world_ptr& )
+{ }
+#endif
+
 void run_projectile_sample( uint16_t x_res, uint16_t y_res )
 {
     using namespace this_thread;
@@ -188,6 +210,7 @@ void run_simple_scene_sample( uint16_t x_res, uint16_t y_res )
     cam->set_transform( ls::transform::view( ls::f_point( 0, 1.5f, -5 ), ls::f_point( 0, 1, 0 ), ls::f_vector( 0, 1, 0 ) ) );
 
     auto canv = cam->render( w );
+    print_trace_stats( "Simple Scene", w );
     
     canv.write_to( "simple_scene_render.ppm" );
 }
@@ -230,13 +253,423 @@ void run_hexagon_scene_sample( uint16_t x_res, uint16_t y_res )
     cam->set_transform( ls::transform::view( ls::f_point( 0, 1.5f, -5 ), ls::f_point( 0, 1, 0 ), ls::f_vector( 0, 1, 0 ) ) );
 
     auto canv = cam->render( w );
+    print_trace_stats( "Hexagon Scene", w );
 
     canv.write_to( "hexagon_scene_render.ppm" );
 }
 
+void run_many_lights_scene_sample( uint16_t x_res, uint16_t y_res )
+{
+    auto floor = ls::plane::create();
+    auto floor_mat = ls::phong_material::create();
+    floor_mat->surface_pattern = ls::checker_pattern::create( ls::f_color( 1, 1, 1 ), ls::f_color( 0.2f, 0.2f, 0.2f ) );
+    floor_mat->specular = 0.2f;
+    floor->set_material( floor_mat );
+
+    auto w = ls::world::create();
+    w->add_object( floor );
+
+    for ( int i = 0; i < 5; i++ )
+    {
+        for ( int j = 0; j < 5; j++ )
+        {
+            auto sph = ls::sphere::create();
+            sph->set_transform( ls::transform::translation( -6.f + i * 3.f, 0.75f, -6.f + j * 3.f ) *
+                                ls::transform::scale( 0.75f, 0.75f, 0.75f ) );
+            auto sph_mat = ls::phong_material::create( ls::f_color( 0.2f + 0.15f * i, 0.8f, 0.2f + 0.15f * j ), 0.f, 0.7f, 0.3f );
+            sph->set_material( sph_mat );
+            w->add_object( sph );
+        }
+    }
+
+    // A 16x16 grid of small, colored lights with quadratic falloff hovering over the floor
+    for ( int i = 0; i < 16; i++ )
+    {
+        for ( int j = 0; j < 16; j++ )
+        {
+            auto light = ls::point_light::create( ls::f_color( 0.25f + 0.05f * ( i % 16 ), 0.5f, 0.25f + 0.05f * ( j % 16 ) ),
+                                                  ls::f_point( -12.f + i * 1.6f, 2.5f, -12.f + j * 1.6f ) );
+            light->set_falloff( 1.f, 0.f, 8.f );
+            w->add_light( light );
+        }
+    }
+
+    auto cam = ls::camera::create( x_res, y_res, ls::pi_over_3 );
+    cam->set_transform( ls::transform::view( ls::f_point( 0, 9.f, -14.f ), ls::f_point( 0, 0, 0 ), ls::f_vector( 0, 1, 0 ) ) );
+
+    auto start = chrono::steady_clock::now();
+    auto canv = cam->render( w );
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start );
+
+    cout << "[Many Lights Scene]: " << w->lights().size() << " lights rendered in " << elapsed.count() << "ms" << endl;
+    print_trace_stats( "Many Lights Scene", w );
+
+    canv.write_to( "many_lights_scene_render.ppm" );
+}
+void run_soft_shadow_scene_sample( uint16_t x_res, uint16_t y_res )
+{
+    auto floor = ls::plane::create();
+    auto floor_mat = ls::phong_material::create( ls::f_color( 1, 0.9f, 0.9f ) );
+    floor_mat->specular = 0.f;
+    floor->set_material( floor_mat );
+
+    auto sph = ls::sphere::create();
+    sph->set_transform( ls::transform::translation( 0.f, 1.f, 0.f ) );
+    sph->set_material( ls::phong_material::create( ls::f_color( 0.1f, 0.5f, 1.f ), 0.1f, 0.7f, 0.3f ) );
+
+    auto w = ls::world::create();
+    w->add_object( floor );
+    w->add_object( sph );
+
+    auto cam = ls::camera::create( x_res, y_res, ls::pi_over_3 );
+    cam->set_transform( ls::transform::view( ls::f_point( 0, 3.f, -6.f ), ls::f_point( 0, 0.75f, 0 ), ls::f_vector( 0, 1, 0 ) ) );
+
+    auto render_timed = [&cam, &w] ( const string& name ) {
+        auto start = chrono::steady_clock::now();
+        auto canv = cam->render( w );
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start );
+        cout << "[Soft Shadow Scene]: " << name << " rendered in " << elapsed.count() << "ms" << endl;
+        print_trace_stats( "Soft Shadow Scene", w );
+        return canv;
+    };
+
+    w->set_light( ls::point_light::create( ls::f_color( 1.5f, 1.5f, 1.5f ), ls::f_point( -3, 6, -3 ) ) );
+    render_timed( "Point light" );
+
+    // An 8x8 stratified rectangle light with the same center as the point light
+    auto area = ls::rectangle_light::create( ls::f_color( 1.5f, 1.5f, 1.5f ), ls::f_point( -4, 6, -4 ),
+                                             ls::f_vector( 2, 0, 0 ), 8, ls::f_vector( 0, 0, 2 ), 8 );
+    w->set_light( area );
+#if DEVELOPMENT
+    w->reset_stats();
+#endif
+    auto canv = render_timed( "8x8 area light" );
+
+    canv.write_to( "soft_shadow_scene_render.ppm" );
+}
+
+void run_compiled_scene_sample( uint16_t x_res, uint16_t y_res )
+{
+    auto floor = ls::plane::create();
+    floor->set_material( ls::phong_material::create( ls::f_color( 0.9f, 0.9f, 0.8f ) ) );
+
+    auto w = ls::world::create();
+    w->add_object( floor );
+    w->set_light( ls::point_light::create( ls::f_color( 1, 1, 1 ), ls::f_point( -10, 12, -10 ) ) );
+
+    // A 32x32 field of small shapes, one group per row
+    for ( int i = 0; i < 32; i++ )
+    {
+        auto row = ls::group::create();
+        row->set_transform( ls::transform::translation( 0.f, 0.f, -8.f + i * 0.5f ) );
+        for ( int j = 0; j < 32; j++ )
+        {
+            auto obj = j % 2 ? ls::shape_ptr( ls::sphere::create() ) : ls::shape_ptr( ls::cube::create() );
+            obj->set_transform( ls::transform::translation( -8.f + j * 0.5f, 0.2f, 0.f ) *
+                                ls::transform::scale( 0.2f, 0.2f, 0.2f ) );
+            obj->set_material( ls::phong_material::create( ls::f_color( 0.1f + 0.025f * j, 0.4f, 0.1f + 0.025f * i ) ) );
+            row->add_child( obj );
+        }
+        w->add_object( row );
+    }
+
+    auto cam = ls::camera::create( x_res, y_res, ls::pi_over_3 );
+    cam->set_transform( ls::transform::view( ls::f_point( 0, 6.f, -14.f ), ls::f_point( 0, 0, 0 ), ls::f_vector( 0, 1, 0 ) ) );
+    cam->set_threads( 1 );
+
+    // Tracing the authoring objects directly, as color_at does before the world is compiled
+    auto start = chrono::steady_clock::now();
+    auto reference = ls::canvas( x_res, y_res );
+    for ( uint16_t x = 0; x < x_res; x++ )
+    {
+        for ( uint16_t y = 0; y < y_res; y++ )
+        {
+            reference.draw_pixel( x, y, w->color_at( cam->ray_for_pixel( x, y ) ) );
+        }
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start );
+    cout << "[Compiled Scene]: Object traversal rendered in " << elapsed.count() << "ms" << endl;
+
+    start = chrono::steady_clock::now();
+    auto canv = cam->render( w );
+    elapsed = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start );
+    cout << "[Compiled Scene]: " << w->scene()->primitive_count() << " primitives rendered in " << elapsed.count() << "ms" << endl;
+
+    canv.write_to( "compiled_scene_render.ppm" );
+}
+
+void run_image_encoding_sample( uint16_t x_res, uint16_t y_res )
+{
+    auto canv = ls::canvas( x_res, y_res );
+    for ( uint16_t y = 0; y < y_res; y++ )
+    {
+        auto pixels = canv.row( y );
+        for ( uint16_t x = 0; x < x_res; x++ )
+        {
+            pixels[x] = ls::to_pixel( ls::f_color( static_cast<float>( x ) / x_res, static_cast<float>( y ) / y_res, 0.5f ) );
+        }
+    }
+
+    auto encode_timed = [&canv] ( const string& name, const string& file, ls::ppm_format format ) {
+        auto start = chrono::steady_clock::now();
+        ofstream out( file, ios::binary | ios::trunc );
+        ls::ppm_writer writer( out, canv.width(), canv.height(), format );
+        writer.write( canv );
+        writer.finish();
+        auto size = static_cast<double>( out.tellp() );
+        auto elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+        cout << "[Image Encoding]: " << name << " wrote " << size / 1e6 << "MB at " << size / 1e6 / elapsed << "MB/s" << endl;
+    };
+
+    auto map_timed = [&canv] ( const string& name, const ls::tone_mapper& mapper ) {
+        auto start = chrono::steady_clock::now();
+        auto rgb = mapper.map( canv );
+        auto elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+        auto size = static_cast<double>( canv.width() ) * canv.height() * sizeof( ls::rgba_pixel );
+        cout << "[Image Encoding]: " << name << " mapped " << size / 1e6 << "MB at " << size / 1e9 / elapsed << "GB/s" << endl;
+    };
+
+    map_timed( "Clamp", ls::tone_mapper() );
+    map_timed( "Reinhard sRGB", ls::tone_mapper( 1.f, ls::tone_curve::reinhard, ls::color_encoding::srgb ) );
+    map_timed( "ACES sRGB", ls::tone_mapper( 1.f, ls::tone_curve::aces, ls::color_encoding::srgb ) );
+
+    encode_timed( "P3", "image_encoding_p3.ppm", ls::ppm_format::ascii );
+    encode_timed( "P6", "image_encoding_p6.ppm", ls::ppm_format::binary );
+
+    auto start = chrono::steady_clock::now();
+    ofstream out( "image_encoding.pfm", ios::binary | ios::trunc );
+    ls::pfm_writer writer( out, canv.width(), canv.height() );
+    writer.write( canv );
+    writer.finish();
+    auto size = static_cast<double>( out.tellp() );
+    auto elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    cout << "[Image Encoding]: PFM wrote " << size / 1e6 << "MB at " << size / 1e6 / elapsed << "MB/s" << endl;
+
+    start = chrono::steady_clock::now();
+    auto read = ls::canvas::load_pfm( "image_encoding.pfm" );
+    elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    cout << "[Image Encoding]: PFM read " << size / 1e6 << "MB at " << size / 1e6 / elapsed << "MB/s" << endl;
+}
+
+void write_grid_obj( const string& file, uint16_t size )
+{
+    ofstream out( file, ios::trunc );
+    out.precision( 7 );
+    for ( uint16_t z = 0; z <= size; z++ )
+    {
+        for ( uint16_t x = 0; x <= size; x++ )
+        {
+            out << "v " << static_cast<float>( x ) / size - 0.5f << " " << 0.1f * sin( x * 0.3f ) * cos( z * 0.2f ) << " " << static_cast<float>( z ) / size - 0.5f << "\n";
+        }
+    }
+    for ( uint32_t z = 0; z < size; z++ )
+    {
+        out << "g strip" << z << "\n";
+        for ( uint32_t x = 0; x < size; x++ )
+        {
+            auto corner = z * ( size + 1 ) + x + 1;
+            out << "f " << corner << " " << corner + 1 << " " << corner + size + 2 << " " << corner + size + 1 << "\n";
+        }
+    }
+}
+
+void write_grid_ply( const string& file, uint16_t size )
+{
+    // The same grid as write_grid_obj, as a binary PLY in the machine's byte order
+    const uint16_t probe = 1;
+    ofstream out( file, ios::trunc | ios::binary );
+    out << "ply\nformat " << ( *reinterpret_cast<const uint8_t*>( &probe ) ? "binary_little_endian" : "binary_big_endian" ) << " 1.0\n"
+        << "element vertex " << ( size + 1 ) * ( size + 1 ) << "\nproperty float x\nproperty float y\nproperty float z\n"
+        << "element face " << size * size << "\nproperty list uchar int vertex_indices\nend_header\n";
+    for ( uint16_t z = 0; z <= size; z++ )
+    {
+        for ( uint16_t x = 0; x <= size; x++ )
+        {
+            const float v[3] = { static_cast<float>( x ) / size - 0.5f, 0.1f * sin( x * 0.3f ) * cos( z * 0.2f ), static_cast<float>( z ) / size - 0.5f };
+            out.write( reinterpret_cast<const char*>( v ), sizeof( v ) );
+        }
+    }
+    for ( int32_t z = 0; z < size; z++ )
+    {
+        for ( int32_t x = 0; x < size; x++ )
+        {
+            auto corner = z * ( size + 1 ) + x;
+            const int32_t face[4] = { corner, corner + 1, corner + size + 2, corner + size + 1 };
+            out.put( 4 );
+            out.write( reinterpret_cast<const char*>( face ), sizeof( face ) );
+        }
+    }
+}
+
+void run_obj_parsing_sample( uint16_t size )
+{
+    write_grid_obj( "obj_parsing.obj", size );
+    auto bytes = static_cast<double>( ifstream( "obj_parsing.obj", ios::ate | ios::binary ).tellg() );
+
+    auto parse_timed = [bytes] ( const string& name, const function<ls::model_parse_result()>& parse ) {
+        auto start = chrono::steady_clock::now();
+        auto result = parse();
+        auto elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+        cout << "[OBJ Parsing]: " << name << " parsed " << bytes / 1e6 << "MB, " << result.data->vertices.size() << " vertices in "
+            << elapsed * 1000 << "ms, " << bytes / 1e6 / elapsed << "MB/s" << endl;
+    };
+
+    parse_timed( "Stream", [] {
+        ifstream f( "obj_parsing.obj" );
+        return ls::model_parser::obj( f );
+    } );
+    parse_timed( "Mapped", [] {
+        return ls::model_parser::obj( "obj_parsing.obj" );
+    } );
+
+    // The same mapped file split into chunks for an increasing number of threads
+    auto max_threads = ls::thread_pool::hardware_threads();
+    for ( uint16_t threads = 1; ; threads = min<uint16_t>( threads * 2, max_threads ) )
+    {
+        parse_timed( "Mapped, " + to_string( threads ) + " thread(s)", [threads] {
+            return ls::model_parser::obj( "obj_parsing.obj", make_shared<ls::arena>(), threads );
+        } );
+        if ( threads == max_threads )
+        {
+            break;
+        }
+    }
+
+    // Converting once to a mesh cache skips the text entirely on every later load
+    parse_timed( "Converted to mesh cache", [] {
+        return ls::model_parser::obj_to_mesh_cache( "obj_parsing.obj", "obj_parsing.lsmesh" );
+    } );
+    auto start = chrono::steady_clock::now();
+    auto m = ls::mesh::load( "obj_parsing.lsmesh" );
+    auto elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    cout << "[OBJ Parsing]: Mesh cache loaded " << m->positions.size() << " vertices, " << m->triangle_count() << " triangles in "
+        << elapsed * 1000 << "ms" << endl;
+    parse_timed( "Mesh cache with shapes", [] {
+        return ls::model_parser::mesh_cache( "obj_parsing.lsmesh" );
+    } );
+
+    // The same grid read from a binary PLY, reporting against the size of the OBJ text
+    write_grid_ply( "obj_parsing.ply", size );
+    parse_timed( "Binary PLY", [] {
+        return ls::model_parser::ply( "obj_parsing.ply" );
+    } );
+}
+
+/**
+ * Loads and renders each scene file into a PPM next to it, printing the load and render
+ * times of each
+ */
+void run_scene_files_sample( int count, char* files[] )
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        const string file = files[i];
+        auto start = chrono::steady_clock::now();
+        auto result = ls::scene_parser::load( file );
+        auto loaded = chrono::steady_clock::now();
+        if ( result.status != ls::scene_parse_status::SUCCESS )
+        {
+            cout << "[Scene Files]: " << file << ":" << result.error->line_number << ": " << result.error->message << endl;
+            continue;
+        }
+        auto canv = result.camera->render( result.world );
+        auto rendered = chrono::steady_clock::now();
+        canv.write_to( file.substr( 0, file.find_last_of( '.' ) ) + ".ppm" );
+        cout << "[Scene Files]: " << file << " loaded in " << chrono::duration<double, milli>( loaded - start ).count()
+            << "ms, rendered in " << chrono::duration<double, milli>( rendered - loaded ).count() << "ms" << endl;
+    }
+}
+
+/**
+ * Writes a scene of size x size spheres in a handful of materials and times loading it
+ */
+void run_scene_loading_sample( uint16_t size )
+{
+    {
+        ofstream out( "scene_loading.scene" );
+        out << "camera 400 300 60deg from 0 " << size << " " << -size << " to 0 0 0 up 0 1 0\n"
+            << "light point 1 1 1 -10 " << size << " -10\n"
+            << "material shiny diffuse 0.7 specular 0.3 reflectivity 0.2\n"
+            << "plane color 0.3 0.3 0.3\n";
+        for ( int z = 0; z < size; z++ )
+        {
+            out << "group row" << z << " translate 0 0 " << z - size / 2 << "\n";
+            for ( int x = 0; x < size; x++ )
+            {
+                out << "  sphere material shiny color " << ( x % 4 ) / 4.f << " 0.5 " << ( z % 4 ) / 4.f << " scale 0.4 0.4 0.4 translate "
+                    << x - size / 2 << " 0.4 0\n";
+            }
+            out << "end\n";
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    auto result = ls::scene_parser::load( "scene_loading.scene" );
+    auto elapsed = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+    cout << "[Scene Loading]: Loaded " << size * size << " spheres in " << elapsed << "ms" << endl;
+
+    result.camera->render( result.world ).write_to( "scene_loading_render.ppm" );
+}
+
+void run_world_snapshot_sample( uint16_t size )
+{
+    run_scene_loading_sample( size );
+
+    auto start = chrono::steady_clock::now();
+    auto result = ls::scene_parser::load( "scene_loading.scene" );
+    result.world->compile();
+    auto elapsed = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+    cout << "[World Snapshot]: Parsed and compiled " << size * size << " spheres in " << elapsed << "ms" << endl;
+
+    ls::world_snapshot::write( "scene_loading.lsworld", result.world, result.camera );
+    start = chrono::steady_clock::now();
+    auto restored = ls::world_snapshot::load( "scene_loading.lsworld" );
+    elapsed = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+    cout << "[World Snapshot]: Restored them in " << elapsed << "ms" << endl;
+
+    restored.camera->render( restored.world ).write_to( "world_snapshot_render.ppm" );
+}
+
+void run_geometry_proxy_sample( uint16_t size )
+{
+    write_grid_obj( "geometry_proxy_tile.obj", 50 );
+
+    // A size x size field of tiles, all standing in for the same file, seen from above so
+    // that most of them are out of view
+    auto cache = ls::geometry_cache::create( 512 << 20 );
+    auto w = ls::world::create();
+    w->set_light( ls::point_light::create( ls::f_color( 1, 1, 1 ), ls::f_point( -10, 20, -10 ) ) );
+    for ( uint16_t z = 0; z < size; z++ )
+    {
+        for ( uint16_t x = 0; x < size; x++ )
+        {
+            auto tile = ls::geometry_proxy::create( "geometry_proxy_tile.obj", ls::aabb_bounds( ls::f_point( -0.5f, -0.1f, -0.5f ),
+                ls::f_point( 0.5f, 0.1f, 0.5f ) ), cache );
+            tile->set_transform( ls::transform::translation( static_cast<float>( x ), 0.f, static_cast<float>( z ) ) );
+            tile->set_material( ls::phong_material::create( ls::f_color( 0.2f + 0.6f * ( x % 2 ), 0.5f, 0.2f + 0.6f * ( z % 2 ) ) ) );
+            w->add_object( tile );
+        }
+    }
+
+    auto cam = ls::camera::create( 400, 300, ls::pi_over_3 );
+    cam->set_transform( ls::transform::view( ls::f_point( 8, 6, 8 ), ls::f_point( 9, 0, 10 ), ls::f_vector( 0, 0, 1 ) ) );
+    auto start = chrono::steady_clock::now();
+    auto image = cam->render( w );
+    auto elapsed = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+    cout << "[Geometry Proxies]: Rendered " << size * size << " tiles in " << elapsed << "ms, loading " << cache->load_count()
+         << " of them and holding " << cache->bytes_loaded() / 1e6 << "MB" << endl;
+    image.write_to( "geometry_proxy_render.ppm" );
+}
 
 int main( int argc, char* argv[] )
 {
+    // Scene files given on the command line are rendered one after another instead of the samples
+    if ( argc > 1 )
+    {
+        run_scene_files_sample( argc - 1, argv + 1 );
+        return 0;
+    }
+
     uint16_t canvas_width = 800, canvas_height = 600;
 
     // 1. The projectile sample runs a basic physics projectile launch simulation
@@ -258,5 +691,36 @@ int main( int argc, char* argv[] )
     // 5. Draws a scene with a hexagon made from grouped cylinders and spheres
     run_hexagon_scene_sample( canvas_width, canvas_height );
 
+    // 6. Benchmarks shading against 256 point lights with falloff, printing the render time
+    // run_many_lights_scene_sample( canvas_width, canvas_height );
+
+    // 7. Renders a sphere over a floor lit by a point light and then by an 8x8 area light,
+    // printing both render times to compare hard and soft shadows
+    // run_soft_shadow_scene_sample( canvas_width, canvas_height );
+
+    // 8. Renders a field of 1024 grouped shapes by tracing the world's objects directly and
+    // then through its compiled render scene, printing both render times
+    // run_compiled_scene_sample( canvas_width, canvas_height );
+
+    // 9. Encodes a 4K gradient as ASCII and binary PPM, printing the throughput of each
+    // run_image_encoding_sample( 3840, 2160 );
+
+    // 10. Writes a grid mesh as OBJ and parses it from a stream and from a mapped file,
+    // then from the mapped file on 1, 2, 4... threads, printing the throughput of each, and
+    // converts it to a mesh cache and times loading that, then times reading it as binary PLY
+    // run_obj_parsing_sample( 1000 );
+
+    // 11. Writes a scene file of 100x100 spheres sharing a few materials, times loading it and
+    // renders it
+    // run_scene_loading_sample( 100 );
+
+    // 12. Writes the scene of sample 11 as a world snapshot and times restoring it against
+    // parsing and compiling the scene file
+    // run_world_snapshot_sample( 100 );
+
+    // 13. Renders a field of 32x32 tiles standing in for a grid mesh by geometry proxies, and
+    // prints how many of them were loaded and how much memory they hold
+    // run_geometry_proxy_sample( 32 );
+
     return 0;
 }
@@ -0,0 +1,71 @@
+#include "arena.hpp"
+#include <algorithm>
+
+namespace ls {
+    thread_local const arena_ptr* arena_scope::_current = nullptr;
+
+    void* arena::allocate( std::size_t bytes, std::size_t alignment )
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+
+        void* p = _cursor;
+        auto space = _remaining;
+        if ( std::align( alignment, bytes, p, space ) )
+        {
+            _cursor = static_cast<unsigned char*>( p ) + bytes;
+            _remaining = space - bytes;
+            _used += bytes;
+            return p;
+        }
+
+        // Requests larger than half a block get a block of their own, leaving the current
+        // one to be filled by the small allocations that follow
+        auto size = std::max( _block_size, bytes + alignment );
+        if ( _parent )
+        {
+            _blocks.push_back( block{ nullptr, static_cast<unsigned char*>( _parent->allocate( size, alignof( std::max_align_t ) ) ), size } );
+        }
+        else
+        {
+            std::unique_ptr<unsigned char[]> storage( new unsigned char[size] );
+            auto data = storage.get();
+            _blocks.push_back( block{ std::move( storage ), data, size } );
+        }
+        p = _blocks.back().data;
+        space = size;
+        std::align( alignment, bytes, p, space );
+        _used += bytes;
+        if ( bytes <= _block_size / 2 )
+        {
+            _cursor = static_cast<unsigned char*>( p ) + bytes;
+            _remaining = space - bytes;
+        }
+        return p;
+    }
+
+    bool arena::owns( const void* p ) const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        auto address = static_cast<const unsigned char*>( p );
+        for ( const auto& b : _blocks )
+        {
+            if ( address >= b.data && address < b.data + b.size )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::size_t arena::bytes_used() const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        return _used;
+    }
+
+    std::size_t arena::block_count() const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        return _blocks.size();
+    }
+}
@@ -1,9 +1,19 @@
 #include "camera.hpp"
 #include "world.hpp"
+#include "thread_pool.hpp"
+#include "image_writer.hpp"
+#include "mapped_canvas.hpp"
+#include "geometry_proxy.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
 
 namespace ls {
     camera::camera( uint16_t width, uint16_t height, fpnum fov ) : 
-        _width( width ), _height( height ), _field_of_view( fov ), _transform( f4_matrix::identity() )
+        _width( width ), _height( height ), _field_of_view( fov ), _transform( f4_matrix::identity() ),
+        _inverse_transform( f4_matrix::identity() ), _threads( 0 ), _tile_size( default_tile_size )
     { 
         calculate_auxiliary_values();
     }
@@ -25,8 +35,8 @@ namespace ls {
         auto world_x = _half_width - x_offset;
         auto world_y = _half_height - y_offset;
 
-        auto pixel = _transform.inverse() * f_point( world_x, world_y, -1 );
-        auto origin = _transform.inverse() * f_point( 0, 0, 0 );
+        auto pixel = _inverse_transform * f_point( world_x, world_y, -1 );
+        auto origin = _inverse_transform * f_point( 0, 0, 0 );
         auto direction = ( pixel - origin ).normalized();
 
         return ray( origin, direction );
@@ -35,15 +45,199 @@ namespace ls {
     canvas camera::render( const world_ptr& w ) const
     {
         auto image = canvas( _width, _height );
-        for ( auto i = 0; i < _width; i++ )
+        w->prepare();
+        thread_pool pool( _threads );
+        if ( pool.threads() <= 1 )
         {
-            for ( auto j = 0; j < _height; j++ )
+            render_tile( w, image, 0, 0, 0, _width, _height );
+            return image;
+        }
+
+        // Each pixel is shaded independently, so splitting the image into tiles yields the
+        // same image as the serial path regardless of which thread renders which tile
+        std::size_t tiles_x = ( _width + _tile_size - 1 ) / _tile_size;
+        std::size_t tiles_y = ( _height + _tile_size - 1 ) / _tile_size;
+        pool.run( tiles_x * tiles_y, [&] ( std::size_t tile ) {
+            auto x0 = static_cast<uint16_t>( ( tile % tiles_x ) * _tile_size );
+            auto y0 = static_cast<uint16_t>( ( tile / tiles_x ) * _tile_size );
+            auto x1 = static_cast<uint16_t>( std::min<std::size_t>( x0 + _tile_size, _width ) );
+            auto y1 = static_cast<uint16_t>( std::min<std::size_t>( y0 + _tile_size, _height ) );
+            render_tile( w, image, 0, x0, y0, x1, y1 );
+        } );
+        return image;
+    }
+
+    void camera::render( const world_ptr& w, const row_sink& sink ) const
+    {
+        w->prepare();
+        thread_pool pool( _threads );
+
+        std::size_t tiles_x = ( _width + _tile_size - 1 ) / _tile_size;
+        std::size_t bands = ( _height + _tile_size - 1 ) / _tile_size;
+        if ( tiles_x == 0 || bands == 0 )
+        {
+            return;
+        }
+
+        // Enough bands are rendered at once to give every thread a couple of tiles, while
+        // memory stays bounded by the band window rather than the image
+        std::size_t window = std::min( bands, std::max<std::size_t>( 2, ( 2 * pool.threads() + tiles_x - 1 ) / tiles_x ) );
+        std::vector<canvas> buffers( window, canvas( _width, _tile_size ) );
+        std::unique_ptr<std::atomic<std::size_t>[]> remaining( new std::atomic<std::size_t>[window] );
+        std::vector<uint8_t> complete( window );
+        std::mutex emit_lock;
+
+        for ( std::size_t first = 0; first < bands; first += window )
+        {
+            auto count = std::min( window, bands - first );
+            for ( std::size_t band = 0; band < count; band++ )
             {
-                auto ray = ray_for_pixel( i, j );
-                auto color = w->color_at( ray );
-                image.draw_pixel( i, j, color );
+                remaining[band] = tiles_x;
+                complete[band] = 0;
             }
+            std::size_t next = 0;
+
+            pool.run( count * tiles_x, [&] ( std::size_t job ) {
+                auto band = job / tiles_x;
+                auto x0 = static_cast<uint16_t>( ( job % tiles_x ) * _tile_size );
+                auto y0 = static_cast<uint16_t>( ( first + band ) * _tile_size );
+                auto x1 = static_cast<uint16_t>( std::min<std::size_t>( x0 + _tile_size, _width ) );
+                auto y1 = static_cast<uint16_t>( std::min<std::size_t>( y0 + _tile_size, _height ) );
+                render_tile( w, buffers[band], y0, x0, y0, x1, y1 );
+                if ( remaining[band].fetch_sub( 1 ) != 1 )
+                {
+                    return;
+                }
+
+                // The thread finishing a band emits it along with any later bands that were
+                // waiting on it, so rows always reach the sink in order
+                std::lock_guard<std::mutex> guard( emit_lock );
+                complete[band] = 1;
+                while ( next < count && complete[next] )
+                {
+                    auto y = static_cast<uint16_t>( ( first + next ) * _tile_size );
+                    auto rows = static_cast<uint16_t>( std::min<std::size_t>( _tile_size, _height - y ) );
+                    sink( buffers[next].row( 0 ), buffers[next].row_stride(), y, rows );
+                    ++next;
+                }
+            } );
+        }
+    }
+
+    void camera::render_to( const world_ptr& w, const std::string& file, ppm_format format ) const
+    {
+        render_to( w, file, format, tone_mapper() );
+    }
+
+    void camera::render_to( const world_ptr& w, const std::string& file, ppm_format format, const tone_mapper& mapper ) const
+    {
+        std::ofstream out;
+        out.exceptions( std::ios::badbit | std::ios::failbit );
+        try
+        {
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            ppm_writer writer( out, _width, _height, format, mapper );
+            render( w, [&writer] ( const rgba_pixel* pixels, std::size_t stride, uint16_t, uint16_t count ) {
+                writer.write_rows( pixels, stride, count );
+            } );
+            writer.finish();
+            out.close();
+        }
+        catch ( const std::exception& e )
+        {
+            std::cout << "Could not write render to " << file << ": " << e.what() << std::endl;
+        }
+    }
+
+    void camera::render_pfm_to( const world_ptr& w, const std::string& file ) const
+    {
+        std::ofstream out;
+        out.exceptions( std::ios::badbit | std::ios::failbit );
+        try
+        {
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            pfm_writer writer( out, _width, _height );
+            render( w, [&writer] ( const rgba_pixel* pixels, std::size_t stride, uint16_t, uint16_t count ) {
+                writer.write_rows( pixels, stride, count );
+            } );
+            writer.finish();
+            out.close();
+        }
+        catch ( const std::exception& e )
+        {
+            std::cout << "Could not write render to " << file << ": " << e.what() << std::endl;
+        }
+    }
+
+    void camera::render( const world_ptr& w, mapped_canvas& image ) const
+    {
+        if ( image.width() != _width || image.height() != _height )
+        {
+            throw std::invalid_argument( "The canvas does not match the camera's size" );
+        }
+
+        w->prepare();
+        thread_pool pool( _threads );
+
+        std::size_t tiles_x = ( _width + _tile_size - 1 ) / _tile_size;
+        std::size_t bands = ( _height + _tile_size - 1 ) / _tile_size;
+        if ( tiles_x == 0 || bands == 0 )
+        {
+            return;
+        }
+
+        auto band_bytes = image.row_bytes() * _tile_size;
+        auto window = std::min( bands, std::max<std::size_t>( 1, image.resident_limit() / band_bytes ) );
+        for ( std::size_t first = 0; first < bands; first += window )
+        {
+            auto count = std::min( window, bands - first );
+            pool.run( count * tiles_x, [&] ( std::size_t job ) {
+                auto x0 = static_cast<uint16_t>( ( job % tiles_x ) * _tile_size );
+                auto y0 = static_cast<uint16_t>( ( first + job / tiles_x ) * _tile_size );
+                auto x1 = static_cast<uint16_t>( std::min<std::size_t>( x0 + _tile_size, _width ) );
+                auto y1 = static_cast<uint16_t>( std::min<std::size_t>( y0 + _tile_size, _height ) );
+                render_tile( w, image, x0, y0, x1, y1 );
+            } );
+            image.release_rows( static_cast<uint16_t>( first * _tile_size ),
+                static_cast<uint16_t>( std::min<std::size_t>( ( first + count ) * _tile_size, _height ) ) );
+        }
+    }
+
+    void camera::render_tile( const world_ptr& w, canvas& image, uint16_t y_offset, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1 ) const
+    {
+        for ( auto j = y0; j < y1; j++ )
+        {
+            render_span( w, x0, x1, j, image.span( x0, static_cast<uint16_t>( j - y_offset ) ) );
+        }
+    }
+
+    void camera::render_tile( const world_ptr& w, mapped_canvas& image, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1 ) const
+    {
+        if ( image.format() == mapped_pixel_format::rgba_float )
+        {
+            for ( auto j = y0; j < y1; j++ )
+            {
+                render_span( w, x0, x1, j, image.span( x0, j ) );
+            }
+            return;
+        }
+
+        // Other formats are converted on the way in, a row of the tile at a time
+        std::vector<rgba_pixel> pixels( x1 - x0 );
+        for ( auto j = y0; j < y1; j++ )
+        {
+            render_span( w, x0, x1, j, pixels.data() );
+            image.store( x0, j, pixels.data(), pixels.size() );
+        }
+    }
+
+    void camera::render_span( const world_ptr& w, uint16_t x0, uint16_t x1, uint16_t y, rgba_pixel* pixels ) const
+    {
+        geometry_pin_scope pins;
+        for ( auto i = x0; i < x1; i++ )
+        {
+            auto ray = ray_for_pixel( i, y );
+            *pixels++ = to_pixel( w->color_at( ray ) );
         }
-        return image;
     }
-}
\ No newline at end of file
+}
@@ -1,12 +1,18 @@
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 #include "canvas.hpp"
+#include "image_writer.hpp"
 
 namespace ls {
     canvas::canvas( uint16_t width, uint16_t height ) :
         _width( width ), _height( height )
     {
-        _pixels = pixel_space( height, std::vector<f_color>( width, f_color( 0, 0, 0 ) ) );
+        constexpr std::size_t pixels_per_line = canvas_row_alignment / sizeof( rgba_pixel );
+        _stride = ( static_cast<std::size_t>( width ) + pixels_per_line - 1 ) / pixels_per_line * pixels_per_line;
+        _pixels = pixel_space( _stride * height, to_pixel( f_color( 0, 0, 0 ) ) );
     }
 
     void canvas::draw_pixel( uint16_t x, uint16_t y, const f_color& color )
@@ -16,7 +22,7 @@ namespace ls {
             std::cout << ". Could not draw pixel at (" << x << ", " << y << ")." << std::endl;
             return;
         }
-        _pixels[y][x] = color;
+        row( y )[x] = to_pixel( color );
     }
 
     const f_color canvas::pixel_at( uint16_t x, uint16_t y ) const
@@ -26,25 +32,43 @@ namespace ls {
             std::cout << ". No such pixel at (" << x << ", " << y << ")." << std::endl;
             return f_color( 0, 0, 0 );
         }
-        return _pixels[y][x];
+        return to_color( row( y )[x] );
     }
 
     const std::string canvas::to_ppm() const
     {
-        std::stringstream stream;
-        append_ppm_header( stream );
-        append_ppm_pixel_data( stream );
+        return to_ppm( ppm_format::ascii );
+    }
+
+    const std::string canvas::to_ppm( ppm_format format ) const
+    {
+        std::ostringstream stream;
+        ppm_writer writer( stream, _width, _height, format );
+        writer.write( *this );
+        writer.finish();
         return stream.str();
     }
 
     void canvas::write_to( const std::string& file ) const
+    {
+        write_to( file, ppm_format::binary );
+    }
+
+    void canvas::write_to( const std::string& file, ppm_format format ) const
+    {
+        write_to( file, format, tone_mapper() );
+    }
+
+    void canvas::write_to( const std::string& file, ppm_format format, const tone_mapper& mapper ) const
     {
         std::ofstream out;
         out.exceptions( std::ios::badbit | std::ios::failbit );
         try
         {
-            out.open( file, std::fstream::out | std::fstream::trunc );
-            out << to_ppm();
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            ppm_writer writer( out, _width, _height, format, mapper );
+            writer.write( *this );
+            writer.finish();
             out.close();
         }
         catch ( const std::exception& e )
@@ -53,44 +77,84 @@ namespace ls {
         }
     }
 
-    void canvas::append_ppm_header( std::stringstream& os ) const
+    const std::string canvas::to_pfm() const
     {
-        os << "P3" << std::endl;
-        os << static_cast<unsigned int>( _width ) << " " << static_cast<unsigned int>( _height ) << std::endl;
-        os << "255" << std::endl;
+        std::ostringstream stream;
+        pfm_writer writer( stream, _width, _height );
+        writer.write( *this );
+        writer.finish();
+        return stream.str();
+    }
+
+    void canvas::write_pfm_to( const std::string& file ) const
+    {
+        std::ofstream out;
+        out.exceptions( std::ios::badbit | std::ios::failbit );
+        try
+        {
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            pfm_writer writer( out, _width, _height );
+            writer.write( *this );
+            writer.finish();
+            out.close();
+        }
+        catch ( const std::exception& e )
+        {
+            std::cout << "Could not open file at " << file << " for writing: " << e.what() << std::endl;
+        }
     }
 
-    void canvas::append_ppm_pixel_data( std::stringstream& os ) const
+    canvas canvas::from_pfm( std::istream& in )
     {
-        size_t line_width = 0;
-        auto print_color_component = [&os, &line_width] ( const std::string& s, const char& delim = ' ' ) {
-            line_width += s.size() + 1;
-            if ( static_cast<uint16_t>( line_width ) >= max_ppm_line_width )
+        std::string magic;
+        long width = -1, height = -1;
+        double scale = 0;
+        in >> magic >> width >> height >> scale;
+        constexpr long max_size = std::numeric_limits<uint16_t>::max();
+        if ( !in || ( magic != "PF" && magic != "Pf" ) || width < 0 || height < 0 || width > max_size || height > max_size || scale == 0 )
+        {
+            throw std::runtime_error( "Not a PFM image" );
+        }
+        // A single whitespace character separates the header from the data
+        in.get();
+
+        std::size_t channels = magic == "PF" ? 3 : 1;
+        bool swap = ( scale < 0 ) != is_little_endian();
+        auto image = canvas( static_cast<uint16_t>( width ), static_cast<uint16_t>( height ) );
+        std::vector<float> values( channels * image._width );
+        auto row_bytes = values.size() * sizeof( float );
+        for ( auto y = image._height; y > 0; y-- )
+        {
+            if ( !in.read( reinterpret_cast<char*>( values.data() ), static_cast<std::streamsize>( row_bytes ) ) )
             {
-                if ( os.seekg( -1, std::ios_base::end ).get() == ' ' )
+                throw std::runtime_error( "The PFM image is truncated" );
+            }
+            if ( swap )
+            {
+                auto bytes = reinterpret_cast<char*>( values.data() );
+                for ( std::size_t i = 0; i < row_bytes; i += sizeof( float ) )
                 {
-                    os.seekp( -1, std::ios_base::end );
+                    std::reverse( bytes + i, bytes + i + sizeof( float ) );
                 }
-                os << std::endl;
-                line_width = s.size() + 1;
             }
-            os << s << delim;
-        };
 
-        for ( auto i = 0; i < _height; i++ )
-        {
-            for ( auto j = 0; j < _width; j++ )
+            auto pixels = image.row( static_cast<uint16_t>( y - 1 ) );
+            for ( std::size_t x = 0; x < image._width; x++ )
             {
-                const f_color& pixel = _pixels[i][j];
-
-                auto r = std::to_string( static_cast<unsigned int>( clamp( pixel.r * 256, 0.f, 255.f ) ) );
-                print_color_component( r );
-                auto g = std::to_string( static_cast<unsigned int>( clamp( pixel.g * 256, 0.f, 255.f ) ) );
-                print_color_component( g );
-                auto b = std::to_string( static_cast<unsigned int>( clamp( pixel.b * 256, 0.f, 255.f ) ) );
-                print_color_component( b, ( j == _width - 1 ) ? '\n' : ' ' );
+                auto v = values.data() + channels * x;
+                pixels[x] = channels == 3 ? rgba_pixel{ v[0], v[1], v[2], 1.f } : rgba_pixel{ v[0], v[0], v[0], 1.f };
             }
-            line_width = 0;
         }
+        return image;
+    }
+
+    canvas canvas::load_pfm( const std::string& file )
+    {
+        std::ifstream in( file, std::ios::binary );
+        if ( !in )
+        {
+            throw std::runtime_error( "Could not open " + file );
+        }
+        return from_pfm( in );
     }
 }
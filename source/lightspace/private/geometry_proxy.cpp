@@ -0,0 +1,283 @@
+#include "geometry_proxy.hpp"
+#include "render_scene.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace ls {
+    namespace {
+        bool has_extension( const std::string& file, const char* extension )
+        {
+            auto size = std::strlen( extension );
+            return file.size() >= size && file.compare( file.size() - size, size, extension ) == 0;
+        }
+
+        template<typename T>
+        std::size_t vector_bytes( const std::vector<T>& v ) noexcept
+        {
+            return v.capacity() * sizeof( T );
+        }
+
+        std::size_t mesh_bytes( const mesh& m ) noexcept
+        {
+            return sizeof( mesh ) + vector_bytes( m.positions ) + vector_bytes( m.uvs ) + vector_bytes( m.normals ) +
+                vector_bytes( m.corners ) + vector_bytes( m.parts ) + vector_bytes( m.quantized_positions );
+        }
+
+        void apply_material( const group_ptr& g, const phong_material_ptr& mat )
+        {
+            for ( const auto& child : g->children() )
+            {
+                if ( auto grp = std::dynamic_pointer_cast<group>( child ) )
+                {
+                    apply_material( grp, mat );
+                }
+                else
+                {
+                    child->set_material( mat );
+                }
+            }
+        }
+
+        // The innermost pin scope open on this thread
+        thread_local geometry_pin_scope* open_pin_scope = nullptr;
+    }
+
+    geometry_pin_scope::geometry_pin_scope() noexcept :
+        _outer( open_pin_scope )
+    {
+        open_pin_scope = this;
+    }
+
+    geometry_pin_scope::~geometry_pin_scope()
+    {
+        open_pin_scope = _outer;
+    }
+
+    std::size_t geometry_cache::budget() const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        return _budget;
+    }
+
+    void geometry_cache::set_budget( std::size_t bytes )
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        _budget = bytes;
+        trim( nullptr );
+    }
+
+    std::size_t geometry_cache::bytes_loaded() const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        return _bytes;
+    }
+
+    std::size_t geometry_cache::loaded_count() const
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        return _loaded.size();
+    }
+
+    void geometry_cache::evict_all()
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        for ( const auto& e : _loaded )
+        {
+            e.proxy->publish( nullptr );
+        }
+        _loaded.clear();
+        _bytes = 0;
+    }
+
+    void geometry_cache::admit( const geometry_proxy* proxy, const proxy_geometry_ptr& geometry )
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        proxy->_last_use.store( ++_clock );
+        proxy->publish( geometry );
+        _loaded.push_back( entry{ proxy, geometry->bytes } );
+        _bytes += geometry->bytes;
+        trim( proxy );
+    }
+
+    void geometry_cache::release( const geometry_proxy* proxy )
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        auto found = std::find_if( _loaded.begin(), _loaded.end(), [proxy] ( const entry& e ) {
+            return e.proxy == proxy;
+        } );
+        if ( found != _loaded.end() )
+        {
+            _bytes -= found->bytes;
+            _loaded.erase( found );
+        }
+        proxy->publish( nullptr );
+    }
+
+    void geometry_cache::trim( const geometry_proxy* keep )
+    {
+        while ( _bytes > _budget )
+        {
+            auto victim = _loaded.end();
+            for ( auto it = _loaded.begin(); it != _loaded.end(); it++ )
+            {
+                if ( it->proxy != keep && ( victim == _loaded.end() || it->proxy->_last_use.load() < victim->proxy->_last_use.load() ) )
+                {
+                    victim = it;
+                }
+            }
+            if ( victim == _loaded.end() )
+            {
+                return;
+            }
+            victim->proxy->publish( nullptr );
+            _bytes -= victim->bytes;
+            _loaded.erase( victim );
+        }
+    }
+
+    geometry_proxy::~geometry_proxy()
+    {
+        if ( _cache )
+        {
+            _cache->release( this );
+        }
+    }
+
+    proxy_geometry_ptr geometry_proxy::geometry() const
+    {
+        auto g = std::atomic_load( &_geometry );
+        if ( !g )
+        {
+            std::lock_guard<std::mutex> guard( _load_lock );
+            g = std::atomic_load( &_geometry );
+            if ( !g )
+            {
+                g = load();
+                if ( _cache )
+                {
+                    _cache->admit( this, g );
+                }
+                else
+                {
+                    publish( g );
+                }
+            }
+        }
+        touch();
+        return g;
+    }
+
+    const proxy_geometry_ptr& geometry_proxy::pinned_geometry( proxy_geometry_ptr& keep ) const
+    {
+        auto scope = open_pin_scope;
+        if ( !scope )
+        {
+            keep = geometry();
+            return keep;
+        }
+
+        auto& pinned = scope->_pins[this];
+        // The pin keeps its geometry alive, so newly loaded geometry never shares its address
+        if ( pinned && _current.load( std::memory_order_acquire ) == pinned.get() )
+        {
+            touch();
+        }
+        else
+        {
+            pinned = geometry();
+        }
+        return pinned;
+    }
+
+    void geometry_proxy::publish( const proxy_geometry_ptr& geometry ) const
+    {
+        std::atomic_store( &_geometry, geometry );
+        _current.store( geometry.get(), std::memory_order_release );
+    }
+
+    void geometry_proxy::touch() const noexcept
+    {
+        // Only the first use after each load writes, so threads tracing the same proxy do not
+        // keep claiming its cache line
+        if ( _cache )
+        {
+            auto now = _cache->_clock.load( std::memory_order_relaxed );
+            if ( _last_use.load( std::memory_order_relaxed ) != now )
+            {
+                _last_use.store( now, std::memory_order_relaxed );
+            }
+        }
+    }
+
+    void geometry_proxy::evict()
+    {
+        if ( _cache )
+        {
+            _cache->release( this );
+        }
+        else
+        {
+            publish( nullptr );
+        }
+    }
+
+    proxy_geometry_ptr geometry_proxy::load() const
+    {
+        // The file is read on the thread that reached the proxy, as the other threads of a
+        // render are busy tracing
+        auto a = std::make_shared<ls::arena>();
+        model_parse_result parsed;
+        if ( has_extension( _file, ".ply" ) )
+        {
+            parsed = model_parser::ply( _file, a, 1, _options );
+        }
+        else if ( has_extension( _file, ".lsmesh" ) )
+        {
+            parsed = model_parser::mesh_cache( _file, a, 1, _options );
+        }
+        else
+        {
+            parsed = model_parser::obj( _file, a, 1, _options );
+        }
+        if ( parsed.status != model_parse_status::SUCCESS )
+        {
+            throw std::runtime_error( "Could not load " + _file + ": " + parsed.error->message );
+        }
+
+        auto geometry = std::make_shared<proxy_geometry>();
+        {
+            arena_scope scope( a );
+            geometry->root = parsed.to_shape_group();
+        }
+        // The loaded shapes are set up before the root joins the proxy's parent, so setting
+        // them up does not count as an edit to the world holding the proxy
+        apply_material( geometry->root, _mat );
+
+        // The root takes the proxy's place in the hierarchy so normals reach world space,
+        // while the scene is compiled from its children in the proxy's object space
+        geometry->root->set_transform( _transform, _inverse_transform );
+        if ( auto p = parent() )
+        {
+            geometry->root->set_parent( p );
+        }
+        geometry->scene = render_scene::compile( geometry->root->children() );
+        geometry->bytes = a->bytes_used() + mesh_bytes( *parsed.data->mesh ) + geometry->scene->bytes_used();
+        return geometry;
+    }
+
+    intersections intersect( const geometry_proxy_ptr& proxy, const ray& r )
+    {
+        const ray transformed_ray = proxy->inverse_transform() * r;
+
+        intersections itrs;
+        if ( proxy->bounds().intersects( transformed_ray ) )
+        {
+            auto geometry = proxy->geometry();
+            for ( const auto& itr : geometry->scene->intersect( transformed_ray ) )
+            {
+                itrs.push_back( intersection( itr.time(), shape_ptr( geometry, itr.object().get() ) ) );
+            }
+        }
+        return itrs;
+    }
+}
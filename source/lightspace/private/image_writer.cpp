@@ -0,0 +1,195 @@
+#include "image_writer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace ls {
+    namespace {
+        /**
+         * Rows are tone mapped in batches of about this many pixels
+         */
+        constexpr std::size_t pixels_per_batch = 1 << 18;
+    }
+
+    void quantize_row( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) noexcept
+    {
+        static const tone_mapper linear;
+        linear.map_row( pixels, count, rgb );
+    }
+
+    ppm_writer::ppm_writer( std::ostream& out, uint16_t width, uint16_t height, ppm_format format, std::size_t buffer_size ) :
+        ppm_writer( out, width, height, format, tone_mapper(), buffer_size )
+    { }
+
+    ppm_writer::ppm_writer( std::ostream& out, uint16_t width, uint16_t height, ppm_format format, const tone_mapper& mapper, std::size_t buffer_size ) :
+        _out( out ), _width( width ), _height( height ), _format( format ), _mapper( mapper ), _pool( mapper.threads() ),
+        _buffer( std::max<std::size_t>( buffer_size, 64 ) ),
+        _batch_rows( std::max<std::size_t>( 1, std::min<std::size_t>( height, pixels_per_batch / std::max<std::size_t>( 1, width ) ) ) ),
+        _rgb( _batch_rows * 3 * static_cast<std::size_t>( width ) )
+    {
+        auto header = std::string( format == ppm_format::binary ? "P6\n" : "P3\n" ) +
+            std::to_string( width ) + " " + std::to_string( height ) + "\n255\n";
+        append( header.data(), header.size() );
+    }
+
+    ppm_writer::~ppm_writer()
+    {
+        // Anything still buffered is written out, but errors can no longer be reported
+        try
+        {
+            flush_buffer();
+        }
+        catch ( ... )
+        { }
+    }
+
+    void ppm_writer::write_rows( const rgba_pixel* pixels, std::size_t stride, uint16_t count )
+    {
+        auto remaining = std::min<std::size_t>( count, _height - _rows_written );
+        auto row_bytes = 3 * static_cast<std::size_t>( _width );
+        while ( remaining > 0 )
+        {
+            auto batch = std::min( remaining, _batch_rows );
+            _mapper.map_rows( pixels, stride, _width, batch, _rgb.data(), _pool );
+            if ( _format == ppm_format::binary )
+            {
+                append( reinterpret_cast<const char*>( _rgb.data() ), batch * row_bytes );
+            }
+            else
+            {
+                for ( std::size_t i = 0; i < batch; i++ )
+                {
+                    append_ascii_row( _rgb.data() + i * row_bytes );
+                }
+            }
+            pixels += batch * stride;
+            remaining -= batch;
+            _rows_written = static_cast<uint16_t>( _rows_written + batch );
+        }
+    }
+
+    void ppm_writer::write( const canvas& image )
+    {
+        write_rows( image.row( 0 ), image.row_stride(), image.height() );
+    }
+
+    void ppm_writer::finish()
+    {
+        flush_buffer();
+        _out.flush();
+    }
+
+    void ppm_writer::append( const char* data, std::size_t size )
+    {
+        while ( size > 0 )
+        {
+            auto count = std::min( size, _buffer.size() - _used );
+            std::memcpy( _buffer.data() + _used, data, count );
+            _used += count;
+            data += count;
+            size -= count;
+            if ( _used == _buffer.size() )
+            {
+                flush_buffer();
+            }
+        }
+    }
+
+    void ppm_writer::append_ascii_row( const uint8_t* rgb )
+    {
+        // Components are separated by spaces and lines wrapped before they reach the
+        // maximum width, with every image row starting on a new line
+        char line[max_ppm_line_width + 4];
+        std::size_t length = 0;
+        auto components = 3 * static_cast<std::size_t>( _width );
+        for ( std::size_t i = 0; i < components; i++ )
+        {
+            char digits[4];
+            auto value = rgb[i];
+            std::size_t count = value >= 100 ? 3 : ( value >= 10 ? 2 : 1 );
+            for ( auto d = count; d > 0; d-- )
+            {
+                digits[d - 1] = static_cast<char>( '0' + value % 10 );
+                value /= 10;
+            }
+
+            if ( length + count + 1 >= max_ppm_line_width )
+            {
+                line[length - 1] = '\n';
+                append( line, length );
+                length = 0;
+            }
+            std::memcpy( line + length, digits, count );
+            length += count;
+            line[length++] = ' ';
+        }
+        if ( length > 0 )
+        {
+            line[length - 1] = '\n';
+            append( line, length );
+        }
+    }
+
+    void ppm_writer::flush_buffer()
+    {
+        if ( _used > 0 )
+        {
+            _out.write( _buffer.data(), static_cast<std::streamsize>( _used ) );
+            _used = 0;
+        }
+    }
+
+    pfm_writer::pfm_writer( std::ostream& out, uint16_t width, uint16_t height ) :
+        _out( out ), _width( width ), _height( height ), _row( 3 * static_cast<std::size_t>( width ) )
+    {
+        // A negative scale marks little endian data
+        auto header = "PF\n" + std::to_string( width ) + " " + std::to_string( height ) + ( is_little_endian() ? "\n-1.0\n" : "\n1.0\n" );
+        _out.write( header.data(), static_cast<std::streamsize>( header.size() ) );
+        _data_start = static_cast<std::streamoff>( _out.tellp() );
+    }
+
+    void pfm_writer::write_row( uint16_t y, const rgba_pixel* pixels )
+    {
+        if ( y >= _height )
+        {
+            return;
+        }
+
+        auto file_row = static_cast<std::size_t>( _height - 1 - y );
+        auto row_bytes = _row.size() * sizeof( float );
+        if ( file_row != _file_row )
+        {
+            _out.seekp( _data_start + static_cast<std::streamoff>( file_row * row_bytes ) );
+        }
+        for ( std::size_t i = 0; i < _width; i++ )
+        {
+            _row[3 * i] = pixels[i].r;
+            _row[3 * i + 1] = pixels[i].g;
+            _row[3 * i + 2] = pixels[i].b;
+        }
+        _out.write( reinterpret_cast<const char*>( _row.data() ), static_cast<std::streamsize>( row_bytes ) );
+        _file_row = file_row + 1;
+        _rows_written++;
+    }
+
+    void pfm_writer::write_rows( const rgba_pixel* pixels, std::size_t stride, uint16_t count )
+    {
+        for ( uint16_t i = 0; i < count && _next_row < _height; i++, _next_row++ )
+        {
+            write_row( _next_row, pixels + i * stride );
+        }
+    }
+
+    void pfm_writer::write( const canvas& image )
+    {
+        for ( auto y = image.height(); y > 0; y-- )
+        {
+            write_row( static_cast<uint16_t>( y - 1 ), image.row( static_cast<uint16_t>( y - 1 ) ) );
+        }
+    }
+
+    void pfm_writer::finish()
+    {
+        _out.flush();
+    }
+}
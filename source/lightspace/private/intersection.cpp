@@ -1,10 +1,99 @@
 #include "intersection.hpp"
 #include "shapes.hpp"
 #include <algorithm>
+#include <array>
+#include <vector>
 
 namespace ls {
     const intersection intersection::none = intersection();
 
+    namespace {
+        /**
+         * Stack of the shapes enclosing a point along a ray, ordered from outermost to
+         * innermost. The entries live in a fixed buffer and only move to the heap for rays
+         * through more nested containers than it holds.
+         */
+        class containment_stack
+        {
+        public:
+
+            struct entry
+            {
+                uint32_t id;
+                fpnum refractive_index;
+            };
+
+            static constexpr std::size_t capacity = 32;
+
+            bool empty() const noexcept
+            {
+                return size() == 0;
+            }
+
+            const entry& back() const noexcept
+            {
+                return data()[size() - 1];
+            }
+
+            void push( uint32_t id, fpnum refractive_index )
+            {
+                if ( !spilled_ && size_ == capacity )
+                {
+                    spilled_entries_.assign( entries_.begin(), entries_.end() );
+                    spilled_ = true;
+                }
+                if ( spilled_ )
+                {
+                    spilled_entries_.push_back( entry{ id, refractive_index } );
+                    return;
+                }
+                entries_[size_++] = entry{ id, refractive_index };
+            }
+
+            bool remove( uint32_t id ) noexcept
+            {
+                for ( std::size_t idx = size(); idx-- > 0; )
+                {
+                    if ( data()[idx].id != id )
+                    {
+                        continue;
+                    }
+                    if ( spilled_ )
+                    {
+                        spilled_entries_.erase( spilled_entries_.begin() + idx );
+                    }
+                    else
+                    {
+                        std::move( entries_.begin() + idx + 1, entries_.begin() + size_, entries_.begin() + idx );
+                        --size_;
+                    }
+                    return true;
+                }
+                return false;
+            }
+
+        private:
+
+            std::array<entry, capacity> entries_;
+            std::size_t size_{ 0 };
+            std::vector<entry> spilled_entries_;
+            bool spilled_{ false };
+
+        private:
+
+            const entry* data() const noexcept
+            {
+                return spilled_ ? spilled_entries_.data() : entries_.data();
+            }
+
+            std::size_t size() const noexcept
+            {
+                return spilled_ ? spilled_entries_.size() : size_;
+            }
+
+        };
+    }
+
     intersection_state prepare_intersection_state( const intersection& i, const ray& r, const intersections& itrs )
     {
         intersection_state state;
@@ -25,31 +114,34 @@ namespace ls {
         }
 
         state.shifted_point = state.point + ( state.normal * epsilon );
-        state.shifted_under_point = state.point - ( state.normal * epsilon );
         state.reflection = r.direction().reflect( state.normal );
-        
-        std::vector<shape_ptr> shapes;
-        intersection h = hit( itrs );
-        for ( const intersection& i : itrs )
+
+        // The under point and refractive indices are only needed to spawn refracted rays,
+        // so opaque materials skip the containment walk entirely
+        if ( approx( state.object->material()->transparency, 0.f ) )
         {
-            if ( i == h )
-            {
-                state.ridx_from = shapes.empty() ? 1.f : shapes.back()->material()->refractive_index;
-            }
-            
-            auto it = std::find( shapes.begin(), shapes.end(), i.object() );
-            if ( it != shapes.end() )
+            return state;
+        }
+
+        state.shifted_under_point = state.point - ( state.normal * epsilon );
+
+        containment_stack containers;
+        for ( const intersection& itr : itrs )
+        {
+            if ( itr == i )
             {
-                shapes.erase( it );
+                state.ridx_from = containers.empty() ? 1.f : containers.back().refractive_index;
             }
-            else
+
+            const auto& obj = itr.object();
+            if ( !containers.remove( obj->id() ) )
             {
-                shapes.push_back( i.object() );
+                containers.push( obj->id(), obj->material()->refractive_index );
             }
-            
-            if ( i == h )
+
+            if ( itr == i )
             {
-                state.ridx_to = shapes.empty() ? 1.f : shapes.back()->material()->refractive_index;
+                state.ridx_to = containers.empty() ? 1.f : containers.back().refractive_index;
                 break;
             }
         }
@@ -59,13 +151,38 @@ namespace ls {
 
     intersection hit( const intersections& itrs )
     {
-        auto itrs_sorted = itrs;
-        std::sort( itrs_sorted.begin(), itrs_sorted.end(), [] ( intersection i1, intersection i2 ) {
-            return i1.time() < i2.time();
-        } );
-        auto it = itrs_sorted.cbegin();
-        while ( it != itrs_sorted.cend() && it->time() < 0 ) ++it;
-        return it == itrs_sorted.cend() ? intersection::none : *it;
+        auto it = itrs.cend();
+        for ( auto cur = itrs.cbegin(); cur != itrs.cend(); ++cur )
+        {
+            if ( cur->time() >= 0 && ( it == itrs.cend() || cur->time() < it->time() ) )
+            {
+                it = cur;
+            }
+        }
+        return it == itrs.cend() ? intersection::none : *it;
+    }
+
+    const aabb_bounds operator*( const f4_matrix& mat, const aabb_bounds& b ) noexcept
+    {
+        auto finite = std::isfinite( b.min.x ) && std::isfinite( b.min.y ) && std::isfinite( b.min.z ) &&
+            std::isfinite( b.max.x ) && std::isfinite( b.max.y ) && std::isfinite( b.max.z );
+        if ( !finite )
+        {
+            return aabb_bounds( f_point( -infinity, -infinity, -infinity ), f_point( infinity, infinity, infinity ) );
+        }
+
+        aabb_bounds result( f_point( infinity, infinity, infinity ), f_point( -infinity, -infinity, -infinity ) );
+        for ( uint8_t corner = 0; corner < 8; corner++ )
+        {
+            auto p = mat * f_point( corner & 1 ? b.max.x : b.min.x, corner & 2 ? b.max.y : b.min.y, corner & 4 ? b.max.z : b.min.z );
+            result.min.x = std::min( result.min.x, p.x );
+            result.min.y = std::min( result.min.y, p.y );
+            result.min.z = std::min( result.min.z, p.z );
+            result.max.x = std::max( result.max.x, p.x );
+            result.max.y = std::max( result.max.y, p.y );
+            result.max.z = std::max( result.max.z, p.z );
+        }
+        return result;
     }
 
     bool aabb_bounds::intersects( const ray& r )
@@ -75,7 +192,7 @@ namespace ls {
             auto tmax_numerator = max - origin;
 
             fpnum tmin, tmax;
-            if ( abs( direction ) >= epsilon )
+            if ( std::abs( direction ) >= epsilon )
             {
                 tmin = tmin_numerator / direction;
                 tmax = tmax_numerator / direction;
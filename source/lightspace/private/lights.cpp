@@ -1,37 +1,91 @@
 #include "lights.hpp"
+#include <cstring>
 
 namespace ls {
-    f_color phong_lighting( const shape_ptr obj, const phong_material_ptr& mat, const light_ptr& l, const f_point& position, const f_vector& eye, const f_vector& normal, bool in_shadow )
+    namespace {
+        fpnum stratum_jitter( const f_point& from, uint32_t index, uint32_t axis ) noexcept
+        {
+            uint32_t bits[3];
+            float coords[3] = { static_cast<float>( from.x ), static_cast<float>( from.y ), static_cast<float>( from.z ) };
+            std::memcpy( bits, coords, sizeof( bits ) );
+
+            uint32_t h = index * 0x9e3779b9u + axis * 0x85ebca6bu;
+            for ( auto b : bits )
+            {
+                h ^= b + 0x9e3779b9u + ( h << 6 ) + ( h >> 2 );
+            }
+            h ^= h >> 16;
+            h *= 0x7feb352du;
+            h ^= h >> 15;
+            h *= 0x846ca68bu;
+            h ^= h >> 16;
+            return static_cast<fpnum>( h >> 8 ) * ( 1.f / 16777216.f );
+        }
+    }
+
+    f_point area_light::sample_point( uint32_t index, const f_point& from ) const noexcept
+    {
+        auto u = index % _usteps;
+        auto v = index / _usteps;
+        auto ju = _jitter ? stratum_jitter( from, index, 0 ) : 0.5f;
+        auto jv = _jitter ? stratum_jitter( from, index, 1 ) : 0.5f;
+        return surface_point( ( u + ju ) / _usteps, ( v + jv ) / _vsteps, from );
+    }
+
+    f_point sphere_light::surface_point( fpnum u, fpnum v, const f_point& from ) const noexcept
+    {
+        // Build a basis for the disk perpendicular to the direction towards the shaded point
+        auto center = position();
+        auto axis = f_vector( from - center ).normalized();
+        auto helper = std::abs( axis.x ) > 0.9f ? f_vector( 0, 1, 0 ) : f_vector( 1, 0, 0 );
+        auto tangent = axis.cross( helper ).normalized();
+        auto bitangent = axis.cross( tangent );
+
+        auto r = _radius * std::sqrt( u );
+        auto theta = two_pi * v;
+        return center + tangent * ( r * std::cos( theta ) ) + bitangent * ( r * std::sin( theta ) );
+    }
+    phong_terms phong_lighting_terms( const f_color& surface_color, const phong_material_ptr& mat, const light_ptr& l, const f_point& position, const f_vector& eye, const f_vector& normal )
     {
-        f_color color = mat->surface_pattern->color_at( obj, position );
-        auto effective_color = color * l->intensity();
-        auto light_v = ( l->position() - position ).normalized();
+        auto to_light = l->position() - position;
+        auto intensity = l->has_falloff() ? l->intensity_at( to_light.length() ) : l->intensity();
+        auto effective_color = surface_color * intensity;
 
-        auto ambient = effective_color * mat->ambient;
+        phong_terms terms;
+        terms.ambient = effective_color * mat->ambient;
+        terms.direct = f_color( 0, 0, 0 );
 
-        if ( in_shadow )
+        if ( mat->diffuse <= 0.f && mat->specular <= 0.f )
         {
-            return ambient;
+            return terms;
         }
 
-        auto diffuse = f_color( 0, 0, 0 );
-        auto specular = f_color( 0, 0, 0 );
-
+        auto light_v = to_light.normalized();
         auto light_dot_normal = light_v.dot( normal );
-        if ( light_dot_normal >= 0 )
+        if ( light_dot_normal < 0 )
         {
-            diffuse = effective_color * mat->diffuse * light_dot_normal;
+            return terms;
+        }
 
-            auto reflection_v = ( -light_v ).reflect( normal );
-            auto reflect_dot_eye = reflection_v.dot( eye );
-            if ( reflect_dot_eye > 0 )
-            {
-                auto factor = powf( reflect_dot_eye, mat->shininess );
-                specular = l->intensity() * mat->specular * factor;
-            }
+        auto diffuse = effective_color * mat->diffuse * light_dot_normal;
+        auto specular = f_color( 0, 0, 0 );
+
+        auto reflection_v = ( -light_v ).reflect( normal );
+        auto reflect_dot_eye = reflection_v.dot( eye );
+        if ( reflect_dot_eye > 0 )
+        {
+            auto factor = powf( reflect_dot_eye, mat->shininess );
+            specular = intensity * mat->specular * factor;
         }
 
-        return ambient + diffuse + specular;
+        terms.direct = diffuse + specular;
+        return terms;
+    }
+
+    f_color phong_lighting( const shape_ptr obj, const phong_material_ptr& mat, const light_ptr& l, const f_point& position, const f_vector& eye, const f_vector& normal, bool in_shadow )
+    {
+        auto terms = phong_lighting_terms( mat->surface_pattern->color_at( obj, position ), mat, l, position, eye, normal );
+        return in_shadow ? terms.ambient : terms.ambient + terms.direct;
     }
 
     fpnum schlick( const intersection_state& state )
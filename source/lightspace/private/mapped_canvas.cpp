@@ -0,0 +1,352 @@
+#include "mapped_canvas.hpp"
+#include "image_writer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace ls {
+    namespace {
+        constexpr char canvas_magic[8] = { 'L', 'S', 'C', 'A', 'N', 'V', 'A', 'S' };
+        constexpr uint32_t canvas_version = 1;
+
+        /**
+         * The start of a canvas file, stored in native byte order
+         */
+        struct canvas_file_header
+        {
+            char magic[8];
+            uint32_t version;
+            uint16_t width;
+            uint16_t height;
+            uint8_t format;
+            uint8_t reserved[3];
+            uint32_t row_bytes;
+            uint64_t data_offset;
+        };
+
+        std::size_t row_bytes_for( uint16_t width, mapped_pixel_format format ) noexcept
+        {
+            auto pixels_per_line = canvas_row_alignment / mapped_canvas::pixel_bytes( format );
+            auto stride = ( static_cast<std::size_t>( width ) + pixels_per_line - 1 ) / pixels_per_line * pixels_per_line;
+            return stride * mapped_canvas::pixel_bytes( format );
+        }
+    }
+
+    uint16_t to_half( float value ) noexcept
+    {
+        uint32_t bits;
+        std::memcpy( &bits, &value, sizeof( bits ) );
+        uint32_t sign = ( bits >> 16 ) & 0x8000;
+        uint32_t exponent = ( bits >> 23 ) & 0xff;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if ( exponent == 0xff )
+        {
+            return static_cast<uint16_t>( sign | 0x7c00 | ( mantissa != 0 ? 0x200 : 0 ) );
+        }
+
+        // Rebias the exponent and round the dropped mantissa bits to nearest even. A carry out
+        // of the mantissa moves into the exponent, which is exactly the rounded result.
+        int rebiased = static_cast<int>( exponent ) - 127 + 15;
+        if ( rebiased >= 0x1f )
+        {
+            return static_cast<uint16_t>( sign | 0x7c00 );
+        }
+        if ( rebiased <= 0 )
+        {
+            if ( rebiased < -10 )
+            {
+                return static_cast<uint16_t>( sign );
+            }
+            mantissa |= 0x800000;
+            uint32_t shift = static_cast<uint32_t>( 14 - rebiased );
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+            uint32_t halfway = 1u << ( shift - 1 );
+            if ( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+            {
+                half++;
+            }
+            return static_cast<uint16_t>( sign | half );
+        }
+
+        uint32_t half = ( static_cast<uint32_t>( rebiased ) << 10 ) | ( mantissa >> 13 );
+        uint32_t remainder = mantissa & 0x1fff;
+        if ( remainder > 0x1000 || ( remainder == 0x1000 && ( half & 1 ) ) )
+        {
+            half++;
+        }
+        return static_cast<uint16_t>( sign | half );
+    }
+
+    float from_half( uint16_t value ) noexcept
+    {
+        uint32_t sign = static_cast<uint32_t>( value & 0x8000 ) << 16;
+        uint32_t exponent = ( value >> 10 ) & 0x1f;
+        uint32_t mantissa = value & 0x3ff;
+        uint32_t bits;
+
+        if ( exponent == 0 )
+        {
+            if ( mantissa == 0 )
+            {
+                bits = sign;
+            }
+            else
+            {
+                // Subnormal halves are normal floats once the leading bit is shifted into place
+                exponent = 127 - 15 + 1;
+                while ( ( mantissa & 0x400 ) == 0 )
+                {
+                    mantissa <<= 1;
+                    exponent--;
+                }
+                bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+            }
+        }
+        else if ( exponent == 0x1f )
+        {
+            bits = sign | 0x7f800000 | ( mantissa << 13 );
+        }
+        else
+        {
+            bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+        }
+
+        float result;
+        std::memcpy( &result, &bits, sizeof( result ) );
+        return result;
+    }
+
+    mapped_canvas::mapped_canvas( const std::string& file, uint16_t width, uint16_t height, mapped_pixel_format format, std::size_t resident_limit ) :
+        _width( width ), _height( height ), _format( format ), _row_bytes( row_bytes_for( width, format ) ), _resident_limit( resident_limit )
+    {
+        // A fresh file reads as zeros, which is black in both formats
+        _file = mapped_file( file, header_size + _row_bytes * height );
+
+        canvas_file_header header{};
+        std::memcpy( header.magic, canvas_magic, sizeof( canvas_magic ) );
+        header.version = canvas_version;
+        header.width = width;
+        header.height = height;
+        header.format = static_cast<uint8_t>( format );
+        header.row_bytes = static_cast<uint32_t>( _row_bytes );
+        header.data_offset = header_size;
+        std::memcpy( _file.data(), &header, sizeof( header ) );
+    }
+
+    mapped_canvas::mapped_canvas( mapped_file&& file, std::size_t resident_limit ) :
+        _file( std::move( file ) ), _resident_limit( resident_limit )
+    {
+        canvas_file_header header{};
+        bool valid = _file.size() >= header_size;
+        if ( valid )
+        {
+            std::memcpy( &header, _file.data(), sizeof( header ) );
+            auto format = static_cast<mapped_pixel_format>( header.format );
+            valid = std::memcmp( header.magic, canvas_magic, sizeof( canvas_magic ) ) == 0 &&
+                header.version == canvas_version && header.data_offset == header_size &&
+                ( format == mapped_pixel_format::rgba_float || format == mapped_pixel_format::rgba_half ) &&
+                header.row_bytes == row_bytes_for( header.width, format ) &&
+                _file.size() >= header_size + static_cast<std::size_t>( header.row_bytes ) * header.height;
+        }
+        if ( !valid )
+        {
+            throw std::runtime_error( "Not a canvas file" );
+        }
+
+        _width = header.width;
+        _height = header.height;
+        _format = static_cast<mapped_pixel_format>( header.format );
+        _row_bytes = header.row_bytes;
+    }
+
+    mapped_canvas mapped_canvas::open( const std::string& file, std::size_t resident_limit )
+    {
+        return mapped_canvas( mapped_file( file, mapped_file::access::read_write ), resident_limit );
+    }
+
+    rgba_pixel* mapped_canvas::span( uint16_t x, uint16_t y )
+    {
+        if ( _format != mapped_pixel_format::rgba_float )
+        {
+            throw method_not_supported();
+        }
+        return reinterpret_cast<rgba_pixel*>( row_data( y ) ) + x;
+    }
+
+    const rgba_pixel* mapped_canvas::span( uint16_t x, uint16_t y ) const
+    {
+        if ( _format != mapped_pixel_format::rgba_float )
+        {
+            throw method_not_supported();
+        }
+        return reinterpret_cast<const rgba_pixel*>( row_data( y ) ) + x;
+    }
+
+    void mapped_canvas::store( uint16_t x, uint16_t y, const rgba_pixel* pixels, std::size_t count ) noexcept
+    {
+        if ( _format == mapped_pixel_format::rgba_float )
+        {
+            std::memcpy( reinterpret_cast<rgba_pixel*>( row_data( y ) ) + x, pixels, count * sizeof( rgba_pixel ) );
+            return;
+        }
+
+        auto halves = reinterpret_cast<uint16_t*>( row_data( y ) ) + 4 * static_cast<std::size_t>( x );
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            halves[4 * i] = to_half( pixels[i].r );
+            halves[4 * i + 1] = to_half( pixels[i].g );
+            halves[4 * i + 2] = to_half( pixels[i].b );
+            halves[4 * i + 3] = to_half( pixels[i].a );
+        }
+    }
+
+    void mapped_canvas::load( uint16_t x, uint16_t y, rgba_pixel* pixels, std::size_t count ) const noexcept
+    {
+        if ( _format == mapped_pixel_format::rgba_float )
+        {
+            std::memcpy( pixels, reinterpret_cast<const rgba_pixel*>( row_data( y ) ) + x, count * sizeof( rgba_pixel ) );
+            return;
+        }
+
+        auto halves = reinterpret_cast<const uint16_t*>( row_data( y ) ) + 4 * static_cast<std::size_t>( x );
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            pixels[i] = rgba_pixel{ from_half( halves[4 * i] ), from_half( halves[4 * i + 1] ),
+                from_half( halves[4 * i + 2] ), from_half( halves[4 * i + 3] ) };
+        }
+    }
+
+    void mapped_canvas::draw_pixel( uint16_t x, uint16_t y, const f_color& color )
+    {
+        if ( !within_bounds( x, y ) )
+        {
+            std::cout << ". Could not draw pixel at (" << x << ", " << y << ")." << std::endl;
+            return;
+        }
+        auto pixel = to_pixel( color );
+        store( x, y, &pixel, 1 );
+    }
+
+    const f_color mapped_canvas::pixel_at( uint16_t x, uint16_t y ) const
+    {
+        if ( !within_bounds( x, y ) )
+        {
+            std::cout << ". No such pixel at (" << x << ", " << y << ")." << std::endl;
+            return f_color( 0, 0, 0 );
+        }
+        rgba_pixel pixel;
+        load( x, y, &pixel, 1 );
+        return to_color( pixel );
+    }
+
+    void mapped_canvas::release_rows( uint16_t y0, uint16_t y1 ) const noexcept
+    {
+        if ( y0 < y1 )
+        {
+            _file.release( header_size + y0 * _row_bytes, ( y1 - y0 ) * _row_bytes );
+        }
+    }
+
+    void mapped_canvas::flush()
+    {
+        _file.sync();
+    }
+
+    void mapped_canvas::write_to( const std::string& file, ppm_format format ) const
+    {
+        write_to( file, format, tone_mapper() );
+    }
+
+    void mapped_canvas::write_to( const std::string& file, ppm_format format, const tone_mapper& mapper ) const
+    {
+        auto band = band_rows();
+        std::vector<rgba_pixel> buffer;
+        if ( _format != mapped_pixel_format::rgba_float )
+        {
+            buffer.resize( static_cast<std::size_t>( _width ) * band );
+        }
+
+        std::ofstream out;
+        out.exceptions( std::ios::badbit | std::ios::failbit );
+        try
+        {
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            ppm_writer writer( out, _width, _height, format, mapper );
+            _file.advise_sequential();
+            uint16_t rows;
+            for ( uint16_t y = 0; y < _height; y = static_cast<uint16_t>( y + rows ) )
+            {
+                rows = static_cast<uint16_t>( std::min<int>( band, _height - y ) );
+                if ( _format == mapped_pixel_format::rgba_float )
+                {
+                    writer.write_rows( span( 0, y ), row_stride(), rows );
+                }
+                else
+                {
+                    for ( uint16_t j = 0; j < rows; j++ )
+                    {
+                        load( 0, static_cast<uint16_t>( y + j ), buffer.data() + j * static_cast<std::size_t>( _width ), _width );
+                    }
+                    writer.write_rows( buffer.data(), _width, rows );
+                }
+                release_rows( y, static_cast<uint16_t>( y + rows ) );
+            }
+            writer.finish();
+            out.close();
+        }
+        catch ( const std::exception& e )
+        {
+            std::cout << "Could not open file at " << file << " for writing: " << e.what() << std::endl;
+        }
+    }
+
+    void mapped_canvas::write_pfm_to( const std::string& file ) const
+    {
+        auto band = band_rows();
+        std::vector<rgba_pixel> buffer( _format == mapped_pixel_format::rgba_float ? 0 : _width );
+
+        std::ofstream out;
+        out.exceptions( std::ios::badbit | std::ios::failbit );
+        try
+        {
+            out.open( file, std::fstream::out | std::fstream::trunc | std::fstream::binary );
+            pfm_writer writer( out, _width, _height );
+            uint16_t start;
+            for ( uint16_t end = _height; end > 0; end = start )
+            {
+                start = static_cast<uint16_t>( end - std::min( band, end ) );
+                for ( auto y = end; y > start; y-- )
+                {
+                    auto row = static_cast<uint16_t>( y - 1 );
+                    if ( _format == mapped_pixel_format::rgba_float )
+                    {
+                        writer.write_row( row, span( 0, row ) );
+                    }
+                    else
+                    {
+                        load( 0, row, buffer.data(), _width );
+                        writer.write_row( row, buffer.data() );
+                    }
+                }
+                release_rows( start, end );
+            }
+            writer.finish();
+            out.close();
+        }
+        catch ( const std::exception& e )
+        {
+            std::cout << "Could not open file at " << file << " for writing: " << e.what() << std::endl;
+        }
+    }
+
+    uint16_t mapped_canvas::band_rows() const noexcept
+    {
+        // Half rows are widened into a band buffer first, which counts towards the limit too
+        auto band_bytes = std::max<std::size_t>( 1, _row_bytes + ( _format == mapped_pixel_format::rgba_float ? 0 : _width * sizeof( rgba_pixel ) ) );
+        return static_cast<uint16_t>( std::min<std::size_t>( _height, std::max<std::size_t>( 1, _resident_limit / band_bytes ) ) );
+    }
+}
@@ -0,0 +1,149 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+#if !defined( __unix__ ) && !defined( __APPLE__ )
+#error "mapped_file maps files with mmap, which this platform does not provide"
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ls {
+    namespace {
+        /**
+         * Closes the descriptor, if any, without losing the error that made us give up on it
+         */
+        [[noreturn]] void throw_error( const std::string& what, const std::string& path, int descriptor = -1 )
+        {
+            auto error = errno;
+            if ( descriptor >= 0 )
+            {
+                ::close( descriptor );
+            }
+            throw std::system_error( error, std::generic_category(), what + " " + path );
+        }
+    }
+
+    mapped_file::mapped_file( const std::string& path, access mode ) :
+        _mode( mode )
+    {
+        auto descriptor = ::open( path.c_str(), mode == access::read_write ? O_RDWR : O_RDONLY );
+        if ( descriptor < 0 )
+        {
+            throw_error( "Could not open", path );
+        }
+
+        struct stat info;
+        if ( ::fstat( descriptor, &info ) != 0 )
+        {
+            throw_error( "Could not read the size of", path, descriptor );
+        }
+        _size = static_cast<std::size_t>( info.st_size );
+        map( descriptor, path );
+    }
+
+    mapped_file::mapped_file( const std::string& path, std::size_t size ) :
+        _size( size ), _mode( access::read_write )
+    {
+        auto descriptor = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+        if ( descriptor < 0 )
+        {
+            throw_error( "Could not create", path );
+        }
+        if ( ::ftruncate( descriptor, static_cast<off_t>( size ) ) != 0 )
+        {
+            throw_error( "Could not resize", path, descriptor );
+        }
+        map( descriptor, path );
+    }
+
+    mapped_file::mapped_file( mapped_file&& other ) noexcept :
+        _data( std::exchange( other._data, nullptr ) ), _size( std::exchange( other._size, 0 ) ), _mode( other._mode )
+    { }
+
+    mapped_file& mapped_file::operator=( mapped_file&& other ) noexcept
+    {
+        if ( this != &other )
+        {
+            close();
+            _data = std::exchange( other._data, nullptr );
+            _size = std::exchange( other._size, 0 );
+            _mode = other._mode;
+        }
+        return *this;
+    }
+
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    void mapped_file::release( std::size_t offset, std::size_t length ) const noexcept
+    {
+        // Only pages lying entirely in the range are dropped, as the ones it shares with its
+        // neighbours may still be in use
+        auto page = page_size();
+        auto first = ( offset + page - 1 ) / page * page;
+        auto last = std::min( offset + length, _size ) / page * page;
+        if ( _data != nullptr && first < last )
+        {
+            ::madvise( _data + first, last - first, MADV_DONTNEED );
+        }
+    }
+
+    void mapped_file::advise_sequential() const noexcept
+    {
+        if ( _data != nullptr )
+        {
+            ::madvise( _data, _size, MADV_SEQUENTIAL );
+        }
+    }
+
+    void mapped_file::sync()
+    {
+        if ( _data != nullptr && writable() && ::msync( _data, _size, MS_SYNC ) != 0 )
+        {
+            throw std::system_error( errno, std::generic_category(), "Could not write back a mapped file" );
+        }
+    }
+
+    void mapped_file::close() noexcept
+    {
+        if ( _data != nullptr )
+        {
+            ::munmap( _data, _size );
+            _data = nullptr;
+            _size = 0;
+        }
+    }
+
+    std::size_t mapped_file::page_size() noexcept
+    {
+        static const std::size_t size = static_cast<std::size_t>( ::sysconf( _SC_PAGESIZE ) );
+        return size;
+    }
+
+    void mapped_file::map( int descriptor, const std::string& path )
+    {
+        // Empty files cannot be mapped, but are still valid to open
+        if ( _size == 0 )
+        {
+            ::close( descriptor );
+            return;
+        }
+
+        auto protection = _mode == access::read_write ? PROT_READ | PROT_WRITE : PROT_READ;
+        auto address = ::mmap( nullptr, _size, protection, MAP_SHARED, descriptor, 0 );
+        if ( address == MAP_FAILED )
+        {
+            _size = 0;
+            throw_error( "Could not map", path, descriptor );
+        }
+        // The mapping keeps its own reference to the file
+        ::close( descriptor );
+        _data = static_cast<uint8_t*>( address );
+    }
+}
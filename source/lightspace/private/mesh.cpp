@@ -0,0 +1,363 @@
+#include "mesh.hpp"
+#include "mapped_file.hpp"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace ls {
+    namespace {
+        constexpr char mesh_magic[8] = { 'L', 'S', 'M', 'E', 'S', 'H', 0, 0 };
+        constexpr uint32_t mesh_version = 1;
+        constexpr std::size_t table_alignment = 16;
+
+        /**
+         * The start of a mesh cache, stored in native byte order. Positions and normals are
+         * three floats each, texture coordinates two, corners three 32-bit indices as in
+         * mesh::corner and part names are packed one after another.
+         */
+        struct mesh_file_header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t part_count;
+            uint64_t position_count;
+            uint64_t uv_count;
+            uint64_t normal_count;
+            uint64_t triangle_count;
+            uint64_t positions_offset;
+            uint64_t uvs_offset;
+            uint64_t normals_offset;
+            uint64_t corners_offset;
+            uint64_t parts_offset;
+            uint64_t names_offset;
+            uint64_t names_size;
+        };
+
+        struct mesh_file_part
+        {
+            uint64_t first_triangle;
+            uint64_t triangle_count;
+            uint64_t name_offset;
+            uint64_t name_size;
+        };
+
+        static_assert( sizeof( mesh::corner ) == 3 * sizeof( uint32_t ), "Corners are stored as they are laid out in memory" );
+
+        std::size_t align_table( std::size_t offset ) noexcept
+        {
+            return ( offset + table_alignment - 1 ) / table_alignment * table_alignment;
+        }
+
+        /**
+         * Whether count elements of the given size fit in the file from offset on
+         */
+        bool table_fits( uint64_t offset, uint64_t count, std::size_t element_size, std::size_t file_size ) noexcept
+        {
+            return offset <= file_size && count <= ( file_size - offset ) / element_size;
+        }
+
+        /**
+         * The cell of a coordinate in a grid of cell_size wide cells. Exact coordinates, with
+         * a cell size of 0, and cells too far out to count are keyed by their bits, with -0 the
+         * same as 0.
+         */
+        int64_t cell_coordinate( fpnum value, fpnum cell_size ) noexcept
+        {
+            double v = value + fpnum( 0 );
+            auto scaled = cell_size > 0 ? std::floor( v / cell_size ) : 0.0;
+            if ( cell_size > 0 && std::abs( scaled ) < 1e15 )
+            {
+                return static_cast<int64_t>( scaled );
+            }
+            int64_t bits;
+            std::memcpy( &bits, &v, sizeof( bits ) );
+            return bits;
+        }
+
+        uint64_t cell_hash( int64_t x, int64_t y, int64_t z ) noexcept
+        {
+            return static_cast<uint64_t>( x ) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>( y ) * 0xC2B2AE3D27D4EB4Full ^
+                static_cast<uint64_t>( z ) * 0x165667B19E3779F9ull;
+        }
+
+        uint16_t quantize_coordinate( fpnum value, fpnum origin, fpnum step ) noexcept
+        {
+            return step > 0 ? static_cast<uint16_t>( std::min<fpnum>( std::round( ( value - origin ) / step ), 65535 ) ) : 0;
+        }
+
+        void store_floats( uint8_t* out, float a, float b ) noexcept
+        {
+            const float values[2] = { a, b };
+            std::memcpy( out, values, sizeof( values ) );
+        }
+
+        void store_floats( uint8_t* out, float a, float b, float c ) noexcept
+        {
+            const float values[3] = { a, b, c };
+            std::memcpy( out, values, sizeof( values ) );
+        }
+    }
+
+    constexpr uint32_t mesh::missing;
+
+    bool mesh::has_normals( std::size_t t ) const noexcept
+    {
+        auto c = triangle_corners( t );
+        return c[0].normal != missing && c[1].normal != missing && c[2].normal != missing;
+    }
+
+    bool mesh::has_uvs( std::size_t t ) const noexcept
+    {
+        auto c = triangle_corners( t );
+        return c[0].uv != missing && c[1].uv != missing && c[2].uv != missing;
+    }
+
+    f_vector mesh::interpolated_normal( std::size_t t, fpnum u, fpnum v ) const noexcept
+    {
+        auto c = triangle_corners( t );
+        return normals[c[0].normal] * ( 1 - u - v ) + normals[c[1].normal] * u + normals[c[2].normal] * v;
+    }
+
+    texture_uv mesh::interpolated_uv( std::size_t t, fpnum u, fpnum v ) const noexcept
+    {
+        auto c = triangle_corners( t );
+        const auto& a = uvs[c[0].uv];
+        const auto& b = uvs[c[1].uv];
+        const auto& d = uvs[c[2].uv];
+        return texture_uv{ a.u * ( 1 - u - v ) + b.u * u + d.u * v, a.v * ( 1 - u - v ) + b.v * u + d.v * v };
+    }
+
+    std::size_t mesh::weld( fpnum tolerance )
+    {
+        if ( quantized() )
+        {
+            return 0;
+        }
+
+        // Kept positions sharing a cell hash are chained through next. Cells are twice the
+        // tolerance wide, so the box within tolerance of a position overlaps at most two of
+        // them on each axis, and hash collisions only cost an extra comparison.
+        std::unordered_map<uint64_t, uint32_t> cells;
+        cells.reserve( positions.size() );
+        std::vector<uint32_t> next;
+        std::vector<f_point> kept;
+        std::vector<uint32_t> remap( positions.size() );
+        const auto cell_size = 2 * tolerance;
+        for ( std::size_t i = 0; i < positions.size(); i++ )
+        {
+            const auto& p = positions[i];
+            const int64_t cell[3] = { cell_coordinate( p.x, cell_size ), cell_coordinate( p.y, cell_size ), cell_coordinate( p.z, cell_size ) };
+            int64_t low[3] = {
+                cell_coordinate( p.x - tolerance, cell_size ), cell_coordinate( p.y - tolerance, cell_size ), cell_coordinate( p.z - tolerance, cell_size )
+            };
+            int64_t high[3] = {
+                cell_coordinate( p.x + tolerance, cell_size ), cell_coordinate( p.y + tolerance, cell_size ), cell_coordinate( p.z + tolerance, cell_size )
+            };
+            for ( std::size_t axis = 0; axis < 3; axis++ )
+            {
+                // Cells keyed by bits have no neighbours to look through
+                if ( static_cast<uint64_t>( high[axis] ) - static_cast<uint64_t>( low[axis] ) > 1 )
+                {
+                    low[axis] = high[axis] = cell[axis];
+                }
+            }
+            auto found = missing;
+            for ( auto x = low[0]; x <= high[0] && found == missing; x++ )
+            {
+                for ( auto y = low[1]; y <= high[1] && found == missing; y++ )
+                {
+                    for ( auto z = low[2]; z <= high[2] && found == missing; z++ )
+                    {
+                        auto bucket = cells.find( cell_hash( x, y, z ) );
+                        for ( auto k = bucket == cells.end() ? missing : bucket->second; k != missing; k = next[k] )
+                        {
+                            const auto& q = kept[k];
+                            if ( std::abs( q.x - p.x ) <= tolerance && std::abs( q.y - p.y ) <= tolerance && std::abs( q.z - p.z ) <= tolerance )
+                            {
+                                found = k;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            if ( found == missing )
+            {
+                found = static_cast<uint32_t>( kept.size() );
+                kept.push_back( p );
+                auto& head = cells.emplace( cell_hash( cell[0], cell[1], cell[2] ), missing ).first->second;
+                next.push_back( head );
+                head = found;
+            }
+            remap[i] = found;
+        }
+
+        for ( auto& c : corners )
+        {
+            c.position = remap[c.position];
+        }
+        auto removed = positions.size() - kept.size();
+        positions.swap( kept );
+        return removed;
+    }
+
+    void mesh::quantize()
+    {
+        if ( quantized() || positions.empty() )
+        {
+            return;
+        }
+        auto low = positions.front(), high = positions.front();
+        for ( const auto& p : positions )
+        {
+            low = f_point( std::min( low.x, p.x ), std::min( low.y, p.y ), std::min( low.z, p.z ) );
+            high = f_point( std::max( high.x, p.x ), std::max( high.y, p.y ), std::max( high.z, p.z ) );
+        }
+        quantization_origin = low;
+        quantization_step = f_vector( ( high.x - low.x ) / 65535, ( high.y - low.y ) / 65535, ( high.z - low.z ) / 65535 );
+
+        quantized_positions.resize( positions.size() );
+        for ( std::size_t i = 0; i < positions.size(); i++ )
+        {
+            const auto& p = positions[i];
+            quantized_positions[i] = quantized_position{
+                quantize_coordinate( p.x, low.x, quantization_step.x ),
+                quantize_coordinate( p.y, low.y, quantization_step.y ),
+                quantize_coordinate( p.z, low.z, quantization_step.z )
+            };
+        }
+        std::vector<f_point>().swap( positions );
+    }
+
+    void mesh::write_to( const std::string& file ) const
+    {
+        mesh_file_header header{};
+        std::memcpy( header.magic, mesh_magic, sizeof( mesh_magic ) );
+        header.version = mesh_version;
+        header.part_count = static_cast<uint32_t>( parts.size() );
+        header.position_count = vertex_count();
+        header.uv_count = uvs.size();
+        header.normal_count = normals.size();
+        header.triangle_count = triangle_count();
+        header.positions_offset = align_table( sizeof( header ) );
+        header.uvs_offset = align_table( header.positions_offset + 3 * sizeof( float ) * header.position_count );
+        header.normals_offset = align_table( header.uvs_offset + 2 * sizeof( float ) * uvs.size() );
+        header.corners_offset = align_table( header.normals_offset + 3 * sizeof( float ) * normals.size() );
+        header.parts_offset = align_table( header.corners_offset + 3 * sizeof( corner ) * header.triangle_count );
+        header.names_offset = header.parts_offset + sizeof( mesh_file_part ) * parts.size();
+        for ( const auto& p : parts )
+        {
+            header.names_size += p.name.size();
+        }
+
+        mapped_file out( file, static_cast<std::size_t>( header.names_offset + header.names_size ) );
+        auto data = out.data();
+        std::memcpy( data, &header, sizeof( header ) );
+        for ( std::size_t i = 0; i < header.position_count; i++ )
+        {
+            auto p = position( i );
+            store_floats( data + header.positions_offset + 3 * sizeof( float ) * i, p.x, p.y, p.z );
+        }
+        for ( std::size_t i = 0; i < uvs.size(); i++ )
+        {
+            store_floats( data + header.uvs_offset + 2 * sizeof( float ) * i, uvs[i].u, uvs[i].v );
+        }
+        for ( std::size_t i = 0; i < normals.size(); i++ )
+        {
+            const auto& n = normals[i];
+            store_floats( data + header.normals_offset + 3 * sizeof( float ) * i, n.x, n.y, n.z );
+        }
+        if ( !corners.empty() )
+        {
+            std::memcpy( data + header.corners_offset, corners.data(), corners.size() * sizeof( corner ) );
+        }
+        uint64_t name_offset = 0;
+        for ( std::size_t i = 0; i < parts.size(); i++ )
+        {
+            const auto& p = parts[i];
+            mesh_file_part entry{ p.first_triangle, p.triangle_count, name_offset, p.name.size() };
+            std::memcpy( data + header.parts_offset + sizeof( entry ) * i, &entry, sizeof( entry ) );
+            std::memcpy( data + header.names_offset + name_offset, p.name.data(), p.name.size() );
+            name_offset += p.name.size();
+        }
+        out.sync();
+    }
+
+    mesh_ptr mesh::load( const std::string& file )
+    {
+        mapped_file in( file );
+        in.advise_sequential();
+        auto data = in.data();
+        auto size = in.size();
+
+        mesh_file_header header{};
+        bool valid = size >= sizeof( header );
+        if ( valid )
+        {
+            std::memcpy( &header, data, sizeof( header ) );
+            valid = std::memcmp( header.magic, mesh_magic, sizeof( mesh_magic ) ) == 0 && header.version == mesh_version &&
+                header.position_count < missing && header.uv_count < missing && header.normal_count < missing &&
+                table_fits( header.positions_offset, header.position_count, 3 * sizeof( float ), size ) &&
+                table_fits( header.uvs_offset, header.uv_count, 2 * sizeof( float ), size ) &&
+                table_fits( header.normals_offset, header.normal_count, 3 * sizeof( float ), size ) &&
+                table_fits( header.corners_offset, header.triangle_count, 3 * sizeof( corner ), size ) &&
+                table_fits( header.parts_offset, header.part_count, sizeof( mesh_file_part ), size ) &&
+                table_fits( header.names_offset, header.names_size, 1, size );
+        }
+        if ( !valid )
+        {
+            throw std::runtime_error( "Not a mesh cache" );
+        }
+
+        auto m = mesh::create();
+        m->positions.resize( header.position_count );
+        m->uvs.resize( header.uv_count );
+        m->normals.resize( header.normal_count );
+        m->corners.resize( 3 * header.triangle_count );
+        float values[3];
+        for ( std::size_t i = 0; i < m->positions.size(); i++ )
+        {
+            std::memcpy( values, data + header.positions_offset + sizeof( values ) * i, sizeof( values ) );
+            m->positions[i] = f_point( values[0], values[1], values[2] );
+        }
+        for ( std::size_t i = 0; i < m->uvs.size(); i++ )
+        {
+            std::memcpy( values, data + header.uvs_offset + 2 * sizeof( float ) * i, 2 * sizeof( float ) );
+            m->uvs[i] = texture_uv{ values[0], values[1] };
+        }
+        for ( std::size_t i = 0; i < m->normals.size(); i++ )
+        {
+            std::memcpy( values, data + header.normals_offset + sizeof( values ) * i, sizeof( values ) );
+            m->normals[i] = f_vector( values[0], values[1], values[2] );
+        }
+        if ( !m->corners.empty() )
+        {
+            std::memcpy( m->corners.data(), data + header.corners_offset, m->corners.size() * sizeof( corner ) );
+        }
+
+        // Every index is checked once here, so that the intersector and shading can trust them
+        for ( const auto& c : m->corners )
+        {
+            if ( c.position >= header.position_count || ( c.uv != missing && c.uv >= header.uv_count ) ||
+                ( c.normal != missing && c.normal >= header.normal_count ) )
+            {
+                throw std::runtime_error( "Mesh cache index out of range" );
+            }
+        }
+        m->parts.reserve( header.part_count );
+        for ( std::size_t i = 0; i < header.part_count; i++ )
+        {
+            mesh_file_part entry;
+            std::memcpy( &entry, data + header.parts_offset + sizeof( entry ) * i, sizeof( entry ) );
+            if ( entry.first_triangle > header.triangle_count || entry.triangle_count > header.triangle_count - entry.first_triangle ||
+                entry.name_offset > header.names_size || entry.name_size > header.names_size - entry.name_offset )
+            {
+                throw std::runtime_error( "Mesh cache part out of range" );
+            }
+            auto name = reinterpret_cast<const char*>( data + header.names_offset + entry.name_offset );
+            m->parts.push_back( part{ std::string( name, name + entry.name_size ), entry.first_triangle, entry.triangle_count } );
+        }
+        return m;
+    }
+}
@@ -1,118 +1,1548 @@
 #include "model_parser.hpp"
 #include "shapes.hpp"
-#include <sstream>
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
+#include <system_error>
 
 namespace ls {
-    model_parse_data::model_parse_data()
-    {
-        lines_ignored = 0;
-        root_group = group::create();
-    }
+    namespace {
+        /**
+         * A view of characters within the parsed buffer
+         */
+        struct token
+        {
+            const char* begin;
+            const char* end;
+
+            inline std::size_t size() const noexcept
+            {
+                return static_cast<std::size_t>( end - begin );
+            }
+
+            inline bool is( char lower ) const noexcept
+            {
+                return size() == 1 && ( *begin == lower || *begin == lower - 'a' + 'A' );
+            }
+
+            inline bool is( const char* lower ) const noexcept
+            {
+                auto p = begin;
+                for ( ; p < end && *lower; ++p, ++lower )
+                {
+                    if ( *p != *lower && *p != *lower - 'a' + 'A' )
+                    {
+                        return false;
+                    }
+                }
+                return p == end && !*lower;
+            }
+
+            std::string str() const
+            {
+                return std::string( begin, end );
+            }
+        };
+
+        /**
+         * Lines are already split at '\n', the rest of what std::isspace accepts separates
+         * tokens the way the stream extraction used to
+         */
+        inline bool is_space( char c ) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+        }
+
+        inline bool is_digit( char c ) noexcept
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        void split( const char* begin, const char* end, std::vector<token>& tokens )
+        {
+            tokens.clear();
+            while ( true )
+            {
+                while ( begin < end && is_space( *begin ) )
+                {
+                    ++begin;
+                }
+                if ( begin == end )
+                {
+                    return;
+                }
+                auto start = begin;
+                while ( begin < end && !is_space( *begin ) )
+                {
+                    ++begin;
+                }
+                tokens.push_back( token{ start, begin } );
+            }
+        }
+
+        /**
+         * Converts the number prefix of the token with a strtof-like function, which needs a
+         * null terminated copy of it
+         */
+        template<typename Number>
+        bool convert_number( const token& t, Number( *convert )( const char*, char** ), Number& value )
+        {
+            char buffer[64];
+            std::string long_token;
+            auto text = buffer;
+            if ( t.size() < sizeof( buffer ) )
+            {
+                std::memcpy( buffer, t.begin, t.size() );
+                buffer[t.size()] = '\0';
+            }
+            else
+            {
+                long_token = t.str();
+                text = &long_token[0];
+            }
+            char* stop;
+            errno = 0;
+            value = convert( text, &stop );
+            return stop != text && errno != ERANGE;
+        }
+
+        /**
+         * Parses like std::stof, a number prefix of the token, without throwing. Plain
+         * decimals of up to seven significant digits are converted directly: both the digits
+         * and the power of ten are exact floats then, so one division rounds correctly and
+         * gives the same float as strtof. Anything else goes through strtof.
+         */
+        bool parse_float( const token& t, float& value )
+        {
+            static const float powers_of_ten[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+            auto p = t.begin;
+            bool negative = p < t.end && *p == '-';
+            if ( p < t.end && ( *p == '-' || *p == '+' ) )
+            {
+                ++p;
+            }
+            uint32_t mantissa = 0;
+            int significant = 0, fraction = 0;
+            bool digits = false;
+            for ( ; p < t.end && is_digit( *p ) && significant < 8; ++p, digits = true )
+            {
+                mantissa = mantissa * 10 + static_cast<uint32_t>( *p - '0' );
+                significant += mantissa != 0;
+            }
+            if ( p < t.end && *p == '.' )
+            {
+                for ( ++p; p < t.end && is_digit( *p ) && significant < 8; ++p, digits = true )
+                {
+                    mantissa = mantissa * 10 + static_cast<uint32_t>( *p - '0' );
+                    significant += mantissa != 0;
+                    fraction++;
+                }
+            }
+            if ( p == t.end && digits && significant <= 7 && fraction <= 10 )
+            {
+                value = static_cast<float>( mantissa ) / powers_of_ten[fraction];
+                value = negative ? -value : value;
+                return true;
+            }
+
+            return convert_number( t, std::strtof, value );
+        }
+
+        /**
+         * Parses like std::stod, a number prefix of the token, without throwing
+         */
+        bool parse_double( const token& t, double& value )
+        {
+            return convert_number( t, std::strtod, value );
+        }
+
+        /**
+         * Parses like std::stoi, the integer prefix of the token, without throwing
+         */
+        bool parse_index( const token& t, long& value ) noexcept
+        {
+            auto p = t.begin;
+            bool negative = p < t.end && *p == '-';
+            if ( p < t.end && ( *p == '-' || *p == '+' ) )
+            {
+                ++p;
+            }
+            long magnitude = 0;
+            auto first = p;
+            for ( ; p < t.end && is_digit( *p ); ++p )
+            {
+                magnitude = magnitude * 10 + ( *p - '0' );
+                if ( magnitude > static_cast<long>( INT_MAX ) + 1 )
+                {
+                    return false;
+                }
+            }
+            value = negative ? -magnitude : magnitude;
+            return p != first && value <= INT_MAX;
+        }
+
+        void fail( model_parse_result& result, unsigned int line_number, const std::string& message )
+        {
+            result.status = model_parse_status::FAIL;
+            result.data.reset( nullptr );
+            result.error.reset( new model_parse_error );
+            result.error->line_number = line_number;
+            result.error->message = message;
+        }
+
+        const char* const invalid_argument_message = "Invalid argument encountered";
+
+        const char* const out_of_range_messages[3] = {
+            "Vertex index out of range", "Texture coordinate index out of range", "Normal index out of range"
+        };
+
+        /**
+         * The indices of a face corner as written, where 0 stands for an attribute the corner
+         * does not have
+         */
+        struct obj_corner
+        {
+            int32_t position;
+            int32_t uv;
+            int32_t normal;
+        };
+
+        /**
+         * Splits a corner into its v, vt and vn fields and parses each like std::stoi. Only
+         * the texture coordinate may be left empty, between two slashes. An index of 0 is out
+         * of range whatever comes before it, so it is reported right away. Returns the error
+         * message, with the fields before the failing one filled in.
+         */
+        const char* parse_corner( const token& t, obj_corner& c ) noexcept
+        {
+            c = obj_corner{ 0, 0, 0 };
+            token fields[3];
+            std::size_t count = 0;
+            for ( auto p = t.begin, start = t.begin; ; ++p )
+            {
+                if ( p == t.end || *p == '/' )
+                {
+                    if ( count == 3 )
+                    {
+                        return invalid_argument_message;
+                    }
+                    fields[count++] = token{ start, p };
+                    if ( p == t.end )
+                    {
+                        break;
+                    }
+                    start = p + 1;
+                }
+            }
+
+            int32_t* targets[3] = { &c.position, &c.uv, &c.normal };
+            for ( std::size_t i = 0; i < count; i++ )
+            {
+                if ( i == 1 && count == 3 && fields[i].size() == 0 )
+                {
+                    continue;
+                }
+                long index;
+                if ( !parse_index( fields[i], index ) )
+                {
+                    return invalid_argument_message;
+                }
+                if ( index == 0 )
+                {
+                    return out_of_range_messages[i];
+                }
+                *targets[i] = static_cast<int32_t>( index );
+            }
+            return nullptr;
+        }
+
+        /**
+         * Turns a 1-based or negative, relative index into a 0-based one among the available
+         * elements. 0 marks a missing attribute.
+         */
+        bool resolve_index( int32_t index, std::size_t available, uint32_t& resolved ) noexcept
+        {
+            if ( index == 0 )
+            {
+                resolved = mesh::missing;
+                return true;
+            }
+            auto i = index > 0 ? static_cast<long long>( index ) - 1 : static_cast<long long>( available ) + index;
+            if ( i < 0 || i >= static_cast<long long>( available ) )
+            {
+                return false;
+            }
+            resolved = static_cast<uint32_t>( i );
+            return true;
+        }
+
+        /**
+         * Chunks are at least this large, so that small files are not slowed down by
+         * starting threads, and each thread is given a few of them to balance the load
+         */
+        constexpr std::size_t min_chunk_bytes = 1 << 16;
+        constexpr std::size_t chunks_per_thread = 4;
+
+        /**
+         * Shapes for a cached mesh are created in jobs of up to this many triangles
+         */
+        constexpr std::size_t triangles_per_job = 1 << 15;
+
+        /**
+         * How many of each element the chunks before a chunk defined
+         */
+        struct obj_offsets
+        {
+            std::size_t positions;
+            std::size_t uvs;
+            std::size_t normals;
+            std::size_t triangles;
+        };
+
+        struct obj_face
+        {
+            std::size_t first_corner;
+            std::size_t corner_count;
+            obj_offsets before;
+            unsigned int line;
+        };
+
+        struct obj_group
+        {
+            std::string name;
+            std::size_t first_triangle;
+        };
+
+        /**
+         * What a run of whole lines parses into. Elements and lines are counted from the
+         * start of the chunk, faces keep their indices until the chunks before them have been
+         * counted and groups remember the triangle they start at.
+         */
+        struct obj_chunk
+        {
+            const char* begin;
+            const char* end;
+            unsigned int lines{ 0 };
+            unsigned int lines_ignored{ 0 };
+            std::vector<f_point> vertices;
+            std::vector<texture_uv> uvs;
+            std::vector<f_vector> normals;
+            std::vector<obj_corner> corners;
+            std::vector<obj_face> faces;
+            std::vector<obj_group> groups;
+            std::size_t triangle_count{ 0 };
+            std::vector<shape_ptr> triangles;
+            unsigned int error_line{ 0 };
+            const char* error{ nullptr };
+
+            obj_chunk( const char* b, const char* e ) noexcept :
+                begin( b ), end( e )
+            {
+            }
+
+            obj_offsets counts() const noexcept
+            {
+                return obj_offsets{ vertices.size(), uvs.size(), normals.size(), triangle_count };
+            }
+
+            void fail( unsigned int line, const char* message ) noexcept
+            {
+                // A face checked after scanning can only fail on or before the line scanning
+                // stopped at, and on the same line its bad index came first
+                if ( !error || line <= error_line )
+                {
+                    error_line = line;
+                    error = message;
+                }
+            }
+        };
+
+        std::vector<obj_chunk> split_chunks( const char* begin, const char* end, std::size_t threads )
+        {
+            auto size = static_cast<std::size_t>( end - begin );
+            auto count = std::max<std::size_t>( 1, std::min( threads * chunks_per_thread, size / min_chunk_bytes ) );
+            std::vector<obj_chunk> chunks;
+            chunks.reserve( count );
+            auto chunk_begin = begin;
+            for ( std::size_t i = 1; i < count && chunk_begin < end; i++ )
+            {
+                auto target = std::max( chunk_begin, begin + size / count * i );
+                auto line_end = static_cast<const char*>( std::memchr( target, '\n', static_cast<std::size_t>( end - target ) ) );
+                if ( !line_end )
+                {
+                    break;
+                }
+                chunks.emplace_back( chunk_begin, line_end + 1 );
+                chunk_begin = line_end + 1;
+            }
+            if ( chunk_begin < end || chunks.empty() )
+            {
+                chunks.emplace_back( chunk_begin, end );
+            }
+            return chunks;
+        }
+
+        bool parse_floats( const std::vector<token>& tokens, std::size_t count, float* values )
+        {
+            for ( std::size_t i = 0; i < count; i++ )
+            {
+                if ( !parse_float( tokens[i + 1], values[i] ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Parses the lines of a chunk, stopping at the first malformed one. A face that fails
+         * is still recorded with the indices before the failure, as one of those being out of
+         * range is what parsing the file in one go would have reported.
+         */
+        void scan_chunk( obj_chunk& chunk )
+        {
+            std::vector<token> tokens;
+            float values[3];
+            for ( auto line = chunk.begin; line < chunk.end; )
+            {
+                auto line_end = static_cast<const char*>( std::memchr( line, '\n', static_cast<std::size_t>( chunk.end - line ) ) );
+                line_end = line_end ? line_end : chunk.end;
+                split( line, line_end, tokens );
+                line = line_end + 1;
+                chunk.lines++;
+
+                if ( tokens.size() == 2 && tokens[0].is( 'g' ) )
+                {
+                    chunk.groups.push_back( obj_group{ tokens[1].str(), chunk.triangle_count } );
+                }
+                else if ( tokens.size() == 4 && tokens[0].is( 'v' ) )
+                {
+                    if ( !parse_floats( tokens, 3, values ) )
+                    {
+                        chunk.fail( chunk.lines, invalid_argument_message );
+                        return;
+                    }
+                    chunk.vertices.push_back( f_point( values[0], values[1], values[2] ) );
+                }
+                else if ( ( tokens.size() == 3 || tokens.size() == 4 ) && tokens[0].is( "vt" ) )
+                {
+                    // An optional third coordinate is read but not kept
+                    if ( !parse_floats( tokens, tokens.size() - 1, values ) )
+                    {
+                        chunk.fail( chunk.lines, invalid_argument_message );
+                        return;
+                    }
+                    chunk.uvs.push_back( texture_uv{ values[0], values[1] } );
+                }
+                else if ( tokens.size() == 4 && tokens[0].is( "vn" ) )
+                {
+                    if ( !parse_floats( tokens, 3, values ) )
+                    {
+                        chunk.fail( chunk.lines, invalid_argument_message );
+                        return;
+                    }
+                    chunk.normals.push_back( f_vector( values[0], values[1], values[2] ) );
+                }
+                else if ( tokens.size() >= 4 && tokens[0].is( 'f' ) )
+                {
+                    auto face = obj_face{ chunk.corners.size(), 0, chunk.counts(), chunk.lines };
+                    for ( std::size_t i = 1; i < tokens.size(); i++ )
+                    {
+                        obj_corner corner;
+                        auto error = parse_corner( tokens[i], corner );
+                        chunk.corners.push_back( corner );
+                        face.corner_count++;
+                        if ( error )
+                        {
+                            chunk.faces.push_back( face );
+                            chunk.fail( chunk.lines, error );
+                            return;
+                        }
+                    }
+                    chunk.faces.push_back( face );
+                    chunk.triangle_count += face.corner_count - 2;
+                }
+                else
+                {
+                    chunk.lines_ignored++;
+                }
+            }
+        }
+
+        /**
+         * Creates the shapes for triangles [first, last) of the mesh. Triangles with texture
+         * coordinates or normals at any corner refer back to the mesh, as do all triangles of
+         * a quantized mesh, so that compiled scenes can decode their corners from it. The
+         * others are plain triangles.
+         */
+        void create_triangles( const mesh_ptr& m, std::size_t first, std::size_t last, shape_ptr* out )
+        {
+            for ( auto t = first; t < last; t++ )
+            {
+                auto c = m->triangle_corners( t );
+                bool attributes = m->quantized();
+                for ( std::size_t i = 0; i < 3; i++ )
+                {
+                    attributes = attributes || c[i].uv != mesh::missing || c[i].normal != mesh::missing;
+                }
+                *out++ = attributes ?
+                    std::static_pointer_cast<shape>( mesh_triangle::create( m, static_cast<uint32_t>( t ) ) ) :
+                    triangle::create( m->position( c[0].position ), m->position( c[1].position ), m->position( c[2].position ) );
+            }
+        }
+
+        /**
+         * Resolves the corners of a chunk's faces against the elements defined before each
+         * of them and, when the whole chunk is valid, triangulates the faces into the mesh
+         */
+        void build_chunk( obj_chunk& chunk, const obj_offsets& first, const mesh_ptr& m, bool create_shapes )
+        {
+            std::vector<mesh::corner> resolved( chunk.corners.size() );
+            for ( const auto& face : chunk.faces )
+            {
+                const std::size_t available[3] = {
+                    first.positions + face.before.positions, first.uvs + face.before.uvs, first.normals + face.before.normals
+                };
+                for ( auto i = face.first_corner; i < face.first_corner + face.corner_count; i++ )
+                {
+                    const auto& corner = chunk.corners[i];
+                    const int32_t indices[3] = { corner.position, corner.uv, corner.normal };
+                    uint32_t* targets[3] = { &resolved[i].position, &resolved[i].uv, &resolved[i].normal };
+                    for ( std::size_t k = 0; k < 3; k++ )
+                    {
+                        if ( !resolve_index( indices[k], available[k], *targets[k] ) )
+                        {
+                            chunk.fail( face.line, out_of_range_messages[k] );
+                            return;
+                        }
+                    }
+                }
+            }
+            if ( chunk.error )
+            {
+                return;
+            }
+
+            auto t = first.triangles;
+            for ( const auto& face : chunk.faces )
+            {
+                auto c = resolved.data() + face.first_corner;
+                for ( std::size_t i = 1; i + 1 < face.corner_count; i++, t++ )
+                {
+                    m->corners[3 * t] = c[0];
+                    m->corners[3 * t + 1] = c[i];
+                    m->corners[3 * t + 2] = c[i + 1];
+                }
+            }
+            if ( create_shapes )
+            {
+                chunk.triangles.resize( chunk.triangle_count );
+                create_triangles( m, first.triangles, t, chunk.triangles.data() );
+            }
+        }
+
+        template<typename T>
+        void copy_stream( const std::vector<T>& from, std::vector<T>& to, std::size_t offset )
+        {
+            std::copy( from.cbegin(), from.cend(), to.begin() + offset );
+        }
+
+        /**
+         * Splits the text at line boundaries into chunks that are parsed in parallel. Once
+         * every chunk's elements are counted, a prefix sum gives each chunk the global index
+         * of its first vertex, texture coordinate, normal, triangle and line, so that faces
+         * can be resolved and errors reported exactly as a single pass over the file would.
+         * Groups are then assembled in file order, which keeps the result independent of the
+         * number of threads. Without create_shapes only the mesh and its parts are filled in.
+         */
+        model_parse_result parse_obj( const char* begin, const char* end, const arena_ptr& a, uint16_t threads, bool create_shapes )
+        {
+            arena_scope scope( a );
+            auto chunks = split_chunks( begin, end, threads ? threads : thread_pool::hardware_threads() );
+            thread_pool pool( chunks.size() > 1 ? threads : 1 );
+
+            pool.run( chunks.size(), [&] ( std::size_t i ) {
+                scan_chunk( chunks[i] );
+            } );
+
+            model_parse_result result;
+            result.data.reset( new model_parse_data( a ) );
+            auto& data = *result.data;
+            auto& m = *data.mesh;
+            std::vector<obj_offsets> first( chunks.size() );
+            obj_offsets total{ 0, 0, 0, 0 };
+            for ( std::size_t i = 0; i < chunks.size(); i++ )
+            {
+                first[i] = total;
+                auto counts = chunks[i].counts();
+                total = obj_offsets{
+                    total.positions + counts.positions, total.uvs + counts.uvs, total.normals + counts.normals, total.triangles + counts.triangles
+                };
+            }
+            m.positions.resize( total.positions );
+            m.uvs.resize( total.uvs );
+            m.normals.resize( total.normals );
+            m.corners.resize( 3 * total.triangles );
+
+            pool.run( chunks.size(), [&] ( std::size_t i ) {
+                copy_stream( chunks[i].vertices, m.positions, first[i].positions );
+                copy_stream( chunks[i].uvs, m.uvs, first[i].uvs );
+                copy_stream( chunks[i].normals, m.normals, first[i].normals );
+            } );
+            pool.run( chunks.size(), [&] ( std::size_t i ) {
+                // Each chunk fills blocks of its own, rather than every triangle, material and
+                // pattern taking the shared arena's lock
+                arena_scope worker_scope( a ? std::make_shared<arena>( a ) : a );
+                build_chunk( chunks[i], first[i], data.mesh, create_shapes );
+            } );
+
+            unsigned int first_line = 0;
+            for ( const auto& chunk : chunks )
+            {
+                if ( chunk.error )
+                {
+                    fail( result, first_line + chunk.error_line, chunk.error );
+                    return result;
+                }
+                first_line += chunk.lines;
+            }
+
+            // A group named again replaces the earlier one, and so does its part of the mesh
+            group_ptr current_group = data.root_group;
+            std::map<std::string, std::size_t> part_indices;
+            m.parts.push_back( mesh::part{ "", 0, 0 } );
+            std::size_t current_part = 0;
+            for ( std::size_t i = 0; i < chunks.size(); i++ )
+            {
+                const auto& chunk = chunks[i];
+                data.lines_ignored += chunk.lines_ignored;
+                auto triangle = chunk.triangles.cbegin();
+                for ( const auto& g : chunk.groups )
+                {
+                    auto start = first[i].triangles + g.first_triangle;
+                    m.parts[current_part].triangle_count = start - m.parts[current_part].first_triangle;
+                    auto index = part_indices.emplace( g.name, m.parts.size() );
+                    if ( index.second )
+                    {
+                        m.parts.push_back( mesh::part{ g.name, start, 0 } );
+                    }
+                    current_part = index.first->second;
+                    m.parts[current_part].first_triangle = start;
+
+                    if ( create_shapes )
+                    {
+                        current_group->add_children( triangle, chunk.triangles.cbegin() + g.first_triangle );
+                        triangle = chunk.triangles.cbegin() + g.first_triangle;
+                    }
+                    current_group = group::create( g.name );
+                    data.groups[g.name] = current_group;
+                }
+                current_group->add_children( triangle, chunk.triangles.cend() );
+            }
+            m.parts[current_part].triangle_count = total.triangles - m.parts[current_part].first_triangle;
+            result.status = model_parse_status::SUCCESS;
+            return result;
+        }
+
+        /**
+         * Creates the shapes for every part of the mesh in jobs of up to triangles_per_job
+         * triangles, each on a child of the arena, and collects them into a group per part.
+         * The part without a name becomes the root group.
+         */
+        model_parse_result create_groups( const mesh_ptr& m, const arena_ptr& a, uint16_t threads )
+        {
+            struct part_job
+            {
+                std::size_t part;
+                std::size_t first;
+                std::size_t last;
+            };
+            std::vector<std::vector<shape_ptr>> shapes( m->parts.size() );
+            std::vector<part_job> jobs;
+            for ( std::size_t p = 0; p < m->parts.size(); p++ )
+            {
+                const auto& part = m->parts[p];
+                shapes[p].resize( part.triangle_count );
+                for ( std::size_t t = 0; t < part.triangle_count; t += triangles_per_job )
+                {
+                    jobs.push_back( part_job{ p, t, std::min( part.triangle_count, t + triangles_per_job ) } );
+                }
+            }
+
+            thread_pool pool( jobs.size() > 1 ? threads : 1 );
+            pool.run( jobs.size(), [&] ( std::size_t i ) {
+                const auto& job = jobs[i];
+                arena_scope worker_scope( a ? std::make_shared<arena>( a ) : a );
+                auto first = m->parts[job.part].first_triangle;
+                create_triangles( m, first + job.first, first + job.last, shapes[job.part].data() + job.first );
+            } );
+
+            model_parse_result result;
+            result.data.reset( new model_parse_data( a, m ) );
+            auto& data = *result.data;
+            for ( std::size_t p = 0; p < m->parts.size(); p++ )
+            {
+                const auto& name = m->parts[p].name;
+                auto g = name.empty() ? data.root_group : group::create( name );
+                g->add_children( shapes[p] );
+                if ( !name.empty() )
+                {
+                    data.groups[name] = g;
+                }
+            }
+            result.status = model_parse_status::SUCCESS;
+            return result;
+        }
+
+        void apply_import_options( mesh& m, const mesh_import_options& options )
+        {
+            if ( options.weld )
+            {
+                m.weld( options.weld_tolerance );
+            }
+            if ( options.quantize )
+            {
+                m.quantize();
+            }
+        }
+
+        const char* const unexpected_end_message = "Unexpected end of file";
+
+        /**
+         * Binary vertex records are decoded in jobs of this many
+         */
+        constexpr std::size_t vertices_per_job = 1 << 16;
+
+        enum class ply_type : uint8_t
+        {
+            none, int8, uint8, int16, uint16, int32, uint32, float32, float64
+        };
+
+        enum class ply_format
+        {
+            ascii, binary_little_endian, binary_big_endian
+        };
+
+        std::size_t ply_type_size( ply_type type ) noexcept
+        {
+            switch ( type )
+            {
+            case ply_type::int8:
+            case ply_type::uint8:
+                return 1;
+            case ply_type::int16:
+            case ply_type::uint16:
+                return 2;
+            case ply_type::int32:
+            case ply_type::uint32:
+            case ply_type::float32:
+                return 4;
+            case ply_type::float64:
+                return 8;
+            default:
+                return 0;
+            }
+        }
+
+        ply_type parse_ply_type( const token& t ) noexcept
+        {
+            static const struct
+            {
+                const char* name;
+                ply_type type;
+            } names[] = {
+                { "char", ply_type::int8 }, { "int8", ply_type::int8 }, { "uchar", ply_type::uint8 }, { "uint8", ply_type::uint8 },
+                { "short", ply_type::int16 }, { "int16", ply_type::int16 }, { "ushort", ply_type::uint16 }, { "uint16", ply_type::uint16 },
+                { "int", ply_type::int32 }, { "int32", ply_type::int32 }, { "uint", ply_type::uint32 }, { "uint32", ply_type::uint32 },
+                { "float", ply_type::float32 }, { "float32", ply_type::float32 }, { "double", ply_type::float64 }, { "float64", ply_type::float64 }
+            };
+            for ( const auto& n : names )
+            {
+                if ( t.is( n.name ) )
+                {
+                    return n.type;
+                }
+            }
+            return ply_type::none;
+        }
+
+        /**
+         * Parses a whole token as an integer that fits in the given PLY integer type
+         */
+        bool parse_ply_integer( const token& t, ply_type type, double& value ) noexcept
+        {
+            int64_t min = 0, max = 0;
+            switch ( type )
+            {
+            case ply_type::int8: min = INT8_MIN; max = INT8_MAX; break;
+            case ply_type::uint8: max = UINT8_MAX; break;
+            case ply_type::int16: min = INT16_MIN; max = INT16_MAX; break;
+            case ply_type::uint16: max = UINT16_MAX; break;
+            case ply_type::int32: min = INT32_MIN; max = INT32_MAX; break;
+            case ply_type::uint32: max = UINT32_MAX; break;
+            default: return false;
+            }
+
+            auto p = t.begin;
+            bool negative = p < t.end && *p == '-';
+            if ( p < t.end && ( *p == '-' || *p == '+' ) )
+            {
+                ++p;
+            }
+            if ( p == t.end )
+            {
+                return false;
+            }
+            int64_t magnitude = 0;
+            for ( ; p < t.end; ++p )
+            {
+                if ( !is_digit( *p ) )
+                {
+                    return false;
+                }
+                magnitude = magnitude * 10 + ( *p - '0' );
+                if ( magnitude > static_cast<int64_t>( UINT32_MAX ) + 1 )
+                {
+                    return false;
+                }
+            }
+            auto integer = negative ? -magnitude : magnitude;
+            value = static_cast<double>( integer );
+            return integer >= min && integer <= max;
+        }
 
-    group_ptr model_parse_result::to_shape_group() const
-    {
-        auto group = group::create( "Root" );
-        if ( !data->root_group->children().empty() )
+        /**
+         * A property of a PLY element. Lists have a count_type, scalars none.
+         */
+        struct ply_property
         {
-            group->add_child( data->root_group );
+            std::string name;
+            ply_type type;
+            ply_type count_type;
+        };
+
+        struct ply_element
+        {
+            std::string name;
+            std::size_t count;
+            std::vector<ply_property> properties;
+
+            /**
+             * The index of the first property with one of the given names, or the number of
+             * properties when there is none
+             */
+            std::size_t find( std::initializer_list<const char*> names ) const noexcept
+            {
+                for ( const auto name : names )
+                {
+                    for ( std::size_t i = 0; i < properties.size(); i++ )
+                    {
+                        if ( properties[i].name == name )
+                        {
+                            return i;
+                        }
+                    }
+                }
+                return properties.size();
+            }
+
+            /**
+             * The size of each binary record, or 0 when records hold lists and vary in size
+             */
+            std::size_t record_size() const noexcept
+            {
+                std::size_t size = 0;
+                for ( const auto& p : properties )
+                {
+                    if ( p.count_type != ply_type::none )
+                    {
+                        return 0;
+                    }
+                    size += ply_type_size( p.type );
+                }
+                return size;
+            }
+        };
+
+        struct ply_header
+        {
+            ply_format format{ ply_format::ascii };
+            std::vector<ply_element> elements;
+            const char* body{ nullptr };
+            unsigned int lines{ 0 };
+        };
+
+        /**
+         * Reads the header up to and including its end_header line. Returns the error
+         * message, with header.lines at the failing line.
+         */
+        const char* parse_ply_header( const char* begin, const char* end, ply_header& header )
+        {
+            std::vector<token> tokens;
+            bool has_format = false;
+            for ( auto line = begin; line < end; )
+            {
+                auto line_end = static_cast<const char*>( std::memchr( line, '\n', static_cast<std::size_t>( end - line ) ) );
+                line_end = line_end ? line_end : end;
+                split( line, line_end, tokens );
+                line = line_end + 1;
+                header.lines++;
+
+                if ( header.lines == 1 )
+                {
+                    if ( tokens.size() != 1 || !tokens[0].is( "ply" ) )
+                    {
+                        return "Not a PLY file";
+                    }
+                }
+                else if ( tokens.empty() || tokens[0].is( "comment" ) || tokens[0].is( "obj_info" ) )
+                {
+                    continue;
+                }
+                else if ( tokens.size() == 3 && tokens[0].is( "format" ) )
+                {
+                    if ( tokens[1].is( "ascii" ) )
+                    {
+                        header.format = ply_format::ascii;
+                    }
+                    else if ( tokens[1].is( "binary_little_endian" ) )
+                    {
+                        header.format = ply_format::binary_little_endian;
+                    }
+                    else if ( tokens[1].is( "binary_big_endian" ) )
+                    {
+                        header.format = ply_format::binary_big_endian;
+                    }
+                    else
+                    {
+                        return "Unsupported PLY format";
+                    }
+                    has_format = true;
+                }
+                else if ( tokens.size() == 3 && tokens[0].is( "element" ) )
+                {
+                    long count;
+                    if ( !parse_index( tokens[2], count ) || count < 0 )
+                    {
+                        return invalid_argument_message;
+                    }
+                    header.elements.push_back( ply_element{ tokens[1].str(), static_cast<std::size_t>( count ), {} } );
+                }
+                else if ( tokens.size() == 3 && tokens[0].is( "property" ) && !header.elements.empty() )
+                {
+                    auto type = parse_ply_type( tokens[1] );
+                    if ( type == ply_type::none )
+                    {
+                        return invalid_argument_message;
+                    }
+                    header.elements.back().properties.push_back( ply_property{ tokens[2].str(), type, ply_type::none } );
+                }
+                else if ( tokens.size() == 5 && tokens[0].is( "property" ) && tokens[1].is( "list" ) && !header.elements.empty() )
+                {
+                    auto count_type = parse_ply_type( tokens[2] );
+                    auto type = parse_ply_type( tokens[3] );
+                    if ( count_type == ply_type::none || count_type == ply_type::float32 || count_type == ply_type::float64 ||
+                        type == ply_type::none )
+                    {
+                        return invalid_argument_message;
+                    }
+                    header.elements.back().properties.push_back( ply_property{ tokens[4].str(), type, count_type } );
+                }
+                else if ( tokens.size() == 1 && tokens[0].is( "end_header" ) )
+                {
+                    header.body = std::min( line, end );
+                    return has_format ? nullptr : "Unsupported PLY format";
+                }
+                else
+                {
+                    return invalid_argument_message;
+                }
+            }
+            return unexpected_end_message;
         }
-        for ( auto it = data->groups.cbegin(); it != data->groups.cend(); it++ )
+
+        /**
+         * Where the attributes the mesh keeps are among the vertex element's properties
+         */
+        struct ply_vertex_layout
         {
-            group->add_child( it->second );
+            std::size_t position[3];
+            std::size_t normal[3];
+            std::size_t uv[2];
+            bool normals;
+            bool uvs;
+
+            explicit ply_vertex_layout( const ply_element& vertex ) :
+                position{ vertex.find( { "x" } ), vertex.find( { "y" } ), vertex.find( { "z" } ) },
+                normal{ vertex.find( { "nx" } ), vertex.find( { "ny" } ), vertex.find( { "nz" } ) },
+                uv{ vertex.find( { "u", "s", "texture_u", "texture_s" } ), vertex.find( { "v", "t", "texture_v", "texture_t" } ) }
+            {
+                normals = scalar( vertex, normal, 3 );
+                uvs = scalar( vertex, uv, 2 );
+            }
+
+            static bool scalar( const ply_element& vertex, const std::size_t* indices, std::size_t count ) noexcept
+            {
+                for ( std::size_t i = 0; i < count; i++ )
+                {
+                    if ( indices[i] == vertex.properties.size() || vertex.properties[indices[i]].count_type != ply_type::none )
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /**
+             * Stores vertex i of the mesh from the values of its record
+             */
+            void store( mesh& m, std::size_t i, const double* values ) const
+            {
+                m.positions[i] = f_point( values[position[0]], values[position[1]], values[position[2]] );
+                if ( normals )
+                {
+                    m.normals[i] = f_vector( values[normal[0]], values[normal[1]], values[normal[2]] );
+                }
+                if ( uvs )
+                {
+                    m.uvs[i] = texture_uv{ static_cast<fpnum>( values[uv[0]] ), static_cast<fpnum>( values[uv[1]] ) };
+                }
+            }
+        };
+
+        template<typename T>
+        T load_raw( const uint8_t* p, bool swap ) noexcept
+        {
+            uint8_t bytes[sizeof( T )];
+            std::memcpy( bytes, p, sizeof( T ) );
+            if ( swap )
+            {
+                std::reverse( bytes, bytes + sizeof( T ) );
+            }
+            T value;
+            std::memcpy( &value, bytes, sizeof( T ) );
+            return value;
         }
-        return group;
-    }
 
-    model_parse_result model_parser::obj( std::ifstream& f )
-    {
-        unsigned int line_num = 1;
-        model_parse_result result;
-        result.data.reset( new model_parse_data );
-        group_ptr current_group = result.data->root_group;
+        double load_scalar( const uint8_t* p, ply_type type, bool swap ) noexcept
+        {
+            switch ( type )
+            {
+            case ply_type::int8:
+                return load_raw<int8_t>( p, swap );
+            case ply_type::uint8:
+                return load_raw<uint8_t>( p, swap );
+            case ply_type::int16:
+                return load_raw<int16_t>( p, swap );
+            case ply_type::uint16:
+                return load_raw<uint16_t>( p, swap );
+            case ply_type::int32:
+                return load_raw<int32_t>( p, swap );
+            case ply_type::uint32:
+                return load_raw<uint32_t>( p, swap );
+            case ply_type::float32:
+                return load_raw<float>( p, swap );
+            case ply_type::float64:
+                return load_raw<double>( p, swap );
+            default:
+                return 0;
+            }
+        }
+
+        bool host_is_little_endian() noexcept
+        {
+            const uint16_t probe = 1;
+            uint8_t first;
+            std::memcpy( &first, &probe, 1 );
+            return first == 1;
+        }
 
-        std::string line;
-        while ( std::getline( f, line ) )
+        /**
+         * Reads the scalars and lists of PLY records from either body format, one record at
+         * a time. Scalars are stored in values by property index, the items of the list at
+         * list_index in items, and other lists are skipped.
+         */
+        class ply_reader
         {
-            std::istringstream iss( line );
-            std::vector<std::string> comps( ( std::istream_iterator<std::string>{iss} ),
-                                              std::istream_iterator<std::string>() );
+        public:
 
-            if ( comps.size() == 2 && ( comps[0] == "g" || comps[0] == "G" ) )
+            ply_reader( const ply_header& header, const char* end ) :
+                _format( header.format ), _p( header.body ), _end( end ), _line( header.lines ),
+                _swap( header.format == ply_format::binary_little_endian ? !host_is_little_endian() : host_is_little_endian() )
             {
-                result.data->groups[comps[1]] = group::create( comps[1] );
-                current_group = result.data->groups[comps[1]];
             }
-            else if ( comps.size() == 4 && ( comps[0] == "v" || comps[0] == "V" ) )
+
+            const char* read( const ply_element& e, double* values, std::size_t list_index, std::vector<double>& items )
+            {
+                return _format == ply_format::ascii ? read_text( e, values, list_index, items ) : read_binary( e, values, list_index, items );
+            }
+
+            /**
+             * Decodes the element's fixed size binary records in parallel jobs, handing
+             * each record's values to store. Returns false when the body is too short.
+             */
+            template<typename Store>
+            bool read_records( const ply_element& e, std::size_t size, thread_pool& pool, const Store& store )
             {
-                try
+                auto count = e.count;
+                if ( count > remaining() / size )
                 {
-                    fpnum x = std::stof( comps[1] );
-                    fpnum y = std::stof( comps[2] );
-                    fpnum z = std::stof( comps[3] );
-                    result.data->vertices.push_back( f_point( x, y, z ) );
+                    return false;
                 }
-                catch ( const std::invalid_argument& ex )
+                auto records = reinterpret_cast<const uint8_t*>( _p );
+                std::vector<std::size_t> offsets;
+                for ( std::size_t i = 0, offset = 0; i < e.properties.size(); offset += ply_type_size( e.properties[i++].type ) )
                 {
-                    result.data.reset( nullptr );
-                    result.error.reset( new model_parse_error );
-                    result.error->line_number = line_num;
-                    result.error->message = "Invalid argument encountered";
-                    return result;
+                    offsets.push_back( offset );
                 }
+                auto swap = _swap;
+                pool.run( ( count + vertices_per_job - 1 ) / vertices_per_job, [&] ( std::size_t job ) {
+                    std::vector<double> values( e.properties.size() );
+                    auto last = std::min( count, ( job + 1 ) * vertices_per_job );
+                    for ( auto i = job * vertices_per_job; i < last; i++ )
+                    {
+                        auto record = records + i * size;
+                        for ( std::size_t k = 0; k < values.size(); k++ )
+                        {
+                            values[k] = load_scalar( record + offsets[k], e.properties[k].type, swap );
+                        }
+                        store( i, values.data() );
+                    }
+                } );
+                _p += count * size;
+                return true;
             }
-            else if ( comps.size() == 4 && ( comps[0] == "f" || comps[0] == "F" ) )
+
+            bool skip_records( const ply_element& e, std::size_t size ) noexcept
             {
-                try
+                if ( e.count > remaining() / size )
                 {
-                    auto p1_idx = std::stoi( comps[1] );
-                    auto p2_idx = std::stoi( comps[2] );
-                    auto p3_idx = std::stoi( comps[3] );
-                    auto t = triangle::create( result.data->vertices[p1_idx - 1], result.data->vertices[p2_idx - 1], result.data->vertices[p3_idx - 1] );
-                    current_group->add_child( t );
+                    return false;
                 }
-                catch ( const std::invalid_argument& ex )
+                _p += e.count * size;
+                return true;
+            }
+
+            bool binary() const noexcept
+            {
+                return _format != ply_format::ascii;
+            }
+
+            /**
+             * The line of the last text record read, or 0 for binary bodies
+             */
+            unsigned int line() const noexcept
+            {
+                return binary() ? 0 : _line;
+            }
+
+        private:
+
+            ply_format _format;
+            const char* _p;
+            const char* _end;
+            unsigned int _line;
+            bool _swap;
+            std::vector<token> _tokens;
+
+        private:
+
+            std::size_t remaining() const noexcept
+            {
+                return static_cast<std::size_t>( _end - _p );
+            }
+
+            const char* read_binary( const ply_element& e, double* values, std::size_t list_index, std::vector<double>& items )
+            {
+                auto p = reinterpret_cast<const uint8_t*>( _p );
+                auto end = reinterpret_cast<const uint8_t*>( _end );
+                items.clear();
+                for ( std::size_t k = 0; k < e.properties.size(); k++ )
                 {
-                    result.data.reset( nullptr );
-                    result.error.reset( new model_parse_error );
-                    result.error->line_number = line_num;
-                    result.error->message = "Invalid argument encountered";
-                    return result;
+                    const auto& property = e.properties[k];
+                    auto size = ply_type_size( property.type );
+                    std::size_t count = 1;
+                    if ( property.count_type != ply_type::none )
+                    {
+                        auto count_size = ply_type_size( property.count_type );
+                        if ( static_cast<std::size_t>( end - p ) < count_size )
+                        {
+                            return unexpected_end_message;
+                        }
+                        auto items_count = load_scalar( p, property.count_type, _swap );
+                        if ( items_count < 0 )
+                        {
+                            return invalid_argument_message;
+                        }
+                        count = static_cast<std::size_t>( items_count );
+                        p += count_size;
+                    }
+                    if ( count > static_cast<std::size_t>( end - p ) / size )
+                    {
+                        return unexpected_end_message;
+                    }
+                    if ( property.count_type == ply_type::none )
+                    {
+                        values[k] = load_scalar( p, property.type, _swap );
+                    }
+                    else if ( k == list_index )
+                    {
+                        for ( std::size_t i = 0; i < count; i++ )
+                        {
+                            items.push_back( load_scalar( p + i * size, property.type, _swap ) );
+                        }
+                    }
+                    p += count * size;
+                }
+                _p = reinterpret_cast<const char*>( p );
+                return nullptr;
+            }
+
+            bool parse_value( const token& t, ply_type type, double& value )
+            {
+                if ( type == ply_type::float64 )
+                {
+                    return parse_double( t, value );
+                }
+                if ( type == ply_type::float32 )
+                {
+                    float f;
+                    if ( !parse_float( t, f ) )
+                    {
+                        return false;
+                    }
+                    value = f;
+                    return true;
                 }
+                return parse_ply_integer( t, type, value );
             }
-            else if ( comps.size() > 4 && ( comps[0] == "f" || comps[0] == "F" ) )
+
+            const char* read_text( const ply_element& e, double* values, std::size_t list_index, std::vector<double>& items )
             {
-                std::vector<f_point> vertices;
-                for ( auto i = 1; i < comps.size(); i++ )
+                // Blank lines between records are skipped
+                do
                 {
-                    auto idx = std::stoi( comps[i] );
-                    vertices.push_back( result.data->vertices[idx - 1] );
+                    if ( _p >= _end )
+                    {
+                        _line++;
+                        return unexpected_end_message;
+                    }
+                    auto line_end = static_cast<const char*>( std::memchr( _p, '\n', static_cast<std::size_t>( _end - _p ) ) );
+                    line_end = line_end ? line_end : _end;
+                    split( _p, line_end, _tokens );
+                    _p = std::min( line_end + 1, _end );
+                    _line++;
                 }
+                while ( _tokens.empty() );
 
-                try
+                items.clear();
+                std::size_t t = 0;
+                for ( std::size_t k = 0; k < e.properties.size(); k++ )
                 {
-                    for ( auto i = 1; i < vertices.size() - 1; i++ )
+                    const auto& property = e.properties[k];
+                    double value;
+                    if ( t == _tokens.size() || !parse_value( _tokens[t++], property.count_type != ply_type::none ? property.count_type : property.type, value ) )
+                    {
+                        return invalid_argument_message;
+                    }
+                    if ( property.count_type == ply_type::none )
+                    {
+                        values[k] = value;
+                        continue;
+                    }
+                    if ( value < 0 || static_cast<std::size_t>( value ) > _tokens.size() - t )
                     {
-                        auto t = triangle::create( vertices[0], vertices[i], vertices[i + 1] );
-                        current_group->add_child( t );
+                        return invalid_argument_message;
+                    }
+                    for ( auto count = static_cast<std::size_t>( value ); count > 0; count-- )
+                    {
+                        if ( !parse_value( _tokens[t++], property.type, value ) )
+                        {
+                            return invalid_argument_message;
+                        }
+                        if ( k == list_index )
+                        {
+                            items.push_back( value );
+                        }
                     }
                 }
-                catch ( const std::invalid_argument& ex )
+                return t == _tokens.size() ? nullptr : invalid_argument_message;
+            }
+        };
+
+        /**
+         * Reads the vertex and face elements of a PLY file into a mesh, skipping any other
+         * elements. Vertex normals and texture coordinates are indexed like the positions.
+         */
+        model_parse_result parse_ply( const char* begin, const char* end, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+        {
+            arena_scope scope( a );
+            model_parse_result result;
+            ply_header header;
+            if ( auto error = parse_ply_header( begin, end, header ) )
+            {
+                fail( result, header.lines, error );
+                return result;
+            }
+
+            auto vertex = std::find_if( header.elements.cbegin(), header.elements.cend(), [] ( const ply_element& e ) {
+                return e.name == "vertex";
+            } );
+            if ( vertex == header.elements.cend() )
+            {
+                fail( result, header.lines, "PLY files need a vertex element" );
+                return result;
+            }
+            ply_vertex_layout layout( *vertex );
+            if ( !ply_vertex_layout::scalar( *vertex, layout.position, 3 ) )
+            {
+                fail( result, header.lines, "PLY vertices need x, y and z" );
+                return result;
+            }
+
+            auto m = mesh::create();
+            m->positions.resize( vertex->count );
+            m->normals.resize( layout.normals ? vertex->count : 0 );
+            m->uvs.resize( layout.uvs ? vertex->count : 0 );
+
+            ply_reader reader( header, end );
+            thread_pool pool( vertex->count > vertices_per_job ? threads : 1 );
+            std::vector<double> values;
+            std::vector<double> items;
+            for ( const auto& e : header.elements )
+            {
+                auto is_vertex = &e == &*vertex;
+                auto is_face = e.name == "face";
+                auto list_index = is_face ? e.find( { "vertex_indices", "vertex_index" } ) : e.properties.size();
+                if ( is_face && ( list_index == e.properties.size() || e.properties[list_index].count_type == ply_type::none ) )
                 {
-                    result.data.reset( nullptr );
-                    result.error.reset( new model_parse_error );
-                    result.error->line_number = line_num;
-                    result.error->message = "Invalid argument encountered";
+                    fail( result, header.lines, "PLY faces need a vertex_indices list" );
                     return result;
                 }
+
+                // Fixed size binary records are bounds checked once and read in bulk
+                auto size = e.record_size();
+                if ( reader.binary() && size != 0 )
+                {
+                    auto complete = is_vertex ?
+                        reader.read_records( e, size, pool, [&] ( std::size_t i, const double* v ) { layout.store( *m, i, v ); } ) :
+                        reader.skip_records( e, size );
+                    if ( !complete )
+                    {
+                        fail( result, 0, unexpected_end_message );
+                        return result;
+                    }
+                    continue;
+                }
+
+                values.resize( e.properties.size() );
+                for ( std::size_t i = 0; i < e.count; i++ )
+                {
+                    if ( auto error = reader.read( e, values.data(), list_index, items ) )
+                    {
+                        fail( result, reader.line(), error );
+                        return result;
+                    }
+                    if ( is_vertex )
+                    {
+                        layout.store( *m, i, values.data() );
+                    }
+                    else if ( is_face )
+                    {
+                        for ( const auto index : items )
+                        {
+                            // Indices stored in float properties must still be whole numbers
+                            if ( index != std::floor( index ) )
+                            {
+                                fail( result, reader.line(), invalid_argument_message );
+                                return result;
+                            }
+                            if ( !( index >= 0 && index < vertex->count ) )
+                            {
+                                fail( result, reader.line(), out_of_range_messages[0] );
+                                return result;
+                            }
+                        }
+                        auto corner = [&] ( double index ) {
+                            auto i = static_cast<uint32_t>( index );
+                            return mesh::corner{ i, layout.uvs ? i : mesh::missing, layout.normals ? i : mesh::missing };
+                        };
+                        for ( std::size_t k = 1; k + 1 < items.size(); k++ )
+                        {
+                            m->corners.push_back( corner( items[0] ) );
+                            m->corners.push_back( corner( items[k] ) );
+                            m->corners.push_back( corner( items[k + 1] ) );
+                        }
+                    }
+                }
             }
-            else
+
+            m->parts.push_back( mesh::part{ "", 0, m->triangle_count() } );
+            apply_import_options( *m, options );
+            return create_groups( m, a, threads );
+        }
+
+        /**
+         * Parses an OBJ model. With import steps to apply, the mesh is read without shapes
+         * first and its shapes are created once the steps have changed it.
+         */
+        model_parse_result parse_obj( const char* begin, const char* end, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+        {
+            if ( !options.weld && !options.quantize )
+            {
+                return parse_obj( begin, end, a, threads, true );
+            }
+            auto parsed = parse_obj( begin, end, a, threads, false );
+            if ( parsed.status != model_parse_status::SUCCESS )
             {
-                result.data->lines_ignored += 1;
+                return parsed;
             }
+            arena_scope scope( a );
+            auto m = parsed.data->mesh;
+            apply_import_options( *m, options );
+            auto result = create_groups( m, a, threads );
+            result.data->lines_ignored = parsed.data->lines_ignored;
+            return result;
+        }
+    }
+
+    model_parse_data::model_parse_data( const arena_ptr& a, const mesh_ptr& m ) :
+        mesh( m ? m : ls::mesh::create() ), vertices( mesh->positions ), arena( a )
+    {
+        lines_ignored = 0;
+        root_group = group::create();
+    }
+
+    group_ptr model_parse_result::to_shape_group() const
+    {
+        auto group = group::create( "Root" );
+        if ( !data->root_group->children().empty() )
+        {
+            group->add_child( data->root_group );
+        }
+        for ( auto it = data->groups.cbegin(); it != data->groups.cend(); it++ )
+        {
+            group->add_child( it->second );
+        }
+        return group;
+    }
+
+    model_parse_result model_parser::obj( std::ifstream& f )
+    {
+        // Every triangle brings its own material and pattern, so a model is parsed into an
+        // arena of its own rather than scattering them across the heap
+        return obj( f, std::make_shared<ls::arena>() );
+    }
+
+    model_parse_result model_parser::obj( std::ifstream& f, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+    {
+        std::string text( ( std::istreambuf_iterator<char>( f ) ), std::istreambuf_iterator<char>() );
+        return parse_obj( text.data(), text.data() + text.size(), a, threads, options );
+    }
+
+    model_parse_result model_parser::obj( const std::string& file )
+    {
+        return obj( file, std::make_shared<ls::arena>() );
+    }
+
+    model_parse_result model_parser::obj( const std::string& file, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+    {
+        mapped_file mapping;
+        try
+        {
+            mapping = mapped_file( file );
+        }
+        catch ( const std::system_error& e )
+        {
+            model_parse_result result;
+            fail( result, 0, e.what() );
+            return result;
+        }
+        mapping.advise_sequential();
+        auto text = reinterpret_cast<const char*>( mapping.data() );
+        return parse_obj( text, text + mapping.size(), a, threads, options );
+    }
+
+    model_parse_result model_parser::mesh_cache( const std::string& file )
+    {
+        return mesh_cache( file, std::make_shared<ls::arena>() );
+    }
+
+    model_parse_result model_parser::mesh_cache( const std::string& file, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+    {
+        arena_scope scope( a );
+        mesh_ptr m;
+        try
+        {
+            m = mesh::load( file );
+        }
+        catch ( const std::exception& e )
+        {
+            model_parse_result result;
+            fail( result, 0, e.what() );
+            return result;
+        }
+        apply_import_options( *m, options );
+        return create_groups( m, a, threads );
+    }
 
-            ++line_num;
+    model_parse_result model_parser::obj_to_mesh_cache( const std::string& obj_file, const std::string& cache_file, uint16_t threads )
+    {
+        mapped_file mapping;
+        try
+        {
+            mapping = mapped_file( obj_file );
+        }
+        catch ( const std::system_error& e )
+        {
+            model_parse_result result;
+            fail( result, 0, e.what() );
+            return result;
+        }
+        mapping.advise_sequential();
+        auto text = reinterpret_cast<const char*>( mapping.data() );
+        auto result = parse_obj( text, text + mapping.size(), nullptr, threads, false );
+        if ( result.status == model_parse_status::SUCCESS )
+        {
+            try
+            {
+                result.data->mesh->write_to( cache_file );
+            }
+            catch ( const std::system_error& e )
+            {
+                fail( result, 0, e.what() );
+            }
         }
         return result;
     }
+
+    model_parse_result model_parser::ply( const std::string& file )
+    {
+        return ply( file, std::make_shared<ls::arena>() );
+    }
+
+    model_parse_result model_parser::ply( const std::string& file, const arena_ptr& a, uint16_t threads, const mesh_import_options& options )
+    {
+        mapped_file mapping;
+        try
+        {
+            mapping = mapped_file( file );
+        }
+        catch ( const std::system_error& e )
+        {
+            model_parse_result result;
+            fail( result, 0, e.what() );
+            return result;
+        }
+        mapping.advise_sequential();
+        auto text = reinterpret_cast<const char*>( mapping.data() );
+        return parse_ply( text, text + mapping.size(), a, threads, options );
+    }
 }
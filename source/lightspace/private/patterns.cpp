@@ -1,11 +1,11 @@
 #include "patterns.hpp"
-#include "shapes.cpp"
+#include "shapes.hpp"
 
 namespace ls {
     f_color pattern::color_at( const shape_ptr obj, const f_point& point ) const
     {
         auto obj_point = obj->world_to_object( point );
-        auto patt_point = transform_.inverse() * obj_point;
+        auto patt_point = inverse_transform_ * obj_point;
         return color_at( patt_point );
     }
 
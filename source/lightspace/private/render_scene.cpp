@@ -0,0 +1,487 @@
+#include "render_scene.hpp"
+#include <algorithm>
+
+namespace ls {
+    namespace {
+        static constexpr std::size_t max_leaf_primitives = 4;
+        static constexpr uint8_t max_traversal_depth = 64;
+
+        bool finite_bounds( const aabb_bounds& b ) noexcept
+        {
+            return std::isfinite( b.min.x ) && std::isfinite( b.min.y ) && std::isfinite( b.min.z ) &&
+                std::isfinite( b.max.x ) && std::isfinite( b.max.y ) && std::isfinite( b.max.z );
+        }
+
+        /**
+         * Padding keeps flat primitives and hits on a box face from being lost to rounding
+         */
+        void pad_bounds( aabb_bounds& b ) noexcept
+        {
+            for ( uint8_t axis = 0; axis < 3; axis++ )
+            {
+                b.min( axis ) -= epsilon * ( 1 + std::abs( b.min( axis ) ) );
+                b.max( axis ) += epsilon * ( 1 + std::abs( b.max( axis ) ) );
+            }
+        }
+
+        /**
+         * Clips [t_min, t_max] against the node's slabs. NaNs from rays lying in a slab's plane
+         * fail every comparison and leave the interval untouched.
+         */
+        bool intersects_box( const fpnum* min, const fpnum* max, const fpnum* origin, const fpnum* inv_direction, fpnum t_min, fpnum t_max ) noexcept
+        {
+            for ( uint8_t axis = 0; axis < 3; axis++ )
+            {
+                auto t0 = ( min[axis] - origin[axis] ) * inv_direction[axis];
+                auto t1 = ( max[axis] - origin[axis] ) * inv_direction[axis];
+                if ( inv_direction[axis] < 0 )
+                {
+                    std::swap( t0, t1 );
+                }
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if ( t_max < t_min )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    render_scene_ptr render_scene::compile( const std::vector<shape_ptr>& objects )
+    {
+        auto scene = render_scene_ptr( new render_scene() );
+        material_lookup lookup;
+        std::vector<build_entry> entries;
+        for ( const auto& object : objects )
+        {
+            scene->add_shape( unowned( object ), f4_matrix::identity(), f4_matrix::identity(), lookup, entries );
+        }
+        if ( !entries.empty() )
+        {
+            scene->_nodes.reserve( 2 * entries.size() / max_leaf_primitives + 1 );
+            scene->_leaf_primitives.reserve( entries.size() );
+            scene->build_node( entries, 0, entries.size() );
+        }
+        return scene;
+    }
+
+    void render_scene::add_shape( const shape_ptr& s, const f4_matrix& object_to_world, const f4_matrix& world_to_object,
+        material_lookup& lookup, std::vector<build_entry>& entries )
+    {
+        // Transforms are accumulated down the hierarchy the same way shape::world_to_object
+        // walks back up it, so each leaf applies a single matrix
+        auto to_world = object_to_world * s->transform();
+        auto to_object = s->inverse_transform() * world_to_object;
+
+        if ( auto grp = dynamic_cast<const group*>( s.get() ) )
+        {
+            for ( const auto& child : grp->children() )
+            {
+                add_shape( unowned( child ), to_world, to_object, lookup, entries );
+            }
+            return;
+        }
+
+        primitive_t type;
+        uint32_t slot;
+        aabb_bounds local_bounds;
+        auto mt = dynamic_cast<const mesh_triangle*>( s.get() );
+        if ( auto sph = dynamic_cast<const sphere*>( s.get() ) )
+        {
+            type = primitive_t::sphere;
+            slot = static_cast<uint32_t>( _spheres.origin.size() );
+            _spheres.world_to_object.push_back( to_object );
+            _spheres.origin.push_back( sph->origin() );
+            local_bounds = aabb_bounds( sph->origin() + f_vector( -1, -1, -1 ), sph->origin() + f_vector( 1, 1, 1 ) );
+        }
+        else if ( dynamic_cast<const plane*>( s.get() ) )
+        {
+            type = primitive_t::plane;
+            slot = static_cast<uint32_t>( _planes.world_to_object.size() );
+            _planes.world_to_object.push_back( to_object );
+            local_bounds = s->bounds();
+        }
+        else if ( dynamic_cast<const cube*>( s.get() ) )
+        {
+            type = primitive_t::cube;
+            slot = static_cast<uint32_t>( _cubes.world_to_object.size() );
+            _cubes.world_to_object.push_back( to_object );
+            local_bounds = s->bounds();
+        }
+        else if ( auto cyl = dynamic_cast<const cylinder*>( s.get() ) )
+        {
+            type = primitive_t::cylinder;
+            slot = static_cast<uint32_t>( _cylinders.world_to_object.size() );
+            _cylinders.world_to_object.push_back( to_object );
+            _cylinders.min_extent.push_back( cyl->min_extent() );
+            _cylinders.max_extent.push_back( cyl->max_extent() );
+            _cylinders.closed.push_back( cyl->closed() );
+            local_bounds = s->bounds();
+        }
+        else if ( auto cn = dynamic_cast<const cone*>( s.get() ) )
+        {
+            type = primitive_t::cone;
+            slot = static_cast<uint32_t>( _cones.world_to_object.size() );
+            _cones.world_to_object.push_back( to_object );
+            _cones.min_extent.push_back( cn->min_extent() );
+            _cones.max_extent.push_back( cn->max_extent() );
+            _cones.closed.push_back( cn->closed() );
+            local_bounds = s->bounds();
+        }
+        else if ( mt && mt->source_mesh()->quantized() )
+        {
+            auto& array = _mesh_triangles;
+            type = primitive_t::mesh_triangle;
+            slot = static_cast<uint32_t>( array.index.size() );
+            if ( array.world_to_object.empty() || !( array.world_to_object.back() == to_object ) )
+            {
+                array.world_to_object.push_back( to_object );
+            }
+            array.source.push_back( mt->source_mesh().get() );
+            array.index.push_back( mt->index() );
+            array.transform.push_back( static_cast<uint32_t>( array.world_to_object.size() - 1 ) );
+            local_bounds = s->bounds();
+        }
+        else if ( mt || dynamic_cast<const triangle*>( s.get() ) )
+        {
+            // Triangles of meshes that are not quantized are baked like any other
+            auto tr = dynamic_cast<const triangle*>( s.get() );
+            type = primitive_t::triangle;
+            slot = static_cast<uint32_t>( _triangles.p1.size() );
+            auto p1 = to_world * ( mt ? mt->p1() : tr->p1() );
+            auto p2 = to_world * ( mt ? mt->p2() : tr->p2() );
+            auto p3 = to_world * ( mt ? mt->p3() : tr->p3() );
+            _triangles.p1.push_back( p1 );
+            _triangles.e1.push_back( p2 - p1 );
+            _triangles.e2.push_back( p3 - p1 );
+            local_bounds = aabb_bounds(
+                f_point( std::min( { p1.x, p2.x, p3.x } ), std::min( { p1.y, p2.y, p3.y } ), std::min( { p1.z, p2.z, p3.z } ) ),
+                f_point( std::max( { p1.x, p2.x, p3.x } ), std::max( { p1.y, p2.y, p3.y } ), std::max( { p1.z, p2.z, p3.z } ) ) );
+            to_world = f4_matrix::identity();
+        }
+        else if ( auto px = dynamic_cast<const geometry_proxy*>( s.get() ) )
+        {
+            type = primitive_t::proxy;
+            slot = static_cast<uint32_t>( _proxies.source.size() );
+            _proxies.world_to_object.push_back( to_object );
+            _proxies.source.push_back( px );
+            local_bounds = s->bounds();
+            auto padded = local_bounds;
+            pad_bounds( padded );
+            _proxies.bounds.push_back( padded );
+        }
+        else
+        {
+            // Plain shapes have no surface to hit
+            return;
+        }
+
+        auto primitive = static_cast<uint32_t>( _types.size() );
+        _types.push_back( type );
+        _slots.push_back( slot );
+        _objects.push_back( s );
+
+        auto inserted = lookup.emplace( s->material().get(), static_cast<uint32_t>( _materials.size() ) );
+        if ( inserted.second )
+        {
+            _materials.push_back( s->material() );
+        }
+        _material_indices.push_back( inserted.first->second );
+
+        auto world_bounds = to_world * local_bounds;
+        if ( !finite_bounds( world_bounds ) )
+        {
+            _unbounded.push_back( primitive );
+            return;
+        }
+
+        pad_bounds( world_bounds );
+        auto centroid = world_bounds.min + ( world_bounds.max - world_bounds.min ) * 0.5f;
+        entries.push_back( build_entry{ primitive, world_bounds, centroid } );
+    }
+
+    uint32_t render_scene::build_node( std::vector<build_entry>& entries, std::size_t begin, std::size_t end )
+    {
+        auto index = static_cast<uint32_t>( _nodes.size() );
+        _nodes.push_back( bvh_node() );
+
+        bvh_node node{ { infinity, infinity, infinity }, { -infinity, -infinity, -infinity }, 0, 0, 0 };
+        fpnum centroid_min[3] = { infinity, infinity, infinity };
+        fpnum centroid_max[3] = { -infinity, -infinity, -infinity };
+        for ( auto i = begin; i < end; i++ )
+        {
+            const auto& entry = entries[i];
+            for ( uint8_t axis = 0; axis < 3; axis++ )
+            {
+                node.min[axis] = std::min( node.min[axis], entry.bounds.min( axis ) );
+                node.max[axis] = std::max( node.max[axis], entry.bounds.max( axis ) );
+                centroid_min[axis] = std::min( centroid_min[axis], entry.centroid( axis ) );
+                centroid_max[axis] = std::max( centroid_max[axis], entry.centroid( axis ) );
+            }
+        }
+
+        uint8_t axis = 0;
+        for ( uint8_t a = 1; a < 3; a++ )
+        {
+            if ( centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis] )
+            {
+                axis = a;
+            }
+        }
+
+        auto count = end - begin;
+        if ( count <= max_leaf_primitives || centroid_max[axis] - centroid_min[axis] <= 0 )
+        {
+            node.offset = static_cast<uint32_t>( _leaf_primitives.size() );
+            node.count = static_cast<uint32_t>( count );
+            for ( auto i = begin; i < end; i++ )
+            {
+                _leaf_primitives.push_back( entries[i].primitive );
+            }
+            _nodes[index] = node;
+            return index;
+        }
+
+        // Median splits along the widest centroid axis keep the tree balanced, bounding its depth
+        auto mid = begin + count / 2;
+        std::nth_element( entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+            [axis] ( const build_entry& e1, const build_entry& e2 ) {
+                return e1.centroid( axis ) < e2.centroid( axis );
+            } );
+
+        node.axis = axis;
+        build_node( entries, begin, mid );
+        node.offset = build_node( entries, mid, end );
+        _nodes[index] = node;
+        return index;
+    }
+
+    uint8_t render_scene::intersect_primitive( uint32_t primitive, const ray& r, fpnum* ts ) const
+    {
+        auto slot = _slots[primitive];
+        switch ( _types[primitive] )
+        {
+        case primitive_t::sphere:
+            return local_intersect::sphere( _spheres.world_to_object[slot] * r, _spheres.origin[slot], ts );
+        case primitive_t::plane:
+            return local_intersect::plane( _planes.world_to_object[slot] * r, ts );
+        case primitive_t::cube:
+            return local_intersect::cube( _cubes.world_to_object[slot] * r, ts );
+        case primitive_t::cylinder:
+            return local_intersect::cylinder( _cylinders.world_to_object[slot] * r, _cylinders.min_extent[slot],
+                _cylinders.max_extent[slot], _cylinders.closed[slot] != 0, ts );
+        case primitive_t::cone:
+            return local_intersect::cone( _cones.world_to_object[slot] * r, _cones.min_extent[slot],
+                _cones.max_extent[slot], _cones.closed[slot] != 0, ts );
+        case primitive_t::triangle:
+            return local_intersect::triangle( r, _triangles.p1[slot], _triangles.e1[slot], _triangles.e2[slot], ts );
+        case primitive_t::mesh_triangle:
+        {
+            const auto& m = *_mesh_triangles.source[slot];
+            auto c = m.triangle_corners( _mesh_triangles.index[slot] );
+            auto p1 = m.position( c[0].position );
+            return local_intersect::triangle( _mesh_triangles.world_to_object[_mesh_triangles.transform[slot]] * r, p1,
+                m.position( c[1].position ) - p1, m.position( c[2].position ) - p1, ts );
+        }
+        case primitive_t::proxy:
+            // Proxies hit shapes of their own, so the traversals trace them separately
+            return 0;
+        }
+        return 0;
+    }
+
+    const proxy_geometry_ptr* render_scene::reached_proxy( uint32_t slot, const ray& local, fpnum t_min, fpnum t_max,
+        proxy_geometry_ptr& keep ) const
+    {
+        const auto& b = _proxies.bounds[slot];
+        const fpnum min[3] = { b.min.x, b.min.y, b.min.z };
+        const fpnum max[3] = { b.max.x, b.max.y, b.max.z };
+        const fpnum origin[3] = { local.origin().x, local.origin().y, local.origin().z };
+        const fpnum inv_direction[3] = { 1 / local.direction().x, 1 / local.direction().y, 1 / local.direction().z };
+        if ( !intersects_box( min, max, origin, inv_direction, t_min, t_max ) )
+        {
+            return nullptr;
+        }
+        return &_proxies.source[slot]->pinned_geometry( keep );
+    }
+
+    std::size_t render_scene::bytes_used() const noexcept
+    {
+        auto bytes = [] ( const auto& v ) {
+            return v.capacity() * sizeof( v[0] );
+        };
+        return sizeof( render_scene ) + bytes( _types ) + bytes( _slots ) + bytes( _material_indices ) + bytes( _objects ) +
+            bytes( _materials ) + bytes( _spheres.world_to_object ) + bytes( _spheres.origin ) + bytes( _planes.world_to_object ) +
+            bytes( _cubes.world_to_object ) + bytes( _cylinders.world_to_object ) + bytes( _cylinders.min_extent ) +
+            bytes( _cylinders.max_extent ) + bytes( _cylinders.closed ) + bytes( _cones.world_to_object ) + bytes( _cones.min_extent ) +
+            bytes( _cones.max_extent ) + bytes( _cones.closed ) + bytes( _triangles.p1 ) + bytes( _triangles.e1 ) + bytes( _triangles.e2 ) +
+            bytes( _mesh_triangles.source ) + bytes( _mesh_triangles.index ) + bytes( _mesh_triangles.transform ) +
+            bytes( _mesh_triangles.world_to_object ) + bytes( _proxies.world_to_object ) + bytes( _proxies.source ) +
+            bytes( _proxies.bounds ) + bytes( _nodes ) + bytes( _leaf_primitives ) + bytes( _unbounded );
+    }
+
+    template<typename Visitor>
+    void render_scene::traverse( const ray& r, fpnum t_min, const fpnum& t_max, Visitor&& visit ) const
+    {
+        for ( auto primitive : _unbounded )
+        {
+            if ( visit( primitive ) )
+            {
+                return;
+            }
+        }
+        if ( _nodes.empty() )
+        {
+            return;
+        }
+
+        const fpnum origin[3] = { r.origin().x, r.origin().y, r.origin().z };
+        const fpnum inv_direction[3] = { 1 / r.direction().x, 1 / r.direction().y, 1 / r.direction().z };
+
+        uint32_t stack[max_traversal_depth];
+        uint8_t size = 0;
+        stack[size++] = 0;
+        while ( size > 0 )
+        {
+            auto index = stack[--size];
+            const auto& node = _nodes[index];
+            if ( !intersects_box( node.min, node.max, origin, inv_direction, t_min, t_max ) )
+            {
+                continue;
+            }
+
+            if ( node.count > 0 )
+            {
+                for ( uint32_t i = node.offset; i < node.offset + node.count; i++ )
+                {
+                    if ( visit( _leaf_primitives[i] ) )
+                    {
+                        return;
+                    }
+                }
+                continue;
+            }
+
+            // The child nearer along the split axis is visited first so closest hits shrink t_max early
+            if ( inv_direction[node.axis] < 0 )
+            {
+                stack[size++] = index + 1;
+                stack[size++] = node.offset;
+            }
+            else
+            {
+                stack[size++] = node.offset;
+                stack[size++] = index + 1;
+            }
+        }
+    }
+
+    bool render_scene::closest_hit( const ray& r, hit_record& hit ) const
+    {
+        fpnum closest = infinity;
+        bool found = false;
+        shape_ptr proxied;
+        traverse( r, 0.f, closest, [&] ( uint32_t primitive ) {
+            if ( _types[primitive] == primitive_t::proxy )
+            {
+                auto slot = _slots[primitive];
+                auto local = _proxies.world_to_object[slot] * r;
+                hit_record inner;
+                proxy_geometry_ptr keep;
+                auto geometry = reached_proxy( slot, local, 0.f, closest, keep );
+                if ( geometry && ( *geometry )->scene->closest_hit( local, inner ) && inner.time < closest )
+                {
+                    closest = inner.time;
+                    hit.primitive = primitive;
+                    proxied = shape_ptr( *geometry, inner.object.get() );
+                    found = true;
+                }
+                return false;
+            }
+
+            fpnum ts[local_intersect::max_hits];
+            auto count = intersect_primitive( primitive, r, ts );
+            for ( uint8_t i = 0; i < count; i++ )
+            {
+                if ( ts[i] >= 0 && ts[i] < closest )
+                {
+                    closest = ts[i];
+                    hit.primitive = primitive;
+                    proxied.reset();
+                    found = true;
+                }
+            }
+            return false;
+        } );
+        hit.time = closest;
+        if ( found )
+        {
+            hit.object = proxied ? proxied : _objects[hit.primitive];
+        }
+        return found;
+    }
+
+    bool render_scene::occluded( const ray& r, fpnum max_time ) const
+    {
+        bool blocked = false;
+        traverse( r, 0.f, max_time, [&] ( uint32_t primitive ) {
+            if ( _types[primitive] == primitive_t::proxy )
+            {
+                auto slot = _slots[primitive];
+                auto local = _proxies.world_to_object[slot] * r;
+                proxy_geometry_ptr keep;
+                auto geometry = reached_proxy( slot, local, 0.f, max_time, keep );
+                blocked = geometry && ( *geometry )->scene->occluded( local, max_time );
+                return blocked;
+            }
+
+            fpnum ts[local_intersect::max_hits];
+            auto count = intersect_primitive( primitive, r, ts );
+            for ( uint8_t i = 0; i < count; i++ )
+            {
+                if ( ts[i] >= 0 && ts[i] < max_time )
+                {
+                    blocked = true;
+                }
+            }
+            return blocked;
+        } );
+        return blocked;
+    }
+
+    intersections render_scene::intersect( const ray& r ) const
+    {
+        intersections itrs;
+        const fpnum unbounded = infinity;
+        traverse( r, -infinity, unbounded, [&] ( uint32_t primitive ) {
+            if ( _types[primitive] == primitive_t::proxy )
+            {
+                auto slot = _slots[primitive];
+                auto local = _proxies.world_to_object[slot] * r;
+                proxy_geometry_ptr keep;
+                if ( auto geometry = reached_proxy( slot, local, -infinity, infinity, keep ) )
+                {
+                    for ( const auto& itr : ( *geometry )->scene->intersect( local ) )
+                    {
+                        itrs.push_back( intersection( itr.time(), shape_ptr( *geometry, itr.object().get() ) ) );
+                    }
+                }
+                return false;
+            }
+
+            fpnum ts[local_intersect::max_hits];
+            auto count = intersect_primitive( primitive, r, ts );
+            for ( uint8_t i = 0; i < count; i++ )
+            {
+                itrs.push_back( intersection( ts[i], _objects[primitive] ) );
+            }
+            return false;
+        } );
+        std::sort( itrs.begin(), itrs.end(), [] ( const intersection& i1, const intersection& i2 ) {
+            return i1.time() < i2.time();
+        } );
+        return itrs;
+    }
+}
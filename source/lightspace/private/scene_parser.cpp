@@ -0,0 +1,782 @@
+#include "scene_parser.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "materials.hpp"
+#include "patterns.hpp"
+#include "transform.hpp"
+#include "world.hpp"
+#include "camera.hpp"
+#include "model_parser.hpp"
+#include "geometry_proxy.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace ls {
+    namespace {
+        /**
+         * Thrown while reading a statement and turned into the parse error of its line
+         */
+        struct scene_syntax_error
+        {
+            std::string message;
+        };
+
+        /**
+         * Transforms are inverted as they are set, so one that cannot be is an error in the statement
+         */
+        const f4_matrix& invertible( const f4_matrix& m )
+        {
+            if ( !m.is_invertible() )
+            {
+                throw scene_syntax_error{ "Singular transform" };
+            }
+            return m;
+        }
+
+        /**
+         * The words of one statement, consumed front to back
+         */
+        class statement_reader
+        {
+        public:
+
+            explicit statement_reader( const std::string& line )
+            {
+                std::istringstream words( line.substr( 0, line.find( '#' ) ) );
+                _words.assign( std::istream_iterator<std::string>( words ), std::istream_iterator<std::string>() );
+            }
+
+            bool done() const noexcept
+            {
+                return _next == _words.size();
+            }
+
+            const std::string& peek() const
+            {
+                static const std::string none;
+                return done() ? none : _words[_next];
+            }
+
+            /**
+             * Consumes the next word if it is the given one
+             */
+            bool accept( const char* word )
+            {
+                if ( done() || _words[_next] != word )
+                {
+                    return false;
+                }
+                _next++;
+                return true;
+            }
+
+            void expect( const char* word )
+            {
+                if ( !accept( word ) )
+                {
+                    throw scene_syntax_error{ std::string( "Expected '" ) + word + "'" };
+                }
+            }
+
+            const std::string& word( const char* what )
+            {
+                if ( done() )
+                {
+                    throw scene_syntax_error{ std::string( "Expected " ) + what };
+                }
+                return _words[_next++];
+            }
+
+            /**
+             * Whether the next word is a number, without consuming it
+             */
+            bool at_number() const
+            {
+                fpnum value;
+                return !done() && to_number( _words[_next], value );
+            }
+
+            fpnum number( const char* what )
+            {
+                fpnum value;
+                if ( done() || !to_number( _words[_next], value ) )
+                {
+                    throw scene_syntax_error{ std::string( "Expected " ) + what };
+                }
+                _next++;
+                return value;
+            }
+
+            fpnum angle( const char* what )
+            {
+                if ( !done() )
+                {
+                    const auto& w = _words[_next];
+                    fpnum value;
+                    if ( w.size() > 3 && w.compare( w.size() - 3, 3, "deg" ) == 0 && to_number( w.substr( 0, w.size() - 3 ), value ) )
+                    {
+                        _next++;
+                        return value * pi / 180.f;
+                    }
+                }
+                return number( what );
+            }
+
+            uint16_t count( const char* what )
+            {
+                auto value = number( what );
+                if ( value < 0 || value > std::numeric_limits<uint16_t>::max() || value != std::floor( value ) )
+                {
+                    throw scene_syntax_error{ std::string( "Expected " ) + what };
+                }
+                return static_cast<uint16_t>( value );
+            }
+
+            f_point point( const char* what )
+            {
+                auto x = number( what );
+                auto y = number( what );
+                return f_point( x, y, number( what ) );
+            }
+
+            f_vector vector( const char* what )
+            {
+                auto x = number( what );
+                auto y = number( what );
+                return f_vector( x, y, number( what ) );
+            }
+
+            f_color color()
+            {
+                auto r = number( "a color" );
+                auto g = number( "a color" );
+                return f_color( r, g, number( "a color" ) );
+            }
+
+            /**
+             * Reads a transform if one comes next and applies it after m
+             */
+            bool read_transform( f4_matrix& m )
+            {
+                if ( accept( "translate" ) )
+                {
+                    auto v = vector( "a translation" );
+                    m = transform::translation( v.x, v.y, v.z ) * m;
+                }
+                else if ( accept( "scale" ) )
+                {
+                    auto v = vector( "a scale" );
+                    m = transform::scale( v.x, v.y, v.z ) * m;
+                }
+                else if ( accept( "rotate_x" ) )
+                {
+                    m = transform::rotation_x( angle( "an angle" ) ) * m;
+                }
+                else if ( accept( "rotate_y" ) )
+                {
+                    m = transform::rotation_y( angle( "an angle" ) ) * m;
+                }
+                else if ( accept( "rotate_z" ) )
+                {
+                    m = transform::rotation_z( angle( "an angle" ) ) * m;
+                }
+                else if ( accept( "shear" ) )
+                {
+                    fpnum s[6];
+                    for ( auto& v : s )
+                    {
+                        v = number( "six shear factors" );
+                    }
+                    m = transform::shear( s[0], s[1], s[2], s[3], s[4], s[5] ) * m;
+                }
+                else
+                {
+                    return false;
+                }
+                return true;
+            }
+
+            void expect_end()
+            {
+                if ( !done() )
+                {
+                    throw scene_syntax_error{ "Unexpected '" + _words[_next] + "'" };
+                }
+            }
+
+        private:
+
+            std::vector<std::string> _words;
+            std::size_t _next{ 0 };
+
+        private:
+
+            static bool to_number( const std::string& w, fpnum& value )
+            {
+                char* end = nullptr;
+                value = static_cast<fpnum>( std::strtod( w.c_str(), &end ) );
+                return !w.empty() && end == w.c_str() + w.size();
+            }
+        };
+
+        /**
+         * The values a material is made from, compared in full when deciding whether two
+         * materials can be shared
+         */
+        struct material_values
+        {
+            pattern_ptr surface_pattern;
+            fpnum ambient{ 0.1f };
+            fpnum diffuse{ 0.9f };
+            fpnum specular{ 0.9f };
+            fpnum shininess{ 200.f };
+            fpnum reflectivity{ 0.f };
+            fpnum transparency{ 0.f };
+            fpnum refractive_index{ 1.f };
+
+            bool operator<( const material_values& rhs ) const noexcept
+            {
+                return std::tie( surface_pattern, ambient, diffuse, specular, shininess, reflectivity, transparency, refractive_index ) <
+                    std::tie( rhs.surface_pattern, rhs.ambient, rhs.diffuse, rhs.specular, rhs.shininess, rhs.reflectivity, rhs.transparency,
+                        rhs.refractive_index );
+            }
+        };
+
+        enum class pattern_kind
+        {
+            solid, stripe, gradient, ring, checker, test
+        };
+
+        class scene_builder
+        {
+        public:
+
+            scene_builder( const std::string& directory ) :
+                _directory( directory ), _world( world::create() ), _scope( _world->arena() )
+            {
+                _frames.emplace_back();
+                _default_material.surface_pattern = shared_pattern( pattern_kind::solid, f_color( 1, 1, 1 ), f_color( 1, 1, 1 ), f4_matrix::identity() );
+            }
+
+            void statement( statement_reader& in, unsigned int line )
+            {
+                if ( in.done() )
+                {
+                    return;
+                }
+                const auto keyword = in.word( "a statement" );
+                if ( keyword == "camera" )
+                {
+                    read_camera( in );
+                }
+                else if ( keyword == "light" )
+                {
+                    read_light( in );
+                }
+                else if ( keyword == "pattern" )
+                {
+                    read_pattern( in );
+                }
+                else if ( keyword == "material" )
+                {
+                    const auto name = in.word( "a material name" );
+                    auto values = _default_material;
+                    read_shape_options( in, values, nullptr );
+                    _materials[name] = values;
+                }
+                else if ( keyword == "group" )
+                {
+                    auto grp = group::create( !in.done() && !is_transform( in.peek() ) ? in.word( "a name" ) : std::string( "Default" ) );
+                    f4_matrix m = f4_matrix::identity();
+                    while ( in.read_transform( m ) )
+                    { }
+                    in.expect_end();
+                    grp->set_transform( invertible( m ) );
+                    _frames.push_back( { grp, {}, line } );
+                }
+                else if ( keyword == "end" )
+                {
+                    in.expect_end();
+                    if ( _frames.size() == 1 )
+                    {
+                        throw scene_syntax_error{ "'end' without a group" };
+                    }
+                    auto done = std::move( _frames.back() );
+                    _frames.pop_back();
+                    done.group->add_children( done.children );
+                    _frames.back().children.push_back( done.group );
+                }
+                else if ( keyword == "obj" )
+                {
+                    read_obj( in );
+                }
+                else if ( keyword == "proxy" )
+                {
+                    read_proxy( in );
+                }
+                else if ( keyword == "proxy_budget" )
+                {
+                    auto megabytes = in.number( "a budget in megabytes" );
+                    in.expect_end();
+                    if ( megabytes < 0 )
+                    {
+                        throw scene_syntax_error{ "Expected a budget in megabytes" };
+                    }
+                    proxy_cache()->set_budget( static_cast<std::size_t>( static_cast<double>( megabytes ) * ( 1 << 20 ) ) );
+                }
+                else
+                {
+                    read_shape( keyword, in );
+                }
+            }
+
+            scene_parse_result finish( unsigned int last_line )
+            {
+                if ( _frames.size() > 1 )
+                {
+                    return failure( _frames.back().line, "Group is not closed with 'end'" );
+                }
+                if ( !_camera )
+                {
+                    return failure( last_line, "Scene has no camera" );
+                }
+                _world->add_objects( _frames.front().children );
+                for ( const auto& l : _lights )
+                {
+                    _world->add_light( l );
+                }
+                scene_parse_result result;
+                result.status = scene_parse_status::SUCCESS;
+                result.world = _world;
+                result.camera = _camera;
+                return result;
+            }
+
+            static scene_parse_result failure( unsigned int line, const std::string& message )
+            {
+                scene_parse_result result;
+                result.error = std::make_unique<scene_parse_error>();
+                result.error->line_number = line;
+                result.error->message = message;
+                return result;
+            }
+
+        private:
+
+            /**
+             * An open group and the children collected for it, added all at once on its end.
+             * The first frame collects the world's objects.
+             */
+            struct frame
+            {
+                group_ptr group;
+                std::vector<shape_ptr> children;
+                unsigned int line;
+            };
+
+            using pattern_key = std::vector<fpnum>;
+
+            std::string _directory;
+            world_ptr _world;
+            arena_scope _scope;
+            camera_ptr _camera;
+            std::vector<light_ptr> _lights;
+            std::vector<frame> _frames;
+            std::map<std::string, pattern_ptr> _patterns;
+            std::map<std::string, material_values> _materials;
+            std::map<pattern_key, pattern_ptr> _shared_patterns;
+            std::map<material_values, phong_material_ptr> _shared_materials;
+            material_values _default_material;
+            geometry_cache_ptr _proxy_cache;
+
+        private:
+
+            static bool is_transform( const std::string& w )
+            {
+                return w == "translate" || w == "scale" || w == "rotate_x" || w == "rotate_y" || w == "rotate_z" || w == "shear";
+            }
+
+            pattern_ptr shared_pattern( pattern_kind kind, const f_color& first, const f_color& second, const f4_matrix& m )
+            {
+                pattern_key key{ static_cast<fpnum>( kind ), first.r, first.g, first.b, second.r, second.g, second.b };
+                for ( std::size_t r = 0; r < 4; r++ )
+                {
+                    for ( std::size_t c = 0; c < 4; c++ )
+                    {
+                        key.push_back( m( r, c ) );
+                    }
+                }
+                auto& shared = _shared_patterns[key];
+                if ( !shared )
+                {
+                    switch ( kind )
+                    {
+                    case pattern_kind::solid: shared = solid_pattern::create( first ); break;
+                    case pattern_kind::stripe: shared = stripe_pattern::create( first, second ); break;
+                    case pattern_kind::gradient: shared = gradient_pattern::create( first, second ); break;
+                    case pattern_kind::ring: shared = ring_pattern::create( first, second ); break;
+                    case pattern_kind::checker: shared = checker_pattern::create( first, second ); break;
+                    case pattern_kind::test: shared = test_pattern::create(); break;
+                    }
+                    shared->set_transform( invertible( m ) );
+                }
+                return shared;
+            }
+
+            const phong_material_ptr& shared_material( const material_values& values )
+            {
+                auto& shared = _shared_materials[values];
+                if ( !shared )
+                {
+                    shared = phong_material::create( values.surface_pattern, values.ambient, values.diffuse, values.specular, values.shininess );
+                    shared->reflectivity = values.reflectivity;
+                    shared->transparency = values.transparency;
+                    shared->refractive_index = values.refractive_index;
+                }
+                return shared;
+            }
+
+            void read_camera( statement_reader& in )
+            {
+                auto width = in.count( "a width" );
+                auto height = in.count( "a height" );
+                auto fov = in.angle( "a field of view" );
+                in.expect( "from" );
+                auto from = in.point( "a point" );
+                in.expect( "to" );
+                auto to = in.point( "a point" );
+                in.expect( "up" );
+                auto up = in.vector( "a vector" );
+                in.expect_end();
+                const auto view = transform::view( from, to, up );
+                _camera = camera::create( width, height, fov );
+                _camera->set_transform( invertible( view ) );
+            }
+
+            void read_light( statement_reader& in )
+            {
+                const auto kind = in.word( "a light type" );
+                light_ptr l;
+                area_light_ptr area;
+                if ( kind == "point" )
+                {
+                    auto intensity = in.color();
+                    l = point_light::create( intensity, in.point( "a position" ) );
+                }
+                else if ( kind == "rectangle" )
+                {
+                    auto intensity = in.color();
+                    auto corner = in.point( "a corner" );
+                    auto uvec = in.vector( "an edge" );
+                    auto usteps = in.count( "a number of steps" );
+                    auto vvec = in.vector( "an edge" );
+                    auto vsteps = in.count( "a number of steps" );
+                    l = area = rectangle_light::create( intensity, corner, uvec, usteps, vvec, vsteps );
+                }
+                else if ( kind == "sphere" )
+                {
+                    auto intensity = in.color();
+                    auto center = in.point( "a center" );
+                    auto radius = in.number( "a radius" );
+                    auto rings = in.count( "a number of rings" );
+                    l = area = sphere_light::create( intensity, center, radius, rings, in.count( "a number of sectors" ) );
+                }
+                else
+                {
+                    throw scene_syntax_error{ "Unknown light type '" + kind + "'" };
+                }
+                while ( !in.done() )
+                {
+                    if ( in.accept( "falloff" ) )
+                    {
+                        auto c = in.number( "a falloff" );
+                        auto lin = in.number( "a falloff" );
+                        l->set_falloff( c, lin, in.number( "a falloff" ) );
+                    }
+                    else if ( area && in.accept( "nojitter" ) )
+                    {
+                        area->set_jitter( false );
+                    }
+                    else
+                    {
+                        in.expect_end();
+                    }
+                }
+                _lights.push_back( l );
+            }
+
+            void read_pattern( statement_reader& in )
+            {
+                const auto name = in.word( "a pattern name" );
+                const auto kind_name = in.word( "a pattern type" );
+                static const std::map<std::string, pattern_kind> kinds{
+                    { "solid", pattern_kind::solid }, { "stripe", pattern_kind::stripe }, { "gradient", pattern_kind::gradient },
+                    { "ring", pattern_kind::ring }, { "checker", pattern_kind::checker }, { "test", pattern_kind::test } };
+                auto kind = kinds.find( kind_name );
+                if ( kind == kinds.end() )
+                {
+                    throw scene_syntax_error{ "Unknown pattern type '" + kind_name + "'" };
+                }
+                f_color first( 1, 1, 1 ), second( 1, 1, 1 );
+                if ( kind->second != pattern_kind::test )
+                {
+                    first = in.color();
+                    second = kind->second == pattern_kind::solid ? first : in.color();
+                }
+                f4_matrix m = f4_matrix::identity();
+                while ( in.read_transform( m ) )
+                { }
+                in.expect_end();
+                _patterns[name] = shared_pattern( kind->second, first, second, m );
+            }
+
+            /**
+             * Reads material attributes into values and, when m is given, transforms into m
+             */
+            void read_shape_options( statement_reader& in, material_values& values, f4_matrix* m )
+            {
+                while ( !in.done() )
+                {
+                    if ( m && in.read_transform( *m ) )
+                    {
+                        continue;
+                    }
+                    const auto attribute = in.word( "an option" );
+                    if ( attribute == "material" )
+                    {
+                        const auto name = in.word( "a material name" );
+                        auto named = _materials.find( name );
+                        if ( named == _materials.end() )
+                        {
+                            throw scene_syntax_error{ "Unknown material '" + name + "'" };
+                        }
+                        values = named->second;
+                    }
+                    else if ( attribute == "pattern" )
+                    {
+                        const auto name = in.word( "a pattern name" );
+                        auto named = _patterns.find( name );
+                        if ( named == _patterns.end() )
+                        {
+                            throw scene_syntax_error{ "Unknown pattern '" + name + "'" };
+                        }
+                        values.surface_pattern = named->second;
+                    }
+                    else if ( attribute == "color" )
+                    {
+                        auto col = in.color();
+                        values.surface_pattern = shared_pattern( pattern_kind::solid, col, col, f4_matrix::identity() );
+                    }
+                    else if ( attribute == "ambient" )
+                    {
+                        values.ambient = in.number( "an ambient value" );
+                    }
+                    else if ( attribute == "diffuse" )
+                    {
+                        values.diffuse = in.number( "a diffuse value" );
+                    }
+                    else if ( attribute == "specular" )
+                    {
+                        values.specular = in.number( "a specular value" );
+                    }
+                    else if ( attribute == "shininess" )
+                    {
+                        values.shininess = in.number( "a shininess" );
+                    }
+                    else if ( attribute == "reflectivity" )
+                    {
+                        values.reflectivity = in.number( "a reflectivity" );
+                    }
+                    else if ( attribute == "transparency" )
+                    {
+                        values.transparency = in.number( "a transparency" );
+                    }
+                    else if ( attribute == "refractive_index" )
+                    {
+                        values.refractive_index = in.number( "a refractive index" );
+                    }
+                    else
+                    {
+                        throw scene_syntax_error{ "Unknown option '" + attribute + "'" };
+                    }
+                }
+            }
+
+            void read_shape( const std::string& keyword, statement_reader& in )
+            {
+                shape_ptr s;
+                if ( keyword == "sphere" )
+                {
+                    s = sphere::create();
+                }
+                else if ( keyword == "plane" )
+                {
+                    s = plane::create();
+                }
+                else if ( keyword == "cube" )
+                {
+                    s = cube::create();
+                }
+                else if ( keyword == "cylinder" )
+                {
+                    auto min = in.number( "a minimum" );
+                    auto cyl = cylinder::create( min, in.number( "a maximum" ) );
+                    cyl->set_closed( in.accept( "closed" ) );
+                    s = cyl;
+                }
+                else if ( keyword == "cone" )
+                {
+                    auto min = in.number( "a minimum" );
+                    auto cn = cone::create( min, in.number( "a maximum" ) );
+                    cn->set_closed( in.accept( "closed" ) );
+                    s = cn;
+                }
+                else if ( keyword == "triangle" )
+                {
+                    auto p1 = in.point( "a point" );
+                    auto p2 = in.point( "a point" );
+                    s = triangle::create( p1, p2, in.point( "a point" ) );
+                }
+                else
+                {
+                    throw scene_syntax_error{ "Unknown statement '" + keyword + "'" };
+                }
+                auto values = _default_material;
+                f4_matrix m = f4_matrix::identity();
+                read_shape_options( in, values, &m );
+                s->set_transform( invertible( m ) );
+                s->set_material( shared_material( values ) );
+                _frames.back().children.push_back( s );
+            }
+
+            std::string read_path( statement_reader& in )
+            {
+                auto file = in.word( "a file name" );
+                if ( file.front() != '/' )
+                {
+                    file = _directory + "/" + file;
+                }
+                return file;
+            }
+
+            static mesh_import_options read_import_options( statement_reader& in )
+            {
+                mesh_import_options options;
+                while ( true )
+                {
+                    if ( in.accept( "weld" ) )
+                    {
+                        options.weld = true;
+                        options.weld_tolerance = in.at_number() ? in.number( "a tolerance" ) : 0;
+                    }
+                    else if ( in.accept( "quantize" ) )
+                    {
+                        options.quantize = true;
+                    }
+                    else
+                    {
+                        return options;
+                    }
+                }
+            }
+
+            void read_obj( statement_reader& in )
+            {
+                auto file = read_path( in );
+                auto options = read_import_options( in );
+                auto values = _default_material;
+                f4_matrix m = f4_matrix::identity();
+                read_shape_options( in, values, &m );
+
+                auto parsed = model_parser::obj( file, _world->arena(), 0, options );
+                if ( parsed.status != model_parse_status::SUCCESS )
+                {
+                    throw scene_syntax_error{ "Could not load " + file + ": " + parsed.error->message };
+                }
+                auto model = parsed.to_shape_group();
+                model->set_transform( invertible( m ) );
+                set_material( model, shared_material( values ) );
+                _frames.back().children.push_back( model );
+            }
+
+            void read_proxy( statement_reader& in )
+            {
+                auto file = read_path( in );
+                auto min = in.point( "a minimum corner" );
+                auto bounds = aabb_bounds( min, in.point( "a maximum corner" ) );
+                auto options = read_import_options( in );
+                auto values = _default_material;
+                f4_matrix m = f4_matrix::identity();
+                read_shape_options( in, values, &m );
+
+                auto proxy = geometry_proxy::create( file, bounds, proxy_cache(), options );
+                proxy->set_transform( invertible( m ) );
+                proxy->set_material( shared_material( values ) );
+                _frames.back().children.push_back( proxy );
+            }
+
+            const geometry_cache_ptr& proxy_cache()
+            {
+                if ( !_proxy_cache )
+                {
+                    _proxy_cache = geometry_cache::create();
+                }
+                return _proxy_cache;
+            }
+
+            static void set_material( const group_ptr& g, const phong_material_ptr& mat )
+            {
+                for ( const auto& child : g->children() )
+                {
+                    if ( auto grp = std::dynamic_pointer_cast<group>( child ) )
+                    {
+                        set_material( grp, mat );
+                    }
+                    else
+                    {
+                        child->set_material( mat );
+                    }
+                }
+            }
+        };
+    }
+
+    scene_parse_result scene_parser::load( const std::string& file )
+    {
+        std::ifstream f( file, std::ios::binary );
+        if ( !f )
+        {
+            return scene_builder::failure( 0, "Could not open " + file );
+        }
+        std::string text( ( std::istreambuf_iterator<char>( f ) ), std::istreambuf_iterator<char>() );
+        auto slash = file.find_last_of( "/\\" );
+        return parse( text, slash == std::string::npos ? std::string( "." ) : file.substr( 0, slash ) );
+    }
+
+    scene_parse_result scene_parser::parse( const std::string& text, const std::string& directory )
+    {
+        scene_builder builder( directory );
+        std::istringstream lines( text );
+        std::string line;
+        unsigned int line_number = 0;
+        while ( std::getline( lines, line ) )
+        {
+            line_number++;
+            try
+            {
+                statement_reader in( line );
+                builder.statement( in, line_number );
+            }
+            catch ( const scene_syntax_error& e )
+            {
+                return scene_builder::failure( line_number, e.message );
+            }
+        }
+        return builder.finish( line_number );
+    }
+}
@@ -1,24 +1,26 @@
 #include "shapes.hpp"
+#include "geometry_proxy.hpp"
+#include <algorithm>
 
 namespace ls {
     f_point shape::world_to_object( const f_point& p ) const noexcept
     {
         auto pnt = p;
-        if ( !_parent.expired() )
+        if ( _parent_group )
         {
-            pnt = _parent.lock()->world_to_object( pnt );
+            pnt = _parent_group->world_to_object( pnt );
         }
-        return _transform.inverse() * pnt;
+        return _inverse_transform * pnt;
     }
 
     f_vector shape::normal_to_world( const f_vector& n ) const noexcept
     {
-        auto norm = _transform.inverse().transpose() * n;
+        auto norm = _normal_transform * n;
         norm.w = 0.f;
         norm = norm.normalized();
-        if ( !_parent.expired() )
+        if ( _parent_group )
         {
-            norm = _parent.lock()->normal_to_world( norm );
+            norm = _parent_group->normal_to_world( norm );
         }
         return norm;
     }
@@ -30,6 +32,285 @@ namespace ls {
         return normal_to_world( local_norm );
     }
 
+    void shape::mark_edited() const noexcept
+    {
+        for ( const shape* s = this; s != nullptr; s = s->_parent_group )
+        {
+            if ( s->_edits.counter )
+            {
+                s->_edits.counter->fetch_add( 1, std::memory_order_relaxed );
+            }
+        }
+    }
+
+    namespace {
+        intersections to_intersections( const shape_ptr& s, const fpnum* ts, uint8_t count )
+        {
+            intersections itrs;
+            itrs.reserve( count );
+            for ( uint8_t i = 0; i < count; i++ )
+            {
+                itrs.push_back( intersection( ts[i], s ) );
+            }
+            return itrs;
+        }
+
+        uint8_t cylinder_caps( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept
+        {
+            if ( !closed || approx( r.direction().y, 0.f ) )
+            {
+                return 0;
+            }
+
+            uint8_t count = 0;
+            auto t = ( min - r.origin().y ) / r.direction().y;
+            if ( cylinder::check_cap( r, t ) )
+            {
+                ts[count++] = t;
+            }
+
+            t = ( max - r.origin().y ) / r.direction().y;
+            if ( cylinder::check_cap( r, t ) )
+            {
+                ts[count++] = t;
+            }
+            return count;
+        }
+
+        uint8_t cone_caps( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept
+        {
+            if ( !closed || approx( r.direction().y, 0.f ) )
+            {
+                return 0;
+            }
+
+            uint8_t count = 0;
+            auto t = ( min - r.origin().y ) / r.direction().y;
+            if ( cone::check_cap( r, std::abs( min ), t ) )
+            {
+                ts[count++] = t;
+            }
+
+            t = ( max - r.origin().y ) / r.direction().y;
+            if ( cone::check_cap( r, std::abs( max ), t ) )
+            {
+                ts[count++] = t;
+            }
+            return count;
+        }
+    }
+
+    namespace local_intersect {
+        uint8_t sphere( const ray& r, const f_point& origin, fpnum* ts ) noexcept
+        {
+            f_vector sphere_to_ray = r.origin() - origin;
+            f_vector ray_direction = r.direction();
+
+            fpnum a = ray_direction.dot( ray_direction );
+            fpnum b = 2 * ray_direction.dot( sphere_to_ray );
+            fpnum c = sphere_to_ray.dot( sphere_to_ray ) - 1;
+
+            fpnum discriminant = ( b * b ) - 4 * a * c;
+
+            // If the discrimant is zero, the ray did not hit the sphere
+            if ( discriminant < 0 )
+            {
+                return 0;
+            }
+
+            // Precompute these values since divisions and square roots are
+            // expensive operations
+            fpnum discriminant_sqrt = std::sqrt( discriminant );
+            fpnum denom = 1 / ( 2 * a );
+
+            ts[0] = ( -b - discriminant_sqrt ) * denom;
+            ts[1] = ( -b + discriminant_sqrt ) * denom;
+            return 2;
+        }
+
+        uint8_t plane( const ray& r, fpnum* ts ) noexcept
+        {
+            if ( std::abs( r.direction().y ) < epsilon )
+            {
+                return 0;
+            }
+
+            ts[0] = -r.origin().y / r.direction().y;
+            return 1;
+        }
+
+        uint8_t cube( const ray& r, fpnum* ts ) noexcept
+        {
+            auto check_axis = [] ( fpnum origin, fpnum direction ) {
+                auto tmin_numerator = -1.f - origin;
+                auto tmax_numerator = 1.f - origin;
+
+                fpnum tmin, tmax;
+                if ( std::abs( direction ) >= epsilon )
+                {
+                    tmin = tmin_numerator / direction;
+                    tmax = tmax_numerator / direction;
+                }
+                else
+                {
+                    tmin = tmin_numerator * infinity;
+                    tmax = tmax_numerator * infinity;
+                }
+
+                return tmin > tmax ? std::array<fpnum, 2>{tmax, tmin} : std::array<fpnum, 2>{tmin, tmax};
+            };
+
+            const auto& origin = r.origin();
+            const auto& direction = r.direction();
+            auto xt = check_axis( origin.x, direction.x );
+            auto yt = check_axis( origin.y, direction.y );
+            auto zt = check_axis( origin.z, direction.z );
+
+            auto tmin = std::max( { xt[0], yt[0], zt[0] } );
+            auto tmax = std::min( { xt[1], yt[1], zt[1] } );
+
+            if ( tmin > tmax )
+            {
+                return 0;
+            }
+
+            ts[0] = tmin;
+            ts[1] = tmax;
+            return 2;
+        }
+
+        uint8_t cylinder( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept
+        {
+            const auto& direction = r.direction();
+            const auto& origin = r.origin();
+
+            auto a = direction.x * direction.x + direction.z * direction.z;
+            if ( approx( a, 0.f ) )
+            {
+                return cylinder_caps( r, min, max, closed, ts );
+            }
+
+            auto b = 2 * origin.x * direction.x + 2 * origin.z * direction.z;
+            auto c = origin.x * origin.x + origin.z * origin.z - 1;
+            auto discriminant = b * b - 4 * a * c;
+            if ( approx( discriminant, 0.f ) )
+            {
+                discriminant = 0.f;
+            }
+
+            if ( discriminant < 0 )
+            {
+                return cylinder_caps( r, min, max, closed, ts );
+            }
+
+            auto denom = 1.f / ( 2.f * a );
+            auto t0 = ( -b - sqrt( discriminant ) ) * denom;
+            auto t1 = ( -b + sqrt( discriminant ) ) * denom;
+            if ( t0 > t1 )
+            {
+                std::swap( t0, t1 );
+            }
+
+            uint8_t count = 0;
+            auto y0 = origin.y + t0 * direction.y;
+            if ( min < y0 && y0 < max )
+            {
+                ts[count++] = t0;
+            }
+
+            auto y1 = origin.y + t1 * direction.y;
+            if ( min < y1 && y1 < max )
+            {
+                ts[count++] = t1;
+            }
+
+            return count + cylinder_caps( r, min, max, closed, ts + count );
+        }
+
+        uint8_t cone( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept
+        {
+            const auto& direction = r.direction();
+            const auto& origin = r.origin();
+
+            auto a = ( direction.x * direction.x ) - ( direction.y * direction.y ) + ( direction.z * direction.z );
+            auto b = ( 2.f * origin.x * direction.x ) - ( 2.f * origin.y * direction.y ) + ( 2.f * origin.z * direction.z );
+            auto c = ( origin.x * origin.x ) - ( origin.y * origin.y ) + ( origin.z * origin.z );
+
+            if ( approx( a, 0.f ) && approx( b, 0.f ) )
+            {
+                return cone_caps( r, min, max, closed, ts );
+            }
+            else if ( approx( a, 0.f ) )
+            {
+                ts[0] = -c / ( 2.f * b );
+                return 1 + cone_caps( r, min, max, closed, ts + 1 );
+            }
+
+            auto discriminant = b * b - 4 * a * c;
+            if ( approx( discriminant, 0.f ) )
+            {
+                discriminant = 0.f;
+            }
+
+            if ( discriminant < 0 )
+            {
+                return cone_caps( r, min, max, closed, ts );
+            }
+
+            auto denom = 1.f / ( 2.f * a );
+            auto disc_sqrt = std::sqrt( discriminant );
+            auto t0 = ( -b - disc_sqrt ) * denom;
+            auto t1 = ( -b + disc_sqrt ) * denom;
+            if ( t0 > t1 )
+            {
+                std::swap( t0, t1 );
+            }
+
+            uint8_t count = 0;
+            auto y0 = origin.y + t0 * direction.y;
+            if ( min < y0 && y0 < max )
+            {
+                ts[count++] = t0;
+            }
+
+            auto y1 = origin.y + t1 * direction.y;
+            if ( min < y1 && y1 < max )
+            {
+                ts[count++] = t1;
+            }
+
+            return count + cone_caps( r, min, max, closed, ts + count );
+        }
+
+        uint8_t triangle( const ray& r, const f_point& p1, const f_vector& e1, const f_vector& e2, fpnum* ts ) noexcept
+        {
+            auto dir_cross_e2 = r.direction().cross( e2 );
+            auto determinant = e1.dot( dir_cross_e2 );
+            if ( std::abs( determinant ) < epsilon )
+            {
+                return 0;
+            }
+
+            auto f = 1.f / determinant;
+            auto p1_to_origin = r.origin() - p1;
+            auto u = f * p1_to_origin.dot( dir_cross_e2 );
+            if ( u < 0 || u > 1 )
+            {
+                return 0;
+            }
+
+            auto origin_cross_e1 = p1_to_origin.cross( e1 );
+            auto v = f * r.direction().dot( origin_cross_e1 );
+            if ( v < 0 || ( u + v ) > 1 )
+            {
+                return 0;
+            }
+
+            ts[0] = f * e2.dot( origin_cross_e1 );
+            return 1;
+        }
+    }
+
     intersections intersect( const shape_ptr& s, const ray& r )
     {
         auto sph = std::dynamic_pointer_cast<sphere>( s );
@@ -62,12 +343,30 @@ namespace ls {
             return intersect( cn, r );
         }
 
+        auto tr = std::dynamic_pointer_cast<triangle>( s );
+        if ( tr )
+        {
+            return intersect( tr, r );
+        }
+
+        auto mt = std::dynamic_pointer_cast<mesh_triangle>( s );
+        if ( mt )
+        {
+            return intersect( mt, r );
+        }
+
         auto grp = std::dynamic_pointer_cast<group>( s );
         if ( grp )
         {
             return intersect( grp, r );
         }
 
+        auto proxy = std::dynamic_pointer_cast<geometry_proxy>( s );
+        if ( proxy )
+        {
+            return intersect( proxy, r );
+        }
+
         return intersections();
     }
 
@@ -81,46 +380,16 @@ namespace ls {
 
     intersections intersect( const sphere_ptr& s, const ray& r )
     {
-        const ray transformed_ray = s->transform().inverse() * r;
-
-        f_vector sphere_to_ray = transformed_ray.origin() - s->origin();
-        f_vector ray_direction = transformed_ray.direction();
-
-        fpnum a = ray_direction.dot( ray_direction );
-        fpnum b = 2 * ray_direction.dot( sphere_to_ray );
-        fpnum c = sphere_to_ray.dot( sphere_to_ray ) - 1;
-
-        fpnum discriminant = ( b * b ) - 4 * a * c;
-
-        // If the discrimant is zero, the ray did not hit the sphere
-        if ( discriminant < 0 )
-        {
-            return intersections();
-        }
-
-        // Precompute these values since divisions and square roots are
-        // expensive operations
-        fpnum discriminant_sqrt = std::sqrt( discriminant );
-        fpnum denom = 1 / ( 2 * a );
-
-        return intersections{
-            intersection( ( -b - discriminant_sqrt ) * denom, s ),
-            intersection( ( -b + discriminant_sqrt ) * denom, s )
-        };
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::sphere( s->inverse_transform() * r, s->origin(), ts );
+        return to_intersections( s, ts, count );
     }
 
     intersections intersect( const plane_ptr& p, const ray& r )
     {
-        const ray transformed_ray = p->transform().inverse() * r;
-
-        if ( abs( transformed_ray.direction().y ) < epsilon )
-        {
-            return intersections();
-        }
-
-        return intersections{
-            intersection( -transformed_ray.origin().y / transformed_ray.direction().y, p )
-        };
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::plane( p->inverse_transform() * r, ts );
+        return to_intersections( p, ts, count );
     }
 
     f_vector cube::local_normal( const f_point& p ) const
@@ -139,47 +408,9 @@ namespace ls {
 
     intersections intersect( const cube_ptr& c, const ray& r )
     {
-        const ray transformed_ray = c->transform().inverse() * r;
-
-        auto check_axis = [] ( fpnum origin, fpnum direction ) {
-            auto tmin_numerator = -1.f - origin;
-            auto tmax_numerator = 1.f - origin;
-
-            fpnum tmin, tmax;
-            if ( abs( direction ) >= epsilon )
-            {
-                tmin = tmin_numerator / direction;
-                tmax = tmax_numerator / direction;
-            }
-            else
-            {
-                tmin = tmin_numerator * infinity;
-                tmax = tmax_numerator * infinity;
-            }
-
-            return tmin > tmax ? std::array<fpnum, 2>{tmax, tmin} : std::array<fpnum, 2>{tmin, tmax};
-        };
-
-        auto origin = r.origin();
-        auto direction = r.direction();
-        auto xt = check_axis( origin.x, direction.x );
-        auto yt = check_axis( origin.y, direction.y );
-        auto zt = check_axis( origin.z, direction.z );
-
-        auto tmin = std::max( { xt[0], yt[0], zt[0] } );
-        auto tmax = std::min( { xt[1], yt[1], zt[1] } );
-
-        if ( tmin > tmax )
-        {
-            return intersections();
-        }
-        else
-        {
-            return intersections{
-                intersection( tmin, c ),
-                intersection( tmax, c )
-            };
-        }
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::cube( c->inverse_transform() * r, ts );
+        return to_intersections( c, ts, count );
     }
 
     f_vector cylinder::local_normal( const f_point& p ) const
@@ -206,76 +437,19 @@ namespace ls {
 
     void cylinder::intersect_caps( const cylinder_ptr& cyl, const ray& r, intersections& itrs )
     {
-        if ( !cyl->closed() || approx( r.direction().y, 0.f ) )
+        fpnum ts[2];
+        auto count = cylinder_caps( r, cyl->min_extent(), cyl->max_extent(), cyl->closed(), ts );
+        for ( uint8_t i = 0; i < count; i++ )
         {
-            return;
-        }
-
-        auto t = ( cyl->min_extent() - r.origin().y ) / r.direction().y;
-        if ( cylinder::check_cap( r, t ) )
-        {
-            itrs.push_back( intersection( t, cyl ) );
-        }
-
-        t = ( cyl->max_extent() - r.origin().y ) / r.direction().y;
-        if ( cylinder::check_cap( r, t ) )
-        {
-            itrs.push_back( intersection( t, cyl ) );
+            itrs.push_back( intersection( ts[i], cyl ) );
         }
     }
 
     intersections intersect( const cylinder_ptr& cyl, const ray& r )
     {
-        const ray transformed_ray = cyl->transform().inverse() * r;
-
-        auto direction = transformed_ray.direction();
-        auto origin = transformed_ray.origin();
-        auto itrs = intersections();
-
-        auto a = direction.x * direction.x + direction.z * direction.z;
-        if ( approx( a, 0.f ) )
-        {
-            cylinder::intersect_caps( cyl, transformed_ray, itrs );
-            return itrs;
-        }
-
-        auto b = 2 * origin.x * direction.x + 2 * origin.z * direction.z;
-        auto c = origin.x * origin.x + origin.z * origin.z - 1;
-        auto discriminant = b * b - 4 * a * c;
-        if ( approx( discriminant, 0.f ) )
-        {
-            discriminant = 0.f;
-        }
-
-        if ( discriminant < 0 )
-        {
-            cylinder::intersect_caps( cyl, transformed_ray, itrs );
-            return itrs;
-        }
-
-        auto denom = 1.f / ( 2.f * a );
-        auto t0 = ( -b - sqrt( discriminant ) ) * denom;
-        auto t1 = ( -b + sqrt( discriminant ) ) * denom;
-        if ( t0 > t1 )
-        {
-            std::swap( t0, t1 );
-        }
-
-        auto y0 = origin.y + t0 * direction.y;
-        if ( cyl->min_extent() < y0 && y0 < cyl->max_extent() )
-        {
-            itrs.push_back( intersection( t0, cyl ) );
-        }
-
-        auto y1 = origin.y + t1 * direction.y;
-        if ( cyl->min_extent() < y1 && y1 < cyl->max_extent() )
-        {
-            itrs.push_back( intersection( t1, cyl ) );
-        }
-
-        cylinder::intersect_caps( cyl, transformed_ray, itrs );
-
-        return itrs;
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::cylinder( cyl->inverse_transform() * r, cyl->min_extent(), cyl->max_extent(), cyl->closed(), ts );
+        return to_intersections( cyl, ts, count );
     }
 
     f_vector cone::local_normal( const f_point& p ) const
@@ -307,129 +481,114 @@ namespace ls {
 
     void cone::intersect_caps( const cone_ptr& co, const ray& r, intersections& itrs )
     {
-        if ( !co->closed() || approx( r.direction().y, 0.f ) )
-        {
-            return;
-        }
-
-        auto t = ( co->min_extent() - r.origin().y ) / r.direction().y;
-        if ( cone::check_cap( r, std::abs( co->min_extent() ), t ) )
-        {
-            itrs.push_back( intersection( t, co ) );
-        }
-
-        t = ( co->max_extent() - r.origin().y ) / r.direction().y;
-        if ( cone::check_cap( r, std::abs( co->max_extent() ), t ) )
+        fpnum ts[2];
+        auto count = cone_caps( r, co->min_extent(), co->max_extent(), co->closed(), ts );
+        for ( uint8_t i = 0; i < count; i++ )
         {
-            itrs.push_back( intersection( t, co ) );
+            itrs.push_back( intersection( ts[i], co ) );
         }
     }
 
     intersections intersect( const cone_ptr& co, const ray& r )
     {
-        const ray transformed_ray = co->transform().inverse() * r;
-
-        auto direction = transformed_ray.direction();
-        auto origin = transformed_ray.origin();
-        auto itrs = intersections();
-
-        auto a = ( direction.x * direction.x ) - ( direction.y * direction.y ) + ( direction.z * direction.z );
-        auto b = ( 2.f * origin.x * direction.x ) - ( 2.f * origin.y * direction.y ) + ( 2.f * origin.z * direction.z );
-        auto c = ( origin.x * origin.x ) - ( origin.y * origin.y ) + ( origin.z * origin.z );
-
-        if ( approx( a, 0.f ) && approx( b, 0.f ) )
-        {
-            cone::intersect_caps( co, transformed_ray, itrs );
-            return itrs;
-        }
-        else if ( approx( a, 0.f ) )
-        {
-            itrs.push_back( intersection( -c / ( 2.f * b ), co ) );
-            cone::intersect_caps( co, transformed_ray, itrs );
-            return itrs;
-        }
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::cone( co->inverse_transform() * r, co->min_extent(), co->max_extent(), co->closed(), ts );
+        return to_intersections( co, ts, count );
+    }
 
-        auto discriminant = b * b - 4 * a * c;
-        if ( approx( discriminant, 0.f ) )
-        {
-            discriminant = 0.f;
-        }
+    intersections intersect( const triangle_ptr& tr, const ray& r )
+    {
+        fpnum ts[local_intersect::max_hits];
+        auto count = local_intersect::triangle( tr->inverse_transform() * r, tr->p1(), tr->e1(), tr->e2(), ts );
+        return to_intersections( tr, ts, count );
+    }
 
-        if ( discriminant < 0 )
-        {
-            cone::intersect_caps( co, transformed_ray, itrs );
-            return itrs;
-        }
+    intersections intersect( const mesh_triangle_ptr& tr, const ray& r )
+    {
+        fpnum ts[local_intersect::max_hits];
+        auto p1 = tr->p1();
+        auto count = local_intersect::triangle( tr->inverse_transform() * r, p1, tr->p2() - p1, tr->p3() - p1, ts );
+        return to_intersections( tr, ts, count );
+    }
 
-        auto denom = 1.f / ( 2.f * a );
-        auto disc_sqrt = std::sqrt( discriminant );
-        auto t0 = ( -b - disc_sqrt ) * denom;
-        auto t1 = ( -b + disc_sqrt ) * denom;
-        if ( t0 > t1 )
-        {
-            std::swap( t0, t1 );
-        }
+    aabb_bounds mesh_triangle::bounds() const noexcept
+    {
+        auto a = p1(), b = p2(), c = p3();
+        return aabb_bounds(
+            f_point( std::min( { a.x, b.x, c.x } ), std::min( { a.y, b.y, c.y } ), std::min( { a.z, b.z, c.z } ) ),
+            f_point( std::max( { a.x, b.x, c.x } ), std::max( { a.y, b.y, c.y } ), std::max( { a.z, b.z, c.z } ) ) );
+    }
 
-        auto y0 = origin.y + t0 * direction.y;
-        if ( co->min_extent() < y0 && y0 < co->max_extent() )
-        {
-            itrs.push_back( intersection( t0, co ) );
-        }
+    void mesh_triangle::barycentric( const f_point& p, fpnum& u, fpnum& v ) const noexcept
+    {
+        auto first = p1();
+        auto e1 = p2() - first, e2 = p3() - first;
+        auto to_p = p - first;
+        auto d11 = e1.dot( e1 ), d12 = e1.dot( e2 ), d22 = e2.dot( e2 );
+        auto dp1 = to_p.dot( e1 ), dp2 = to_p.dot( e2 );
+        auto denominator = d11 * d22 - d12 * d12;
+        u = ( d22 * dp1 - d12 * dp2 ) / denominator;
+        v = ( d11 * dp2 - d12 * dp1 ) / denominator;
+    }
 
-        auto y1 = origin.y + t1 * direction.y;
-        if ( co->min_extent() < y1 && y1 < co->max_extent() )
+    texture_uv mesh_triangle::uv_at( const f_point& p ) const noexcept
+    {
+        if ( !_mesh->has_uvs( _index ) )
         {
-            itrs.push_back( intersection( t1, co ) );
+            return texture_uv();
         }
-
-        cone::intersect_caps( co, transformed_ray, itrs );
-
-        return itrs;
+        fpnum u, v;
+        barycentric( p, u, v );
+        return _mesh->interpolated_uv( _index, u, v );
     }
 
-    intersections intersect( const triangle_ptr& tr, const ray& r )
+    f_vector mesh_triangle::local_normal( const f_point& p ) const
     {
-        auto dir_cross_e2 = r.direction().cross( tr->e2() );
-        auto determinant = tr->e1().dot( dir_cross_e2 );
-        if ( std::abs( determinant ) < epsilon )
+        if ( !_mesh->has_normals( _index ) )
         {
-            return intersections();
+            return normal();
         }
+        fpnum u, v;
+        barycentric( p, u, v );
+        return _mesh->interpolated_normal( _index, u, v );
+    }
 
-        auto f = 1.f / determinant;
-        auto p1_to_origin = r.origin() - tr->p1();
-        auto u = f * p1_to_origin.dot( dir_cross_e2 );
-        if ( u < 0 || u > 1 )
+    group::~group()
+    {
+        for ( const auto& child : children_ )
         {
-            return intersections();
+            if ( child->_parent_group == this )
+            {
+                child->_parent_group = nullptr;
+            }
         }
+    }
 
-        auto origin_cross_e1 = p1_to_origin.cross( tr->e1() );
-        auto v = f * r.direction().dot( origin_cross_e1 );
-        if ( v < 0 || ( u + v ) > 1 )
-        {
-            return intersections();
-        }
+    void group::add_child( const shape_ptr shape ) noexcept
+    {
+        insert_child( shape, std::static_pointer_cast<group>( shared_from_this() ) );
+    }
 
-        auto t = f * tr->e2().dot( origin_cross_e1 );
-        return intersections{
-            intersection( t, tr )
-        };
+    void group::reserve_children( std::size_t count ) noexcept
+    {
+        children_.reserve( children_.size() + count );
+        child_set_.reserve( child_set_.size() + count );
     }
 
-    void group::add_child( const shape_ptr shape ) noexcept
+    void group::insert_child( const shape_ptr& shape, const group_ptr& self ) noexcept
     {
-        if ( std::find( children_.begin(), children_.end(), shape ) == children_.end() )
+        if ( child_set_.insert( shape.get() ).second )
         {
             children_.push_back( shape );
+            mark_edited();
         }
-        shape->set_parent( std::static_pointer_cast<group>( shared_from_this() ) );
+        shape->set_parent( self );
     }
 
     aabb_bounds group::bounds() const noexcept
     {
         aabb_bounds group_bounds( f_point( infinity, infinity, infinity ), f_point( -infinity, -infinity, -infinity ) );
-        for ( auto child : children_ )
+        for ( const auto& child : children_ )
         {
             auto child_bounds = child->transform() * child->bounds();
             group_bounds.min.x = std::min( child_bounds.min.x, group_bounds.min.x );
@@ -439,36 +598,19 @@ namespace ls {
             group_bounds.max.y = std::max( child_bounds.max.y, group_bounds.max.y );
             group_bounds.max.z = std::max( child_bounds.max.z, group_bounds.max.z );
         }
-
-        f_point blb = _transform * f_point( group_bounds.min.x, group_bounds.min.y, group_bounds.min.z );
-        f_point blf = _transform * f_point( group_bounds.min.x, group_bounds.min.y, group_bounds.max.z );
-        f_point tlb = _transform * f_point( group_bounds.min.x, group_bounds.max.y, group_bounds.min.z );
-        f_point tlf = _transform * f_point( group_bounds.min.x, group_bounds.max.y, group_bounds.max.z );
-        f_point brb = _transform * f_point( group_bounds.max.x, group_bounds.min.y, group_bounds.min.z );
-        f_point brf = _transform * f_point( group_bounds.max.x, group_bounds.min.y, group_bounds.max.z );
-        f_point trb = _transform * f_point( group_bounds.max.x, group_bounds.max.y, group_bounds.min.z );
-        f_point trf = _transform * f_point( group_bounds.max.x, group_bounds.max.y, group_bounds.max.z );
-
-        group_bounds.min.x = std::min( { blb.x, blf.x, tlb.x, tlf.x, brb.x, brf.x, trb.x, trf.x } );
-        group_bounds.min.y = std::min( { blb.y, blf.y, tlb.y, tlf.y, brb.y, brf.y, trb.y, trf.y } );
-        group_bounds.min.z = std::min( { blb.z, blf.z, tlb.z, tlf.z, brb.z, brf.z, trb.z, trf.z } );
-        group_bounds.max.x = std::max( { blb.x, blf.x, tlb.x, tlf.x, brb.x, brf.x, trb.x, trf.x } );
-        group_bounds.max.y = std::max( { blb.y, blf.y, tlb.y, tlf.y, brb.y, brf.y, trb.y, trf.y } );
-        group_bounds.max.z = std::max( { blb.z, blf.z, tlb.z, tlf.z, brb.z, brf.z, trb.z, trf.z } );
-
         return group_bounds;
     }
 
     intersections intersect( const group_ptr& grp, const ray& r )
     {
-        const ray transformed_ray = grp->transform().inverse() * r;
+        const ray transformed_ray = grp->inverse_transform() * r;
 
         intersections itrs;
-        if ( grp->bounds().intersects( r ) )
+        if ( grp->bounds().intersects( transformed_ray ) )
         {
             for ( auto child : grp->children() )
             {
-                auto child_itrs = intersect( child, transformed_ray );
+                auto child_itrs = intersect( unowned( child ), transformed_ray );
                 itrs.insert( itrs.end(), child_itrs.begin(), child_itrs.end() );
             }
             std::sort( itrs.begin(), itrs.end(), [] ( intersection i1, intersection i2 ) {
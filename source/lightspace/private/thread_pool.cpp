@@ -0,0 +1,191 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+
+namespace ls {
+    struct thread_pool::worker_set
+    {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::vector<job_queue> queues;
+        std::vector<std::thread> threads;
+        const std::function<void( std::size_t )>* job{ nullptr };
+        // The threads taking part in the current batch, and how many besides the caller have
+        // yet to finish it
+        std::size_t workers{ 0 };
+        std::size_t pending{ 0 };
+        uint64_t batch{ 0 };
+        bool stopping{ false };
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        explicit worker_set( std::size_t count ) :
+            queues( count )
+        { }
+
+        ~worker_set()
+        {
+            {
+                std::lock_guard<std::mutex> guard( lock );
+                stopping = true;
+            }
+            wake.notify_all();
+            for ( auto& t : threads )
+            {
+                t.join();
+            }
+        }
+    };
+
+    thread_pool::thread_pool( uint16_t threads ) :
+        _threads( threads == 0 ? hardware_threads() : threads )
+    { }
+
+    thread_pool::thread_pool( thread_pool&& ) noexcept = default;
+
+    thread_pool& thread_pool::operator=( thread_pool&& ) noexcept = default;
+
+    thread_pool::~thread_pool() = default;
+
+    uint16_t thread_pool::hardware_threads() noexcept
+    {
+        auto count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : static_cast<uint16_t>( std::min<unsigned int>( count, std::numeric_limits<uint16_t>::max() ) );
+    }
+
+    void thread_pool::run( std::size_t jobs, const std::function<void( std::size_t )>& job )
+    {
+        auto workers = static_cast<std::size_t>( std::min<std::size_t>( _threads, jobs ) );
+        if ( workers <= 1 )
+        {
+            for ( std::size_t i = 0; i < jobs; i++ )
+            {
+                job( i );
+            }
+            return;
+        }
+
+        if ( !_workers )
+        {
+            _workers.reset( new worker_set( _threads ) );
+            auto& set = *_workers;
+            set.threads.reserve( _threads - 1 );
+            for ( std::size_t id = 1; id < _threads; id++ )
+            {
+                set.threads.emplace_back( [&set, id] {
+                    uint64_t seen = 0;
+                    std::unique_lock<std::mutex> guard( set.lock );
+                    while ( true )
+                    {
+                        set.wake.wait( guard, [&set, &seen] { return set.stopping || set.batch != seen; } );
+                        if ( set.stopping )
+                        {
+                            return;
+                        }
+                        seen = set.batch;
+                        if ( id >= set.workers )
+                        {
+                            continue;
+                        }
+
+                        guard.unlock();
+                        work( set, id );
+                        guard.lock();
+                        if ( --set.pending == 0 )
+                        {
+                            set.done.notify_one();
+                        }
+                    }
+                } );
+            }
+        }
+
+        // The threads are idle between batches, so the queues are filled without contention
+        auto& set = *_workers;
+        for ( std::size_t i = 0; i < jobs; i++ )
+        {
+            set.queues[i * workers / jobs].jobs.push_back( i );
+        }
+        {
+            std::lock_guard<std::mutex> guard( set.lock );
+            set.job = &job;
+            set.workers = workers;
+            set.pending = workers - 1;
+            set.error = nullptr;
+            ++set.batch;
+        }
+        set.wake.notify_all();
+
+        work( set, 0 );
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> guard( set.lock );
+            set.done.wait( guard, [&set] { return set.pending == 0; } );
+            set.job = nullptr;
+            error = set.error;
+        }
+
+        if ( error )
+        {
+            std::rethrow_exception( error );
+        }
+    }
+
+    void thread_pool::work( worker_set& set, std::size_t id )
+    {
+        std::size_t next;
+        while ( true )
+        {
+            bool found = pop( set.queues[id], next );
+            for ( std::size_t offset = 1; !found && offset < set.workers; offset++ )
+            {
+                found = steal( set.queues[( id + offset ) % set.workers], next );
+            }
+            // Jobs never enqueue more jobs, so once every queue is empty the batch is done
+            if ( !found )
+            {
+                return;
+            }
+
+            try
+            {
+                ( *set.job )( next );
+            }
+            catch ( ... )
+            {
+                std::lock_guard<std::mutex> guard( set.error_lock );
+                if ( !set.error )
+                {
+                    set.error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    bool thread_pool::pop( job_queue& queue, std::size_t& job )
+    {
+        std::lock_guard<std::mutex> guard( queue.lock );
+        if ( queue.jobs.empty() )
+        {
+            return false;
+        }
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+        return true;
+    }
+
+    bool thread_pool::steal( job_queue& queue, std::size_t& job )
+    {
+        std::lock_guard<std::mutex> guard( queue.lock );
+        if ( queue.jobs.empty() )
+        {
+            return false;
+        }
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+    }
+}
@@ -0,0 +1,194 @@
+#include "tone_mapping.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#define LS_TONE_MAPPING_SSE
+#endif
+
+namespace ls {
+    namespace {
+        constexpr float aces_a = 2.51f;
+        constexpr float aces_b = 0.03f;
+        constexpr float aces_c = 2.43f;
+        constexpr float aces_d = 0.59f;
+        constexpr float aces_e = 0.14f;
+
+        /**
+         * Rows are handed out to threads in batches of at least this many pixels, so that
+         * small images are not slowed down by starting threads
+         */
+        constexpr std::size_t pixels_per_job = 1 << 16;
+
+        std::size_t job_rows( std::size_t width ) noexcept
+        {
+            return std::max<std::size_t>( 1, pixels_per_job / std::max<std::size_t>( 1, width ) );
+        }
+
+        uint8_t encode_srgb( double linear ) noexcept
+        {
+            auto encoded = linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow( linear, 1.0 / 2.4 ) - 0.055;
+            return static_cast<uint8_t>( std::lround( clamp( encoded, 0.0, 1.0 ) * 255.0 ) );
+        }
+
+#if defined( LS_TONE_MAPPING_SSE )
+        template<tone_curve Curve>
+        inline __m128 apply_curve( __m128 v ) noexcept
+        {
+            if ( Curve == tone_curve::reinhard )
+            {
+                v = _mm_max_ps( v, _mm_setzero_ps() );
+                return _mm_div_ps( v, _mm_add_ps( v, _mm_set1_ps( 1.f ) ) );
+            }
+            if ( Curve == tone_curve::aces )
+            {
+                v = _mm_max_ps( v, _mm_setzero_ps() );
+                auto numerator = _mm_mul_ps( v, _mm_add_ps( _mm_mul_ps( v, _mm_set1_ps( aces_a ) ), _mm_set1_ps( aces_b ) ) );
+                auto denominator = _mm_add_ps( _mm_mul_ps( v, _mm_add_ps( _mm_mul_ps( v, _mm_set1_ps( aces_c ) ), _mm_set1_ps( aces_d ) ) ), _mm_set1_ps( aces_e ) );
+                return _mm_div_ps( numerator, denominator );
+            }
+            return v;
+        }
+#else
+        template<tone_curve Curve>
+        inline float apply_curve( float v ) noexcept
+        {
+            if ( Curve == tone_curve::reinhard )
+            {
+                v = std::max( v, 0.f );
+                return v / ( v + 1.f );
+            }
+            if ( Curve == tone_curve::aces )
+            {
+                v = std::max( v, 0.f );
+                return ( v * ( v * aces_a + aces_b ) ) / ( v * ( v * aces_c + aces_d ) + aces_e );
+            }
+            return v;
+        }
+#endif
+    }
+
+    tone_mapper::tone_mapper( float exposure, tone_curve curve, color_encoding encoding ) :
+        _exposure( exposure ), _curve( curve ), _encoding( encoding )
+    {
+        // Each entry encodes the linear value at its own position, which lookups round to
+        if ( encoding == color_encoding::srgb )
+        {
+            _srgb.resize( lut_size );
+            for ( std::size_t i = 0; i < lut_size; i++ )
+            {
+                _srgb[i] = encode_srgb( static_cast<double>( i ) / ( lut_size - 1 ) );
+            }
+        }
+    }
+
+    void tone_mapper::map_row( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) const noexcept
+    {
+        // Dispatching once per row keeps the per pixel loop free of branches
+        switch ( _curve )
+        {
+        case tone_curve::clamp:
+            _encoding == color_encoding::srgb ?
+                map_span<tone_curve::clamp, color_encoding::srgb>( pixels, count, rgb ) :
+                map_span<tone_curve::clamp, color_encoding::linear>( pixels, count, rgb );
+            break;
+        case tone_curve::reinhard:
+            _encoding == color_encoding::srgb ?
+                map_span<tone_curve::reinhard, color_encoding::srgb>( pixels, count, rgb ) :
+                map_span<tone_curve::reinhard, color_encoding::linear>( pixels, count, rgb );
+            break;
+        case tone_curve::aces:
+            _encoding == color_encoding::srgb ?
+                map_span<tone_curve::aces, color_encoding::srgb>( pixels, count, rgb ) :
+                map_span<tone_curve::aces, color_encoding::linear>( pixels, count, rgb );
+            break;
+        }
+    }
+
+    void tone_mapper::map_rows( const rgba_pixel* pixels, std::size_t stride, std::size_t width, std::size_t count, uint8_t* rgb ) const
+    {
+        auto rows_per_job = job_rows( width );
+        auto jobs = ( count + rows_per_job - 1 ) / rows_per_job;
+        thread_pool pool( jobs > 1 ? _threads : 1 );
+        map_rows( pixels, stride, width, count, rgb, pool );
+    }
+
+    void tone_mapper::map_rows( const rgba_pixel* pixels, std::size_t stride, std::size_t width, std::size_t count, uint8_t* rgb, thread_pool& pool ) const
+    {
+        auto rows_per_job = job_rows( width );
+        auto jobs = ( count + rows_per_job - 1 ) / rows_per_job;
+        pool.run( jobs, [&] ( std::size_t job ) {
+            auto last = std::min( count, ( job + 1 ) * rows_per_job );
+            for ( auto y = job * rows_per_job; y < last; y++ )
+            {
+                map_row( pixels + y * stride, width, rgb + 3 * y * width );
+            }
+        } );
+    }
+
+    std::vector<uint8_t> tone_mapper::map( const canvas& image ) const
+    {
+        std::vector<uint8_t> rgb( 3 * static_cast<std::size_t>( image.width() ) * image.height() );
+        map_rows( image.row( 0 ), image.row_stride(), image.width(), image.height(), rgb.data() );
+        return rgb;
+    }
+
+    template<tone_curve Curve, color_encoding Encoding>
+    void tone_mapper::map_span( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) const noexcept
+    {
+        const auto lut = _srgb.data();
+#if defined( LS_TONE_MAPPING_SSE )
+        const auto exposure = _mm_set1_ps( _exposure );
+        const auto zero = _mm_setzero_ps();
+        const auto one = _mm_set1_ps( 1.f );
+        const auto byte_scale = _mm_set1_ps( 256.f );
+        const auto byte_max = _mm_set1_ps( 255.f );
+        const auto lut_scale = _mm_set1_ps( static_cast<float>( lut_size - 1 ) );
+        const auto half = _mm_set1_ps( 0.5f );
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            // Pixels are 16 byte aligned, so each one is a single load. NaNs end up as 0,
+            // since max returns its second operand when either is not a number.
+            auto v = apply_curve<Curve>( _mm_mul_ps( _mm_load_ps( &pixels[i].r ), exposure ) );
+            uint32_t packed;
+            if ( Encoding == color_encoding::linear )
+            {
+                auto q = _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( _mm_mul_ps( v, byte_scale ), zero ), byte_max ) );
+                q = _mm_packs_epi32( q, q );
+                packed = static_cast<uint32_t>( _mm_cvtsi128_si32( _mm_packus_epi16( q, q ) ) );
+            }
+            else
+            {
+                alignas( 16 ) int32_t index[4];
+                _mm_store_si128( reinterpret_cast<__m128i*>( index ), _mm_cvttps_epi32(
+                    _mm_add_ps( _mm_mul_ps( _mm_min_ps( _mm_max_ps( v, zero ), one ), lut_scale ), half ) ) );
+                packed = lut[index[0]] | lut[index[1]] << 8 | static_cast<uint32_t>( lut[index[2]] ) << 16;
+            }
+            // Every pixel but the last may spill its fourth byte, as the next one overwrites it
+            std::memcpy( rgb + 3 * i, &packed, i + 1 < count ? 4 : 3 );
+        }
+#else
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            const float channels[3] = { pixels[i].r, pixels[i].g, pixels[i].b };
+            for ( std::size_t c = 0; c < 3; c++ )
+            {
+                auto v = apply_curve<Curve>( channels[c] * _exposure );
+                if ( Encoding == color_encoding::linear )
+                {
+                    // Written so that NaNs end up as 0, the same as with SSE
+                    auto scaled = v * 256.f;
+                    rgb[3 * i + c] = static_cast<uint8_t>( scaled > 0.f ? std::min( scaled, 255.f ) : 0.f );
+                }
+                else
+                {
+                    auto unit = v > 0.f ? std::min( v, 1.f ) : 0.f;
+                    rgb[3 * i + c] = lut[static_cast<std::size_t>( unit * ( lut_size - 1 ) + 0.5f )];
+                }
+            }
+        }
+#endif
+    }
+}
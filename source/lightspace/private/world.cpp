@@ -1,39 +1,60 @@
 #include "world.hpp"
 #include "lights.hpp"
 #include "ray.hpp"
+#include <algorithm>
 
 namespace ls {
-    void world::add_object( shape_ptr obj )
-    {
-        bool present = false;
-        for ( auto object : _objects )
+    namespace {
+        bool refracted_direction( const intersection_state& state, f_vector& direction )
         {
-            if ( object == obj )
+            // Check for total internal reflection using Snell's Law and a trig identity
+            auto ratio = state.ridx_from / state.ridx_to;
+            auto cos_i = state.eye.dot( state.normal );
+            auto sin2_t = ( ratio * ratio ) * ( 1 - cos_i * cos_i );
+            if ( sin2_t > 1 )
             {
-                present = true;
-                break;
+                return false;
             }
-        }
-        if ( !present )
-        {
-            _objects.push_back( obj );
+            auto cos_t = sqrt( 1.f - sin2_t );
+            direction = state.normal * ( ratio * cos_i - cos_t ) - state.eye * ratio;
+            return true;
         }
     }
 
-    void world::remove_object( shape_ptr obj )
+    void world::add_object( shape_ptr obj )
+    {
+        insert_object( obj );
+    }
+
+    void world::insert_object( const shape_ptr& obj )
     {
-        auto it = _objects.begin();
-        for ( ; it != _objects.end(); it++ )
+        if ( _object_set.insert( obj.get() ).second )
         {
-            if ( *it == obj )
+            _objects.push_back( obj );
+            _scene.reset();
+
+            // A shape counts its edits against the first world it is added to, which the
+            // other worlds holding it then watch as well
+            auto& counter = obj->_edits.counter;
+            if ( !counter )
+            {
+                counter = _edit_counters.front();
+            }
+            else if ( std::find( _edit_counters.begin(), _edit_counters.end(), counter ) == _edit_counters.end() )
             {
-                break;
+                _edit_counters.push_back( counter );
             }
         }
-        if ( it != _objects.end() )
+    }
+
+    void world::remove_object( shape_ptr obj )
+    {
+        if ( !obj || _object_set.erase( obj.get() ) == 0 )
         {
-            _objects.erase( it );
+            return;
         }
+        _objects.erase( std::find( _objects.begin(), _objects.end(), obj ) );
+        _scene.reset();
     }
 
     bool world::contains( const shape_ptr& s ) const
@@ -51,89 +72,322 @@ namespace ls {
     world_ptr world::create_default() noexcept
     {
         auto w = world::create();
-        w->_light = point_light::create( f_color( 1, 1, 1 ), f_point( -10, 10, -10 ) );
+        w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( -10, 10, -10 ) ) );
         auto s = sphere::create();
         s->set_material( phong_material::create( f_color( 0.8f, 1.f, 0.6f ), 0.1f, 0.7f, 0.2f ) );
-        w->_objects.push_back( s );
+        w->add_object( s );
         s = sphere::create();
         s->set_transform( transform::scale( 0.5f, 0.5f, 0.5f ) );
-        w->_objects.push_back( s );
+        w->add_object( s );
         return w;
     }
 
+    const arena_ptr& world::arena()
+    {
+        if ( !_arena )
+        {
+            _arena = std::make_shared<ls::arena>();
+        }
+        return _arena;
+    }
+
+    const render_scene_ptr& world::compile()
+    {
+        std::lock_guard<std::mutex> guard( _compile_lock.mutex );
+        return compile_scene();
+    }
+
+    const render_scene_ptr& world::prepare()
+    {
+        // Checking and compiling under one lock keeps cameras preparing together from both
+        // compiling, which would replace the scene while the first one renders it
+        std::lock_guard<std::mutex> guard( _compile_lock.mutex );
+        return scene_current() ? _scene : compile_scene();
+    }
+
+    const render_scene_ptr& world::compile_scene()
+    {
+        _scene_generation = edit_generation();
+        _scene = render_scene::compile( _objects );
+        return _scene;
+    }
+
+    f_color world::shade_hit( const intersection_state& state )
+    {
+        return shade_hit( state, _max_depth );
+    }
+
     f_color world::shade_hit( const intersection_state& state, uint8_t depth )
     {
-        auto shadowed = in_shadow( state.shifted_point );
-        auto surface = phong_lighting( state.object, state.object->material(), _light, state.shifted_point, state.eye, state.normal, shadowed );
-        auto reflected = reflected_color( state, depth );
-        auto refracted = refracted_color( state, depth );
-        
+        ray_stack stack;
+        auto surface = shade_surface( state, 1.f, depth, stack );
+        return surface + integrate( stack );
+    }
+
+    f_color world::reflected_color( const intersection_state& state )
+    {
+        return reflected_color( state, _max_depth );
+    }
+
+    f_color world::reflected_color( const intersection_state& state, uint8_t depth )
+    {
         const auto& mat = state.object->material();
-        if ( mat->reflectivity > 0.f && mat->transparency > 0.f )
+        if ( approx( mat->reflectivity, 0.f ) || depth <= 0 )
         {
-            auto reflectance = schlick( state );
-            return surface + reflected * reflectance + refracted * ( 1.f - reflectance );
+            return f_color( 0, 0, 0 );
         }
-        else
+        ray_stack stack;
+        push_ray( stack, ray( state.shifted_point, state.reflection ), mat->reflectivity, depth - 1 );
+        return integrate( stack );
+    }
+
+    f_color world::refracted_color( const intersection_state& state )
+    {
+        return refracted_color( state, _max_depth );
+    }
+
+    f_color world::refracted_color( const intersection_state& state, uint8_t depth )
+    {
+        const auto& mat = state.object->material();
+        f_vector direction;
+        if ( approx( mat->transparency, 0.f ) || depth <= 0 || !refracted_direction( state, direction ) )
         {
-            return surface + reflected + refracted;
+            return f_color( 0, 0, 0 );
         }
+        ray_stack stack;
+        push_ray( stack, ray( state.shifted_under_point, direction ), mat->transparency, depth - 1 );
+        return integrate( stack );
     }
 
-    f_color world::reflected_color( const intersection_state& state, uint8_t depth ) {
-        if ( approx( state.object->material()->reflectivity, 0.f ) || depth <= 0 )
+    f_color world::color_at( const ray& r )
+    {
+        return color_at( r, _max_depth );
+    }
+
+    f_color world::color_at( const ray& r, uint8_t depth )
+    {
+        ray_stack stack;
+        stack.push_back( traced_ray{ r, 1.f, depth } );
+        return integrate( stack );
+    }
+
+    bool world::in_shadow( const f_point& p )
+    {
+        return !_lights.empty() && in_shadow( p, _lights.front() );
+    }
+
+    bool world::in_shadow( const f_point& p, const light_ptr& l )
+    {
+        return occluded( p, l->position() );
+    }
+
+    fpnum world::light_visibility( const f_point& p, const light_ptr& l )
+    {
+        auto samples = l->samples();
+        if ( samples == 1 )
         {
-            return f_color( 0, 0, 0 );
+            return occluded( p, l->sample_point( 0, p ) ) ? 0.f : 1.f;
+        }
+
+        // Samples on opposite edges of the light are probed first. When both agree the point is
+        // assumed to be fully lit or fully shadowed and the interior is not sampled. Lights
+        // without two distinct rim samples, such as sphere lights of a single sector, are
+        // sampled in full.
+        auto rims = l->rim_samples();
+        uint32_t lit = 0;
+        if ( rims.first != rims.second )
+        {
+            auto first_blocked = occluded( p, l->sample_point( rims.first, p ) );
+            auto last_blocked = occluded( p, l->sample_point( rims.second, p ) );
+            if ( first_blocked == last_blocked )
+            {
+                return first_blocked ? 0.f : 1.f;
+            }
+            lit = 1;
         }
-        auto reflected_ray = ray( state.shifted_point, state.reflection );
-        auto col = color_at( reflected_ray, depth - 1 );
-        return col * state.object->material()->reflectivity;
+
+        // Sample points are generated as they are traced, so shading a point allocates nothing
+        for ( uint32_t i = 0; i < samples; i++ )
+        {
+            if ( rims.first != rims.second && ( i == rims.first || i == rims.second ) )
+            {
+                continue;
+            }
+            if ( !occluded( p, l->sample_point( i, p ) ) )
+            {
+                ++lit;
+            }
+        }
+        return static_cast<fpnum>( lit ) / samples;
     }
 
-    f_color world::refracted_color( const intersection_state& state, uint8_t depth ) {
-        if ( approx( state.object->material()->transparency, 0.f ) || depth <= 0 )
+    bool world::occluded( const f_point& p, const f_point& target )
+    {
+#if DEVELOPMENT
+        ++_stats.shadow_rays;
+#endif
+        auto to_target = target - p;
+        auto dist = to_target.length();
+        auto r = ray( p, to_target.normalized() );
+        if ( scene_current() )
         {
-            return f_color( 0, 0, 0 );
+            return _scene->occluded( r, dist );
         }
-        // Check for total internal reflection using Snell's Law and a trig identity
-        auto ratio = state.ridx_from / state.ridx_to;
-        auto cos_i = state.eye.dot( state.normal );
-        auto sin2_t = (ratio * ratio) * ( 1 - cos_i * cos_i );
-        if ( sin2_t > 1 )
+
+        // Any intersection between the point and the target occludes it, so there is no need
+        // to gather and sort every intersection along the ray
+        for ( const auto& object : _objects )
         {
-            return f_color( 0, 0, 0 );
+            for ( const auto& itr : intersect( unowned( object ), r ) )
+            {
+                if ( itr.time() >= 0 && itr.time() < dist )
+                {
+                    return true;
+                }
+            }
         }
-        // Get the new color using the refracted ray
-        auto cos_t = sqrt( 1.f - sin2_t );
-        auto direction = state.normal * ( ratio * cos_i - cos_t ) - state.eye * ratio;
-        auto refracted_ray = ray( state.shifted_under_point, direction );
-        auto col = color_at( refracted_ray, depth - 1 );
-        return col * state.object->material()->transparency;
+        return false;
     }
 
-    f_color world::color_at( const ray& r, uint8_t depth )
+    f_color world::integrate( ray_stack& stack )
     {
-        auto itrs = intersect( shared_from_this(), r );
-        auto h = hit( itrs );
-        if ( h == intersection::none )
+        // Secondary rays are traced depth-first from an explicit stack instead of recursing
+        // through color_at, so that each ray's contribution is its local shading scaled by
+        // the product of the weights along its path.
+        auto col = f_color( 0, 0, 0 );
+        while ( !stack.empty() )
         {
-            return f_color( 0, 0, 0 );
+            auto next = stack.back();
+            stack.pop_back();
+
+            intersection h;
+            intersections itrs;
+            if ( !find_hit( next.r, h, itrs ) )
+            {
+                continue;
+            }
+            auto state = prepare_intersection_state( h, next.r, itrs );
+            col = col + shade_surface( state, next.throughput, next.depth, stack );
         }
-        auto state = prepare_intersection_state( h, r );
-        return shade_hit( state, depth );
+        return col;
     }
 
-    bool world::in_shadow( const f_point& p )
+    f_color world::shade_surface( const intersection_state& state, fpnum throughput, uint8_t depth, ray_stack& stack )
+    {
+        auto surface = direct_lighting( state, throughput );
+
+        if ( depth > 0 )
+        {
+            const auto& mat = state.object->material();
+            auto reflect_weight = approx( mat->reflectivity, 0.f ) ? 0.f : mat->reflectivity;
+            auto refract_weight = approx( mat->transparency, 0.f ) ? 0.f : mat->transparency;
+            if ( reflect_weight > 0.f && refract_weight > 0.f )
+            {
+                auto reflectance = schlick( state );
+                reflect_weight *= reflectance;
+                refract_weight *= 1.f - reflectance;
+            }
+
+            if ( reflect_weight > 0.f )
+            {
+                push_ray( stack, ray( state.shifted_point, state.reflection ), throughput * reflect_weight, depth - 1 );
+            }
+
+            f_vector direction;
+            if ( refract_weight > 0.f && refracted_direction( state, direction ) )
+            {
+                push_ray( stack, ray( state.shifted_under_point, direction ), throughput * refract_weight, depth - 1 );
+            }
+        }
+
+        return surface * throughput;
+    }
+
+    f_color world::direct_lighting( const intersection_state& state, fpnum throughput )
     {
-        auto to_light = _light->position() - p;
-        auto dist = to_light.length();
-        auto dir = to_light.normalized();
+        const auto& mat = state.object->material();
+        auto surface_color = mat->surface_pattern->color_at( state.object, state.shifted_point );
+
+        auto col = f_color( 0, 0, 0 );
+        for ( const auto& l : _lights )
+        {
+            // Lights attenuated below what the current ray can contribute to the image are skipped
+            if ( l->has_falloff() )
+            {
+                auto intensity = l->intensity_at( ( l->position() - state.shifted_point ).length() );
+                if ( std::max( { intensity.r, intensity.g, intensity.b } ) * throughput < _min_throughput )
+                {
+                    continue;
+                }
+            }
+
+            auto terms = phong_lighting_terms( surface_color, mat, l, state.shifted_point, state.eye, state.normal );
+            col = col + terms.ambient;
+
+            // Occlusion only matters when the light adds diffuse or specular light, so lights
+            // behind the surface or materials without either term never cast a shadow ray
+#if DEVELOPMENT
+            _stats.light_samples += l->samples();
+#endif
+            if ( terms.has_direct() )
+            {
+                auto visibility = light_visibility( state.shifted_point, l );
+                if ( visibility > 0.f )
+                {
+                    col = col + terms.direct * visibility;
+                }
+            }
+        }
+        return col;
+    }
 
-        auto r = ray( p, dir );
-        auto itrs = intersect( shared_from_this(), r );
-        auto h = hit( itrs );
+    void world::push_ray( ray_stack& stack, const ray& r, fpnum throughput, uint8_t depth ) const
+    {
+        // Rays whose contribution can no longer be noticed in the final image are culled
+        if ( throughput > 0.f && throughput >= _min_throughput )
+        {
+            stack.push_back( traced_ray{ r, throughput, depth } );
+        }
+    }
 
-        return h != intersection::none && h.time() < dist;
+    bool world::find_hit( const ray& r, intersection& h, intersections& itrs ) const
+    {
+        // A scene compiled before its shapes were edited no longer matches them
+        if ( !scene_current() )
+        {
+            itrs = intersect_objects( r );
+            h = hit( itrs );
+            return h != intersection::none;
+        }
+
+        render_scene::hit_record record;
+        if ( !_scene->closest_hit( r, record ) )
+        {
+            return false;
+        }
+        h = intersection( record.time, record.object );
+
+        // Only transparent surfaces need the intersections around the hit to find the
+        // refractive indices on either side of it
+        if ( !approx( record.object->material()->transparency, 0.f ) )
+        {
+            itrs = _scene->intersect( r );
+        }
+        return true;
+    }
+
+    intersections world::intersect_objects( const ray& r ) const
+    {
+        intersections itrs;
+        for ( const shape_ptr& object : _objects )
+        {
+            auto object_itrs = intersect( unowned( object ), r );
+            itrs.insert( itrs.end(), object_itrs.begin(), object_itrs.end() );
+        }
+        std::sort( itrs.begin(), itrs.end(), [] ( const intersection& i1, const intersection& i2 ) {
+            return i1.time() < i2.time();
+        } );
+        return itrs;
     }
 
     intersections intersect( const world_ptr& w, const ray& r )
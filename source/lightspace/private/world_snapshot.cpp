@@ -0,0 +1,1127 @@
+#include "world_snapshot.hpp"
+#include "world.hpp"
+#include "camera.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "materials.hpp"
+#include "patterns.hpp"
+#include "mesh.hpp"
+#include "render_scene.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace ls {
+    namespace {
+        constexpr char snapshot_magic[8] = { 'L', 'S', 'W', 'O', 'R', 'L', 'D', 0 };
+        constexpr uint32_t snapshot_version = 1;
+        constexpr std::size_t table_alignment = 64;
+        constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+        /**
+         * Shapes are created in batches of this many per job, each job allocating from an
+         * arena of its own
+         */
+        constexpr std::size_t shapes_per_job = 1 << 14;
+
+        /**
+         * Deeper hierarchies than this could overflow the traversal stack of a render scene
+         */
+        constexpr uint32_t max_node_depth = 60;
+
+        enum snapshot_table : uint32_t
+        {
+            patterns_table, materials_table, meshes_table, mesh_positions_table, mesh_uvs_table, mesh_normals_table,
+            mesh_corners_table, mesh_quantized_table, shapes_table, names_table, lights_table,
+            primitive_types_table, primitive_slots_table, primitive_materials_table, primitive_objects_table, scene_materials_table,
+            sphere_transforms_table, sphere_origins_table, plane_transforms_table, cube_transforms_table,
+            cylinder_transforms_table, cylinder_min_table, cylinder_max_table, cylinder_closed_table,
+            cone_transforms_table, cone_min_table, cone_max_table, cone_closed_table,
+            triangle_p1_table, triangle_e1_table, triangle_e2_table,
+            mesh_triangle_sources_table, mesh_triangle_indices_table, mesh_triangle_transforms_table, mesh_triangle_matrices_table,
+            nodes_table, leaf_primitives_table, unbounded_table,
+            table_count
+        };
+
+        static_assert( std::is_trivially_copyable<f4_matrix>::value, "Matrices are stored as they are laid out in memory" );
+
+        struct snapshot_camera
+        {
+            uint16_t width;
+            uint16_t height;
+            uint16_t threads;
+            uint16_t tile_size;
+            fpnum field_of_view;
+            f4_matrix transform;
+        };
+
+        /**
+         * The start of a snapshot. Values are stored as fpnum, so a snapshot can only be
+         * restored by a build of the same precision. Each table starts on a cache line.
+         */
+        struct snapshot_header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t fpnum_size;
+            uint32_t has_camera;
+            uint32_t max_depth;
+            fpnum min_throughput;
+            snapshot_camera camera;
+            uint64_t offsets[table_count];
+            uint64_t counts[table_count];
+            uint64_t element_sizes[table_count];
+        };
+
+        enum class pattern_kind : uint32_t
+        {
+            solid, stripe, gradient, ring, checker, test
+        };
+
+        struct snapshot_pattern
+        {
+            pattern_kind kind;
+            fpnum first[3];
+            fpnum second[3];
+            f4_matrix transform;
+        };
+
+        struct snapshot_material
+        {
+            uint32_t pattern;
+            fpnum ambient;
+            fpnum diffuse;
+            fpnum specular;
+            fpnum shininess;
+            fpnum reflectivity;
+            fpnum transparency;
+            fpnum refractive_index;
+        };
+
+        /**
+         * Where a mesh's streams start in the mesh tables, which hold every mesh one after
+         * another
+         */
+        struct snapshot_mesh
+        {
+            uint64_t first_position;
+            uint64_t position_count;
+            uint64_t first_uv;
+            uint64_t uv_count;
+            uint64_t first_normal;
+            uint64_t normal_count;
+            uint64_t first_corner;
+            uint64_t corner_count;
+            uint64_t first_quantized;
+            uint64_t quantized_count;
+            fpnum quantization_origin[3];
+            fpnum quantization_step[3];
+        };
+
+        enum class shape_kind : uint8_t
+        {
+            group, sphere, plane, cube, cylinder, cone, triangle, mesh_triangle
+        };
+
+        /**
+         * A shape and its parent, which comes before it. Spheres keep their radius in the
+         * first parameter, cylinders and cones their extents and triangles their corners.
+         */
+        struct snapshot_shape
+        {
+            shape_kind kind;
+            uint8_t closed;
+            uint32_t parent;
+            uint32_t material;
+            uint32_t mesh;
+            uint32_t index;
+            uint32_t name_size;
+            uint64_t name_offset;
+            fpnum origin[3];
+            fpnum params[9];
+            f4_matrix transform;
+            f4_matrix inverse_transform;
+        };
+
+        enum class light_kind : uint32_t
+        {
+            point, rectangle, sphere
+        };
+
+        /**
+         * Rectangle lights keep their corner in position, sphere lights their center
+         */
+        struct snapshot_light
+        {
+            light_kind kind;
+            uint16_t usteps;
+            uint16_t vsteps;
+            uint32_t jitter;
+            fpnum intensity[3];
+            fpnum position[3];
+            fpnum falloff[3];
+            fpnum uvec[3];
+            fpnum vvec[3];
+            fpnum radius;
+        };
+
+        template<typename T>
+        void store_xyz( fpnum* out, const T& t ) noexcept
+        {
+            out[0] = t.x;
+            out[1] = t.y;
+            out[2] = t.z;
+        }
+
+        std::size_t align_table( std::size_t offset ) noexcept
+        {
+            return ( offset + table_alignment - 1 ) / table_alignment * table_alignment;
+        }
+
+        /**
+         * A table to be written, copied into the file by fill
+         */
+        struct table_source
+        {
+            uint64_t count{ 0 };
+            std::size_t element_size{ 1 };
+            std::function<void( uint8_t* )> fill;
+        };
+
+        template<typename T>
+        table_source raw_table( const std::vector<T>& v )
+        {
+            static_assert( std::is_trivially_copyable<T>::value, "Raw tables are copied as they are laid out in memory" );
+            return table_source{ v.size(), sizeof( T ), [&v] ( uint8_t* out ) {
+                if ( !v.empty() )
+                {
+                    std::memcpy( out, v.data(), v.size() * sizeof( T ) );
+                }
+            } };
+        }
+
+        /**
+         * Points and vectors are stored as their three coordinates
+         */
+        template<typename T>
+        table_source xyz_table( const std::vector<T>& v )
+        {
+            return table_source{ v.size(), 3 * sizeof( fpnum ), [&v] ( uint8_t* out ) {
+                for ( const auto& t : v )
+                {
+                    fpnum xyz[3];
+                    store_xyz( xyz, t );
+                    std::memcpy( out, xyz, sizeof( xyz ) );
+                    out += sizeof( xyz );
+                }
+            } };
+        }
+
+        /**
+         * Gives every pattern, material, mesh and shape reachable from a world an index into
+         * its table, storing each of them once
+         */
+        class snapshot_builder
+        {
+        public:
+
+            std::vector<snapshot_pattern> patterns;
+            std::vector<snapshot_material> materials;
+            std::vector<snapshot_mesh> meshes;
+            std::vector<const mesh*> mesh_sources;
+            std::vector<snapshot_shape> shapes;
+            std::vector<snapshot_light> lights;
+            std::vector<char> names;
+            std::unordered_map<const shape*, uint32_t> shape_ids;
+
+        public:
+
+            uint32_t pattern_index( const pattern_ptr& p )
+            {
+                if ( !p )
+                {
+                    throw std::runtime_error( "World snapshots cannot store materials without a pattern" );
+                }
+                auto inserted = _pattern_ids.emplace( p.get(), static_cast<uint32_t>( patterns.size() ) );
+                if ( !inserted.second )
+                {
+                    return inserted.first->second;
+                }
+                snapshot_pattern record{};
+                record.transform = p->transform();
+                const auto& type = typeid( *p );
+                if ( type == typeid( solid_pattern ) )
+                {
+                    record.kind = pattern_kind::solid;
+                    store_xyz( record.first, rgb( static_cast<const solid_pattern&>( *p ).color() ) );
+                }
+                else if ( type == typeid( stripe_pattern ) )
+                {
+                    store_colors( record, pattern_kind::stripe, static_cast<const stripe_pattern&>( *p ) );
+                }
+                else if ( type == typeid( gradient_pattern ) )
+                {
+                    store_colors( record, pattern_kind::gradient, static_cast<const gradient_pattern&>( *p ) );
+                }
+                else if ( type == typeid( ring_pattern ) )
+                {
+                    store_colors( record, pattern_kind::ring, static_cast<const ring_pattern&>( *p ) );
+                }
+                else if ( type == typeid( checker_pattern ) )
+                {
+                    store_colors( record, pattern_kind::checker, static_cast<const checker_pattern&>( *p ) );
+                }
+                else if ( type == typeid( test_pattern ) )
+                {
+                    record.kind = pattern_kind::test;
+                }
+                else
+                {
+                    throw std::runtime_error( "World snapshots cannot store custom patterns" );
+                }
+                patterns.push_back( record );
+                return inserted.first->second;
+            }
+
+            uint32_t material_index( const phong_material_ptr& m )
+            {
+                if ( !m )
+                {
+                    throw std::runtime_error( "World snapshots cannot store shapes without a material" );
+                }
+                auto found = _material_ids.find( m.get() );
+                if ( found != _material_ids.end() )
+                {
+                    return found->second;
+                }
+                auto record = snapshot_material{ pattern_index( m->surface_pattern ), m->ambient, m->diffuse, m->specular, m->shininess,
+                    m->reflectivity, m->transparency, m->refractive_index };
+                auto index = static_cast<uint32_t>( materials.size() );
+                materials.push_back( record );
+                _material_ids.emplace( m.get(), index );
+                return index;
+            }
+
+            uint32_t mesh_index( const mesh* m )
+            {
+                auto inserted = _mesh_ids.emplace( m, static_cast<uint32_t>( meshes.size() ) );
+                if ( inserted.second )
+                {
+                    snapshot_mesh record{};
+                    const auto* last = meshes.empty() ? &record : &meshes.back();
+                    record.first_position = last->first_position + last->position_count;
+                    record.position_count = m->positions.size();
+                    record.first_uv = last->first_uv + last->uv_count;
+                    record.uv_count = m->uvs.size();
+                    record.first_normal = last->first_normal + last->normal_count;
+                    record.normal_count = m->normals.size();
+                    record.first_corner = last->first_corner + last->corner_count;
+                    record.corner_count = m->corners.size();
+                    record.first_quantized = last->first_quantized + last->quantized_count;
+                    record.quantized_count = m->quantized_positions.size();
+                    store_xyz( record.quantization_origin, m->quantization_origin );
+                    store_xyz( record.quantization_step, m->quantization_step );
+                    meshes.push_back( record );
+                    mesh_sources.push_back( m );
+                }
+                return inserted.first->second;
+            }
+
+            void add_shape( const shape_ptr& s, uint32_t parent )
+            {
+                auto index = static_cast<uint32_t>( shapes.size() );
+                if ( !shape_ids.emplace( s.get(), index ).second )
+                {
+                    throw std::runtime_error( "World snapshots cannot store a shape more than once" );
+                }
+
+                snapshot_shape record{};
+                record.parent = parent;
+                record.material = material_index( s->material() );
+                record.mesh = none;
+                record.transform = s->transform();
+                record.inverse_transform = s->inverse_transform();
+                store_xyz( record.origin, s->origin() );
+
+                const auto& type = typeid( *s );
+                const group* grp = nullptr;
+                if ( type == typeid( group ) )
+                {
+                    grp = static_cast<const group*>( s.get() );
+                    record.kind = shape_kind::group;
+                    record.name_offset = names.size();
+                    record.name_size = static_cast<uint32_t>( grp->name().size() );
+                    names.insert( names.end(), grp->name().begin(), grp->name().end() );
+                }
+                else if ( type == typeid( sphere ) )
+                {
+                    record.kind = shape_kind::sphere;
+                    record.params[0] = static_cast<const sphere&>( *s ).radius();
+                }
+                else if ( type == typeid( plane ) )
+                {
+                    record.kind = shape_kind::plane;
+                }
+                else if ( type == typeid( cube ) )
+                {
+                    record.kind = shape_kind::cube;
+                }
+                else if ( type == typeid( cylinder ) )
+                {
+                    const auto& cyl = static_cast<const cylinder&>( *s );
+                    record.kind = shape_kind::cylinder;
+                    record.params[0] = cyl.min_extent();
+                    record.params[1] = cyl.max_extent();
+                    record.closed = cyl.closed();
+                }
+                else if ( type == typeid( cone ) )
+                {
+                    const auto& cn = static_cast<const cone&>( *s );
+                    record.kind = shape_kind::cone;
+                    record.params[0] = cn.min_extent();
+                    record.params[1] = cn.max_extent();
+                    record.closed = cn.closed();
+                }
+                else if ( type == typeid( triangle ) )
+                {
+                    const auto& tr = static_cast<const triangle&>( *s );
+                    record.kind = shape_kind::triangle;
+                    store_xyz( record.params, tr.p1() );
+                    store_xyz( record.params + 3, tr.p2() );
+                    store_xyz( record.params + 6, tr.p3() );
+                }
+                else if ( type == typeid( mesh_triangle ) )
+                {
+                    const auto& mt = static_cast<const mesh_triangle&>( *s );
+                    record.kind = shape_kind::mesh_triangle;
+                    record.mesh = mesh_index( mt.source_mesh().get() );
+                    record.index = mt.index();
+                }
+                else
+                {
+                    throw std::runtime_error( "World snapshots cannot store custom shapes" );
+                }
+                shapes.push_back( record );
+
+                if ( grp )
+                {
+                    for ( const auto& child : grp->children() )
+                    {
+                        add_shape( child, index );
+                    }
+                }
+            }
+
+            void add_light( const light_ptr& l )
+            {
+                snapshot_light record{};
+                store_xyz( record.intensity, rgb( l->intensity() ) );
+                store_xyz( record.position, l->position() );
+                record.falloff[0] = l->constant_falloff();
+                record.falloff[1] = l->linear_falloff();
+                record.falloff[2] = l->quadratic_falloff();
+                record.usteps = record.vsteps = 1;
+                const auto& type = typeid( *l );
+                if ( type == typeid( point_light ) )
+                {
+                    record.kind = light_kind::point;
+                }
+                else if ( type == typeid( rectangle_light ) )
+                {
+                    const auto& rect = static_cast<const rectangle_light&>( *l );
+                    record.kind = light_kind::rectangle;
+                    store_area( record, rect );
+                    store_xyz( record.position, rect.corner() );
+                    store_xyz( record.uvec, rect.uvec() );
+                    store_xyz( record.vvec, rect.vvec() );
+                }
+                else if ( type == typeid( sphere_light ) )
+                {
+                    const auto& sph = static_cast<const sphere_light&>( *l );
+                    record.kind = light_kind::sphere;
+                    store_area( record, sph );
+                    record.radius = sph.radius();
+                }
+                else
+                {
+                    throw std::runtime_error( "World snapshots cannot store custom lights" );
+                }
+                lights.push_back( record );
+            }
+
+        private:
+
+            /**
+             * Colors have r, g and b rather than x, y and z
+             */
+            struct xyz_color
+            {
+                fpnum x;
+                fpnum y;
+                fpnum z;
+            };
+
+            std::unordered_map<const pattern*, uint32_t> _pattern_ids;
+            std::unordered_map<const phong_material*, uint32_t> _material_ids;
+            std::unordered_map<const mesh*, uint32_t> _mesh_ids;
+
+        private:
+
+            static xyz_color rgb( const f_color& c ) noexcept
+            {
+                return xyz_color{ c.r, c.g, c.b };
+            }
+
+            template<typename P>
+            static void store_colors( snapshot_pattern& record, pattern_kind kind, const P& p ) noexcept
+            {
+                record.kind = kind;
+                store_xyz( record.first, rgb( p.first() ) );
+                store_xyz( record.second, rgb( p.second() ) );
+            }
+
+            static void store_area( snapshot_light& record, const area_light& l ) noexcept
+            {
+                record.usteps = l.usteps();
+                record.vsteps = l.vsteps();
+                record.jitter = l.jitter();
+            }
+        };
+
+        /**
+         * A mapped snapshot whose header and table bounds have been checked
+         */
+        class snapshot_reader
+        {
+        public:
+
+            explicit snapshot_reader( const std::string& file ) :
+                _file( file )
+            {
+                _file.advise_sequential();
+                auto size = _file.size();
+                bool valid = size >= sizeof( _header );
+                if ( valid )
+                {
+                    std::memcpy( &_header, _file.data(), sizeof( _header ) );
+                    valid = std::memcmp( _header.magic, snapshot_magic, sizeof( snapshot_magic ) ) == 0 &&
+                        _header.version == snapshot_version && _header.fpnum_size == sizeof( fpnum );
+                    for ( uint32_t t = 0; valid && t < table_count; t++ )
+                    {
+                        auto element_size = _header.element_sizes[t];
+                        valid = element_size > 0 && _header.offsets[t] <= size && _header.counts[t] <= ( size - _header.offsets[t] ) / element_size;
+                    }
+                }
+                if ( !valid )
+                {
+                    throw std::runtime_error( "Not a world snapshot" );
+                }
+            }
+
+            const snapshot_header& header() const noexcept
+            {
+                return _header;
+            }
+
+            std::size_t count( snapshot_table t ) const noexcept
+            {
+                return static_cast<std::size_t>( _header.counts[t] );
+            }
+
+            template<typename T>
+            T record( snapshot_table t, std::size_t i ) const
+            {
+                T value;
+                std::memcpy( &value, at( t, sizeof( T ) ) + sizeof( T ) * i, sizeof( T ) );
+                return value;
+            }
+
+            /**
+             * Copies count elements of the table from first on into out
+             */
+            template<typename T>
+            void read( snapshot_table t, std::vector<T>& out, std::size_t first = 0, std::size_t count = none ) const
+            {
+                check_range( t, first, count );
+                out.resize( count );
+                if ( count > 0 )
+                {
+                    std::memcpy( out.data(), at( t, sizeof( T ) ) + sizeof( T ) * first, count * sizeof( T ) );
+                }
+            }
+
+            template<typename T>
+            void read_xyz( snapshot_table t, std::vector<T>& out, std::size_t first = 0, std::size_t count = none ) const
+            {
+                check_range( t, first, count );
+                auto data = at( t, 3 * sizeof( fpnum ) ) + 3 * sizeof( fpnum ) * first;
+                out.clear();
+                out.reserve( count );
+                for ( std::size_t i = 0; i < count; i++ )
+                {
+                    fpnum xyz[3];
+                    std::memcpy( xyz, data + sizeof( xyz ) * i, sizeof( xyz ) );
+                    out.emplace_back( xyz[0], xyz[1], xyz[2] );
+                }
+            }
+
+            const char* chars( snapshot_table t ) const
+            {
+                return reinterpret_cast<const char*>( at( t, 1 ) );
+            }
+
+        private:
+
+            mapped_file _file;
+            snapshot_header _header{};
+
+        private:
+
+            const uint8_t* at( snapshot_table t, std::size_t element_size ) const
+            {
+                if ( _header.element_sizes[t] != element_size )
+                {
+                    throw std::runtime_error( "Not a world snapshot" );
+                }
+                return _file.data() + _header.offsets[t];
+            }
+
+            void check_range( snapshot_table t, std::size_t first, std::size_t& count ) const
+            {
+                auto size = this->count( t );
+                if ( count == none )
+                {
+                    count = size;
+                }
+                if ( first > size || count > size - first )
+                {
+                    throw std::runtime_error( "World snapshot index out of range" );
+                }
+            }
+        };
+
+        void check_index( bool in_range )
+        {
+            if ( !in_range )
+            {
+                throw std::runtime_error( "World snapshot index out of range" );
+            }
+        }
+
+        f_color load_color( const fpnum* c ) noexcept
+        {
+            return f_color( c[0], c[1], c[2] );
+        }
+
+        f_point load_point( const fpnum* p ) noexcept
+        {
+            return f_point( p[0], p[1], p[2] );
+        }
+
+        f_vector load_vector( const fpnum* v ) noexcept
+        {
+            return f_vector( v[0], v[1], v[2] );
+        }
+
+        pattern_ptr restore_pattern( const snapshot_pattern& record )
+        {
+            auto first = load_color( record.first );
+            auto second = load_color( record.second );
+            pattern_ptr p;
+            switch ( record.kind )
+            {
+            case pattern_kind::solid: p = solid_pattern::create( first ); break;
+            case pattern_kind::stripe: p = stripe_pattern::create( first, second ); break;
+            case pattern_kind::gradient: p = gradient_pattern::create( first, second ); break;
+            case pattern_kind::ring: p = ring_pattern::create( first, second ); break;
+            case pattern_kind::checker: p = checker_pattern::create( first, second ); break;
+            case pattern_kind::test: p = test_pattern::create(); break;
+            default: throw std::runtime_error( "Not a world snapshot" );
+            }
+            p->set_transform( record.transform );
+            return p;
+        }
+
+        mesh_ptr restore_mesh( const snapshot_reader& in, const snapshot_mesh& record )
+        {
+            auto m = mesh::create();
+            in.read_xyz( mesh_positions_table, m->positions, record.first_position, record.position_count );
+            in.read( mesh_uvs_table, m->uvs, record.first_uv, record.uv_count );
+            in.read_xyz( mesh_normals_table, m->normals, record.first_normal, record.normal_count );
+            in.read( mesh_corners_table, m->corners, record.first_corner, record.corner_count );
+            in.read( mesh_quantized_table, m->quantized_positions, record.first_quantized, record.quantized_count );
+            m->quantization_origin = load_point( record.quantization_origin );
+            m->quantization_step = load_vector( record.quantization_step );
+            check_index( m->corners.size() % 3 == 0 && ( m->positions.empty() || m->quantized_positions.empty() ) );
+            for ( const auto& c : m->corners )
+            {
+                check_index( c.position < m->vertex_count() && ( c.uv == mesh::missing || c.uv < m->uvs.size() ) &&
+                    ( c.normal == mesh::missing || c.normal < m->normals.size() ) );
+            }
+            return m;
+        }
+
+        shape_ptr restore_shape( const snapshot_shape& record, const std::vector<mesh_ptr>& meshes, const char* names )
+        {
+            shape_ptr s;
+            switch ( record.kind )
+            {
+            case shape_kind::group:
+                s = group::create( std::string( names + record.name_offset, record.name_size ) );
+                break;
+            case shape_kind::sphere:
+                s = sphere::create( load_point( record.origin ), record.params[0] );
+                break;
+            case shape_kind::plane:
+                s = plane::create();
+                break;
+            case shape_kind::cube:
+                s = cube::create();
+                break;
+            case shape_kind::cylinder:
+            {
+                auto cyl = cylinder::create( record.params[0], record.params[1] );
+                cyl->set_closed( record.closed != 0 );
+                s = cyl;
+                break;
+            }
+            case shape_kind::cone:
+            {
+                auto cn = cone::create( record.params[0], record.params[1] );
+                cn->set_closed( record.closed != 0 );
+                s = cn;
+                break;
+            }
+            case shape_kind::triangle:
+                s = triangle::create( load_point( record.params ), load_point( record.params + 3 ), load_point( record.params + 6 ) );
+                break;
+            case shape_kind::mesh_triangle:
+                s = mesh_triangle::create( meshes[record.mesh], record.index );
+                break;
+            }
+            s->set_transform( record.transform, record.inverse_transform );
+            return s;
+        }
+
+        light_ptr restore_light( const snapshot_light& record )
+        {
+            auto intensity = load_color( record.intensity );
+            light_ptr l;
+            area_light_ptr area;
+            switch ( record.kind )
+            {
+            case light_kind::point:
+                l = point_light::create( intensity, load_point( record.position ) );
+                break;
+            case light_kind::rectangle:
+                l = area = rectangle_light::create( intensity, load_point( record.position ), load_vector( record.uvec ), record.usteps,
+                    load_vector( record.vvec ), record.vsteps );
+                break;
+            case light_kind::sphere:
+                l = area = sphere_light::create( intensity, load_point( record.position ), record.radius, record.usteps, record.vsteps );
+                break;
+            default:
+                throw std::runtime_error( "Not a world snapshot" );
+            }
+            if ( area )
+            {
+                area->set_jitter( record.jitter != 0 );
+            }
+            l->set_falloff( record.falloff[0], record.falloff[1], record.falloff[2] );
+            return l;
+        }
+    }
+
+    void world_snapshot::write( const std::string& file, const world_ptr& w, const camera_ptr& cam )
+    {
+        // A scene compiled before its shapes were edited no longer matches them
+        const auto& scene = w->prepare();
+
+        snapshot_builder b;
+        for ( const auto& object : w->objects() )
+        {
+            b.add_shape( object, none );
+        }
+        for ( const auto& l : w->lights() )
+        {
+            b.add_light( l );
+        }
+
+        // The scene refers to shapes, materials and meshes by their index in the tables
+        std::vector<uint32_t> objects;
+        objects.reserve( scene->_objects.size() );
+        for ( const auto& object : scene->_objects )
+        {
+            auto found = b.shape_ids.find( object.get() );
+            if ( found == b.shape_ids.end() )
+            {
+                throw std::runtime_error( "The world's scene is out of date, compile it before writing a snapshot" );
+            }
+            objects.push_back( found->second );
+        }
+        std::vector<uint32_t> scene_materials;
+        for ( const auto& m : scene->_materials )
+        {
+            scene_materials.push_back( b.material_index( m ) );
+        }
+        std::vector<uint32_t> sources;
+        for ( auto m : scene->_mesh_triangles.source )
+        {
+            sources.push_back( b.mesh_index( m ) );
+        }
+
+        const auto& meshes = b.mesh_sources;
+        auto total = [&meshes] ( const std::function<std::size_t( const mesh& )>& size ) {
+            uint64_t sum = 0;
+            for ( auto m : meshes )
+            {
+                sum += size( *m );
+            }
+            return sum;
+        };
+
+        std::array<table_source, table_count> tables;
+        tables[patterns_table] = raw_table( b.patterns );
+        tables[materials_table] = raw_table( b.materials );
+        tables[meshes_table] = raw_table( b.meshes );
+        tables[mesh_positions_table] = table_source{ total( [] ( const mesh& m ) { return m.positions.size(); } ), 3 * sizeof( fpnum ),
+            [&meshes] ( uint8_t* out ) {
+                for ( auto m : meshes )
+                {
+                    xyz_table( m->positions ).fill( out );
+                    out += 3 * sizeof( fpnum ) * m->positions.size();
+                }
+            } };
+        tables[mesh_uvs_table] = table_source{ total( [] ( const mesh& m ) { return m.uvs.size(); } ), sizeof( texture_uv ),
+            [&meshes] ( uint8_t* out ) {
+                for ( auto m : meshes )
+                {
+                    raw_table( m->uvs ).fill( out );
+                    out += sizeof( texture_uv ) * m->uvs.size();
+                }
+            } };
+        tables[mesh_normals_table] = table_source{ total( [] ( const mesh& m ) { return m.normals.size(); } ), 3 * sizeof( fpnum ),
+            [&meshes] ( uint8_t* out ) {
+                for ( auto m : meshes )
+                {
+                    xyz_table( m->normals ).fill( out );
+                    out += 3 * sizeof( fpnum ) * m->normals.size();
+                }
+            } };
+        tables[mesh_corners_table] = table_source{ total( [] ( const mesh& m ) { return m.corners.size(); } ), sizeof( mesh::corner ),
+            [&meshes] ( uint8_t* out ) {
+                for ( auto m : meshes )
+                {
+                    raw_table( m->corners ).fill( out );
+                    out += sizeof( mesh::corner ) * m->corners.size();
+                }
+            } };
+        tables[mesh_quantized_table] = table_source{ total( [] ( const mesh& m ) { return m.quantized_positions.size(); } ),
+            sizeof( mesh::quantized_position ), [&meshes] ( uint8_t* out ) {
+                for ( auto m : meshes )
+                {
+                    raw_table( m->quantized_positions ).fill( out );
+                    out += sizeof( mesh::quantized_position ) * m->quantized_positions.size();
+                }
+            } };
+        tables[shapes_table] = raw_table( b.shapes );
+        tables[names_table] = raw_table( b.names );
+        tables[lights_table] = raw_table( b.lights );
+        tables[primitive_types_table] = raw_table( scene->_types );
+        tables[primitive_slots_table] = raw_table( scene->_slots );
+        tables[primitive_materials_table] = raw_table( scene->_material_indices );
+        tables[primitive_objects_table] = raw_table( objects );
+        tables[scene_materials_table] = raw_table( scene_materials );
+        tables[sphere_transforms_table] = raw_table( scene->_spheres.world_to_object );
+        tables[sphere_origins_table] = xyz_table( scene->_spheres.origin );
+        tables[plane_transforms_table] = raw_table( scene->_planes.world_to_object );
+        tables[cube_transforms_table] = raw_table( scene->_cubes.world_to_object );
+        tables[cylinder_transforms_table] = raw_table( scene->_cylinders.world_to_object );
+        tables[cylinder_min_table] = raw_table( scene->_cylinders.min_extent );
+        tables[cylinder_max_table] = raw_table( scene->_cylinders.max_extent );
+        tables[cylinder_closed_table] = raw_table( scene->_cylinders.closed );
+        tables[cone_transforms_table] = raw_table( scene->_cones.world_to_object );
+        tables[cone_min_table] = raw_table( scene->_cones.min_extent );
+        tables[cone_max_table] = raw_table( scene->_cones.max_extent );
+        tables[cone_closed_table] = raw_table( scene->_cones.closed );
+        tables[triangle_p1_table] = xyz_table( scene->_triangles.p1 );
+        tables[triangle_e1_table] = xyz_table( scene->_triangles.e1 );
+        tables[triangle_e2_table] = xyz_table( scene->_triangles.e2 );
+        tables[mesh_triangle_sources_table] = raw_table( sources );
+        tables[mesh_triangle_indices_table] = raw_table( scene->_mesh_triangles.index );
+        tables[mesh_triangle_transforms_table] = raw_table( scene->_mesh_triangles.transform );
+        tables[mesh_triangle_matrices_table] = raw_table( scene->_mesh_triangles.world_to_object );
+        tables[nodes_table] = raw_table( scene->_nodes );
+        tables[leaf_primitives_table] = raw_table( scene->_leaf_primitives );
+        tables[unbounded_table] = raw_table( scene->_unbounded );
+
+        snapshot_header header{};
+        std::memcpy( header.magic, snapshot_magic, sizeof( snapshot_magic ) );
+        header.version = snapshot_version;
+        header.fpnum_size = sizeof( fpnum );
+        header.max_depth = w->max_depth();
+        header.min_throughput = w->min_throughput();
+        if ( cam )
+        {
+            header.has_camera = 1;
+            header.camera = snapshot_camera{ cam->width(), cam->height(), cam->threads(), cam->tile_size(), cam->field_of_view(), cam->transform() };
+        }
+        std::size_t size = align_table( sizeof( header ) );
+        for ( uint32_t t = 0; t < table_count; t++ )
+        {
+            header.offsets[t] = size;
+            header.counts[t] = tables[t].count;
+            header.element_sizes[t] = tables[t].element_size;
+            size = align_table( size + tables[t].count * tables[t].element_size );
+        }
+
+        // The snapshot only takes the file's name once it is complete, so a write that fails
+        // part way leaves any earlier snapshot in place rather than a truncated one
+        const auto partial = file + ".partial";
+        try
+        {
+            mapped_file out( partial, size );
+            std::memcpy( out.data(), &header, sizeof( header ) );
+            for ( uint32_t t = 0; t < table_count; t++ )
+            {
+                tables[t].fill( out.data() + header.offsets[t] );
+            }
+            out.sync();
+        }
+        catch ( ... )
+        {
+            std::remove( partial.c_str() );
+            throw;
+        }
+        if ( std::rename( partial.c_str(), file.c_str() ) != 0 )
+        {
+            auto error = errno;
+            std::remove( partial.c_str() );
+            throw std::system_error( error, std::generic_category(), "Could not write " + file );
+        }
+    }
+
+    world_snapshot world_snapshot::load( const std::string& file, uint16_t threads )
+    {
+        snapshot_reader in( file );
+        const auto& header = in.header();
+
+        world_snapshot snapshot;
+        auto w = snapshot.world = world::create();
+        const auto& a = w->arena();
+        arena_scope scope( a );
+
+        std::vector<pattern_ptr> patterns;
+        for ( std::size_t i = 0; i < in.count( patterns_table ); i++ )
+        {
+            patterns.push_back( restore_pattern( in.record<snapshot_pattern>( patterns_table, i ) ) );
+        }
+        std::vector<phong_material_ptr> materials;
+        for ( std::size_t i = 0; i < in.count( materials_table ); i++ )
+        {
+            auto record = in.record<snapshot_material>( materials_table, i );
+            check_index( record.pattern < patterns.size() );
+            auto m = phong_material::create( patterns[record.pattern], record.ambient, record.diffuse, record.specular, record.shininess );
+            m->reflectivity = record.reflectivity;
+            m->transparency = record.transparency;
+            m->refractive_index = record.refractive_index;
+            materials.push_back( m );
+        }
+        std::vector<mesh_ptr> meshes;
+        for ( std::size_t i = 0; i < in.count( meshes_table ); i++ )
+        {
+            meshes.push_back( restore_mesh( in, in.record<snapshot_mesh>( meshes_table, i ) ) );
+        }
+
+        // Every index is checked once here, so that the shapes can be created in parallel and
+        // the scene can trust them
+        auto shape_count = in.count( shapes_table );
+        auto names = in.chars( names_table );
+        std::vector<uint32_t> parents( shape_count );
+        std::vector<uint32_t> child_counts( shape_count );
+        for ( std::size_t i = 0; i < shape_count; i++ )
+        {
+            auto record = in.record<snapshot_shape>( shapes_table, i );
+            check_index( record.kind <= shape_kind::mesh_triangle && record.material < materials.size() &&
+                record.name_offset <= in.count( names_table ) && record.name_size <= in.count( names_table ) - record.name_offset );
+            check_index( record.kind != shape_kind::mesh_triangle ||
+                ( record.mesh < meshes.size() && record.index < meshes[record.mesh]->triangle_count() ) );
+            if ( record.parent != none )
+            {
+                check_index( record.parent < i && in.record<snapshot_shape>( shapes_table, record.parent ).kind == shape_kind::group );
+                child_counts[record.parent]++;
+            }
+            parents[i] = record.parent;
+        }
+
+        std::vector<shape_ptr> shapes( shape_count );
+        auto jobs = ( shape_count + shapes_per_job - 1 ) / shapes_per_job;
+        thread_pool pool( jobs > 1 ? threads : 1 );
+        pool.run( jobs, [&] ( std::size_t job ) {
+            arena_scope worker_scope( std::make_shared<arena>( a ) );
+            auto last = std::min( shape_count, ( job + 1 ) * shapes_per_job );
+            for ( auto i = job * shapes_per_job; i < last; i++ )
+            {
+                auto record = in.record<snapshot_shape>( shapes_table, i );
+                shapes[i] = restore_shape( record, meshes, names );
+                shapes[i]->set_material( materials[record.material] );
+            }
+        } );
+
+        // Children are gathered per group and added in bulk, in the order they were written
+        std::vector<std::vector<shape_ptr>> children( shape_count );
+        std::vector<shape_ptr> objects;
+        for ( std::size_t i = 0; i < shape_count; i++ )
+        {
+            if ( parents[i] == none )
+            {
+                objects.push_back( shapes[i] );
+                continue;
+            }
+            auto& siblings = children[parents[i]];
+            siblings.reserve( child_counts[parents[i]] );
+            siblings.push_back( shapes[i] );
+        }
+        for ( std::size_t i = 0; i < shape_count; i++ )
+        {
+            if ( !children[i].empty() )
+            {
+                std::static_pointer_cast<group>( shapes[i] )->add_children( children[i] );
+            }
+        }
+        w->add_objects( objects );
+
+        for ( std::size_t i = 0; i < in.count( lights_table ); i++ )
+        {
+            w->add_light( restore_light( in.record<snapshot_light>( lights_table, i ) ) );
+        }
+        w->set_max_depth( static_cast<uint8_t>( header.max_depth ) );
+        w->set_min_throughput( header.min_throughput );
+
+        auto scene = render_scene_ptr( new render_scene() );
+        in.read( primitive_types_table, scene->_types );
+        in.read( primitive_slots_table, scene->_slots );
+        in.read( primitive_materials_table, scene->_material_indices );
+        in.read( sphere_transforms_table, scene->_spheres.world_to_object );
+        in.read_xyz( sphere_origins_table, scene->_spheres.origin );
+        in.read( plane_transforms_table, scene->_planes.world_to_object );
+        in.read( cube_transforms_table, scene->_cubes.world_to_object );
+        in.read( cylinder_transforms_table, scene->_cylinders.world_to_object );
+        in.read( cylinder_min_table, scene->_cylinders.min_extent );
+        in.read( cylinder_max_table, scene->_cylinders.max_extent );
+        in.read( cylinder_closed_table, scene->_cylinders.closed );
+        in.read( cone_transforms_table, scene->_cones.world_to_object );
+        in.read( cone_min_table, scene->_cones.min_extent );
+        in.read( cone_max_table, scene->_cones.max_extent );
+        in.read( cone_closed_table, scene->_cones.closed );
+        in.read_xyz( triangle_p1_table, scene->_triangles.p1 );
+        in.read_xyz( triangle_e1_table, scene->_triangles.e1 );
+        in.read_xyz( triangle_e2_table, scene->_triangles.e2 );
+        in.read( mesh_triangle_indices_table, scene->_mesh_triangles.index );
+        in.read( mesh_triangle_transforms_table, scene->_mesh_triangles.transform );
+        in.read( mesh_triangle_matrices_table, scene->_mesh_triangles.world_to_object );
+        in.read( nodes_table, scene->_nodes );
+        in.read( leaf_primitives_table, scene->_leaf_primitives );
+        in.read( unbounded_table, scene->_unbounded );
+
+        const auto primitive_count = scene->_types.size();
+        std::vector<uint32_t> ids;
+        in.read( scene_materials_table, ids );
+        for ( auto id : ids )
+        {
+            check_index( id < materials.size() );
+            scene->_materials.push_back( materials[id] );
+        }
+        in.read( primitive_objects_table, ids );
+        check_index( ids.size() == primitive_count );
+        scene->_objects.reserve( ids.size() );
+        for ( auto id : ids )
+        {
+            check_index( id < shape_count );
+            scene->_objects.push_back( unowned( shapes[id] ) );
+        }
+        in.read( mesh_triangle_sources_table, ids );
+        const auto& mesh_triangles = scene->_mesh_triangles;
+        check_index( ids.size() == mesh_triangles.index.size() && ids.size() == mesh_triangles.transform.size() );
+        for ( std::size_t i = 0; i < ids.size(); i++ )
+        {
+            check_index( ids[i] < meshes.size() && mesh_triangles.index[i] < meshes[ids[i]]->triangle_count() &&
+                mesh_triangles.transform[i] < mesh_triangles.world_to_object.size() );
+            scene->_mesh_triangles.source.push_back( meshes[ids[i]].get() );
+        }
+
+        const auto& cylinders = scene->_cylinders;
+        const auto& cones = scene->_cones;
+        const auto& triangles = scene->_triangles;
+        check_index( scene->_spheres.origin.size() == scene->_spheres.world_to_object.size() &&
+            cylinders.min_extent.size() == cylinders.world_to_object.size() && cylinders.max_extent.size() == cylinders.world_to_object.size() &&
+            cylinders.closed.size() == cylinders.world_to_object.size() && cones.min_extent.size() == cones.world_to_object.size() &&
+            cones.max_extent.size() == cones.world_to_object.size() && cones.closed.size() == cones.world_to_object.size() &&
+            triangles.e1.size() == triangles.p1.size() && triangles.e2.size() == triangles.p1.size() &&
+            scene->_slots.size() == primitive_count && scene->_material_indices.size() == primitive_count );
+        for ( std::size_t i = 0; i < primitive_count; i++ )
+        {
+            std::size_t slots = 0;
+            switch ( scene->_types[i] )
+            {
+            case render_scene::primitive_t::sphere: slots = scene->_spheres.origin.size(); break;
+            case render_scene::primitive_t::plane: slots = scene->_planes.world_to_object.size(); break;
+            case render_scene::primitive_t::cube: slots = scene->_cubes.world_to_object.size(); break;
+            case render_scene::primitive_t::cylinder: slots = cylinders.world_to_object.size(); break;
+            case render_scene::primitive_t::cone: slots = cones.world_to_object.size(); break;
+            case render_scene::primitive_t::triangle: slots = triangles.p1.size(); break;
+            case render_scene::primitive_t::mesh_triangle: slots = mesh_triangles.index.size(); break;
+            // Proxies are never written, so a snapshot naming one is rejected
+            case render_scene::primitive_t::proxy: break;
+            }
+            check_index( scene->_slots[i] < slots && scene->_material_indices[i] < scene->_materials.size() );
+        }
+
+        // Children always follow their parent, so the hierarchy has no cycles and its depth
+        // is found in a single pass
+        const auto& nodes = scene->_nodes;
+        std::vector<uint32_t> depths( nodes.size() );
+        for ( std::size_t i = 0; i < nodes.size(); i++ )
+        {
+            const auto& node = nodes[i];
+            check_index( depths[i] < max_node_depth && node.axis < 3 );
+            if ( node.count > 0 )
+            {
+                check_index( node.offset <= scene->_leaf_primitives.size() && node.count <= scene->_leaf_primitives.size() - node.offset );
+                continue;
+            }
+            check_index( i + 1 < nodes.size() && node.offset > i + 1 && node.offset < nodes.size() );
+            depths[i + 1] = std::max( depths[i + 1], depths[i] + 1 );
+            depths[node.offset] = std::max( depths[node.offset], depths[i] + 1 );
+        }
+        for ( auto primitive : scene->_leaf_primitives )
+        {
+            check_index( primitive < primitive_count );
+        }
+        for ( auto primitive : scene->_unbounded )
+        {
+            check_index( primitive < primitive_count );
+        }
+        w->_scene = scene;
+        w->_scene_generation = w->edit_generation();
+
+        if ( header.has_camera )
+        {
+            const auto& c = header.camera;
+            snapshot.camera = camera::create( c.width, c.height, c.field_of_view );
+            snapshot.camera->set_transform( c.transform );
+            snapshot.camera->set_threads( c.threads );
+            snapshot.camera->set_tile_size( c.tile_size );
+        }
+        return snapshot;
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ls {
+    class arena;
+    using arena_ptr = std::shared_ptr<arena>;
+
+    /**
+     * A monotonic allocator that hands out memory from large blocks and only releases it
+     * when it is destroyed. Allocations are synchronized so loaders on several threads can
+     * share one arena.
+     */
+    class arena
+    {
+    public:
+
+        static constexpr std::size_t default_block_size = 1 << 20;
+
+    public:
+
+        explicit arena( std::size_t block_size = default_block_size ) :
+            _block_size( block_size )
+        { }
+
+        /**
+         * An arena whose blocks are allocated from the parent, so that a thread can fill one
+         * without contending for the parent's lock while the parent still owns the memory
+         */
+        explicit arena( const arena_ptr& parent, std::size_t block_size = default_block_size / 16 ) :
+            _parent( parent ), _block_size( block_size )
+        { }
+
+        arena( const arena& ) = delete;
+
+        arena& operator=( const arena& ) = delete;
+
+        void* allocate( std::size_t bytes, std::size_t alignment );
+
+        bool owns( const void* p ) const;
+
+        std::size_t bytes_used() const;
+
+        std::size_t block_count() const;
+
+    private:
+
+        struct block
+        {
+            std::unique_ptr<unsigned char[]> storage;
+            unsigned char* data;
+            std::size_t size;
+        };
+
+    private:
+
+        mutable std::mutex _lock;
+        arena_ptr _parent;
+        std::size_t _block_size;
+        std::vector<block> _blocks;
+        unsigned char* _cursor = nullptr;
+        std::size_t _remaining = 0;
+        std::size_t _used = 0;
+
+    };
+
+    /**
+     * Standard allocator over an arena. Every copy shares ownership of the arena, so memory
+     * handed to std::allocate_shared outlives the arena's other owners for as long as the
+     * object in it does. Deallocation is a no-op.
+     */
+    template<typename T>
+    class arena_allocator
+    {
+    public:
+
+        using value_type = T;
+
+        explicit arena_allocator( const arena_ptr& a ) noexcept :
+            _arena( a )
+        { }
+
+        template<typename U>
+        arena_allocator( const arena_allocator<U>& other ) noexcept :
+            _arena( other.owner() )
+        { }
+
+        T* allocate( std::size_t n )
+        {
+            return static_cast<T*>( _arena->allocate( n * sizeof( T ), alignof( T ) ) );
+        }
+
+        void deallocate( T*, std::size_t ) noexcept
+        { }
+
+        const arena_ptr& owner() const noexcept
+        {
+            return _arena;
+        }
+
+        template<typename U>
+        bool operator==( const arena_allocator<U>& rhs ) const noexcept
+        {
+            return _arena == rhs.owner();
+        }
+
+        template<typename U>
+        bool operator!=( const arena_allocator<U>& rhs ) const noexcept
+        {
+            return _arena != rhs.owner();
+        }
+
+    private:
+
+        arena_ptr _arena;
+
+    };
+
+    /**
+     * Routes every object created through a PTR_FACTORY on this thread into the arena for
+     * the lifetime of the scope, including the materials and patterns shapes create for
+     * themselves. Scopes nest, restoring the previous arena when they end.
+     */
+    class arena_scope
+    {
+    public:
+
+        explicit arena_scope( const arena_ptr& a ) noexcept :
+            _arena( a ), _previous( _current )
+        {
+            _current = &_arena;
+        }
+
+        ~arena_scope()
+        {
+            _current = _previous;
+        }
+
+        arena_scope( const arena_scope& ) = delete;
+
+        arena_scope& operator=( const arena_scope& ) = delete;
+
+        static const arena_ptr* current() noexcept
+        {
+            return _current;
+        }
+
+    private:
+
+        arena_ptr _arena;
+        const arena_ptr* _previous;
+
+        static thread_local const arena_ptr* _current;
+
+    };
+
+    /**
+     * Creates a shared object with its control block in the same allocation, taken from the
+     * current arena when there is one
+     */
+    template<typename T, typename... Ts>
+    inline std::shared_ptr<T> make_object( Ts&&... args )
+    {
+        auto a = arena_scope::current();
+        if ( a && *a )
+        {
+            return std::allocate_shared<T>( arena_allocator<T>( *a ), std::forward<Ts>( args )... );
+        }
+        return std::make_shared<T>( std::forward<Ts>( args )... );
+    }
+}
@@ -4,8 +4,24 @@
 #include "canvas.hpp"
 #include "transform.hpp"
 #include "ray.hpp"
+#include <algorithm>
+#include <functional>
 
 namespace ls {
+    static constexpr uint16_t default_tile_size = 16;
+
+    enum class ppm_format;
+
+    class mapped_canvas;
+
+    class tone_mapper;
+
+    /**
+     * Receives count finished image rows starting at row y, each stride pixels after the
+     * previous one. The pixels are only valid for the duration of the call.
+     */
+    using row_sink = std::function<void( const rgba_pixel* pixels, std::size_t stride, uint16_t y, uint16_t count )>;
+
     class camera
     {
     public:
@@ -42,15 +58,67 @@ namespace ls {
             return _transform;
         }
 
-        void set_transform( const f4_matrix& m ) noexcept
+        void set_transform( const f4_matrix& m )
         {
             _transform = m;
+            _inverse_transform = m.inverse();
+        }
+
+        uint16_t threads() const noexcept
+        {
+            return _threads;
+        }
+
+        /**
+         * Sets the number of threads used to render, where 0 uses every hardware thread
+         * and 1 renders serially on the calling thread
+         */
+        void set_threads( uint16_t threads ) noexcept
+        {
+            _threads = threads;
+        }
+
+        uint16_t tile_size() const noexcept
+        {
+            return _tile_size;
+        }
+
+        void set_tile_size( uint16_t size ) noexcept
+        {
+            _tile_size = std::max<uint16_t>( size, 1 );
         }
 
         ray ray_for_pixel( uint16_t x, uint16_t y ) const;
 
         canvas render( const world_ptr& w ) const;
 
+        /**
+         * Renders the image in bands of tile_size rows and hands each band to the sink in
+         * order as soon as all of its tiles are done. Only the few bands being rendered at
+         * once are held in memory, so the image itself may be larger than memory.
+         */
+        void render( const world_ptr& w, const row_sink& sink ) const;
+
+        /**
+         * Streams the image straight into a PPM file through render( w, sink )
+         */
+        void render_to( const world_ptr& w, const std::string& file, ppm_format format ) const;
+
+        void render_to( const world_ptr& w, const std::string& file, ppm_format format, const tone_mapper& mapper ) const;
+
+        /**
+         * Streams the unclamped image into a Portable Float Map, seeking to put each band
+         * in place as the file is stored bottom up
+         */
+        void render_pfm_to( const world_ptr& w, const std::string& file ) const;
+
+        /**
+         * Renders straight into a mapped canvas of the camera's size. Tiles write into the
+         * mapping a window of bands at a time, sized to the canvas' resident limit, and each
+         * window is released back to the file once it is done.
+         */
+        void render( const world_ptr& w, mapped_canvas& image ) const;
+
         PTR_FACTORY( camera )
 
     protected:
@@ -67,6 +135,24 @@ namespace ls {
         fpnum _pixel_size;
         fpnum _aspect;
         f4_matrix _transform;
+        f4_matrix _inverse_transform;
+        uint16_t _threads;
+        uint16_t _tile_size;
+
+    private:
+
+        /**
+         * Renders the pixels in [x0, x1) x [y0, y1) into the image, whose first row holds
+         * image row y_offset
+         */
+        void render_tile( const world_ptr& w, canvas& image, uint16_t y_offset, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1 ) const;
+
+        void render_tile( const world_ptr& w, mapped_canvas& image, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1 ) const;
+
+        /**
+         * Renders the pixels [x0, x1) of row y into pixels
+         */
+        void render_span( const world_ptr& w, uint16_t x0, uint16_t x1, uint16_t y, rgba_pixel* pixels ) const;
 
     };
 }
\ No newline at end of file
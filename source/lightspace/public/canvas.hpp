@@ -5,12 +5,42 @@
 
 namespace ls {
     static constexpr uint16_t max_ppm_line_width = 70;
+    static constexpr std::size_t canvas_row_alignment = 64;
 
+    enum class ppm_format;
+
+    class tone_mapper;
+
+    struct alignas( 16 ) rgba_pixel
+    {
+        float r;
+        float g;
+        float b;
+        float a;
+    };
+
+    inline rgba_pixel to_pixel( const f_color& c ) noexcept
+    {
+        return rgba_pixel{ static_cast<float>( c.r ), static_cast<float>( c.g ), static_cast<float>( c.b ), static_cast<float>( c.a ) };
+    }
+
+    inline f_color to_color( const rgba_pixel& p ) noexcept
+    {
+        return f_color( p.r, p.g, p.b, p.a );
+    }
+
+    /**
+     * An image held in a single allocation of RGBA floats. Rows start on cache line
+     * boundaries, every row_stride() pixels from the previous one.
+     *
+     * draw_pixel and pixel_at check their coordinates. Renderers that already know they
+     * are in bounds write through row() and span() instead, which do not.
+     */
     class canvas
     {
     public:
 
-        using pixel_space = std::vector<std::vector<f_color>>;
+        using pixel_space = std::vector<rgba_pixel, aligned_allocator<rgba_pixel, canvas_row_alignment>>;
 
         canvas( uint16_t width, uint16_t height );
 
@@ -24,23 +54,77 @@ namespace ls {
             return _height;
         }
 
+        inline std::size_t row_stride() const noexcept
+        {
+            return _stride;
+        }
+
         inline const pixel_space& pixels() const noexcept
         {
             return _pixels;
         }
 
+        inline rgba_pixel* row( uint16_t y ) noexcept
+        {
+            return _pixels.data() + y * _stride;
+        }
+
+        inline const rgba_pixel* row( uint16_t y ) const noexcept
+        {
+            return _pixels.data() + y * _stride;
+        }
+
+        inline rgba_pixel* span( uint16_t x, uint16_t y ) noexcept
+        {
+            return row( y ) + x;
+        }
+
+        inline const rgba_pixel* span( uint16_t x, uint16_t y ) const noexcept
+        {
+            return row( y ) + x;
+        }
+
         void draw_pixel( uint16_t x, uint16_t y, const f_color& color );
 
         const f_color pixel_at( uint16_t x, uint16_t y ) const;
 
         const std::string to_ppm() const;
 
+        const std::string to_ppm( ppm_format format ) const;
+
+        /**
+         * Writes a binary PPM by default, or the ASCII variant when asked for
+         */
         void write_to( const std::string& file ) const;
 
+        void write_to( const std::string& file, ppm_format format ) const;
+
+        /**
+         * Writes a PPM with the pixels tone mapped and encoded by mapper
+         */
+        void write_to( const std::string& file, ppm_format format, const tone_mapper& mapper ) const;
+
+        /**
+         * Encodes the image as a Portable Float Map, which keeps the unclamped floats so
+         * that it can be tone mapped again later
+         */
+        const std::string to_pfm() const;
+
+        void write_pfm_to( const std::string& file ) const;
+
+        /**
+         * Reads a color or grayscale Portable Float Map in either byte order. Throws
+         * std::runtime_error when the stream does not hold a complete PFM image.
+         */
+        static canvas from_pfm( std::istream& in );
+
+        static canvas load_pfm( const std::string& file );
+
     private:
 
         uint16_t _width{ 0 };
         uint16_t _height{ 0 };
+        std::size_t _stride{ 0 };
         pixel_space _pixels;
 
     private:
@@ -50,9 +134,5 @@ namespace ls {
             return x >= 0 && x < _width && y >= 0 && y < _height;
         }
 
-        void append_ppm_header( std::stringstream& os ) const;
-
-        void append_ppm_pixel_data( std::stringstream& os ) const;
-
     };
-}
\ No newline at end of file
+}
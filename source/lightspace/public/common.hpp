@@ -6,6 +6,9 @@
 #include <cmath>
 #include <string>
 #include <atomic>
+#include <memory>
+#include <cstdint>
+#include "arena.hpp"
 
 #if DOUBLE_PRECISION
 using fpnum = double;
@@ -24,7 +27,7 @@ using fpnum = float;
 template<typename... Ts>\
 static type##_ptr create( Ts&&... args ) noexcept\
 {\
-    return type##_ptr( new type( std::forward<Ts>( args )... ) );\
+    return ls::make_object<type>( std::forward<Ts>( args )... );\
 }
 
 namespace ls {
@@ -45,10 +48,18 @@ namespace ls {
     DECLARE_SHARED_PTR_TYPE( cylinder );
     DECLARE_SHARED_PTR_TYPE( cone );
     DECLARE_SHARED_PTR_TYPE( triangle );
+    DECLARE_SHARED_PTR_TYPE( mesh_triangle );
+    DECLARE_SHARED_PTR_TYPE( mesh );
     DECLARE_SHARED_PTR_TYPE( group );
+    DECLARE_SHARED_PTR_TYPE( geometry_proxy );
+    DECLARE_SHARED_PTR_TYPE( geometry_cache );
     DECLARE_SHARED_PTR_TYPE( world );
+    DECLARE_SHARED_PTR_TYPE( render_scene );
     DECLARE_SHARED_PTR_TYPE( light );
     DECLARE_SHARED_PTR_TYPE( point_light );
+    DECLARE_SHARED_PTR_TYPE( area_light );
+    DECLARE_SHARED_PTR_TYPE( rectangle_light );
+    DECLARE_SHARED_PTR_TYPE( sphere_light );
     DECLARE_SHARED_PTR_TYPE( material );
     DECLARE_SHARED_PTR_TYPE( phong_material );
     DECLARE_SHARED_PTR_TYPE( camera );
@@ -71,12 +82,80 @@ namespace ls {
         return fabs( static_cast<fpnum>( lhs ) - static_cast<fpnum>( rhs ) ) <= epsilon;
     }
 
+    /**
+     * Returns a handle that refers to the same object without sharing its ownership, so
+     * copying it never touches a reference count. It is only valid while the object is
+     * kept alive by its owners.
+     */
+    template<typename T>
+    inline std::shared_ptr<T> unowned( const std::shared_ptr<T>& p ) noexcept
+    {
+        return std::shared_ptr<T>( std::shared_ptr<T>(), p.get() );
+    }
+
+    /**
+     * Allocates storage aligned to Align bytes, such as cache lines for buffers that are
+     * processed a row at a time
+     */
+    template<typename T, std::size_t Align>
+    class aligned_allocator
+    {
+    public:
+
+        using value_type = T;
+
+        template<typename U>
+        struct rebind
+        {
+            using other = aligned_allocator<U, Align>;
+        };
+
+        aligned_allocator() = default;
+
+        template<typename U>
+        aligned_allocator( const aligned_allocator<U, Align>& ) noexcept
+        { }
+
+        T* allocate( std::size_t n )
+        {
+            // The block handed out by operator new is stored just before the aligned address
+            auto raw = static_cast<unsigned char*>( ::operator new( n * sizeof( T ) + Align + sizeof( void* ) ) );
+            auto aligned = ( reinterpret_cast<std::uintptr_t>( raw ) + sizeof( void* ) + Align - 1 ) & ~static_cast<std::uintptr_t>( Align - 1 );
+            reinterpret_cast<void**>( aligned )[-1] = raw;
+            return reinterpret_cast<T*>( aligned );
+        }
+
+        void deallocate( T* p, std::size_t ) noexcept
+        {
+            ::operator delete( reinterpret_cast<void**>( p )[-1] );
+        }
+
+        template<typename U>
+        bool operator==( const aligned_allocator<U, Align>& ) const noexcept
+        {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=( const aligned_allocator<U, Align>& ) const noexcept
+        {
+            return false;
+        }
+
+    };
+
     template<typename T>
     inline T clamp( T x, T a, T b ) noexcept
     {
         return x > b ? b : ( x < a ? a : x );
     }
 
+    inline bool is_little_endian() noexcept
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const uint8_t*>( &probe ) == 1;
+    }
+
     inline uint32_t get_uid() noexcept
     {
         static std::atomic_uint32_t current_uid{0};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "common.hpp"
+#include "shapes.hpp"
+#include "model_parser.hpp"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ls {
+    /**
+     * The shapes a proxy loaded from its file, compiled into a render scene of their own in
+     * the proxy's object space. Shapes hit inside it are handed out by pointers that share
+     * its ownership, so evicting it never frees geometry a thread is still shading.
+     */
+    struct proxy_geometry
+    {
+        group_ptr root;
+        render_scene_ptr scene;
+        std::size_t bytes{ 0 };
+    };
+
+    using proxy_geometry_ptr = std::shared_ptr<const proxy_geometry>;
+
+    /**
+     * A memory budget shared by geometry proxies. When a load takes the geometry held by the
+     * cache over its budget, the proxies used least recently are evicted until it fits again,
+     * except for the one just loaded. Recency is counted in loads, so every proxy traced since
+     * the last load counts as just used.
+     */
+    class geometry_cache
+    {
+    public:
+
+        static constexpr std::size_t unlimited = std::numeric_limits<std::size_t>::max();
+
+    public:
+
+        explicit geometry_cache( std::size_t budget = unlimited ) :
+            _budget( budget )
+        { }
+
+        geometry_cache( const geometry_cache& ) = delete;
+
+        geometry_cache& operator=( const geometry_cache& ) = delete;
+
+        std::size_t budget() const;
+
+        /**
+         * Changes the budget, evicting proxies right away when they no longer fit in it
+         */
+        void set_budget( std::size_t bytes );
+
+        /**
+         * The estimated size of the geometry the cache holds loaded
+         */
+        std::size_t bytes_loaded() const;
+
+        std::size_t loaded_count() const;
+
+        /**
+         * How many times proxies using the cache have loaded their files
+         */
+        uint64_t load_count() const noexcept
+        {
+            return _clock.load();
+        }
+
+        void evict_all();
+
+        PTR_FACTORY( geometry_cache )
+
+    private:
+
+        friend class geometry_proxy;
+
+        struct entry
+        {
+            const geometry_proxy* proxy;
+            std::size_t bytes;
+        };
+
+    private:
+
+        mutable std::mutex _lock;
+        std::size_t _budget;
+        std::size_t _bytes{ 0 };
+        std::vector<entry> _loaded;
+        std::atomic<uint64_t> _clock{ 0 };
+
+    private:
+
+        void admit( const geometry_proxy* proxy, const proxy_geometry_ptr& geometry );
+
+        void release( const geometry_proxy* proxy );
+
+        void trim( const geometry_proxy* keep );
+
+    };
+
+    /**
+     * Pins the geometry of the proxies its thread reaches while it is open, so rays traced
+     * meanwhile find it through a plain load rather than by taking a reference each. Pinned
+     * geometry stays alive until the scope closes even when its proxy is evicted, while the
+     * rays after the eviction load the proxy again. Cameras open one per row of a tile.
+     */
+    class geometry_pin_scope
+    {
+    public:
+
+        geometry_pin_scope() noexcept;
+        ~geometry_pin_scope();
+
+        geometry_pin_scope( const geometry_pin_scope& ) = delete;
+
+        geometry_pin_scope& operator=( const geometry_pin_scope& ) = delete;
+
+    private:
+
+        friend class geometry_proxy;
+
+    private:
+
+        // Rows of city scenes reach thousands of proxies, so pins are found by hashing, and
+        // references to them are handed out, which node-based maps keep valid as they grow
+        std::unordered_map<const geometry_proxy*, proxy_geometry_ptr> _pins;
+        geometry_pin_scope* _outer;
+
+    };
+
+    /**
+     * Stands in for an OBJ, PLY or mesh cache file by the bounds of its model in object space,
+     * loading the file and compiling its shapes only once a ray reaches those bounds. Threads
+     * reaching a proxy that is not loaded wait for one of them to load it, and a proxy evicted
+     * by its cache is loaded again the next time it is reached. Every loaded shape uses the
+     * proxy's material.
+     *
+     * Loading is the one change tracing makes to a world, so a file that fails to load throws
+     * std::runtime_error out of the render that reached it. Worlds holding proxies cannot be
+     * stored in a world snapshot.
+     */
+    class geometry_proxy : public shape
+    {
+    public:
+
+        geometry_proxy( const std::string& file, const aabb_bounds& bounds, const geometry_cache_ptr& cache = nullptr,
+            const mesh_import_options& options = mesh_import_options() ) :
+            shape(), _file( file ), _bounds( bounds ), _cache( cache ), _options( options )
+        { }
+        ~geometry_proxy();
+
+        const std::string& file() const noexcept
+        {
+            return _file;
+        }
+
+        const geometry_cache_ptr& cache() const noexcept
+        {
+            return _cache;
+        }
+
+        aabb_bounds bounds() const noexcept override
+        {
+            return _bounds;
+        }
+
+        bool loaded() const noexcept
+        {
+            return std::atomic_load( &_geometry ) != nullptr;
+        }
+
+        /**
+         * Returns the loaded geometry, loading it first when it is not
+         */
+        proxy_geometry_ptr geometry() const;
+
+        /**
+         * Returns the loaded geometry like geometry(), through the pin scope open on this
+         * thread when there is one. Without a scope the geometry is held in keep.
+         */
+        const proxy_geometry_ptr& pinned_geometry( proxy_geometry_ptr& keep ) const;
+
+        /**
+         * Releases the geometry once no thread uses it any more
+         */
+        void evict();
+
+        PTR_FACTORY( geometry_proxy )
+
+    private:
+
+        friend class geometry_cache;
+
+        std::string _file;
+        aabb_bounds _bounds;
+        geometry_cache_ptr _cache;
+        mesh_import_options _options;
+        mutable std::mutex _load_lock;
+        mutable proxy_geometry_ptr _geometry;
+        mutable std::atomic<const proxy_geometry*> _current{ nullptr };
+        mutable std::atomic<uint64_t> _last_use{ 0 };
+
+    private:
+
+        proxy_geometry_ptr load() const;
+
+        /**
+         * Replaces the geometry the proxy holds, which pins compare against to find out
+         * whether theirs is still the loaded one
+         */
+        void publish( const proxy_geometry_ptr& geometry ) const;
+
+        void touch() const noexcept;
+
+        f_vector local_normal( const f_point& ) const override
+        {
+            throw method_not_supported();
+        }
+
+    };
+
+    /**
+     * Intersections with the proxy's shapes keep its geometry loaded while they are alive
+     */
+    intersections intersect( const geometry_proxy_ptr& proxy, const ray& r );
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include "canvas.hpp"
+#include "tone_mapping.hpp"
+#include "thread_pool.hpp"
+
+namespace ls {
+    static constexpr std::size_t default_write_buffer_size = 1 << 20;
+
+    enum class ppm_format
+    {
+        ascii, binary
+    };
+
+    /**
+     * Converts a row of pixels to 8-bit RGB triplets, clamping each channel the same way
+     * the ASCII PPM output always has. Equivalent to mapping with a default tone_mapper.
+     */
+    void quantize_row( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) noexcept;
+
+    /**
+     * Streams an image to a PPM file one row at a time. Rows are tone mapped in batches,
+     * spread over the mapper's threads, into a large buffer that is handed to the stream
+     * whenever it fills up, so the encoded image never has to exist in memory as a whole.
+     */
+    class ppm_writer
+    {
+    public:
+
+        ppm_writer( std::ostream& out, uint16_t width, uint16_t height, ppm_format format = ppm_format::binary,
+            std::size_t buffer_size = default_write_buffer_size );
+
+        ppm_writer( std::ostream& out, uint16_t width, uint16_t height, ppm_format format, const tone_mapper& mapper,
+            std::size_t buffer_size = default_write_buffer_size );
+
+        ~ppm_writer();
+
+        uint16_t rows_written() const noexcept
+        {
+            return _rows_written;
+        }
+
+        /**
+         * Appends count rows starting at pixels, each stride pixels after the previous one
+         */
+        void write_rows( const rgba_pixel* pixels, std::size_t stride, uint16_t count );
+
+        void write( const canvas& image );
+
+        /**
+         * Hands everything buffered to the stream and flushes it
+         */
+        void finish();
+
+    private:
+
+        std::ostream& _out;
+        uint16_t _width;
+        uint16_t _height;
+        ppm_format _format;
+        uint16_t _rows_written{ 0 };
+        tone_mapper _mapper;
+        thread_pool _pool;
+        std::vector<char> _buffer;
+        std::size_t _used{ 0 };
+        std::size_t _batch_rows;
+        std::vector<uint8_t> _rgb;
+
+    private:
+
+        void append( const char* data, std::size_t size );
+
+        void append_ascii_row( const uint8_t* rgb );
+
+        void flush_buffer();
+
+    };
+
+    /**
+     * Streams an image to a Portable Float Map, keeping the unclamped floats of the
+     * framebuffer. PFM stores RGB in the machine's byte order with the bottom row first.
+     * Every row is converted into one buffer and handed to the stream in a single write.
+     *
+     * Rows that do not arrive in file order, such as the top down rows of a streamed
+     * render, are put in place by seeking, so the stream has to support it.
+     */
+    class pfm_writer
+    {
+    public:
+
+        pfm_writer( std::ostream& out, uint16_t width, uint16_t height );
+
+        uint16_t rows_written() const noexcept
+        {
+            return _rows_written;
+        }
+
+        /**
+         * Writes image row y, counting rows from the top
+         */
+        void write_row( uint16_t y, const rgba_pixel* pixels );
+
+        /**
+         * Appends count rows starting at pixels, each stride pixels after the previous one,
+         * continuing down from the last row appended
+         */
+        void write_rows( const rgba_pixel* pixels, std::size_t stride, uint16_t count );
+
+        /**
+         * Writes the image bottom row first, which never needs to seek
+         */
+        void write( const canvas& image );
+
+        void finish();
+
+    private:
+
+        std::ostream& _out;
+        uint16_t _width;
+        uint16_t _height;
+        uint16_t _rows_written{ 0 };
+        uint16_t _next_row{ 0 };
+        std::streamoff _data_start{ 0 };
+        std::size_t _file_row{ 0 };
+        std::vector<float> _row;
+
+    };
+}
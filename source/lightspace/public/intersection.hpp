@@ -66,7 +66,7 @@ namespace ls {
         bool inside;
 
         intersection_state() :
-            time( 0 ), object( nullptr ), point( f_point( 0, 0, 0 ) ), shifted_point( f_point( 0, 0, 0 ) ), shifted_under_point( f_point( 0, 0, 0 ) ),
+            time( 0 ), ridx_from( 1.f ), ridx_to( 1.f ), object( nullptr ), point( f_point( 0, 0, 0 ) ), shifted_point( f_point( 0, 0, 0 ) ), shifted_under_point( f_point( 0, 0, 0 ) ),
             eye( f_vector( 0, 0, 0 ) ), normal( f_vector( 0, 0, 0 ) ), reflection( f_vector( 0, 0, 0 ) ), inside( false )
         { }
     };
@@ -93,8 +93,9 @@ namespace ls {
         bool intersects( const ray& r );
     };
 
-    inline const aabb_bounds operator*( const f4_matrix& mat, const aabb_bounds& b ) noexcept
-    {
-        return aabb_bounds( mat * b.min, mat * b.max );
-    }
+    /**
+     * Bounds the eight transformed corners of the box. Unbounded boxes stay unbounded in
+     * every direction, since a rotation can turn an infinite extent along any axis.
+     */
+    const aabb_bounds operator*( const f4_matrix& mat, const aabb_bounds& b ) noexcept;
 }
@@ -4,6 +4,7 @@
 #include "tensor.hpp"
 #include "materials.hpp"
 #include "intersection.hpp"
+#include <utility>
 
 namespace ls {
     class light
@@ -11,7 +12,7 @@ namespace ls {
     public:
 
         light( const f_color& intensity, const f_point& position ) :
-            _intensity( intensity ), _position( position )
+            _intensity( intensity ), _position( position ), _constant_falloff( 1.f ), _linear_falloff( 0.f ), _quadratic_falloff( 0.f )
         { }
         virtual ~light() 
         { }
@@ -36,6 +37,62 @@ namespace ls {
             _position = position;
         }
 
+        void set_falloff( fpnum constant, fpnum linear, fpnum quadratic ) noexcept
+        {
+            _constant_falloff = constant;
+            _linear_falloff = linear;
+            _quadratic_falloff = quadratic;
+        }
+
+        fpnum constant_falloff() const noexcept
+        {
+            return _constant_falloff;
+        }
+
+        fpnum linear_falloff() const noexcept
+        {
+            return _linear_falloff;
+        }
+
+        fpnum quadratic_falloff() const noexcept
+        {
+            return _quadratic_falloff;
+        }
+
+        bool has_falloff() const noexcept
+        {
+            return _linear_falloff != 0.f || _quadratic_falloff != 0.f || _constant_falloff != 1.f;
+        }
+
+        fpnum attenuation( fpnum distance ) const noexcept
+        {
+            return 1.f / ( _constant_falloff + _linear_falloff * distance + _quadratic_falloff * distance * distance );
+        }
+
+        const f_color intensity_at( fpnum distance ) const noexcept
+        {
+            return has_falloff() ? _intensity * attenuation( distance ) : _intensity;
+        }
+
+        virtual uint32_t samples() const noexcept
+        {
+            return 1;
+        }
+
+        virtual f_point sample_point( uint32_t, const f_point& ) const noexcept
+        {
+            return _position;
+        }
+
+        /**
+         * Two samples on opposite edges of the light as seen from any point, which shadow
+         * tests probe before the others. Lights with a single sample return it twice.
+         */
+        virtual std::pair<uint32_t, uint32_t> rim_samples() const noexcept
+        {
+            return std::make_pair( 0u, 0u );
+        }
+
         bool operator==( const light& rhs ) const noexcept
         {
             return _intensity == rhs._intensity && _position == rhs._position;
@@ -47,6 +104,9 @@ namespace ls {
 
         f_color _intensity;
         f_point _position;
+        fpnum _constant_falloff;
+        fpnum _linear_falloff;
+        fpnum _quadratic_falloff;
 
     };
 
@@ -62,6 +122,168 @@ namespace ls {
 
     };
 
+    /**
+     * A light with a surface, sampled over a grid of usteps x vsteps strata. Each
+     * sample is placed inside its stratum with a jitter derived from the shaded point,
+     * so soft shadow noise is deterministic from render to render.
+     */
+    class area_light : public light
+    {
+    public:
+
+        area_light( const f_color& intensity, const f_point& position, uint16_t usteps, uint16_t vsteps ) :
+            light( intensity, position ), _usteps( std::max<uint16_t>( usteps, 1 ) ), _vsteps( std::max<uint16_t>( vsteps, 1 ) ), _jitter( true )
+        { }
+
+        uint16_t usteps() const noexcept
+        {
+            return _usteps;
+        }
+
+        uint16_t vsteps() const noexcept
+        {
+            return _vsteps;
+        }
+
+        void set_steps( uint16_t usteps, uint16_t vsteps ) noexcept
+        {
+            _usteps = std::max<uint16_t>( usteps, 1 );
+            _vsteps = std::max<uint16_t>( vsteps, 1 );
+        }
+
+        bool jitter() const noexcept
+        {
+            return _jitter;
+        }
+
+        void set_jitter( bool jitter ) noexcept
+        {
+            _jitter = jitter;
+        }
+
+        uint32_t samples() const noexcept override
+        {
+            return static_cast<uint32_t>( _usteps ) * _vsteps;
+        }
+
+        f_point sample_point( uint32_t index, const f_point& from ) const noexcept override;
+
+        /**
+         * The first and last strata, which lie in opposite corners of the grid
+         */
+        std::pair<uint32_t, uint32_t> rim_samples() const noexcept override
+        {
+            return std::make_pair( 0u, samples() - 1 );
+        }
+
+    protected:
+
+        uint16_t _usteps;
+        uint16_t _vsteps;
+        bool _jitter;
+
+    protected:
+
+        virtual f_point surface_point( fpnum u, fpnum v, const f_point& from ) const noexcept = 0;
+
+    };
+
+    class rectangle_light : public area_light
+    {
+    public:
+
+        rectangle_light( const f_color& intensity, const f_point& corner, const f_vector& uvec, uint16_t usteps, const f_vector& vvec, uint16_t vsteps ) :
+            area_light( intensity, corner + uvec * 0.5f + vvec * 0.5f, usteps, vsteps ), _corner( corner ), _uvec( uvec ), _vvec( vvec )
+        { }
+
+        const f_point& corner() const noexcept
+        {
+            return _corner;
+        }
+
+        const f_vector& uvec() const noexcept
+        {
+            return _uvec;
+        }
+
+        const f_vector& vvec() const noexcept
+        {
+            return _vvec;
+        }
+
+        PTR_FACTORY( rectangle_light )
+
+    private:
+
+        f_point _corner;
+        f_vector _uvec;
+        f_vector _vvec;
+
+    private:
+
+        f_point surface_point( fpnum u, fpnum v, const f_point& ) const noexcept override
+        {
+            return _corner + _uvec * u + _vvec * v;
+        }
+
+    };
+
+    /**
+     * A spherical light, sampled over the disk it covers as seen from the shaded point.
+     * The u strata are concentric rings and the v strata are sectors of those rings.
+     */
+    class sphere_light : public area_light
+    {
+    public:
+
+        sphere_light( const f_color& intensity, const f_point& center, fpnum radius, uint16_t rings, uint16_t sectors ) :
+            area_light( intensity, center, rings, sectors ), _radius( radius )
+        { }
+
+        fpnum radius() const noexcept
+        {
+            return _radius;
+        }
+
+        /**
+         * The first sector and the one halfway round of the outermost ring, which face each
+         * other across the disk
+         */
+        std::pair<uint32_t, uint32_t> rim_samples() const noexcept override
+        {
+            uint32_t outer = _usteps - 1u;
+            return std::make_pair( outer, outer + ( _vsteps / 2u ) * _usteps );
+        }
+
+        PTR_FACTORY( sphere_light )
+
+    private:
+
+        fpnum _radius;
+
+    private:
+
+        f_point surface_point( fpnum u, fpnum v, const f_point& from ) const noexcept override;
+
+    };
+
+    /**
+     * The phong contribution of a single light, split into the ambient term and the
+     * diffuse plus specular term that only reaches the surface when it is unoccluded
+     */
+    struct phong_terms
+    {
+        f_color ambient;
+        f_color direct;
+
+        bool has_direct() const noexcept
+        {
+            return direct.r > 0.f || direct.g > 0.f || direct.b > 0.f;
+        }
+    };
+
+    phong_terms phong_lighting_terms( const f_color& surface_color, const phong_material_ptr& mat, const light_ptr& l, const f_point& position, const f_vector& eye, const f_vector& normal );
+
     f_color phong_lighting( const shape_ptr obj, const phong_material_ptr& mat, const light_ptr& l, const f_point& position, const f_vector& eye, const f_vector& normal, bool in_shadow = false );
 
     fpnum schlick( const intersection_state& state );
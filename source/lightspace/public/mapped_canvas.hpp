@@ -0,0 +1,169 @@
+#pragma once
+
+#include "canvas.hpp"
+#include "mapped_file.hpp"
+
+namespace ls {
+    static constexpr std::size_t default_resident_limit = std::size_t( 256 ) << 20;
+
+    /**
+     * How a mapped canvas lays out its pixels on disk. Floats keep the exact framebuffer and
+     * can be written to in place, halves take half the space at about three decimal digits
+     * of precision.
+     */
+    enum class mapped_pixel_format : uint8_t
+    {
+        rgba_float = 1, rgba_half = 2
+    };
+
+    uint16_t to_half( float value ) noexcept;
+
+    float from_half( uint16_t value ) noexcept;
+
+    /**
+     * A canvas backed by a memory-mapped file, for images whose framebuffer does not fit in
+     * memory. The file holds a small header padded to header_size bytes followed by the rows,
+     * each starting on a cache line boundary row_bytes() after the previous one.
+     *
+     * Pixels are paged in as they are touched. Renderers work through the image a few bands
+     * at a time, keeping at most resident_limit() bytes of it in play, and hand finished rows
+     * back to the file with release_rows().
+     */
+    class mapped_canvas
+    {
+    public:
+
+        static constexpr std::size_t header_size = 4096;
+
+        /**
+         * Creates the file, replacing any existing one, with every pixel black
+         */
+        mapped_canvas( const std::string& file, uint16_t width, uint16_t height,
+            mapped_pixel_format format = mapped_pixel_format::rgba_float, std::size_t resident_limit = default_resident_limit );
+
+        /**
+         * Maps an existing canvas file for reading and writing. Throws std::runtime_error
+         * when the file is not a canvas.
+         */
+        static mapped_canvas open( const std::string& file, std::size_t resident_limit = default_resident_limit );
+
+        inline uint16_t width() const noexcept
+        {
+            return _width;
+        }
+
+        inline uint16_t height() const noexcept
+        {
+            return _height;
+        }
+
+        inline mapped_pixel_format format() const noexcept
+        {
+            return _format;
+        }
+
+        inline std::size_t resident_limit() const noexcept
+        {
+            return _resident_limit;
+        }
+
+        inline std::size_t row_bytes() const noexcept
+        {
+            return _row_bytes;
+        }
+
+        /**
+         * The distance between rows in whole pixels of the stored format
+         */
+        inline std::size_t row_stride() const noexcept
+        {
+            return _row_bytes / pixel_bytes( _format );
+        }
+
+        /**
+         * Float canvases can be written to in place. Half canvases have no rgba_pixel
+         * storage and throw method_not_supported, use store() and load() instead.
+         */
+        rgba_pixel* span( uint16_t x, uint16_t y );
+
+        const rgba_pixel* span( uint16_t x, uint16_t y ) const;
+
+        /**
+         * Writes count pixels to row y from column x on, converting them to the stored format
+         */
+        void store( uint16_t x, uint16_t y, const rgba_pixel* pixels, std::size_t count ) noexcept;
+
+        /**
+         * Reads count pixels of row y from column x on into pixels
+         */
+        void load( uint16_t x, uint16_t y, rgba_pixel* pixels, std::size_t count ) const noexcept;
+
+        void draw_pixel( uint16_t x, uint16_t y, const f_color& color );
+
+        const f_color pixel_at( uint16_t x, uint16_t y ) const;
+
+        /**
+         * Drops rows [y0, y1) from memory. They stay in the file and are paged back in when
+         * touched again.
+         */
+        void release_rows( uint16_t y0, uint16_t y1 ) const noexcept;
+
+        /**
+         * Blocks until every pixel written so far has reached the file
+         */
+        void flush();
+
+        /**
+         * Streams the image into a PPM file a band of rows at a time, releasing each band
+         * once it has been written
+         */
+        void write_to( const std::string& file, ppm_format format ) const;
+
+        void write_to( const std::string& file, ppm_format format, const tone_mapper& mapper ) const;
+
+        /**
+         * Streams the image into a Portable Float Map, bottom band first
+         */
+        void write_pfm_to( const std::string& file ) const;
+
+        static std::size_t pixel_bytes( mapped_pixel_format format ) noexcept
+        {
+            return format == mapped_pixel_format::rgba_float ? sizeof( rgba_pixel ) : 4 * sizeof( uint16_t );
+        }
+
+    private:
+
+        mapped_file _file;
+        uint16_t _width{ 0 };
+        uint16_t _height{ 0 };
+        mapped_pixel_format _format{ mapped_pixel_format::rgba_float };
+        std::size_t _row_bytes{ 0 };
+        std::size_t _resident_limit{ default_resident_limit };
+
+    private:
+
+        mapped_canvas( mapped_file&& file, std::size_t resident_limit );
+
+        inline uint8_t* row_data( uint16_t y ) noexcept
+        {
+            return _file.data() + header_size + y * _row_bytes;
+        }
+
+        inline const uint8_t* row_data( uint16_t y ) const noexcept
+        {
+            return _file.data() + header_size + y * _row_bytes;
+        }
+
+        /**
+         * The number of rows streamed out at a time, with half rows also being widened
+         * into a buffer of floats
+         */
+        uint16_t band_rows() const noexcept;
+
+        inline bool within_bounds( const uint16_t& x, const uint16_t& y ) const noexcept
+        {
+            return x < _width && y < _height;
+        }
+
+    };
+}
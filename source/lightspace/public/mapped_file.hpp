@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.hpp"
+#include <string>
+
+namespace ls {
+    /**
+     * A whole file mapped into memory. Read-only mappings share the page cache with every
+     * other reader of the file; writable ones are written back by the kernel as it sees fit,
+     * or when sync() is called.
+     *
+     * Failing to open, size or map the file throws std::system_error.
+     *
+     * Files are mapped with mmap, so only POSIX systems are supported.
+     */
+    class mapped_file
+    {
+    public:
+
+        enum class access
+        {
+            read_only, read_write
+        };
+
+        mapped_file() = default;
+
+        /**
+         * Maps an existing file in its entirety
+         */
+        explicit mapped_file( const std::string& path, access mode = access::read_only );
+
+        /**
+         * Creates the file, or truncates an existing one, sized to size bytes of zeros and
+         * maps it for writing. The file is sparse until pages are written to.
+         */
+        mapped_file( const std::string& path, std::size_t size );
+
+        mapped_file( const mapped_file& ) = delete;
+
+        mapped_file& operator=( const mapped_file& ) = delete;
+
+        mapped_file( mapped_file&& other ) noexcept;
+
+        mapped_file& operator=( mapped_file&& other ) noexcept;
+
+        ~mapped_file();
+
+        inline bool is_open() const noexcept
+        {
+            return _data != nullptr;
+        }
+
+        inline bool writable() const noexcept
+        {
+            return _mode == access::read_write;
+        }
+
+        inline std::size_t size() const noexcept
+        {
+            return _size;
+        }
+
+        inline const uint8_t* data() const noexcept
+        {
+            return _data;
+        }
+
+        inline uint8_t* data() noexcept
+        {
+            return _data;
+        }
+
+        /**
+         * Hints that the mapping is going to be read front to back
+         */
+        void advise_sequential() const noexcept;
+
+        /**
+         * Drops the whole pages within [offset, offset + length) from this process. Written
+         * data stays in the file and is paged back in on the next access, so this keeps the
+         * resident size of a mapping bounded while it is being worked through.
+         */
+        void release( std::size_t offset, std::size_t length ) const noexcept;
+
+        /**
+         * Blocks until everything written to the mapping has reached the file
+         */
+        void sync();
+
+        void close() noexcept;
+
+        static std::size_t page_size() noexcept;
+
+    private:
+
+        uint8_t* _data{ nullptr };
+        std::size_t _size{ 0 };
+        access _mode{ access::read_only };
+
+    private:
+
+        void map( int descriptor, const std::string& path );
+
+    };
+}
@@ -173,11 +173,8 @@ namespace ls {
 
         static const matrix<T, Rows, Cols> identity() noexcept
         {
-            static matrix<T, Rows, Cols> result;
-            if ( result._data[0][0] == 0 )
-            {
-                result.initialize_with_identity();
-            }
+            matrix<T, Rows, Cols> result;
+            result.initialize_with_identity();
             return result;
         }
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.hpp"
+#include "tensor.hpp"
+#include <vector>
+
+namespace ls {
+    struct texture_uv
+    {
+        fpnum u{ 0 };
+        fpnum v{ 0 };
+
+        bool operator==( const texture_uv& rhs ) const noexcept
+        {
+            return approx( u, rhs.u ) && approx( v, rhs.v );
+        }
+    };
+
+    /**
+     * Triangles over shared streams of vertex attributes. Every triangle has three corners,
+     * each indexing into the positions and, where the corner has them, into the texture
+     * coordinates and normals, so an attribute shared by many faces is stored once.
+     *
+     * Positions may be quantized to 16 bits per axis within the mesh bounds, after which
+     * positions is empty and position() decodes them as they are needed.
+     */
+    class mesh
+    {
+    public:
+
+        static constexpr uint32_t missing = std::numeric_limits<uint32_t>::max();
+
+        struct corner
+        {
+            uint32_t position;
+            uint32_t uv;
+            uint32_t normal;
+        };
+
+        struct quantized_position
+        {
+            uint16_t x;
+            uint16_t y;
+            uint16_t z;
+        };
+
+        /**
+         * A named run of triangles, such as an OBJ group. The part with an empty name holds
+         * the triangles that come before any group.
+         */
+        struct part
+        {
+            std::string name;
+            std::size_t first_triangle;
+            std::size_t triangle_count;
+        };
+
+    public:
+
+        std::vector<f_point> positions;
+        std::vector<texture_uv> uvs;
+        std::vector<f_vector> normals;
+        std::vector<corner> corners;
+        std::vector<part> parts;
+        std::vector<quantized_position> quantized_positions;
+        f_point quantization_origin;
+        f_vector quantization_step;
+
+    public:
+
+        std::size_t triangle_count() const noexcept
+        {
+            return corners.size() / 3;
+        }
+
+        bool quantized() const noexcept
+        {
+            return !quantized_positions.empty();
+        }
+
+        std::size_t vertex_count() const noexcept
+        {
+            return quantized() ? quantized_positions.size() : positions.size();
+        }
+
+        f_point position( std::size_t i ) const noexcept
+        {
+            if ( !quantized() )
+            {
+                return positions[i];
+            }
+            const auto& q = quantized_positions[i];
+            return f_point( quantization_origin.x + q.x * quantization_step.x, quantization_origin.y + q.y * quantization_step.y,
+                quantization_origin.z + q.z * quantization_step.z );
+        }
+
+        const corner* triangle_corners( std::size_t t ) const noexcept
+        {
+            return corners.data() + 3 * t;
+        }
+
+        bool has_normals( std::size_t t ) const noexcept;
+
+        bool has_uvs( std::size_t t ) const noexcept;
+
+        /**
+         * Blends the corner normals of triangle t, weighting the second corner by u and the
+         * third by v. The result is not normalized.
+         */
+        f_vector interpolated_normal( std::size_t t, fpnum u, fpnum v ) const noexcept;
+
+        texture_uv interpolated_uv( std::size_t t, fpnum u, fpnum v ) const noexcept;
+
+        /**
+         * Merges positions no more than tolerance apart on every axis into the first of them
+         * and points the corners at the merged ones, returning how many were removed. Nearby
+         * positions are found through a spatial hash of tolerance sized cells, or of the exact
+         * coordinates when tolerance is 0. Quantized meshes are left as they are.
+         */
+        std::size_t weld( fpnum tolerance = 0 );
+
+        /**
+         * Replaces the positions by 16-bit offsets from the lower corner of their bounds, in
+         * 65535 steps across each axis
+         */
+        void quantize();
+
+        /**
+         * Writes the mesh as a mesh cache, a header followed by tables of positions, texture
+         * coordinates, normals, corners and parts in native byte order. Quantized positions
+         * are written decoded. Throws std::system_error when the file cannot be created or
+         * written.
+         */
+        void write_to( const std::string& file ) const;
+
+        /**
+         * Maps a mesh cache and copies its tables straight into a new mesh. Throws
+         * std::runtime_error when the file is not a mesh cache or refers to elements it does
+         * not contain, and std::system_error when it cannot be opened.
+         */
+        static mesh_ptr load( const std::string& file );
+
+        PTR_FACTORY( mesh )
+
+    };
+}
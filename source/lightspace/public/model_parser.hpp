@@ -2,6 +2,7 @@
 
 #include "common.hpp"
 #include "tensor.hpp"
+#include "mesh.hpp"
 #include <fstream>
 #include <vector>
 #include <map>
@@ -12,14 +13,27 @@ namespace ls {
         SUCCESS, FAIL
     };
 
+    /**
+     * The parsed model. Vertices, texture coordinates and normals are read into the streams
+     * of one indexed mesh, together with the corners of every triangulated face and a part
+     * for each group. Triangles whose corners have texture coordinates or normals become
+     * mesh triangles referring to those streams, the others plain triangles.
+     */
     struct model_parse_data
     {
         unsigned int lines_ignored;
-        std::vector<f_point> vertices;
+        mesh_ptr mesh;
+        // The mesh's positions, which are empty once the mesh was quantized on import. Its
+        // position() decodes every vertex either way.
+        std::vector<f_point>& vertices;
         std::map<std::string, group_ptr> groups;
         group_ptr root_group;
+        arena_ptr arena;
 
-        model_parse_data();
+        /**
+         * Starts from the given mesh, or from an empty one
+         */
+        explicit model_parse_data( const arena_ptr& a, const mesh_ptr& m = nullptr );
     };
 
     struct model_parse_error
@@ -38,8 +52,76 @@ namespace ls {
         group_ptr to_shape_group() const;
     };
 
+    /**
+     * Optional steps applied to a mesh after it is read and before its shapes are created.
+     * Welding merges duplicated vertices, see mesh::weld(), and quantizing stores positions
+     * in 16 bits per axis, see mesh::quantize().
+     */
+    struct mesh_import_options
+    {
+        bool weld{ false };
+        fpnum weld_tolerance{ 0 };
+        bool quantize{ false };
+    };
+
+    /**
+     * Parses Wavefront OBJ models. Lines are scanned in place, numbers converted without
+     * creating strings and the only allocations made are for the parsed data itself.
+     *
+     * Face corners may be given as v, v/vt, v//vn or v/vt/vn, where negative indices count
+     * back from the last element defined before the face. Indices beyond what is defined
+     * fail the parse at the face's line.
+     *
+     * Large files are split into chunks of whole lines that are parsed on up to threads
+     * threads, where 0 uses every hardware thread. The result is the same for any number
+     * of threads.
+     */
     struct model_parser
     {
         static model_parse_result obj( std::ifstream& f );
+
+        /**
+         * Allocates the parsed shapes from the given arena, such as a world's
+         */
+        static model_parse_result obj( std::ifstream& f, const arena_ptr& a, uint16_t threads = 0,
+            const mesh_import_options& options = mesh_import_options() );
+
+        /**
+         * Memory-maps the file and parses it without copying it first. A file that cannot
+         * be opened fails with an error on line 0.
+         */
+        static model_parse_result obj( const std::string& file );
+
+        static model_parse_result obj( const std::string& file, const arena_ptr& a, uint16_t threads = 0,
+            const mesh_import_options& options = mesh_import_options() );
+
+        /**
+         * Reads the vertex and face elements of an ASCII or binary PLY file into a mesh, with
+         * the vertex normals and texture coordinates it has. Binary vertices with a fixed
+         * record layout are decoded straight from the mapped file on up to threads threads,
+         * and faces are triangulated as fans. Errors in an ASCII file are reported at their
+         * line, errors in a binary body on line 0.
+         */
+        static model_parse_result ply( const std::string& file );
+
+        static model_parse_result ply( const std::string& file, const arena_ptr& a, uint16_t threads = 0,
+            const mesh_import_options& options = mesh_import_options() );
+
+        /**
+         * Loads a mesh cache written by obj_to_mesh_cache() or mesh::write_to(), creating the
+         * same groups and triangles as parsing the original OBJ file. A cache that cannot be
+         * opened or is not valid fails with an error on line 0.
+         */
+        static model_parse_result mesh_cache( const std::string& file );
+
+        static model_parse_result mesh_cache( const std::string& file, const arena_ptr& a, uint16_t threads = 0,
+            const mesh_import_options& options = mesh_import_options() );
+
+        /**
+         * Parses an OBJ file into a mesh without creating any shapes and writes the mesh to
+         * cache_file. The result holds the mesh and any parse error, or fails on line 0 when
+         * the cache cannot be written.
+         */
+        static model_parse_result obj_to_mesh_cache( const std::string& obj_file, const std::string& cache_file, uint16_t threads = 0 );
     };
 }
@@ -10,7 +10,7 @@ namespace ls {
     public:
         
         pattern() :
-            transform_( f4_matrix::identity() )
+            transform_( f4_matrix::identity() ), inverse_transform_( f4_matrix::identity() )
         { }
         virtual ~pattern()
         { }
@@ -20,9 +20,10 @@ namespace ls {
             return transform_;
         }
         
-        void set_transform( const f4_matrix& transform ) noexcept
+        void set_transform( const f4_matrix& transform )
         {
             transform_ = transform;
+            inverse_transform_ = transform.inverse();
         }
         
         f_color color_at( const shape_ptr obj, const f_point& point ) const;
@@ -32,6 +33,7 @@ namespace ls {
     protected:
         
         f4_matrix transform_;
+        f4_matrix inverse_transform_;
         
     };
 
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include "common.hpp"
+#include "shapes.hpp"
+#include "geometry_proxy.hpp"
+
+namespace ls {
+    /**
+     * A flat, immutable representation of a world's objects built for tracing. Groups are
+     * flattened into their leaf primitives, each primitive type keeps its parameters in its
+     * own arrays with the transform from world space baked in, materials are indices into a
+     * shared table and the bounded primitives are organized into a bounding volume hierarchy.
+     *
+     * Primitives refer back to the shapes they were compiled from for shading, so a scene is
+     * only valid while those shapes are alive and unmodified. Edits require compiling again.
+     */
+    class render_scene
+    {
+    public:
+
+        /**
+         * A hit along a ray, identifying the primitive by its index in the scene and the shape
+         * hit, which is one of a geometry proxy's shapes when the primitive is a proxy
+         */
+        struct hit_record
+        {
+            fpnum time;
+            uint32_t primitive;
+            shape_ptr object;
+        };
+
+    public:
+
+        static render_scene_ptr compile( const std::vector<shape_ptr>& objects );
+
+        std::size_t primitive_count() const noexcept
+        {
+            return _types.size();
+        }
+
+        std::size_t material_count() const noexcept
+        {
+            return _materials.size();
+        }
+
+        std::size_t node_count() const noexcept
+        {
+            return _nodes.size();
+        }
+
+        /**
+         * The memory held by the scene's arrays
+         */
+        std::size_t bytes_used() const noexcept;
+
+        const shape_ptr& object( uint32_t primitive ) const noexcept
+        {
+            return _objects[primitive];
+        }
+
+        const phong_material_ptr& material( uint32_t primitive ) const noexcept
+        {
+            return _materials[_material_indices[primitive]];
+        }
+
+        /**
+         * Finds the nearest hit at a non-negative time, returning false when the ray misses
+         */
+        bool closest_hit( const ray& r, hit_record& hit ) const;
+
+        /**
+         * Returns true as soon as any hit in [0, max_time) is found
+         */
+        bool occluded( const ray& r, fpnum max_time ) const;
+
+        /**
+         * Gathers every intersection along the ray's line sorted by time, including those
+         * behind its origin, as refraction needs them to track the surrounding media
+         */
+        intersections intersect( const ray& r ) const;
+
+    private:
+
+        friend struct world_snapshot;
+
+        enum class primitive_t : uint8_t
+        {
+            sphere, plane, cube, cylinder, cone, triangle, mesh_triangle, proxy
+        };
+
+        struct transformed_array
+        {
+            std::vector<f4_matrix> world_to_object;
+        };
+
+        struct sphere_array : transformed_array
+        {
+            std::vector<f_point> origin;
+        };
+
+        struct capped_array : transformed_array
+        {
+            std::vector<fpnum> min_extent;
+            std::vector<fpnum> max_extent;
+            std::vector<uint8_t> closed;
+        };
+
+        /**
+         * Triangles are baked into world space, since their edges transform with the ray
+         */
+        struct triangle_array
+        {
+            std::vector<f_point> p1;
+            std::vector<f_vector> e1;
+            std::vector<f_vector> e2;
+        };
+
+        /**
+         * Triangles of quantized meshes are not baked. Their corners are decoded from the mesh
+         * for every test, against the ray taken into the mesh's space by one of the transforms
+         * shared by consecutive triangles.
+         */
+        struct mesh_triangle_array
+        {
+            std::vector<const mesh*> source;
+            std::vector<uint32_t> index;
+            std::vector<uint32_t> transform;
+            std::vector<f4_matrix> world_to_object;
+        };
+
+        /**
+         * Proxies are traced against the scene of their geometry once the ray, taken into
+         * their object space, reaches their padded bounds
+         */
+        struct proxy_array : transformed_array
+        {
+            std::vector<const geometry_proxy*> source;
+            std::vector<aabb_bounds> bounds;
+        };
+
+        /**
+         * Interior nodes store the index of their second child in offset, the first one
+         * following them directly. Leaves list count primitives from offset in _leaf_primitives.
+         */
+        struct bvh_node
+        {
+            fpnum min[3];
+            fpnum max[3];
+            uint32_t offset;
+            uint32_t count;
+            uint8_t axis;
+        };
+
+        struct build_entry
+        {
+            uint32_t primitive;
+            aabb_bounds bounds;
+            f_point centroid;
+        };
+
+        using material_lookup = std::unordered_map<const phong_material*, uint32_t>;
+
+    private:
+
+        std::vector<primitive_t> _types;
+        std::vector<uint32_t> _slots;
+        std::vector<uint32_t> _material_indices;
+        std::vector<shape_ptr> _objects;
+        std::vector<phong_material_ptr> _materials;
+
+        sphere_array _spheres;
+        transformed_array _planes;
+        transformed_array _cubes;
+        capped_array _cylinders;
+        capped_array _cones;
+        triangle_array _triangles;
+        mesh_triangle_array _mesh_triangles;
+        proxy_array _proxies;
+
+        std::vector<bvh_node> _nodes;
+        std::vector<uint32_t> _leaf_primitives;
+        std::vector<uint32_t> _unbounded;
+
+    private:
+
+        render_scene() = default;
+
+        void add_shape( const shape_ptr& s, const f4_matrix& object_to_world, const f4_matrix& world_to_object,
+            material_lookup& lookup, std::vector<build_entry>& entries );
+
+        uint32_t build_node( std::vector<build_entry>& entries, std::size_t begin, std::size_t end );
+
+        uint8_t intersect_primitive( uint32_t primitive, const ray& r, fpnum* ts ) const;
+
+        /**
+         * Returns the geometry of the proxy in the given slot, loading it if needed, when the
+         * ray in its object space reaches its bounds within [t_min, t_max], and null otherwise.
+         * The geometry is pinned by the scope open on the thread, or else held in keep.
+         */
+        const proxy_geometry_ptr* reached_proxy( uint32_t slot, const ray& local, fpnum t_min, fpnum t_max, proxy_geometry_ptr& keep ) const;
+
+        template<typename Visitor>
+        void traverse( const ray& r, fpnum t_min, const fpnum& t_max, Visitor&& visit ) const;
+
+    };
+}
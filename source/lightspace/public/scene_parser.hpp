@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.hpp"
+#include <memory>
+#include <string>
+
+namespace ls {
+    enum class scene_parse_status
+    {
+        SUCCESS, FAIL
+    };
+
+    struct scene_parse_error
+    {
+        unsigned int line_number{ 0 };
+        std::string message;
+    };
+
+    struct scene_parse_result
+    {
+        scene_parse_status status{ scene_parse_status::FAIL };
+        world_ptr world;
+        camera_ptr camera;
+        std::unique_ptr<scene_parse_error> error;
+    };
+
+    /**
+     * Reads text scene descriptions, one statement per line, with # starting a comment:
+     *
+     *     camera <width> <height> <fov> from <x y z> to <x y z> up <x y z>
+     *     light point <r g b> <x y z> [falloff <c l q>]
+     *     light rectangle <r g b> <corner> <uvec> <usteps> <vvec> <vsteps> [falloff <c l q>] [nojitter]
+     *     light sphere <r g b> <center> <radius> <rings> <sectors> [falloff <c l q>]
+     *     pattern <name> solid <r g b> | stripe|gradient|ring|checker <r g b> <r g b> | test [transforms]
+     *     material <name> [material attributes]
+     *     group [name] [transforms] ... end
+     *     sphere|plane|cube [shape options]
+     *     cylinder|cone <min> <max> [closed] [shape options]
+     *     triangle <x y z> <x y z> <x y z> [shape options]
+     *     obj <file> [weld [tolerance]] [quantize] [shape options]
+     *     proxy <file> <min x y z> <max x y z> [weld [tolerance]] [quantize] [shape options]
+     *     proxy_budget <megabytes>
+     *
+     * Material attributes are material <name> to start from a named material, color <r g b>,
+     * pattern <name>, ambient, diffuse, specular, shininess, reflectivity, transparency and
+     * refractive_index <value>. Shape options are material attributes and transforms, which
+     * are translate and scale <x y z>, rotate_x, rotate_y and rotate_z <angle> and shear
+     * <xy xz yx yz zx zy>, each applied after the ones before it. Angles are in radians, or in
+     * degrees when suffixed with deg. The camera is required.
+     *
+     * Everything is allocated from the world's arena and added to the world and groups in
+     * bulk. Patterns and materials with the same values are created once and shared by every
+     * shape using them, including the triangles of included OBJ models, whose paths are
+     * relative to the scene. Proxies stand in for OBJ, PLY or mesh cache files by the bounds
+     * of their models until a ray reaches them, sharing one cache whose budget is unlimited
+     * unless proxy_budget sets it.
+     */
+    struct scene_parser
+    {
+        /**
+         * A file that cannot be read fails with an error on line 0
+         */
+        static scene_parse_result load( const std::string& file );
+
+        static scene_parse_result parse( const std::string& text, const std::string& directory = "." );
+    };
+}
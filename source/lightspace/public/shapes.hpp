@@ -4,20 +4,39 @@
 #include "matrix.hpp"
 #include "materials.hpp"
 #include "intersection.hpp"
+#include "mesh.hpp"
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
 
 namespace ls {
+    /**
+     * Counts the edits to the shapes of a world that change how they are compiled into a
+     * render scene, such as new transforms, materials, extents or children, so the world
+     * can tell whether its scene is still current
+     */
+    using edit_counter = std::atomic<uint64_t>;
+    using edit_counter_ptr = std::shared_ptr<edit_counter>;
+
     class shape : public std::enable_shared_from_this<shape>
     {
     public:
 
         shape() :
-            _id( get_uid() ), _origin( f_point( 0, 0, 0 ) ), _transform( f4_matrix::identity() ), _mat( phong_material::create() )
+            _id( get_uid() ), _origin( f_point( 0, 0, 0 ) ), _transform( f4_matrix::identity() ), _inverse_transform( f4_matrix::identity() ),
+            _normal_transform( f4_matrix::identity() ), _mat( phong_material::create() ), _parent_group( nullptr )
         { }
         explicit shape( const f_point& o ) :
-            _id( get_uid() ), _origin( o ), _transform( f4_matrix::identity() ), _mat( phong_material::create() )
+            _id( get_uid() ), _origin( o ), _transform( f4_matrix::identity() ), _inverse_transform( f4_matrix::identity() ),
+            _normal_transform( f4_matrix::identity() ), _mat( phong_material::create() ), _parent_group( nullptr )
         { }
         virtual ~shape() { }
 
+        uint32_t id() const noexcept
+        {
+            return _id;
+        }
+
         const f_point& origin() const noexcept
         {
             return _origin;
@@ -28,9 +47,29 @@ namespace ls {
             return _transform;
         }
 
-        void set_transform( const f4_matrix& t ) noexcept
+        const f4_matrix& inverse_transform() const noexcept
+        {
+            return _inverse_transform;
+        }
+
+        void set_transform( const f4_matrix& t )
         {
+            mark_edited();
             _transform = t;
+            _inverse_transform = t.inverse();
+            _normal_transform = _inverse_transform.transpose();
+        }
+
+        /**
+         * Sets a transform whose inverse is already known, such as one restored from a
+         * snapshot, without inverting it again
+         */
+        void set_transform( const f4_matrix& t, const f4_matrix& inverse )
+        {
+            mark_edited();
+            _transform = t;
+            _inverse_transform = inverse;
+            _normal_transform = inverse.transpose();
         }
 
         const phong_material_ptr& material() const noexcept
@@ -40,6 +79,7 @@ namespace ls {
 
         void set_material( const phong_material_ptr& mat ) noexcept
         {
+            mark_edited();
             _mat = mat;
         }
 
@@ -56,6 +96,7 @@ namespace ls {
         {
             _parent.reset();
             _parent = group_ptr_weak( p );
+            _parent_group = p.get();
         }
 
         f_point world_to_object( const f_point& p ) const noexcept;
@@ -83,14 +124,46 @@ namespace ls {
 
     protected:
 
+        friend class group;
+        friend class world;
+
+        /**
+         * The edit counter of the first world the shape was added to. Copies start without
+         * one, so editing them does not count against that world.
+         */
+        struct edit_link
+        {
+            edit_counter_ptr counter;
+
+            edit_link() = default;
+
+            edit_link( const edit_link& ) noexcept
+            { }
+
+            edit_link& operator=( const edit_link& ) noexcept
+            {
+                return *this;
+            }
+        };
+
         uint32_t _id;
         f_point _origin;
         f4_matrix _transform;
+        f4_matrix _inverse_transform;
+        f4_matrix _normal_transform;
         phong_material_ptr _mat;
         group_ptr_weak _parent;
+        // Raw alias of _parent for the render path, cleared by the parent when it is destroyed
+        const group* _parent_group;
+        edit_link _edits;
 
     protected:
 
+        /**
+         * Counts an edit against the worlds holding the shape or any of the groups above it
+         */
+        void mark_edited() const noexcept;
+
         virtual f_vector local_normal( const f_point& p ) const
         {
             return f_vector( 0, 0, 0 );
@@ -100,6 +173,27 @@ namespace ls {
 
     intersections intersect( const shape_ptr& s, const ray& r );
 
+    /**
+     * Intersection kernels shared by the shapes and the compiled render scene. Each takes
+     * a ray already in the primitive's space, writes up to max_hits times into ts in the
+     * order the shape reports them and returns how many it wrote.
+     */
+    namespace local_intersect {
+        static constexpr uint8_t max_hits = 4;
+
+        uint8_t sphere( const ray& r, const f_point& origin, fpnum* ts ) noexcept;
+
+        uint8_t plane( const ray& r, fpnum* ts ) noexcept;
+
+        uint8_t cube( const ray& r, fpnum* ts ) noexcept;
+
+        uint8_t cylinder( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept;
+
+        uint8_t cone( const ray& r, fpnum min, fpnum max, bool closed, fpnum* ts ) noexcept;
+
+        uint8_t triangle( const ray& r, const f_point& p1, const f_vector& e1, const f_vector& e2, fpnum* ts ) noexcept;
+    }
+
     class sphere : public shape
     {
     public:
@@ -216,6 +310,7 @@ namespace ls {
         
         void set_min_extent( fpnum extent ) noexcept
         {
+            mark_edited();
             min_extent_ = extent;
         }
         
@@ -226,6 +321,7 @@ namespace ls {
         
         void set_max_extent( fpnum extent ) noexcept
         {
+            mark_edited();
             max_extent_ = extent;
         }
         
@@ -236,6 +332,7 @@ namespace ls {
         
         void set_closed( bool closed ) noexcept
         {
+            mark_edited();
             closed_ = closed;
         }
 
@@ -283,6 +380,7 @@ namespace ls {
 
         void set_min_extent( fpnum extent ) noexcept
         {
+            mark_edited();
             min_extent_ = extent;
         }
 
@@ -293,6 +391,7 @@ namespace ls {
 
         void set_max_extent( fpnum extent ) noexcept
         {
+            mark_edited();
             max_extent_ = extent;
         }
 
@@ -303,12 +402,14 @@ namespace ls {
 
         void set_closed( bool closed ) noexcept
         {
+            mark_edited();
             closed_ = closed;
         }
 
         aabb_bounds bounds() const noexcept override
         {
-            return aabb_bounds( f_point( -1, min_extent_, -1 ), f_point( 1, max_extent_, 1 ) );
+            auto radius = std::max( std::abs( min_extent_ ), std::abs( max_extent_ ) );
+            return aabb_bounds( f_point( -radius, min_extent_, -radius ), f_point( radius, max_extent_, radius ) );
         }
 
         static bool check_cap( const ray& r, fpnum radius, fpnum t ) noexcept;
@@ -374,6 +475,13 @@ namespace ls {
             return normal_;
         }
 
+        aabb_bounds bounds() const noexcept override
+        {
+            return aabb_bounds(
+                f_point( std::min( { p1_.x, p2_.x, p3_.x } ), std::min( { p1_.y, p2_.y, p3_.y } ), std::min( { p1_.z, p2_.z, p3_.z } ) ),
+                f_point( std::max( { p1_.x, p2_.x, p3_.x } ), std::max( { p1_.y, p2_.y, p3_.y } ), std::max( { p1_.z, p2_.z, p3_.z } ) ) );
+        }
+
         void precompute_edges() noexcept
         {
             e1_ = p2_ - p1_;
@@ -407,6 +515,97 @@ namespace ls {
 
     intersections intersect( const triangle_ptr& tr, const ray& r );
 
+    /**
+     * A triangle of an indexed mesh. Its corners are decoded from the mesh whenever they are
+     * needed instead of being copied, so beside the shape itself it only holds the mesh and
+     * its index, and triangles of quantized meshes stay as compact as their mesh. Normals and
+     * texture coordinates come from the mesh's shared streams as well. Where all three
+     * corners have a normal the surface normal is interpolated across the face.
+     */
+    class mesh_triangle : public shape
+    {
+    public:
+
+        using shape::normal;
+
+        mesh_triangle( const mesh_ptr& m, uint32_t index ) :
+            shape(), _mesh( m ), _index( index )
+        { }
+
+        const mesh_ptr& source_mesh() const noexcept
+        {
+            return _mesh;
+        }
+
+        uint32_t index() const noexcept
+        {
+            return _index;
+        }
+
+        f_point p1() const noexcept
+        {
+            return corner( 0 );
+        }
+
+        f_point p2() const noexcept
+        {
+            return corner( 1 );
+        }
+
+        f_point p3() const noexcept
+        {
+            return corner( 2 );
+        }
+
+        f_vector e1() const noexcept
+        {
+            return p2() - p1();
+        }
+
+        f_vector e2() const noexcept
+        {
+            return p3() - p1();
+        }
+
+        f_vector normal() const noexcept
+        {
+            return e2().cross( e1() ).normalized();
+        }
+
+        aabb_bounds bounds() const noexcept override;
+
+        /**
+         * The weights of the second and third corner at a point on the triangle in object
+         * space
+         */
+        void barycentric( const f_point& p, fpnum& u, fpnum& v ) const noexcept;
+
+        /**
+         * Interpolates the texture coordinates at a point on the triangle in object space,
+         * or returns ( 0, 0 ) when the corners have none
+         */
+        texture_uv uv_at( const f_point& p ) const noexcept;
+
+        PTR_FACTORY( mesh_triangle )
+
+    private:
+
+        mesh_ptr _mesh;
+        uint32_t _index;
+
+    private:
+
+        f_point corner( std::size_t i ) const noexcept
+        {
+            return _mesh->position( _mesh->triangle_corners( _index )[i].position );
+        }
+
+        f_vector local_normal( const f_point& p ) const override;
+
+    };
+
+    intersections intersect( const mesh_triangle_ptr& tr, const ray& r );
+
     class group : public shape
     {
     public:
@@ -419,6 +618,7 @@ namespace ls {
         group( const std::string& name ) :
             shape(), name_( name )
         { }
+        ~group();
 
         const std::string& name() const noexcept
         {
@@ -435,8 +635,34 @@ namespace ls {
             name_ = name;
         }
 
+        bool has_child( const shape_ptr& shape ) const noexcept
+        {
+            return shape && child_set_.count( shape.get() ) > 0;
+        }
+
         void add_child( const shape_ptr shape ) noexcept;
 
+        /**
+         * Adds every shape in [first, last) that is not already a child, reserving space up
+         * front so building a large group is linear in the number of children
+         */
+        template<typename It>
+        void add_children( It first, It last ) noexcept
+        {
+            auto self = std::static_pointer_cast<group>( shared_from_this() );
+            reserve_children( static_cast<std::size_t>( std::distance( first, last ) ) );
+            for ( ; first != last; ++first )
+            {
+                insert_child( *first, self );
+            }
+        }
+
+        template<typename Range>
+        void add_children( const Range& shapes ) noexcept
+        {
+            add_children( std::begin( shapes ), std::end( shapes ) );
+        }
+
         aabb_bounds bounds() const noexcept override;
 
         PTR_FACTORY( group )
@@ -445,6 +671,13 @@ namespace ls {
 
         std::string name_;
         children_list children_;
+        std::unordered_set<const shape*> child_set_;
+
+    private:
+
+        void reserve_children( std::size_t count ) noexcept;
+
+        void insert_child( const shape_ptr& shape, const group_ptr& self ) noexcept;
 
     private:
 
@@ -455,5 +688,9 @@ namespace ls {
 
     };
 
+    /**
+     * Intersections with the children of a group refer to them without sharing their
+     * ownership, and are only valid while the group is alive
+     */
     intersections intersect( const group_ptr& grp, const ray& r );
 }
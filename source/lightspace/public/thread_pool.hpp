@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.hpp"
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace ls {
+    /**
+     * Runs a batch of independent jobs across a fixed number of threads. Jobs are dealt
+     * out in contiguous blocks to per-thread queues; a thread that drains its own queue
+     * steals from the back of the other queues until every job has been run.
+     *
+     * The calling thread takes part in every batch. The other threads are started by the
+     * first batch that needs them and wait for the next batch until the pool is destroyed,
+     * so running many small batches on one pool does not start threads for each of them.
+     */
+    class thread_pool
+    {
+    public:
+
+        explicit thread_pool( uint16_t threads = 0 );
+
+        thread_pool( thread_pool&& ) noexcept;
+
+        thread_pool& operator=( thread_pool&& ) noexcept;
+
+        ~thread_pool();
+
+        uint16_t threads() const noexcept
+        {
+            return _threads;
+        }
+
+        /**
+         * Runs job for every index in [0, jobs) and returns once all of them are done, one
+         * batch at a time
+         */
+        void run( std::size_t jobs, const std::function<void( std::size_t )>& job );
+
+        static uint16_t hardware_threads() noexcept;
+
+    private:
+
+        struct job_queue
+        {
+            std::mutex lock;
+            std::deque<std::size_t> jobs;
+        };
+
+        struct worker_set;
+
+    private:
+
+        uint16_t _threads;
+        std::unique_ptr<worker_set> _workers;
+
+    private:
+
+        static void work( worker_set& set, std::size_t id );
+
+        static bool pop( job_queue& queue, std::size_t& job );
+
+        static bool steal( job_queue& queue, std::size_t& job );
+
+    };
+}
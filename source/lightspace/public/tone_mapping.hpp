@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include "canvas.hpp"
+
+namespace ls {
+    class thread_pool;
+
+    /**
+     * How scene radiance is compressed into the displayable range. clamp cuts everything
+     * above 1 off, reinhard maps x to x / ( 1 + x ) and aces follows the filmic curve of
+     * Narkowicz' ACES fit.
+     */
+    enum class tone_curve
+    {
+        clamp, reinhard, aces
+    };
+
+    /**
+     * How displayable values are stored in bytes. linear keeps the historical
+     * clamp( c * 256, 0, 255 ) quantization, srgb applies the sRGB transfer function.
+     */
+    enum class color_encoding
+    {
+        linear, srgb
+    };
+
+    /**
+     * Turns framebuffer floats into 8-bit RGB. Pixels are scaled by the exposure, run through
+     * the tone curve and encoded, four channels at a time with SSE where it is available. The
+     * sRGB transfer function is looked up in a table rather than computed per channel.
+     *
+     * The default mapper reproduces quantize_row exactly.
+     */
+    class tone_mapper
+    {
+    public:
+
+        static constexpr std::size_t lut_size = 1 << 12;
+
+        explicit tone_mapper( float exposure = 1.f, tone_curve curve = tone_curve::clamp, color_encoding encoding = color_encoding::linear );
+
+        float exposure() const noexcept
+        {
+            return _exposure;
+        }
+
+        tone_curve curve() const noexcept
+        {
+            return _curve;
+        }
+
+        color_encoding encoding() const noexcept
+        {
+            return _encoding;
+        }
+
+        uint16_t threads() const noexcept
+        {
+            return _threads;
+        }
+
+        /**
+         * Sets the number of threads map_rows spreads large batches of rows over, where 0
+         * uses every hardware thread
+         */
+        void set_threads( uint16_t threads ) noexcept
+        {
+            _threads = threads;
+        }
+
+        void map_row( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) const noexcept;
+
+        /**
+         * Maps count rows of width pixels, each stride pixels after the previous one, into
+         * tightly packed RGB rows
+         */
+        void map_rows( const rgba_pixel* pixels, std::size_t stride, std::size_t width, std::size_t count, uint8_t* rgb ) const;
+
+        /**
+         * Maps rows like the overload above on the threads of pool, which callers mapping
+         * many batches keep from one batch to the next
+         */
+        void map_rows( const rgba_pixel* pixels, std::size_t stride, std::size_t width, std::size_t count, uint8_t* rgb, thread_pool& pool ) const;
+
+        std::vector<uint8_t> map( const canvas& image ) const;
+
+    private:
+
+        float _exposure;
+        tone_curve _curve;
+        color_encoding _encoding;
+        uint16_t _threads{ 0 };
+        std::vector<uint8_t> _srgb;
+
+    private:
+
+        template<tone_curve Curve, color_encoding Encoding>
+        void map_span( const rgba_pixel* pixels, std::size_t count, uint8_t* rgb ) const noexcept;
+
+    };
+}
@@ -1,25 +1,100 @@
 #pragma once
 
 #include <vector>
+#include <iterator>
+#include <unordered_set>
+#include <mutex>
 #include "common.hpp"
 #include "shapes.hpp"
 #include "lights.hpp"
 #include "transform.hpp"
 #include "intersection.hpp"
+#include "render_scene.hpp"
 
 namespace ls {
+    static constexpr uint8_t default_ray_depth = 5;
+    static constexpr fpnum default_min_throughput = 0.001f;
+
+#if DEVELOPMENT
+    /**
+     * Counters gathered while tracing to evaluate how much work the renderer avoids.
+     * light_samples counts the shadow rays a renderer testing every light sample
+     * at every shading point would cast.
+     */
+    struct trace_stats
+    {
+        std::atomic_uint64_t light_samples{ 0 };
+        std::atomic_uint64_t shadow_rays{ 0 };
+
+        trace_stats() = default;
+
+        trace_stats( const trace_stats& other ) :
+            light_samples( other.light_samples.load() ), shadow_rays( other.shadow_rays.load() )
+        { }
+    };
+#endif
+
+    /**
+     * Rendering treats the world as frozen: the objects, lights, materials and patterns
+     * reachable from it must not be modified while a camera renders it. In exchange
+     * color_at may be called from many threads at once, and traversal avoids lazy statics,
+     * weak_ptr locks and reference count updates. Threads only write shared state to take a
+     * reference on the shape each hit returns, to count traces in DEVELOPMENT builds and to
+     * load geometry proxies; rays reaching a proxy outside a camera's pin scope also take a
+     * reference on its geometry.
+     * Authoring edits are free again once the render returns.
+     *
+     * Cameras prepare the world before rendering and color_at traces against the scene it
+     * holds, or against its objects while that scene is missing or out of date. Preparing compiles a render_scene only when the world has none or shapes were
+     * edited since it was built, so renders of an unchanged world share one scene and never
+     * replace it under each other. Adding or removing objects discards the scene.
+     */
     class world : public std::enable_shared_from_this<world>
     {
     public:
 
         const light_ptr light() const noexcept
         {
-            return _light;
+            return _lights.empty() ? nullptr : _lights.front();
         }
 
         void set_light( light_ptr light ) noexcept
         {
-            _light = light;
+            _lights.clear();
+            add_light( light );
+        }
+
+        const std::vector<light_ptr>& lights() const noexcept
+        {
+            return _lights;
+        }
+
+        void add_light( light_ptr light ) noexcept
+        {
+            if ( light )
+            {
+                _lights.push_back( light );
+            }
+        }
+
+        uint8_t max_depth() const noexcept
+        {
+            return _max_depth;
+        }
+
+        void set_max_depth( uint8_t depth ) noexcept
+        {
+            _max_depth = depth;
+        }
+
+        fpnum min_throughput() const noexcept
+        {
+            return _min_throughput;
+        }
+
+        void set_min_throughput( fpnum throughput ) noexcept
+        {
+            _min_throughput = throughput;
         }
 
         const std::vector<shape_ptr>& objects() const noexcept
@@ -29,28 +104,188 @@ namespace ls {
 
         void add_object( shape_ptr obj );
 
+        /**
+         * Adds every shape in [first, last) that is not already in the world
+         */
+        template<typename It>
+        void add_objects( It first, It last )
+        {
+            auto count = static_cast<std::size_t>( std::distance( first, last ) );
+            _objects.reserve( _objects.size() + count );
+            _object_set.reserve( _object_set.size() + count );
+            for ( ; first != last; ++first )
+            {
+                insert_object( *first );
+            }
+        }
+
+        template<typename Range>
+        void add_objects( const Range& objs )
+        {
+            add_objects( std::begin( objs ), std::end( objs ) );
+        }
+
         void remove_object( shape_ptr obj );
 
+        bool has_object( const shape_ptr& obj ) const noexcept
+        {
+            return obj && _object_set.count( obj.get() ) > 0;
+        }
+
         bool contains( const shape_ptr& s ) const;
 
         static world_ptr create_default() noexcept;
 
-        f_color shade_hit( const intersection_state& state, uint8_t depth = 5 );
-        
-        f_color reflected_color( const intersection_state& state, uint8_t depth = 5 );
-        
-        f_color refracted_color( const intersection_state& state, uint8_t depth = 5 );
+        /**
+         * The arena objects built for this world can be allocated from by creating them
+         * inside an arena_scope on it. They then sit next to each other in memory and are
+         * released together once the world and every one of them are gone.
+         */
+        const arena_ptr& arena();
+
+        /**
+         * Builds the render scene that tracing uses until the world's objects change
+         */
+        const render_scene_ptr& compile();
+
+        /**
+         * Compiles the world unless the scene it holds, compiled or restored from a snapshot,
+         * is still current
+         */
+        const render_scene_ptr& prepare();
+
+        /**
+         * Whether the world holds a scene and none of its shapes was edited since it was built
+         */
+        bool scene_current() const noexcept
+        {
+            return _scene && _scene_generation == edit_generation();
+        }
+
+        const render_scene_ptr& scene() const noexcept
+        {
+            return _scene;
+        }
+
+        f_color shade_hit( const intersection_state& state );
+
+        f_color shade_hit( const intersection_state& state, uint8_t depth );
+
+        f_color reflected_color( const intersection_state& state );
+
+        f_color reflected_color( const intersection_state& state, uint8_t depth );
+
+        f_color refracted_color( const intersection_state& state );
+
+        f_color refracted_color( const intersection_state& state, uint8_t depth );
+
+        f_color color_at( const ray& r );
+
+        f_color color_at( const ray& r, uint8_t depth );
+
+#if DEVELOPMENT
+        const trace_stats& stats() const noexcept
+        {
+            return _stats;
+        }
 
-        f_color color_at( const ray& r, uint8_t depth = 5 );
+        void reset_stats() noexcept
+        {
+            _stats.light_samples = 0;
+            _stats.shadow_rays = 0;
+        }
+#endif
 
         bool in_shadow( const f_point& p );
 
+        bool in_shadow( const f_point& p, const light_ptr& l );
+
+        fpnum light_visibility( const f_point& p, const light_ptr& l );
+
         PTR_FACTORY( world )
 
     private:
 
-        light_ptr _light = nullptr;
+        friend struct world_snapshot;
+
+        /**
+         * A secondary ray waiting to be traced, weighted by the accumulated
+         * reflectivity, transparency and fresnel factors along its path
+         */
+        struct traced_ray
+        {
+            ray r;
+            fpnum throughput;
+            uint8_t depth;
+        };
+
+        using ray_stack = std::vector<traced_ray>;
+
+        /**
+         * Serializes compiling, while leaving worlds copyable with a lock of their own
+         */
+        struct compile_lock
+        {
+            std::mutex mutex;
+
+            compile_lock() = default;
+
+            compile_lock( const compile_lock& )
+            { }
+        };
+
+    private:
+
+        std::vector<light_ptr> _lights;
         std::vector<shape_ptr> _objects;
+        std::unordered_set<const shape*> _object_set;
+        // The world's own counter first, then those of objects that came from other worlds
+        std::vector<edit_counter_ptr> _edit_counters{ std::make_shared<edit_counter>( 0 ) };
+        render_scene_ptr _scene;
+        uint64_t _scene_generation{ 0 };
+        compile_lock _compile_lock;
+        arena_ptr _arena;
+        uint8_t _max_depth = default_ray_depth;
+        fpnum _min_throughput = default_min_throughput;
+#if DEVELOPMENT
+        trace_stats _stats;
+#endif
+
+    private:
+
+        void insert_object( const shape_ptr& obj );
+
+        /**
+         * Counters only grow, so their sum changes with every edit to the world's shapes
+         */
+        uint64_t edit_generation() const noexcept
+        {
+            uint64_t generation = 0;
+            for ( const auto& counter : _edit_counters )
+            {
+                generation += counter->load( std::memory_order_relaxed );
+            }
+            return generation;
+        }
+
+        /**
+         * Compiles the world, with the compile lock already held
+         */
+        const render_scene_ptr& compile_scene();
+
+        f_color integrate( ray_stack& stack );
+
+        f_color shade_surface( const intersection_state& state, fpnum throughput, uint8_t depth, ray_stack& stack );
+
+        f_color direct_lighting( const intersection_state& state, fpnum throughput );
+
+        void push_ray( ray_stack& stack, const ray& r, fpnum throughput, uint8_t depth ) const;
+
+        bool occluded( const f_point& p, const f_point& target );
+
+        bool find_hit( const ray& r, intersection& h, intersections& itrs ) const;
+
+        intersections intersect_objects( const ray& r ) const;
 
     };
 
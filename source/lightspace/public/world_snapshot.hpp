@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.hpp"
+#include <string>
+
+namespace ls {
+    /**
+     * A world saved together with its compiled render scene, so that a restarted renderer
+     * can trace it without parsing anything or building its bounding volume hierarchy.
+     *
+     * The file holds a header followed by tables in native byte order: patterns, materials,
+     * meshes, the shapes in depth first order with their parents, lights and every array of
+     * the render scene. Loading maps it, checks every index once and copies the tables into
+     * place. The shapes are the only objects created one by one, and the scene is used as it
+     * is until an object is added to or removed from the world.
+     *
+     * Only the shapes, patterns and lights of this library can be stored, and mesh parts are
+     * not kept.
+     */
+    struct world_snapshot
+    {
+        world_ptr world;
+        camera_ptr camera;
+
+        /**
+         * Writes the world and, when given, the camera, compiling the world first unless its
+         * scene is current. Throws std::runtime_error when it contains an object that cannot
+         * be stored, and std::system_error when the file cannot be written, in which case an
+         * existing file of that name is left as it was.
+         */
+        static void write( const std::string& file, const world_ptr& w, const camera_ptr& cam = nullptr );
+
+        /**
+         * Restores a snapshot, creating the shapes on up to threads threads, where 0 uses
+         * every hardware thread. Throws std::runtime_error when the file is not a snapshot of
+         * this build or refers to elements it does not contain, and std::system_error when
+         * it cannot be opened.
+         */
+        static world_snapshot load( const std::string& file, uint16_t threads = 0 );
+    };
+}
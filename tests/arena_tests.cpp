@@ -0,0 +1,120 @@
+#include "catch.hpp"
+#include "arena.hpp"
+#include "shapes.hpp"
+#include "world.hpp"
+#include "model_parser.hpp"
+
+using namespace ls;
+
+TEST_CASE( "Arena processing", "[arena]" )
+{
+    SECTION( "Allocations are aligned and packed into one block" )
+    {
+        auto a = std::make_shared<arena>( 1024 );
+        auto p1 = static_cast<unsigned char*>( a->allocate( 3, 1 ) );
+        auto p2 = static_cast<unsigned char*>( a->allocate( 8, 8 ) );
+
+        REQUIRE( reinterpret_cast<std::uintptr_t>( p2 ) % 8 == 0 );
+        REQUIRE( p2 - p1 < 16 );
+        REQUIRE( a->block_count() == 1 );
+        REQUIRE( a->bytes_used() == 11 );
+        REQUIRE( a->owns( p1 ) );
+        REQUIRE( a->owns( p2 ) );
+    }
+
+    SECTION( "Large allocations get their own block" )
+    {
+        auto a = std::make_shared<arena>( 1024 );
+        auto small = static_cast<unsigned char*>( a->allocate( 16, 8 ) );
+        a->allocate( 4096, 8 );
+        auto next = static_cast<unsigned char*>( a->allocate( 16, 8 ) );
+
+        REQUIRE( a->block_count() == 2 );
+        REQUIRE( next == small + 16 );
+    }
+
+    SECTION( "Child arenas take their blocks from the parent" )
+    {
+        auto parent = std::make_shared<arena>( 4096 );
+        auto child = std::make_shared<arena>( parent, 256 );
+        auto p1 = child->allocate( 100, 8 );
+        auto p2 = child->allocate( 200, 8 );
+
+        REQUIRE( child->block_count() == 2 );
+        REQUIRE( parent->block_count() == 1 );
+        REQUIRE( parent->owns( p1 ) );
+        REQUIRE( parent->owns( p2 ) );
+        REQUIRE( child->owns( p2 ) );
+        REQUIRE_FALSE( child->owns( parent->allocate( 8, 8 ) ) );
+    }
+
+    SECTION( "Factories allocate from the arena in scope" )
+    {
+        auto a = std::make_shared<arena>();
+        sphere_ptr inside;
+        {
+            arena_scope scope( a );
+            inside = sphere::create();
+        }
+        auto outside = sphere::create();
+
+        REQUIRE( a->owns( inside.get() ) );
+        REQUIRE( a->owns( inside->material().get() ) );
+        REQUIRE( a->owns( inside->material()->surface_pattern.get() ) );
+        REQUIRE( !a->owns( outside.get() ) );
+        REQUIRE( arena_scope::current() == nullptr );
+    }
+
+    SECTION( "Nested scopes restore the previous arena" )
+    {
+        auto a1 = std::make_shared<arena>();
+        auto a2 = std::make_shared<arena>();
+        arena_scope outer( a1 );
+        {
+            arena_scope inner( a2 );
+            REQUIRE( *arena_scope::current() == a2 );
+        }
+
+        REQUIRE( *arena_scope::current() == a1 );
+    }
+
+    SECTION( "Objects keep their arena alive" )
+    {
+        std::weak_ptr<arena> weak;
+        shape_ptr s;
+        {
+            auto a = std::make_shared<arena>();
+            weak = a;
+            arena_scope scope( a );
+            s = cube::create();
+        }
+
+        REQUIRE( !weak.expired() );
+        s.reset();
+        REQUIRE( weak.expired() );
+    }
+
+    SECTION( "Objects built for a world share its arena" )
+    {
+        auto w = world::create();
+        {
+            arena_scope scope( w->arena() );
+            w->add_object( sphere::create() );
+            w->add_object( plane::create() );
+        }
+
+        REQUIRE( w->arena() );
+        REQUIRE( w->arena()->owns( w->objects()[0].get() ) );
+        REQUIRE( w->arena()->owns( w->objects()[1].get() ) );
+    }
+
+    SECTION( "Parsed models are allocated from an arena" )
+    {
+        std::ifstream f( "triangles.obj" );
+        auto result = model_parser::obj( f );
+
+        REQUIRE( result.data->arena );
+        REQUIRE( result.data->arena->owns( result.data->root_group.get() ) );
+        REQUIRE( result.data->arena->owns( result.data->root_group->children()[0].get() ) );
+    }
+};
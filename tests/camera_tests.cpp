@@ -1,6 +1,13 @@
 #include "catch.hpp"
 #include "camera.hpp"
 #include "world.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "patterns.hpp"
+#include "image_writer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 
 using namespace ls;
 
@@ -73,4 +80,124 @@ TEST_CASE( "Camera processing", "[camera]" )
 
         REQUIRE( img.pixel_at( 5, 5 ) == f_color( 0.38066f, 0.47583f, 0.2855f ) );
     }
+    SECTION( "The default render settings" )
+    {
+        auto c = camera( 160, 120, pi_over_2 );
+
+        REQUIRE( c.threads() == 0 );
+        REQUIRE( c.tile_size() == default_tile_size );
+    }
+
+    SECTION( "Rendering in parallel tiles matches the serial render exactly" )
+    {
+        auto w = world::create_default();
+        w->objects()[0]->material()->reflectivity = 0.3f;
+        auto c = camera::create( 37, 23, pi_over_2 );
+        c->set_transform( transform::view( f_point( 0, 0.5f, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        c->set_threads( 1 );
+        auto serial = c->render( w );
+        c->set_threads( 4 );
+        c->set_tile_size( 5 );
+        auto parallel = c->render( w );
+
+        bool identical = true;
+        for ( uint16_t y = 0; y < serial.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < serial.width(); x++ )
+            {
+                auto a = serial.pixel_at( x, y ), b = parallel.pixel_at( x, y );
+                identical = identical && a.r == b.r && a.g == b.g && a.b == b.b;
+            }
+        }
+
+        REQUIRE( identical );
+    }
+    SECTION( "Rendering a frozen world with many threads" )
+    {
+        // Build with -DTHREAD_SANITIZER=ON to check the render path for data races
+        auto w = world::create_default();
+        w->objects()[0]->material()->reflectivity = 0.5f;
+        w->objects()[1]->material()->transparency = 0.8f;
+        w->objects()[1]->material()->refractive_index = 1.5f;
+        w->objects()[1]->material()->surface_pattern = checker_pattern::create( f_color( 1, 1, 1 ), f_color( 0, 0, 0 ) );
+        auto g = group::create();
+        auto s = sphere::create();
+        s->set_transform( transform::translation( 0.f, 0.f, -1.f ) );
+        g->add_child( s );
+        g->set_transform( transform::translation( 1.5f, 0.f, 0.f ) );
+        w->add_object( g );
+        w->add_light( rectangle_light::create( f_color( 0.5f, 0.5f, 0.5f ), f_point( 5, 10, -10 ), f_vector( 1, 0, 0 ), 2, f_vector( 0, 1, 0 ), 2 ) );
+        auto c = camera::create( 48, 32, pi_over_2 );
+        c->set_transform( transform::view( f_point( 0, 1.f, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        c->set_threads( 1 );
+        auto serial = c->render( w );
+        c->set_threads( 32 );
+        c->set_tile_size( 2 );
+        auto parallel = c->render( w );
+
+        bool identical = true;
+        for ( uint16_t y = 0; y < serial.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < serial.width(); x++ )
+            {
+                auto a = serial.pixel_at( x, y ), b = parallel.pixel_at( x, y );
+                identical = identical && a.r == b.r && a.g == b.g && a.b == b.b;
+            }
+        }
+
+        REQUIRE( identical );
+    }
+    SECTION( "Streaming a render emits every band in order with the tiled pixels" )
+    {
+        auto w = world::create_default();
+        w->objects()[0]->material()->reflectivity = 0.3f;
+        auto c = camera::create( 37, 23, pi_over_2 );
+        c->set_transform( transform::view( f_point( 0, 0.5f, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        c->set_threads( 1 );
+        auto expected = c->render( w );
+
+        for ( uint16_t threads : { 1, 4 } )
+        {
+            c->set_threads( threads );
+            c->set_tile_size( 5 );
+            uint16_t next_row = 0;
+            bool in_order = true, identical = true;
+            c->render( w, [&] ( const rgba_pixel* pixels, std::size_t stride, uint16_t y, uint16_t count ) {
+                in_order = in_order && y == next_row && count <= 5;
+                for ( uint16_t j = 0; j < count; j++ )
+                {
+                    for ( uint16_t x = 0; x < expected.width(); x++ )
+                    {
+                        auto a = expected.pixel_at( x, y + j ), b = to_color( pixels[j * stride + x] );
+                        identical = identical && a.r == b.r && a.g == b.g && a.b == b.b;
+                    }
+                }
+                next_row = y + count;
+            } );
+
+            REQUIRE( in_order );
+            REQUIRE( next_row == expected.height() );
+            REQUIRE( identical );
+        }
+    }
+    SECTION( "Streaming a render into files matches encoding the finished canvas" )
+    {
+        auto w = world::create_default();
+        auto c = camera::create( 23, 19, pi_over_2 );
+        c->set_transform( transform::view( f_point( 0, 0.5f, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        c->set_tile_size( 4 );
+        auto expected = c->render( w );
+        c->render_to( w, "camera_stream_test.ppm", ppm_format::binary );
+        c->render_pfm_to( w, "camera_stream_test.pfm" );
+
+        auto read_file = [] ( const char* path ) {
+            std::ifstream in( path, std::ios::binary );
+            return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+        };
+
+        REQUIRE( read_file( "camera_stream_test.ppm" ) == expected.to_ppm( ppm_format::binary ) );
+        REQUIRE( read_file( "camera_stream_test.pfm" ) == expected.to_pfm() );
+        std::remove( "camera_stream_test.ppm" );
+        std::remove( "camera_stream_test.pfm" );
+    }
 };
\ No newline at end of file
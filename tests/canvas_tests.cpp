@@ -1,5 +1,8 @@
 #include "catch.hpp"
 #include "canvas.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
 
 using namespace ls;
 
@@ -12,16 +15,40 @@ TEST_CASE( "Canvas processing", "[canvas]" )
         REQUIRE( canv.width() == 20 );
         REQUIRE( canv.height() == 10 );
 
-        const canvas::pixel_space& pixels = canv.pixels();
-        for ( auto i = 0; i < canv.height(); i++ )
+        for ( uint16_t i = 0; i < canv.height(); i++ )
         {
-            for ( auto j = 0; j < canv.width(); j++ )
+            for ( uint16_t j = 0; j < canv.width(); j++ )
             {
-                REQUIRE( pixels[i][j] == f_color( 0, 0, 0 ) );
+                REQUIRE( canv.pixel_at( j, i ) == f_color( 0, 0, 0 ) );
             }
         }
     }
 
+    SECTION( "Canvas rows are aligned and share one allocation" )
+    {
+        auto canv = canvas( 21, 10 );
+
+        REQUIRE( canv.row_stride() >= canv.width() );
+        REQUIRE( canv.pixels().size() == canv.row_stride() * canv.height() );
+        for ( uint16_t i = 0; i < canv.height(); i++ )
+        {
+            REQUIRE( reinterpret_cast<std::uintptr_t>( canv.row( i ) ) % canvas_row_alignment == 0 );
+            REQUIRE( canv.row( i ) == canv.pixels().data() + i * canv.row_stride() );
+        }
+    }
+
+    SECTION( "Writing through a row span" )
+    {
+        auto canv = canvas( 20, 10 );
+        auto span = canv.span( 4, 3 );
+        span[0] = to_pixel( f_color( 1, 0, 0 ) );
+        span[1] = to_pixel( f_color( 0, 1, 0 ) );
+
+        REQUIRE( canv.pixel_at( 4, 3 ) == f_color( 1, 0, 0 ) );
+        REQUIRE( canv.pixel_at( 5, 3 ) == f_color( 0, 1, 0 ) );
+        REQUIRE( canv.row( 3 )[5].g == 1.f );
+    }
+
     SECTION( "Writing a pixel to a canvas" )
     {
         auto canv = canvas( 20, 10 );
@@ -102,4 +129,44 @@ TEST_CASE( "Canvas processing", "[canvas]" )
 
         REQUIRE( ppm.back() == '\n' );
     }
+
+    SECTION( "Reading back a PFM restores the exact floats" )
+    {
+        auto canv = canvas( 7, 3 );
+        canv.draw_pixel( 0, 0, f_color( 12.5f, -0.125f, 0.1f ) );
+        canv.draw_pixel( 6, 2, f_color( 1e-6f, 3e4f, 1 ) );
+        std::istringstream in( canv.to_pfm() );
+        auto read = canvas::from_pfm( in );
+
+        REQUIRE( read.width() == 7 );
+        REQUIRE( read.height() == 3 );
+        REQUIRE( read.pixel_at( 0, 0 ) == f_color( 12.5f, -0.125f, 0.1f ) );
+        REQUIRE( read.pixel_at( 6, 2 ) == f_color( 1e-6f, 3e4f, 1 ) );
+        REQUIRE( read.pixel_at( 3, 1 ) == f_color( 0, 0, 0 ) );
+    }
+
+    SECTION( "Reading a grayscale PFM in the other byte order" )
+    {
+        float values[2] = { 0.5f, 8.f };
+        auto bytes = std::string( reinterpret_cast<const char*>( values ), sizeof( values ) );
+        for ( std::size_t i = 0; i < bytes.size(); i += sizeof( float ) )
+        {
+            std::reverse( bytes.begin() + i, bytes.begin() + i + sizeof( float ) );
+        }
+        std::istringstream in( std::string( is_little_endian() ? "Pf\n1 2\n1.0\n" : "Pf\n1 2\n-1.0\n" ) + bytes );
+        auto read = canvas::from_pfm( in );
+
+        REQUIRE( read.pixel_at( 0, 1 ) == f_color( 0.5f, 0.5f, 0.5f ) );
+        REQUIRE( read.pixel_at( 0, 0 ) == f_color( 8, 8, 8 ) );
+    }
+
+    SECTION( "Reading something that is not a complete PFM" )
+    {
+        std::istringstream ppm( canvas( 2, 2 ).to_ppm() );
+        auto pfm = canvas( 2, 2 ).to_pfm();
+        std::istringstream truncated( pfm.substr( 0, pfm.size() - 1 ) );
+
+        REQUIRE_THROWS_AS( canvas::from_pfm( ppm ), std::runtime_error );
+        REQUIRE_THROWS_AS( canvas::from_pfm( truncated ), std::runtime_error );
+    }
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "catch.hpp"
 #include "shapes.hpp"
+#include "transform.hpp"
 
 using namespace ls;
 
@@ -25,6 +26,18 @@ TEST_CASE( "Cube processing", "[cubes]" )
         REQUIRE( xs.size() == 0 );
     }
     
+    SECTION( "Intersecting a transformed cube" )
+    {
+        auto c = cube::create();
+        c->set_transform( transform::translation( 5.f, 0.f, 0.f ) );
+        auto r = ray( f_point( 5, 0, -5 ), f_vector( 0, 0, 1 ) );
+        auto xs = intersect( c, r );
+
+        REQUIRE( xs.size() == 2 );
+        REQUIRE( approx( xs[0].time(), 4.f ) );
+        REQUIRE( approx( xs[1].time(), 6.f ) );
+    }
+
     SECTION( "The normal on the surface of a cube" )
     {
         auto c = cube::create();
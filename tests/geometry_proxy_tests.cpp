@@ -0,0 +1,228 @@
+#include "catch.hpp"
+#include "geometry_proxy.hpp"
+#include "world_snapshot.hpp"
+#include "model_parser.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "materials.hpp"
+#include "world.hpp"
+#include "camera.hpp"
+
+using namespace ls;
+
+namespace {
+    bool similar_image( const canvas& c1, const canvas& c2 )
+    {
+        if ( c1.width() != c2.width() || c1.height() != c2.height() )
+        {
+            return false;
+        }
+        for ( uint16_t y = 0; y < c1.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < c1.width(); x++ )
+            {
+                auto p1 = c1.pixel_at( x, y );
+                auto p2 = c2.pixel_at( x, y );
+                if ( std::abs( p1.r - p2.r ) > 1e-3f || std::abs( p1.g - p2.g ) > 1e-3f || std::abs( p1.b - p2.b ) > 1e-3f )
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The two triangles of triangles.obj span x in [-1, 1] and y in [0, 1] at z = 0
+    const aabb_bounds triangles_bounds( f_point( -1, 0, 0 ), f_point( 1, 1, 0 ) );
+}
+
+TEST_CASE( "Geometry proxies", "[geometry_proxy]" )
+{
+    SECTION( "A proxy loads its file the first time a ray reaches its bounds" )
+    {
+        auto cache = geometry_cache::create();
+        auto proxy = geometry_proxy::create( "triangles.obj", triangles_bounds, cache );
+        proxy->set_material( phong_material::create( f_color( 1, 0.2f, 0.2f ) ) );
+        auto w = world::create();
+        w->add_object( proxy );
+        w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( 0, 5, -5 ) ) );
+        const auto& scene = w->compile();
+        REQUIRE( !proxy->loaded() );
+
+        render_scene::hit_record record;
+        REQUIRE( !scene->closest_hit( ray( f_point( 3, 0.5f, -5 ), f_vector( 0, 0, 1 ) ), record ) );
+        REQUIRE( !scene->occluded( ray( f_point( 0, 2, -5 ), f_vector( 0, 0, 1 ) ), infinity ) );
+        REQUIRE( !proxy->loaded() );
+        REQUIRE( cache->load_count() == 0 );
+
+        REQUIRE( scene->closest_hit( ray( f_point( 0, 0.5f, -5 ), f_vector( 0, 0, 1 ) ), record ) );
+        REQUIRE( approx( record.time, 5.f ) );
+        REQUIRE( std::dynamic_pointer_cast<triangle>( record.object ) != nullptr );
+        REQUIRE( record.object->material() == proxy->material() );
+        REQUIRE( scene->object( record.primitive ) == proxy );
+        REQUIRE( proxy->loaded() );
+        REQUIRE( cache->loaded_count() == 1 );
+        REQUIRE( cache->bytes_loaded() > 0 );
+
+        REQUIRE( scene->occluded( ray( f_point( 0.5f, 0.5f, -5 ), f_vector( 0, 0, 1 ) ), infinity ) );
+        REQUIRE( scene->intersect( ray( f_point( -0.5f, 0.5f, -5 ), f_vector( 0, 0, 1 ) ) ).size() == 1 );
+        REQUIRE( cache->load_count() == 1 );
+
+        REQUIRE_THROWS_WITH( world_snapshot::write( "proxy.lsworld", w ), "World snapshots cannot store custom shapes" );
+    }
+
+    SECTION( "A proxy renders like the model it stands in for" )
+    {
+        auto mat = phong_material::create( f_color( 0.2f, 0.6f, 1 ) );
+        auto placement = transform::translation( 0.f, 0.f, 1.f ) * transform::rotation_y( 0.4f );
+        auto proxy_world = world::create();
+        auto proxy = geometry_proxy::create( "triangles.obj", triangles_bounds );
+        proxy->set_transform( transform::scale( 2.f, 2.f, 2.f ) );
+        proxy->set_material( mat );
+        auto proxy_parent = group::create();
+        proxy_parent->set_transform( placement );
+        proxy_parent->add_child( proxy );
+        proxy_world->add_object( proxy_parent );
+
+        auto model_world = world::create();
+        auto model = model_parser::obj( "triangles.obj" ).to_shape_group();
+        model->set_transform( transform::scale( 2.f, 2.f, 2.f ) );
+        for ( const auto& part : model->children() )
+        {
+            for ( const auto& tr : std::static_pointer_cast<group>( part )->children() )
+            {
+                tr->set_material( mat );
+            }
+        }
+        auto model_parent = group::create();
+        model_parent->set_transform( placement );
+        model_parent->add_child( model );
+        model_world->add_object( model_parent );
+
+        for ( const auto& w : { proxy_world, model_world } )
+        {
+            w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( -2, 4, -5 ) ) );
+        }
+        auto cam = camera::create( 40, 20, pi_over_3 );
+        cam->set_transform( transform::view( f_point( 0, 1, -4 ), f_point( 0, 1, 0 ), f_vector( 0, 1, 0 ) ) );
+        REQUIRE( similar_image( cam->render( proxy_world ), cam->render( model_world ) ) );
+        REQUIRE( proxy_world->scene_current() );
+
+        // Without a compiled scene the proxy is intersected like a group
+        auto itrs = intersect( std::static_pointer_cast<shape>( proxy_parent ), ray( f_point( 0, 1, -5 ), f_vector( 0, 0, 1 ) ) );
+        REQUIRE( itrs.size() == 1 );
+        REQUIRE( itrs[0].object()->material() == mat );
+    }
+
+    SECTION( "Threads reaching a proxy together load it once" )
+    {
+        auto cache = geometry_cache::create();
+        auto w = world::create();
+        w->add_object( geometry_proxy::create( "triangles.obj", triangles_bounds, cache ) );
+        w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( 0, 5, -5 ) ) );
+        auto cam = camera::create( 64, 64, pi_over_3 );
+        cam->set_transform( transform::view( f_point( 0, 0.5f, -3 ), f_point( 0, 0.5f, 0 ), f_vector( 0, 1, 0 ) ) );
+        cam->set_threads( 4 );
+        cam->render( w );
+        REQUIRE( cache->load_count() == 1 );
+
+        // Loading builds shapes of the proxy's own, which are not edits to the world
+        auto scene = w->scene();
+        REQUIRE( w->scene_current() );
+        cam->render( w );
+        REQUIRE( w->scene() == scene );
+    }
+
+    SECTION( "A cache evicts the proxies used least recently to stay within its budget" )
+    {
+        auto cache = geometry_cache::create();
+        std::vector<geometry_proxy_ptr> proxies;
+        auto w = world::create();
+        for ( int i = 0; i < 3; i++ )
+        {
+            auto proxy = geometry_proxy::create( "triangles.obj", triangles_bounds, cache );
+            proxy->set_transform( transform::translation( 3.f * i, 0.f, 0.f ) );
+            proxies.push_back( proxy );
+            w->add_object( proxy );
+        }
+        const auto& scene = w->compile();
+        auto reach = [&] ( int i ) {
+            render_scene::hit_record record;
+            return scene->closest_hit( ray( f_point( 3.f * i, 0.5f, -5 ), f_vector( 0, 0, 1 ) ), record );
+        };
+
+        REQUIRE( reach( 0 ) );
+        REQUIRE( reach( 1 ) );
+        REQUIRE( cache->loaded_count() == 2 );
+        cache->set_budget( cache->bytes_loaded() );
+
+        // The first proxy was used least recently, so it makes room for the third
+        REQUIRE( reach( 2 ) );
+        REQUIRE( !proxies[0]->loaded() );
+        REQUIRE( proxies[1]->loaded() );
+        REQUIRE( proxies[2]->loaded() );
+        REQUIRE( cache->bytes_loaded() <= cache->budget() );
+
+        REQUIRE( reach( 0 ) );
+        REQUIRE( cache->load_count() == 4 );
+        REQUIRE( !proxies[1]->loaded() );
+
+        // Geometry a hit still refers to outlives its eviction
+        std::weak_ptr<const proxy_geometry> geometry = proxies[0]->geometry();
+        auto itrs = scene->intersect( ray( f_point( 0, 0.5f, -5 ), f_vector( 0, 0, 1 ) ) );
+        cache->set_budget( 0 );
+        REQUIRE( cache->loaded_count() == 0 );
+        REQUIRE( cache->bytes_loaded() == 0 );
+        REQUIRE( !proxies[0]->loaded() );
+        REQUIRE( !geometry.expired() );
+        REQUIRE( itrs[0].object()->material() == proxies[0]->material() );
+        itrs.clear();
+        REQUIRE( geometry.expired() );
+
+        cache->set_budget( geometry_cache::unlimited );
+        REQUIRE( reach( 1 ) );
+        proxies[1]->evict();
+        REQUIRE( !proxies[1]->loaded() );
+        REQUIRE( cache->loaded_count() == 0 );
+    }
+
+    SECTION( "Rays traced in a pin scope share the geometry it pinned until the proxy is evicted" )
+    {
+        auto cache = geometry_cache::create();
+        auto proxy = geometry_proxy::create( "triangles.obj", triangles_bounds, cache );
+        auto w = world::create();
+        w->add_object( proxy );
+        const auto& scene = w->compile();
+        auto reach = [&] () {
+            return scene->occluded( ray( f_point( 0, 0.5f, -5 ), f_vector( 0, 0, 1 ) ), infinity );
+        };
+
+        std::weak_ptr<const proxy_geometry> first;
+        {
+            geometry_pin_scope pins;
+            REQUIRE( reach() );
+            first = proxy->geometry();
+            // The proxy and the pin hold the geometry, whatever the number of rays
+            REQUIRE( first.use_count() == 2 );
+            REQUIRE( reach() );
+            REQUIRE( first.use_count() == 2 );
+
+            // Rays after an eviction load the proxy again, while the pinned geometry lives on
+            proxy->evict();
+            REQUIRE( !first.expired() );
+            REQUIRE( reach() );
+            REQUIRE( cache->load_count() == 2 );
+            REQUIRE( proxy->geometry() != first.lock() );
+        }
+        REQUIRE( first.expired() );
+        REQUIRE( proxy->geometry().use_count() == 2 );
+    }
+
+    SECTION( "A proxy whose file cannot be loaded fails the trace that reaches it" )
+    {
+        auto w = world::create();
+        w->add_object( geometry_proxy::create( "missing.obj", triangles_bounds ) );
+        w->compile();
+        REQUIRE_THROWS_AS( w->color_at( ray( f_point( 0, 0.5f, -5 ), f_vector( 0, 0, 1 ) ) ), std::runtime_error );
+    }
+}
@@ -26,6 +26,28 @@ TEST_CASE( "Group processing", "[groups]" )
         REQUIRE( sh->parent() == g );
     }
 
+    SECTION( "Adding children in bulk" )
+    {
+        auto g = group::create();
+        auto s1 = sphere::create();
+        auto s2 = cube::create();
+        g->add_child( s1 );
+        std::vector<shape_ptr> shapes{ s1, s2, s2 };
+        g->add_children( shapes );
+
+        REQUIRE( g->children().size() == 2 );
+        REQUIRE( g->children()[1] == s2 );
+        REQUIRE( g->has_child( s2 ) );
+        REQUIRE( s2->parent() == g );
+        REQUIRE( !g->has_child( sphere::create() ) );
+
+        // Copies share the id of their original but are children of their own
+        auto copy = cube::create( *s2 );
+        g->add_child( copy );
+        REQUIRE( g->children().size() == 3 );
+        REQUIRE( g->has_child( copy ) );
+    }
+
     SECTION( "Intersecting a ray with an empty group" )
     {
         auto g = group::create();
@@ -113,4 +135,23 @@ TEST_CASE( "Group processing", "[groups]" )
 
         REQUIRE( n == f_vector( 0.28570f, 0.42854f, -0.85716f ) );
     }
+
+    SECTION( "A group bounds its transformed children in its own space" )
+    {
+        auto g = group::create();
+        g->set_transform( transform::translation( 10.f, 0.f, 0.f ) );
+        auto c = cube::create();
+        c->set_transform( transform::rotation_y( pi_over_4 ) );
+        g->add_child( c );
+        auto nested = group::create();
+        nested->set_transform( transform::translation( 0.f, 0.f, 5.f ) );
+        nested->add_child( triangle::create( f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ) ) );
+        g->add_child( nested );
+        auto b = g->bounds();
+
+        REQUIRE( approx( b.min.x, -std::sqrt( 2.f ) ) );
+        REQUIRE( approx( b.max.x, std::sqrt( 2.f ) ) );
+        REQUIRE( approx( b.max.z, 5.f ) );
+        REQUIRE( intersect( g, ray( f_point( 10, 0.5f, -10 ), f_vector( 0, 0, 1 ) ) ).size() == 3 );
+    }
 };
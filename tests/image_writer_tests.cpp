@@ -0,0 +1,115 @@
+#include "catch.hpp"
+#include "image_writer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace ls;
+
+TEST_CASE( "Image writer processing", "[image_writer]" )
+{
+    SECTION( "Quantizing a row of pixels" )
+    {
+        rgba_pixel pixels[2] = { to_pixel( f_color( 1.5f, 0.5f, -0.5f ) ), to_pixel( f_color( 0.8f, 0.6f, 0.f ) ) };
+        uint8_t rgb[6];
+        quantize_row( pixels, 2, rgb );
+
+        REQUIRE( rgb[0] == 255 );
+        REQUIRE( rgb[1] == 128 );
+        REQUIRE( rgb[2] == 0 );
+        REQUIRE( rgb[3] == 204 );
+        REQUIRE( rgb[4] == 153 );
+        REQUIRE( rgb[5] == 0 );
+    }
+
+    SECTION( "Constructing a binary PPM" )
+    {
+        auto canv = canvas( 2, 2 );
+        canv.draw_pixel( 0, 0, f_color( 1, 0, 0 ) );
+        canv.draw_pixel( 1, 1, f_color( 0, 0.5f, 1 ) );
+        auto ppm = canv.to_ppm( ppm_format::binary );
+
+        std::string expected = std::string( "P6\n2 2\n255\n" ) + std::string( "\xff\x00\x00\x00\x00\x00\x00\x00\x00\x00\x80\xff", 12 );
+        REQUIRE( ppm == expected );
+    }
+
+    SECTION( "Streaming rows through a small buffer" )
+    {
+        auto canv = canvas( 37, 11 );
+        for ( uint16_t y = 0; y < canv.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < canv.width(); x++ )
+            {
+                canv.draw_pixel( x, y, f_color( x / 37.f, y / 11.f, 0.5f ) );
+            }
+        }
+
+        for ( auto format : { ppm_format::ascii, ppm_format::binary } )
+        {
+            std::ostringstream out;
+            ppm_writer writer( out, canv.width(), canv.height(), format, 64 );
+            writer.write_rows( canv.row( 0 ), canv.row_stride(), 4 );
+            writer.write_rows( canv.row( 4 ), canv.row_stride(), 7 );
+            writer.finish();
+
+            REQUIRE( writer.rows_written() == canv.height() );
+            REQUIRE( out.str() == canv.to_ppm( format ) );
+        }
+    }
+
+    SECTION( "Rows past the image height are ignored" )
+    {
+        auto canv = canvas( 3, 2 );
+        std::ostringstream out;
+        ppm_writer writer( out, 3, 1, ppm_format::binary );
+        writer.write( canv );
+        writer.finish();
+
+        REQUIRE( writer.rows_written() == 1 );
+        REQUIRE( out.str().size() == std::string( "P6\n3 1\n255\n" ).size() + 9 );
+    }
+
+    SECTION( "Constructing a PFM keeps unclamped floats, bottom row first" )
+    {
+        auto canv = canvas( 2, 2 );
+        canv.draw_pixel( 0, 0, f_color( 4.5f, -1, 0 ) );
+        canv.draw_pixel( 1, 1, f_color( 0, 0.25f, 1000 ) );
+        auto pfm = canv.to_pfm();
+
+        std::string header = is_little_endian() ? "PF\n2 2\n-1.0\n" : "PF\n2 2\n1.0\n";
+        float expected[12] = { 0, 0, 0, 0, 0.25f, 1000, 4.5f, -1, 0, 0, 0, 0 };
+        REQUIRE( pfm.size() == header.size() + sizeof( expected ) );
+        REQUIRE( pfm.compare( 0, header.size(), header ) == 0 );
+        REQUIRE( std::memcmp( pfm.data() + header.size(), expected, sizeof( expected ) ) == 0 );
+    }
+
+    SECTION( "Streaming PFM rows from the top down" )
+    {
+        auto canv = canvas( 13, 9 );
+        for ( uint16_t y = 0; y < canv.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < canv.width(); x++ )
+            {
+                canv.draw_pixel( x, y, f_color( x * 0.5f, y * 2.f, -0.5f ) );
+            }
+        }
+
+        {
+            std::ofstream out( "pfm_writer_test.pfm", std::ios::binary );
+            pfm_writer writer( out, canv.width(), canv.height() );
+            writer.write_rows( canv.row( 0 ), canv.row_stride(), 4 );
+            writer.write_rows( canv.row( 4 ), canv.row_stride(), 5 );
+            writer.finish();
+
+            REQUIRE( writer.rows_written() == canv.height() );
+        }
+        std::ifstream in( "pfm_writer_test.pfm", std::ios::binary );
+        auto written = std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+
+        REQUIRE( written == canv.to_pfm() );
+        in.close();
+        std::remove( "pfm_writer_test.pfm" );
+    }
+};
@@ -197,4 +197,77 @@ TEST_CASE( "Intersection processing", "[intersections]" )
         
         REQUIRE( approx( reflectance, 0.48873f ) );
     }
+    
+    SECTION( "Finding n1 and n2 at every intersection along the ray" )
+    {
+        auto a = sphere::create_glassy();
+        a->set_transform( transform::scale( 2.f, 2.f, 2.f ) );
+        a->material()->refractive_index = 1.5f;
+        auto b = sphere::create_glassy();
+        b->set_transform( transform::translation( 0.f, 0.f, -0.25f ) );
+        b->material()->refractive_index = 2.f;
+        auto c = sphere::create_glassy();
+        c->set_transform( transform::translation( 0.f, 0.f, 0.25f ) );
+        c->material()->refractive_index = 2.5f;
+        auto r = ray( f_point( 0, 0, -4 ), f_vector( 0, 0, 1 ) );
+        auto xs = intersections{
+            intersection( 2, a ),
+            intersection( 2.75f, b ),
+            intersection( 3.25f, c ),
+            intersection( 4.75f, b ),
+            intersection( 5.25f, c ),
+            intersection( 6, a )
+        };
+        fpnum expected_from[] = { 1.f, 1.5f, 2.f, 2.5f, 2.5f, 1.5f };
+        fpnum expected_to[] = { 1.5f, 2.f, 2.5f, 2.5f, 1.5f, 1.f };
+        
+        for ( std::size_t idx = 0; idx < xs.size(); idx++ )
+        {
+            auto state = prepare_intersection_state( xs[idx], r, xs );
+            
+            REQUIRE( approx( state.ridx_from, expected_from[idx] ) );
+            REQUIRE( approx( state.ridx_to, expected_to[idx] ) );
+        }
+    }
+
+    SECTION( "Refractive indices are tracked through deeply nested containers" )
+    {
+        std::vector<sphere_ptr> spheres;
+        intersections xs;
+        for ( int idx = 0; idx < 40; idx++ )
+        {
+            auto s = sphere::create_glassy();
+            s->material()->refractive_index = 1.1f + 0.01f * idx;
+            spheres.push_back( s );
+            xs.push_back( intersection( static_cast<fpnum>( idx ), s ) );
+        }
+        for ( int idx = 39; idx >= 0; idx-- )
+        {
+            xs.push_back( intersection( 100.f - idx, spheres[idx] ) );
+        }
+        auto r = ray( f_point( 0, 0, -4 ), f_vector( 0, 0, 1 ) );
+
+        // Leaving the second outermost sphere returns into the outermost one
+        auto state = prepare_intersection_state( xs[xs.size() - 2], r, xs );
+        REQUIRE( approx( state.ridx_from, 1.11f ) );
+        REQUIRE( approx( state.ridx_to, 1.1f ) );
+        state = prepare_intersection_state( xs.back(), r, xs );
+        REQUIRE( approx( state.ridx_from, 1.1f ) );
+        REQUIRE( approx( state.ridx_to, 1.f ) );
+    }
+    
+    SECTION( "Refractive indices are not tracked for opaque materials" )
+    {
+        auto s = sphere::create();
+        s->material()->refractive_index = 1.5f;
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+        auto xs = intersections{
+            intersection( 4, s ),
+            intersection( 6, s )
+        };
+        auto state = prepare_intersection_state( xs[0], r, xs );
+        
+        REQUIRE( state.ridx_from == 1.f );
+        REQUIRE( state.ridx_to == 1.f );
+    }
 };
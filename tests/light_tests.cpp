@@ -14,4 +14,84 @@ TEST_CASE( "Light processing", "[lights]" )
         REQUIRE( light.intensity() == intensity );
         REQUIRE( light.position() == position );
     }
+    SECTION( "A point light has no falloff by default" )
+    {
+        auto light = point_light( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ) );
+
+        REQUIRE( !light.has_falloff() );
+        REQUIRE( light.intensity_at( 100.f ) == f_color( 1, 1, 1 ) );
+    }
+
+    SECTION( "The intensity of a light with falloff decreases with distance" )
+    {
+        auto light = point_light( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ) );
+        light.set_falloff( 1.f, 0.f, 1.f );
+
+        REQUIRE( light.has_falloff() );
+        REQUIRE( light.intensity_at( 0.f ) == f_color( 1, 1, 1 ) );
+        REQUIRE( light.intensity_at( 3.f ) == f_color( 0.1f, 0.1f, 0.1f ) );
+    }
+    SECTION( "A point light has a single sample at its position" )
+    {
+        auto light = point_light( f_color( 1, 1, 1 ), f_point( 1, 2, 3 ) );
+
+        REQUIRE( light.samples() == 1 );
+        REQUIRE( light.sample_point( 0, f_point( 0, 0, 0 ) ) == f_point( 1, 2, 3 ) );
+    }
+
+    SECTION( "Creating a rectangle light" )
+    {
+        auto light = rectangle_light( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ), f_vector( 2, 0, 0 ), 4, f_vector( 0, 0, 1 ), 2 );
+
+        REQUIRE( light.position() == f_point( 1, 0, 0.5f ) );
+        REQUIRE( light.usteps() == 4 );
+        REQUIRE( light.vsteps() == 2 );
+        REQUIRE( light.samples() == 8 );
+    }
+
+    SECTION( "Sampling the center of each rectangle light stratum" )
+    {
+        auto light = rectangle_light( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ), f_vector( 2, 0, 0 ), 4, f_vector( 0, 0, 1 ), 2 );
+        light.set_jitter( false );
+        auto from = f_point( 0, -5, 0 );
+
+        REQUIRE( light.sample_point( 0, from ) == f_point( 0.25f, 0, 0.25f ) );
+        REQUIRE( light.sample_point( 3, from ) == f_point( 1.75f, 0, 0.25f ) );
+        REQUIRE( light.sample_point( 5, from ) == f_point( 0.75f, 0, 0.75f ) );
+        REQUIRE( light.sample_point( 7, from ) == f_point( 1.75f, 0, 0.75f ) );
+    }
+
+    SECTION( "Jittered rectangle light samples stay within their stratum" )
+    {
+        auto light = rectangle_light( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ), f_vector( 2, 0, 0 ), 4, f_vector( 0, 0, 1 ), 2 );
+        auto from = f_point( 0.3f, -5, 0.7f );
+
+        for ( uint16_t i = 0; i < light.samples(); i++ )
+        {
+            auto p = light.sample_point( i, from );
+            auto u = i % 4, v = i / 4;
+
+            REQUIRE( p.x >= u * 0.5f );
+            REQUIRE( p.x <= ( u + 1 ) * 0.5f );
+            REQUIRE( p.z >= v * 0.5f );
+            REQUIRE( p.z <= ( v + 1 ) * 0.5f );
+            REQUIRE( p == light.sample_point( i, from ) );
+        }
+    }
+
+    SECTION( "Sphere light samples lie on the disk facing the shaded point" )
+    {
+        auto light = sphere_light( f_color( 1, 1, 1 ), f_point( 0, 10, 0 ), 2.f, 3, 8 );
+        auto from = f_point( 0, 0, 0 );
+
+        REQUIRE( light.samples() == 24 );
+        for ( uint16_t i = 0; i < light.samples(); i++ )
+        {
+            auto p = light.sample_point( i, from );
+            auto offset = f_vector( p - light.position() );
+
+            REQUIRE( approx( p.y, 10.f ) );
+            REQUIRE( offset.length() <= 2.f );
+        }
+    }
 };
\ No newline at end of file
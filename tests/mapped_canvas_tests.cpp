@@ -0,0 +1,240 @@
+#include "catch.hpp"
+#include "mapped_canvas.hpp"
+#include "image_writer.hpp"
+#include "camera.hpp"
+#include "world.hpp"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#if defined( __linux__ )
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace ls;
+
+namespace {
+    std::string read_file( const std::string& path )
+    {
+        std::ifstream in( path, std::ios::binary );
+        return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+    }
+
+    camera_ptr test_camera( uint16_t width, uint16_t height )
+    {
+        auto c = camera::create( width, height, pi_over_2 );
+        c->set_transform( transform::view( f_point( 0, 0.5f, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        return c;
+    }
+
+#if defined( __linux__ )
+    std::size_t resident_bytes()
+    {
+        std::size_t total = 0, resident = 0;
+        std::ifstream( "/proc/self/statm" ) >> total >> resident;
+        return resident * mapped_file::page_size();
+    }
+
+    std::size_t peak_resident_bytes()
+    {
+        rusage usage;
+        getrusage( RUSAGE_SELF, &usage );
+        return static_cast<std::size_t>( usage.ru_maxrss ) * 1024;
+    }
+#endif
+}
+
+TEST_CASE( "Mapped canvas processing", "[mapped_canvas]" )
+{
+    const std::string path = "mapped_canvas_test.lscanvas";
+
+    SECTION( "Creating a mapped canvas" )
+    {
+        {
+            auto c = mapped_canvas( path, 10, 20 );
+
+            REQUIRE( c.width() == 10 );
+            REQUIRE( c.height() == 20 );
+            REQUIRE( c.format() == mapped_pixel_format::rgba_float );
+            REQUIRE( c.row_bytes() % canvas_row_alignment == 0 );
+            REQUIRE( c.pixel_at( 0, 0 ) == f_color( 0, 0, 0, 0 ) );
+            REQUIRE( c.pixel_at( 9, 19 ) == f_color( 0, 0, 0, 0 ) );
+        }
+        std::remove( path.c_str() );
+    }
+    SECTION( "Pixels written to a mapped canvas survive reopening it" )
+    {
+        {
+            auto c = mapped_canvas( path, 10, 20 );
+            c.draw_pixel( 2, 3, f_color( 1, 0, 0 ) );
+            c.draw_pixel( 9, 19, f_color( 0.25f, 2.5f, 100.f ) );
+            c.flush();
+        }
+        {
+            auto c = mapped_canvas::open( path );
+
+            REQUIRE( c.width() == 10 );
+            REQUIRE( c.height() == 20 );
+            REQUIRE( c.pixel_at( 2, 3 ) == f_color( 1, 0, 0 ) );
+            REQUIRE( c.pixel_at( 9, 19 ) == f_color( 0.25f, 2.5f, 100.f ) );
+            REQUIRE( c.pixel_at( 3, 2 ) == f_color( 0, 0, 0, 0 ) );
+        }
+        std::remove( path.c_str() );
+    }
+    SECTION( "Half canvases store pixels at half precision" )
+    {
+        {
+            auto c = mapped_canvas( path, 10, 20, mapped_pixel_format::rgba_half );
+            c.draw_pixel( 4, 5, f_color( 0.5f, 1.25f, -2.f ) );
+            c.draw_pixel( 5, 5, f_color( 0.1f, 3.3f, 1000.f ) );
+
+            REQUIRE( c.row_bytes() < mapped_canvas( "mapped_canvas_float.lscanvas", 10, 20 ).row_bytes() );
+            REQUIRE( c.pixel_at( 4, 5 ) == f_color( 0.5f, 1.25f, -2.f ) );
+            REQUIRE( std::abs( c.pixel_at( 5, 5 ).r - 0.1f ) < 1e-4f );
+            REQUIRE( std::abs( c.pixel_at( 5, 5 ).g - 3.3f ) < 2e-3f );
+            REQUIRE( std::abs( c.pixel_at( 5, 5 ).b - 1000.f ) < 0.5f );
+            REQUIRE_THROWS_AS( c.span( 0, 0 ), method_not_supported );
+        }
+        std::remove( path.c_str() );
+        std::remove( "mapped_canvas_float.lscanvas" );
+    }
+    SECTION( "Converting between floats and halves" )
+    {
+        REQUIRE( to_half( 1.f ) == 0x3c00 );
+        REQUIRE( to_half( -2.f ) == 0xc000 );
+        REQUIRE( to_half( 65504.f ) == 0x7bff );
+        REQUIRE( to_half( 1e6f ) == 0x7c00 );
+        REQUIRE( to_half( 1.f + 1.f / 4096 ) == 0x3c00 );
+        REQUIRE( from_half( 0x0001 ) == std::ldexp( 1.f, -24 ) );
+        REQUIRE( to_half( std::ldexp( 1.f, -24 ) ) == 0x0001 );
+        REQUIRE( std::isinf( from_half( 0x7c00 ) ) );
+        REQUIRE( std::isnan( from_half( to_half( std::numeric_limits<float>::quiet_NaN() ) ) ) );
+    }
+    SECTION( "Opening a file that is not a canvas" )
+    {
+        std::ofstream( path ) << "P3\n1 1\n255\n0 0 0\n";
+
+        REQUIRE_THROWS_AS( mapped_canvas::open( path ), std::runtime_error );
+        std::remove( path.c_str() );
+    }
+    SECTION( "Rendering into a mapped canvas matches the in-memory render" )
+    {
+        auto w = world::create_default();
+        auto c = test_camera( 37, 23 );
+        c->set_tile_size( 5 );
+        auto expected = c->render( w );
+        {
+            auto image = mapped_canvas( path, 37, 23, mapped_pixel_format::rgba_float, 1 );
+            c->render( w, image );
+            auto half_image = mapped_canvas( "mapped_canvas_half.lscanvas", 37, 23, mapped_pixel_format::rgba_half );
+            c->render( w, half_image );
+
+            bool identical = true, close = true;
+            for ( uint16_t y = 0; y < expected.height(); y++ )
+            {
+                for ( uint16_t x = 0; x < expected.width(); x++ )
+                {
+                    auto a = expected.pixel_at( x, y ), b = image.pixel_at( x, y ), h = half_image.pixel_at( x, y );
+                    identical = identical && a.r == b.r && a.g == b.g && a.b == b.b;
+                    close = close && std::abs( a.r - h.r ) < 1e-3f && std::abs( a.g - h.g ) < 1e-3f && std::abs( a.b - h.b ) < 1e-3f;
+                }
+            }
+
+            REQUIRE( identical );
+            REQUIRE( close );
+            auto narrow = mapped_canvas( "mapped_canvas_narrow.lscanvas", 36, 23 );
+            REQUIRE_THROWS_AS( c->render( w, narrow ), std::invalid_argument );
+        }
+        std::remove( path.c_str() );
+        std::remove( "mapped_canvas_half.lscanvas" );
+        std::remove( "mapped_canvas_narrow.lscanvas" );
+    }
+    SECTION( "Streaming a mapped canvas to PPM matches the in-memory canvas" )
+    {
+        auto expected = canvas( 30, 20 );
+        {
+            auto image = mapped_canvas( path, 30, 20, mapped_pixel_format::rgba_float, 1 );
+            for ( uint16_t y = 0; y < 20; y++ )
+            {
+                for ( uint16_t x = 0; x < 30; x++ )
+                {
+                    auto color = f_color( x / 30.f, y / 20.f, ( x + y ) / 50.f );
+                    expected.draw_pixel( x, y, color );
+                    image.draw_pixel( x, y, color );
+                }
+            }
+            image.write_to( "mapped_canvas_test.ppm", ppm_format::binary );
+        }
+
+        REQUIRE( read_file( "mapped_canvas_test.ppm" ) == expected.to_ppm( ppm_format::binary ) );
+        std::remove( path.c_str() );
+        std::remove( "mapped_canvas_test.ppm" );
+    }
+    SECTION( "Streaming a mapped canvas to PFM matches the in-memory canvas" )
+    {
+        auto expected = canvas( 30, 20 );
+        for ( auto format : { mapped_pixel_format::rgba_float, mapped_pixel_format::rgba_half } )
+        {
+            {
+                auto image = mapped_canvas( path, 30, 20, format, 1 );
+                for ( uint16_t y = 0; y < 20; y++ )
+                {
+                    for ( uint16_t x = 0; x < 30; x++ )
+                    {
+                        // Multiples of 1/4 up to 12 are exact in either format
+                        auto color = f_color( x / 4.f, y * 0.5f, -( x + y ) / 8.f );
+                        expected.draw_pixel( x, y, color );
+                        image.draw_pixel( x, y, color );
+                    }
+                }
+                image.write_pfm_to( "mapped_canvas_test.pfm" );
+            }
+
+            REQUIRE( read_file( "mapped_canvas_test.pfm" ) == expected.to_pfm() );
+            std::remove( path.c_str() );
+            std::remove( "mapped_canvas_test.pfm" );
+        }
+    }
+#if defined( __linux__ )
+    SECTION( "Rendering a canvas larger than the resident limit" )
+    {
+        // 64MB of pixels rendered with at most 1MB of them in memory. The render runs in a
+        // child process, whose peak resident size starts out at what it inherited, so the
+        // peak shows whether the pixels were really handed back to the file as it went.
+        const std::size_t limit = std::size_t( 1 ) << 20;
+        const std::size_t allowance = std::size_t( 8 ) << 20;
+        auto w = world::create_default();
+        auto c = test_camera( 2048, 2048 );
+        {
+            auto image = mapped_canvas( path, 2048, 2048, mapped_pixel_format::rgba_float, limit );
+            REQUIRE( image.row_bytes() * image.height() > 4 * ( limit + allowance ) );
+
+            auto child = fork();
+            REQUIRE( child >= 0 );
+            if ( child == 0 )
+            {
+                auto baseline = resident_bytes();
+                c->render( w, image );
+                image.flush();
+                _exit( peak_resident_bytes() <= baseline + limit + allowance ? 0 : 1 );
+            }
+
+            int status = 0;
+            REQUIRE( waitpid( child, &status, 0 ) == child );
+            REQUIRE( WIFEXITED( status ) );
+            REQUIRE( WEXITSTATUS( status ) == 0 );
+
+            // The child wrote the render through its own mapping of the file
+            auto rendered = mapped_canvas::open( path );
+            REQUIRE( rendered.pixel_at( 1024, 1024 ) == w->color_at( c->ray_for_pixel( 1024, 1024 ) ) );
+            REQUIRE( !( rendered.pixel_at( 1024, 1024 ) == f_color( 0, 0, 0 ) ) );
+            REQUIRE( rendered.pixel_at( 0, 0 ) == f_color( 0, 0, 0 ) );
+        }
+        std::remove( path.c_str() );
+    }
+#endif
+};
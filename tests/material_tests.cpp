@@ -84,6 +84,47 @@ TEST_CASE( "Material processing", "[materials]" )
         REQUIRE( phong_lighting( sphere::create(), m, light, p, eye_v, normal_v, true ) == f_color( 0.1f, 0.1f, 0.1f ) );
     }
 
+    SECTION( "A light behind the surface has no direct term" )
+    {
+        auto m = phong_material::create();
+        auto p = f_point( 0, 0, 0 );
+        auto eye_v = f_vector( 0, 0, -1 );
+        auto normal_v = f_vector( 0, 0, -1 );
+        auto light = point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, 10 ) );
+        auto terms = phong_lighting_terms( f_color( 1, 1, 1 ), m, light, p, eye_v, normal_v );
+
+        REQUIRE( terms.ambient == f_color( 0.1f, 0.1f, 0.1f ) );
+        REQUIRE( !terms.has_direct() );
+    }
+
+    SECTION( "A material without diffuse or specular terms has no direct term" )
+    {
+        auto m = phong_material::create();
+        m->diffuse = 0;
+        m->specular = 0;
+        auto p = f_point( 0, 0, 0 );
+        auto eye_v = f_vector( 0, 0, -1 );
+        auto normal_v = f_vector( 0, 0, -1 );
+        auto light = point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, -10 ) );
+        auto terms = phong_lighting_terms( f_color( 1, 1, 1 ), m, light, p, eye_v, normal_v );
+
+        REQUIRE( terms.ambient == f_color( 0.1f, 0.1f, 0.1f ) );
+        REQUIRE( !terms.has_direct() );
+    }
+
+    SECTION( "The direct term of a light facing the surface" )
+    {
+        auto m = phong_material::create();
+        auto p = f_point( 0, 0, 0 );
+        auto eye_v = f_vector( 0, 0, -1 );
+        auto normal_v = f_vector( 0, 0, -1 );
+        auto light = point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, -10 ) );
+        auto terms = phong_lighting_terms( f_color( 1, 1, 1 ), m, light, p, eye_v, normal_v );
+
+        REQUIRE( terms.has_direct() );
+        REQUIRE( terms.direct == f_color( 1.8f, 1.8f, 1.8f ) );
+    }
+
     SECTION( "Lighting with a pattern applied" )
     {
         auto m = phong_material::create();
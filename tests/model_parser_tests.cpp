@@ -1,9 +1,129 @@
 #include "catch.hpp"
 #include "shapes.hpp"
 #include "model_parser.hpp"
+#include <array>
+#include <cstdio>
+#include <system_error>
 
 using namespace ls;
 
+namespace {
+    /**
+     * Writes a grid of quads large enough to be split into several chunks, switching
+     * groups every few rows and reopening the first group further down
+     */
+    void write_grid( const std::string& file, int size, int bad_face_row = -1 )
+    {
+        std::ofstream out( file );
+        out << "# grid\n";
+        for ( int y = 0; y <= size; y++ )
+        {
+            for ( int x = 0; x <= size; x++ )
+            {
+                out << "v " << x * 0.25f << " " << y * 0.5f << " " << ( x + y ) / 7.f << "\n";
+            }
+        }
+        for ( int y = 0; y < size; y++ )
+        {
+            if ( y % 10 == 5 )
+            {
+                out << "g rows" << ( y == 65 ? 5 : y ) << "\n";
+            }
+            for ( int x = 0; x < size; x++ )
+            {
+                auto i = y * ( size + 1 ) + x + 1;
+                out << "f " << i << " " << i + 1 << " " << ( y == bad_face_row ? 0 : i + size + 2 ) << " " << i + size + 1 << "\n";
+            }
+        }
+    }
+
+    model_parse_result parse_text( const std::string& text )
+    {
+        std::ofstream( "parse_text.obj" ) << text;
+        auto result = model_parser::obj( std::string( "parse_text.obj" ) );
+        std::remove( "parse_text.obj" );
+        return result;
+    }
+
+    /**
+     * Writes quad.ply in binary with the given byte order, with an extra comment line and
+     * the faces' vertex counts stored as ints
+     */
+    void write_binary_quad( const std::string& file, bool big_endian, std::size_t truncate = 0 )
+    {
+        std::string body;
+        auto put = [&] ( const void* value, std::size_t size ) {
+            auto bytes = static_cast<const char*>( value );
+            uint16_t probe = 1;
+            bool host_big_endian = *reinterpret_cast<const char*>( &probe ) == 0;
+            for ( std::size_t i = 0; i < size; i++ )
+            {
+                body += bytes[big_endian == host_big_endian ? i : size - 1 - i];
+            }
+        };
+        const float vertices[5][6] = {
+            { 0, 0, 0, 0, 0, 1 }, { 1, 0, 0, 0, 0, 1 }, { 1, 1, 0, 0, 0, 1 }, { 0, 1, 0, 0, 0, 1 }, { 0.5f, 2, 0, 0, 1, 0 }
+        };
+        for ( const auto& v : vertices )
+        {
+            for ( std::size_t i = 0; i < 6; i++ )
+            {
+                body += i == 3 ? std::string( 1, static_cast<char>( 255 ) ) : "";
+                put( &v[i], 4 );
+            }
+        }
+        const std::vector<int32_t> faces[2] = { { 0, 1, 2, 3 }, { 2, 4, 3 } };
+        for ( const auto& f : faces )
+        {
+            int32_t count = static_cast<int32_t>( f.size() );
+            put( &count, 4 );
+            for ( auto i : f )
+            {
+                put( &i, 4 );
+            }
+        }
+        const int32_t edge[2] = { 0, 1 };
+        put( &edge[0], 4 );
+        put( &edge[1], 4 );
+
+        std::ofstream out( file, std::ios::binary );
+        out << "ply\nformat " << ( big_endian ? "binary_big_endian" : "binary_little_endian" ) << " 1.0\ncomment binary\n"
+            << "element vertex 5\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+            << "property float nx\nproperty float ny\nproperty float nz\n"
+            << "element face 2\nproperty list int int vertex_indices\nelement edge 1\nproperty int vertex1\nproperty int vertex2\n"
+            << "end_header\n" << body.substr( 0, body.size() - truncate );
+    }
+
+    /**
+     * The corners of a plain or mesh triangle
+     */
+    std::array<f_point, 3> corners( const shape_ptr& s )
+    {
+        if ( auto mt = std::dynamic_pointer_cast<mesh_triangle>( s ) )
+        {
+            return { { mt->p1(), mt->p2(), mt->p3() } };
+        }
+        auto tr = std::static_pointer_cast<triangle>( s );
+        return { { tr->p1(), tr->p2(), tr->p3() } };
+    }
+
+    bool same_triangles( const group_ptr& a, const group_ptr& b )
+    {
+        if ( a->children().size() != b->children().size() )
+        {
+            return false;
+        }
+        for ( std::size_t i = 0; i < a->children().size(); i++ )
+        {
+            if ( corners( a->children()[i] ) != corners( b->children()[i] ) )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
 TEST_CASE( "Model parser processing", "[model parser]" )
 {
     SECTION( "Ignoring unrecognized lines" )
@@ -109,4 +229,441 @@ TEST_CASE( "Model parser processing", "[model parser]" )
         REQUIRE( it1 != g->children().cend() );
         REQUIRE( it2 != g->children().cend() );
     }
-};
\ No newline at end of file
+
+    SECTION( "Parsing a mapped file matches parsing a stream" )
+    {
+        for ( auto file : { "groups.obj", "polygon.obj", "triangles.obj", "gibberish.obj" } )
+        {
+            std::ifstream f( file );
+            auto streamed = model_parser::obj( f );
+            auto mapped = model_parser::obj( std::string( file ) );
+
+            REQUIRE( mapped.error == nullptr );
+            REQUIRE( mapped.status == model_parse_status::SUCCESS );
+            REQUIRE( mapped.data->lines_ignored == streamed.data->lines_ignored );
+            REQUIRE( mapped.data->vertices == streamed.data->vertices );
+            REQUIRE( mapped.data->groups.size() == streamed.data->groups.size() );
+            REQUIRE( mapped.data->root_group->children().size() == streamed.data->root_group->children().size() );
+        }
+    }
+
+    SECTION( "Numbers are read the way std::stof reads them" )
+    {
+        auto parser = model_parser::obj( std::string( "numbers.obj" ) );
+
+        REQUIRE( parser.error == nullptr );
+        REQUIRE( parser.data->lines_ignored == 1 );
+        REQUIRE( parser.data->vertices.size() == 3 );
+        REQUIRE( parser.data->vertices[0].x == std::stof( "1e2" ) );
+        REQUIRE( parser.data->vertices[0].y == std::stof( "-.5" ) );
+        REQUIRE( parser.data->vertices[0].z == std::stof( "+3." ) );
+        REQUIRE( parser.data->vertices[1].x == std::stof( "0.1234567" ) );
+        REQUIRE( parser.data->vertices[1].y == std::stof( "12345678.9" ) );
+        REQUIRE( parser.data->vertices[1].z == std::stof( "-0" ) );
+        REQUIRE( parser.data->vertices[2].x == std::stof( "0.000001" ) );
+        REQUIRE( parser.data->vertices[2].y == std::stof( "1.5abc" ) );
+    }
+
+    SECTION( "Faces referring to missing vertices" )
+    {
+        auto parser = model_parser::obj( std::string( "bad_index.obj" ) );
+
+        REQUIRE( parser.status == model_parse_status::FAIL );
+        REQUIRE( parser.data == nullptr );
+        REQUIRE( parser.error->line_number == 5 );
+    }
+
+    SECTION( "Parsing a file that does not exist" )
+    {
+        auto parser = model_parser::obj( std::string( "missing.obj" ) );
+
+        REQUIRE( parser.status == model_parse_status::FAIL );
+        REQUIRE( parser.error->line_number == 0 );
+    }
+
+    SECTION( "Parsing in parallel chunks matches parsing in one pass" )
+    {
+        write_grid( "grid_chunks.obj", 120 );
+        auto serial = model_parser::obj( std::string( "grid_chunks.obj" ), std::make_shared<arena>(), 1 );
+        for ( uint16_t threads : { 2, 3, 8 } )
+        {
+            auto parallel = model_parser::obj( std::string( "grid_chunks.obj" ), std::make_shared<arena>(), threads );
+
+            REQUIRE( parallel.error == nullptr );
+            REQUIRE( parallel.data->lines_ignored == serial.data->lines_ignored );
+            REQUIRE( parallel.data->vertices == serial.data->vertices );
+            REQUIRE( same_triangles( parallel.data->root_group, serial.data->root_group ) );
+            REQUIRE( parallel.data->groups.size() == serial.data->groups.size() );
+            for ( const auto& g : serial.data->groups )
+            {
+                REQUIRE( parallel.data->groups.count( g.first ) == 1 );
+                REQUIRE( same_triangles( parallel.data->groups[g.first], g.second ) );
+            }
+        }
+        REQUIRE( serial.data->root_group->children().size() == 2 * 120 * 5 );
+        REQUIRE( serial.data->groups["rows5"]->children().size() == 2 * 120 * 10 );
+        std::remove( "grid_chunks.obj" );
+    }
+
+    SECTION( "Errors in a later chunk are reported at their line in the file" )
+    {
+        write_grid( "grid_chunks.obj", 120, 100 );
+        for ( uint16_t threads : { 1, 4 } )
+        {
+            auto parser = model_parser::obj( std::string( "grid_chunks.obj" ), std::make_shared<arena>(), threads );
+
+            REQUIRE( parser.status == model_parse_status::FAIL );
+            REQUIRE( parser.error->message == "Vertex index out of range" );
+            REQUIRE( parser.error->line_number == 1 + 121 * 121 + 100 * 120 + 10 + 1 );
+        }
+        std::remove( "grid_chunks.obj" );
+    }
+
+    SECTION( "Texture coordinate and normal records" )
+    {
+        auto parser = model_parser::obj( std::string( "attributes.obj" ) );
+
+        REQUIRE( parser.error == nullptr );
+        REQUIRE( parser.data->lines_ignored == 1 );
+        REQUIRE( parser.data->vertices.size() == 3 );
+        REQUIRE( &parser.data->vertices == &parser.data->mesh->positions );
+        REQUIRE( parser.data->mesh->uvs.size() == 3 );
+        REQUIRE( parser.data->mesh->uvs[2] == texture_uv{ 0.5f, 1 } );
+        REQUIRE( parser.data->mesh->normals.size() == 3 );
+        REQUIRE( parser.data->mesh->normals[0] == f_vector( -1, 0, 0 ) );
+        REQUIRE( parser.data->mesh->normals[2] == f_vector( 0, 1, 0 ) );
+    }
+
+    SECTION( "Faces with texture coordinates and normals" )
+    {
+        auto parser = model_parser::obj( std::string( "attributes.obj" ) );
+        const auto& m = parser.data->mesh;
+        const auto& children = parser.data->root_group->children();
+
+        REQUIRE( parser.error == nullptr );
+        REQUIRE( children.size() == 5 );
+        REQUIRE( m->triangle_count() == 5 );
+        for ( std::size_t i = 0; i < 4; i++ )
+        {
+            auto t = std::dynamic_pointer_cast<mesh_triangle>( children[i] );
+            REQUIRE( t );
+            REQUIRE( t->source_mesh() == m );
+            REQUIRE( t->index() == i );
+            REQUIRE( t->p1() == parser.data->vertices[0] );
+            REQUIRE( t->p3() == parser.data->vertices[2] );
+        }
+        REQUIRE( std::dynamic_pointer_cast<mesh_triangle>( children[4] ) == nullptr );
+
+        auto c = m->triangle_corners( 0 );
+        REQUIRE( c[0].position == 0 );
+        REQUIRE( c[0].uv == 0 );
+        REQUIRE( c[0].normal == 2 );
+        REQUIRE( c[1].normal == 0 );
+        REQUIRE( m->triangle_corners( 1 )[0].uv == mesh::missing );
+        REQUIRE( m->has_normals( 1 ) );
+        REQUIRE_FALSE( m->has_uvs( 1 ) );
+        REQUIRE( m->has_uvs( 3 ) );
+        REQUIRE_FALSE( m->has_normals( 3 ) );
+
+        // Negative indices count back from the last element defined
+        auto n = m->triangle_corners( 2 );
+        REQUIRE( n[0].position == 0 );
+        REQUIRE( n[0].uv == 0 );
+        REQUIRE( n[0].normal == 2 );
+        REQUIRE( n[1].normal == 0 );
+        REQUIRE( n[2].normal == 1 );
+
+        auto smooth = std::static_pointer_cast<mesh_triangle>( children[1] );
+        REQUIRE( smooth->normal( 0, 1, 0 ) == f_vector( 0, 1, 0 ) );
+        REQUIRE( smooth->normal( -1, 0, 0 ) == f_vector( -1, 0, 0 ) );
+    }
+
+    SECTION( "Malformed and out of range face corners" )
+    {
+        const std::string vertices = "v 0 1 0\nv -1 0 0\nv 1 0 0\nvt 0 0\nvn 0 0 1\n";
+        struct
+        {
+            const char* face;
+            const char* message;
+        } cases[] = {
+            { "f 1//1 2//2 3//1", "Normal index out of range" },
+            { "f 1/1 2/2 3/1", "Texture coordinate index out of range" },
+            { "f 1 2 -4", "Vertex index out of range" },
+            { "f 1/0/1 2 3", "Texture coordinate index out of range" },
+            { "f 4/abc 2 3", "Vertex index out of range" },
+            { "f 1/1/1/1 2 3", "Invalid argument encountered" },
+            { "f 1// 2 3", "Invalid argument encountered" },
+            { "f 1/ 2 3", "Invalid argument encountered" },
+            { "vn 0 x 1", "Invalid argument encountered" }
+        };
+        for ( const auto& c : cases )
+        {
+            auto parser = parse_text( vertices + c.face + "\n" );
+
+            REQUIRE( parser.status == model_parse_status::FAIL );
+            REQUIRE( parser.error->line_number == 6 );
+            REQUIRE( parser.error->message == c.message );
+        }
+
+        auto parser = parse_text( vertices + "f -3/-1/-1 -2/1/1 3/-1/1\n" );
+        REQUIRE( parser.error == nullptr );
+        REQUIRE( parser.data->root_group->children().size() == 1 );
+    }
+
+    SECTION( "Loading a mesh cache matches parsing the OBJ file" )
+    {
+        write_grid( "grid_cache.obj", 120 );
+        auto parsed = model_parser::obj( std::string( "grid_cache.obj" ) );
+        auto converted = model_parser::obj_to_mesh_cache( "grid_cache.obj", "grid_cache.lsmesh" );
+
+        REQUIRE( converted.error == nullptr );
+        REQUIRE( converted.data->root_group->children().empty() );
+        REQUIRE( converted.data->mesh->parts.size() == parsed.data->groups.size() + 1 );
+        for ( uint16_t threads : { 1, 3 } )
+        {
+            auto cached = model_parser::mesh_cache( "grid_cache.lsmesh", std::make_shared<arena>(), threads );
+
+            REQUIRE( cached.error == nullptr );
+            REQUIRE( cached.data->vertices == parsed.data->vertices );
+            REQUIRE( cached.data->mesh->triangle_count() == parsed.data->mesh->triangle_count() );
+            REQUIRE( same_triangles( cached.data->root_group, parsed.data->root_group ) );
+            REQUIRE( cached.data->groups.size() == parsed.data->groups.size() );
+            for ( const auto& g : parsed.data->groups )
+            {
+                REQUIRE( cached.data->groups.count( g.first ) == 1 );
+                REQUIRE( same_triangles( cached.data->groups[g.first], g.second ) );
+            }
+        }
+
+        auto unwritable = model_parser::obj_to_mesh_cache( "grid_cache.obj", "missing_directory/grid_cache.lsmesh" );
+        REQUIRE( unwritable.status == model_parse_status::FAIL );
+        REQUIRE( unwritable.error->line_number == 0 );
+        REQUIRE_THROWS_AS( parsed.data->mesh->write_to( "missing_directory/grid_cache.lsmesh" ), std::system_error );
+        std::remove( "grid_cache.obj" );
+        std::remove( "grid_cache.lsmesh" );
+    }
+
+    SECTION( "Mesh caches keep texture coordinates and normals" )
+    {
+        auto parsed = model_parser::obj( std::string( "attributes.obj" ) );
+        parsed.data->mesh->write_to( "attributes.lsmesh" );
+        auto cached = model_parser::mesh_cache( "attributes.lsmesh" );
+        const auto& m = cached.data->mesh;
+        const auto& children = cached.data->root_group->children();
+
+        REQUIRE( cached.error == nullptr );
+        REQUIRE( m->uvs.size() == 3 );
+        REQUIRE( m->uvs[2] == texture_uv{ 0.5, 1 } );
+        REQUIRE( m->normals == parsed.data->mesh->normals );
+        REQUIRE( children.size() == 5 );
+        for ( std::size_t t = 0; t < 5; t++ )
+        {
+            auto a = m->triangle_corners( t );
+            auto b = parsed.data->mesh->triangle_corners( t );
+            for ( std::size_t i = 0; i < 3; i++ )
+            {
+                REQUIRE( a[i].position == b[i].position );
+                REQUIRE( a[i].uv == b[i].uv );
+                REQUIRE( a[i].normal == b[i].normal );
+            }
+        }
+        REQUIRE( std::dynamic_pointer_cast<mesh_triangle>( children[1] )->source_mesh() == m );
+        REQUIRE( std::dynamic_pointer_cast<mesh_triangle>( children[4] ) == nullptr );
+        std::remove( "attributes.lsmesh" );
+    }
+
+    SECTION( "Loading an invalid mesh cache" )
+    {
+        auto missing = model_parser::mesh_cache( "missing.lsmesh" );
+        REQUIRE( missing.status == model_parse_status::FAIL );
+        REQUIRE( missing.error->line_number == 0 );
+
+        auto text = model_parser::mesh_cache( "attributes.obj" );
+        REQUIRE( text.status == model_parse_status::FAIL );
+        REQUIRE( text.error->message == "Not a mesh cache" );
+
+        auto m = mesh::create();
+        m->positions = { f_point( 0, 0, 0 ), f_point( 1, 0, 0 ) };
+        m->corners = { { 0, mesh::missing, mesh::missing }, { 1, mesh::missing, mesh::missing }, { 2, mesh::missing, mesh::missing } };
+        m->write_to( "bad_index.lsmesh" );
+        auto bad_index = model_parser::mesh_cache( "bad_index.lsmesh" );
+        REQUIRE( bad_index.status == model_parse_status::FAIL );
+        REQUIRE( bad_index.error->message == "Mesh cache index out of range" );
+
+        m->positions.emplace_back( 0, 1, 0 );
+        m->parts = { { "all", 0, 2 } };
+        m->write_to( "bad_index.lsmesh" );
+        auto bad_part = model_parser::mesh_cache( "bad_index.lsmesh" );
+        REQUIRE( bad_part.error->message == "Mesh cache part out of range" );
+        std::remove( "bad_index.lsmesh" );
+    }
+
+    SECTION( "Reading ASCII and binary PLY files" )
+    {
+        auto text = model_parser::ply( "quad.ply" );
+
+        REQUIRE( text.error == nullptr );
+        REQUIRE( text.data->vertices.size() == 5 );
+        REQUIRE( text.data->vertices[4] == f_point( 0.5, 2, 0 ) );
+        REQUIRE( text.data->mesh->normals.size() == 5 );
+        REQUIRE( text.data->mesh->uvs.empty() );
+        REQUIRE( text.data->mesh->triangle_count() == 3 );
+        REQUIRE( text.data->root_group->children().size() == 3 );
+        REQUIRE( text.data->groups.empty() );
+        auto c = text.data->mesh->triangle_corners( 2 );
+        REQUIRE( c[0].position == 2 );
+        REQUIRE( c[1].normal == 4 );
+        REQUIRE( c[2].uv == mesh::missing );
+        auto top = std::dynamic_pointer_cast<mesh_triangle>( text.data->root_group->children()[2] );
+        REQUIRE( top );
+        REQUIRE( top->normal( 0.5, 2, 0 ) == f_vector( 0, 1, 0 ) );
+
+        for ( bool big_endian : { false, true } )
+        {
+            write_binary_quad( "quad_binary.ply", big_endian );
+            for ( uint16_t threads : { 1, 2 } )
+            {
+                auto binary = model_parser::ply( "quad_binary.ply", std::make_shared<arena>(), threads );
+
+                REQUIRE( binary.error == nullptr );
+                REQUIRE( binary.data->vertices == text.data->vertices );
+                REQUIRE( binary.data->mesh->normals == text.data->mesh->normals );
+                REQUIRE( same_triangles( binary.data->root_group, text.data->root_group ) );
+            }
+        }
+        std::remove( "quad_binary.ply" );
+    }
+
+    SECTION( "Reading a large binary PLY file in parallel" )
+    {
+        const uint32_t size = 300;
+        {
+            std::ofstream out( "grid.ply", std::ios::binary );
+            out << "ply\nformat binary_" << ( *reinterpret_cast<const uint8_t*>( &size ) == 44 ? "little" : "big" ) << "_endian 1.0\n"
+                << "element vertex " << ( size + 1 ) * ( size + 1 ) << "\nproperty float x\nproperty float y\nproperty float z\n"
+                << "property float s\nproperty float t\nelement face 0\nproperty list uchar uint vertex_indices\nend_header\n";
+            for ( uint32_t y = 0; y <= size; y++ )
+            {
+                for ( uint32_t x = 0; x <= size; x++ )
+                {
+                    const float v[5] = { x * 0.5f, y * 0.25f, 1.f, x / float( size ), y / float( size ) };
+                    out.write( reinterpret_cast<const char*>( v ), sizeof( v ) );
+                }
+            }
+        }
+        auto serial = model_parser::ply( "grid.ply", std::make_shared<arena>(), 1 );
+        auto parallel = model_parser::ply( "grid.ply", std::make_shared<arena>(), 3 );
+
+        REQUIRE( serial.error == nullptr );
+        REQUIRE( serial.data->vertices.size() == 301 * 301 );
+        REQUIRE( serial.data->vertices.back() == f_point( 150, 75, 1 ) );
+        REQUIRE( serial.data->mesh->uvs[300] == texture_uv{ 1, 0 } );
+        REQUIRE( parallel.data->vertices == serial.data->vertices );
+        std::remove( "grid.ply" );
+    }
+
+    SECTION( "Reading ASCII PLY values of every type" )
+    {
+        std::ofstream( "values.ply" ) <<
+            "ply\nformat ascii 1.0\nelement vertex 3\nproperty double x\nproperty double y\nproperty double z\nproperty uint flags\n"
+            "element face 1\nproperty list uchar float vertex_indices\nend_header\n"
+            "1e-50 0.5 0 4000000000\n1 0 0 0\n0 1 0 4294967295\n3 0 1.0 2e0\n";
+        auto parser = model_parser::ply( "values.ply" );
+
+        REQUIRE( parser.error == nullptr );
+        REQUIRE( parser.data->vertices[0] == f_point( 0, 0.5f, 0 ) );
+        REQUIRE( parser.data->mesh->triangle_count() == 1 );
+        REQUIRE( parser.data->mesh->corners[2].position == 2 );
+        std::remove( "values.ply" );
+    }
+
+    SECTION( "Malformed PLY files" )
+    {
+        auto not_ply = model_parser::ply( "attributes.obj" );
+        REQUIRE( not_ply.error->message == "Not a PLY file" );
+        REQUIRE( not_ply.error->line_number == 1 );
+
+        write_binary_quad( "truncated.ply", false, 3 );
+        auto truncated = model_parser::ply( "truncated.ply" );
+        REQUIRE( truncated.status == model_parse_status::FAIL );
+        REQUIRE( truncated.error->message == "Unexpected end of file" );
+        REQUIRE( truncated.error->line_number == 0 );
+        std::remove( "truncated.ply" );
+
+        struct
+        {
+            const char* text;
+            unsigned int line;
+            const char* message;
+        } cases[] = {
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty quaternion w\nend_header\n", 4, "Invalid argument encountered" },
+            { "ply\nformat binary_middle_endian 1.0\n", 2, "Unsupported PLY format" },
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\n", 4, "Unexpected end of file" },
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nend_header\n1\n", 5, "PLY vertices need x, y and z" },
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nproperty float y\nproperty float z\nend_header\n1 2\n", 8,
+                "Invalid argument encountered" },
+            { "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n"
+                "element face 1\nproperty list uchar int vertex_indices\nend_header\n0 0 0\n1 0 0\n0 1 0\n3 0 1 3\n", 13,
+                "Vertex index out of range" },
+            { "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n"
+                "element face 1\nproperty list uchar int vertex_indices\nend_header\n0 0 0\n1 0 0\n", 12, "Unexpected end of file" },
+            { "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n"
+                "element face 1\nproperty list uchar float vertex_indices\nend_header\n0 0 0\n1 0 0\n0 1 0\n3 0 1.5 2\n", 13,
+                "Invalid argument encountered" },
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nproperty float y\nproperty float z\nproperty uchar flag\n"
+                "end_header\n0 0 0 256\n", 9, "Invalid argument encountered" },
+            { "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nproperty float y\nproperty float z\nproperty int flag\n"
+                "end_header\n0 0 0 2.5\n", 9, "Invalid argument encountered" }
+        };
+        for ( const auto& c : cases )
+        {
+            std::ofstream( "malformed.ply" ) << c.text;
+            auto parser = model_parser::ply( "malformed.ply" );
+
+            REQUIRE( parser.status == model_parse_status::FAIL );
+            REQUIRE( parser.error->line_number == c.line );
+            REQUIRE( parser.error->message == c.message );
+        }
+        std::remove( "malformed.ply" );
+    }
+
+    SECTION( "Welding and quantizing meshes on import" )
+    {
+        // Every face repeats its own vertices, as some exporters write them
+        {
+            std::ofstream out( "unwelded.obj" );
+            for ( int y = 0; y < 20; y++ )
+            {
+                for ( int x = 0; x < 20; x++ )
+                {
+                    out << "v " << x << " " << y << " 0\nv " << x + 1 << " " << y << " 0\nv " << x + 1 << " " << y + 1 << " 0\n"
+                        << "v " << x << " " << y + 1 << " 0\nf -4 -3 -2 -1\n";
+                }
+            }
+        }
+        auto plain = model_parser::obj( std::string( "unwelded.obj" ) );
+        mesh_import_options options;
+        options.weld = true;
+        auto welded = model_parser::obj( std::string( "unwelded.obj" ), std::make_shared<arena>(), 2, options );
+        options.quantize = true;
+        auto quantized = model_parser::obj( std::string( "unwelded.obj" ), std::make_shared<arena>(), 2, options );
+
+        REQUIRE( plain.data->vertices.size() == 4 * 400 );
+        REQUIRE( welded.error == nullptr );
+        REQUIRE( welded.data->vertices.size() == 21 * 21 );
+        REQUIRE( welded.data->lines_ignored == plain.data->lines_ignored );
+        REQUIRE( same_triangles( welded.data->root_group, plain.data->root_group ) );
+        REQUIRE( quantized.data->mesh->quantized() );
+        REQUIRE( quantized.data->mesh->vertex_count() == 21 * 21 );
+        REQUIRE( std::dynamic_pointer_cast<mesh_triangle>( quantized.data->root_group->children()[0] ) );
+        const auto& step = quantized.data->mesh->quantization_step;
+        for ( std::size_t i = 0; i < plain.data->root_group->children().size(); i++ )
+        {
+            auto a = std::static_pointer_cast<mesh_triangle>( quantized.data->root_group->children()[i] )->p3();
+            auto b = std::static_pointer_cast<triangle>( plain.data->root_group->children()[i] )->p3();
+            REQUIRE( std::abs( a.x - b.x ) <= step.x );
+            REQUIRE( std::abs( a.y - b.y ) <= step.y );
+        }
+        std::remove( "unwelded.obj" );
+    }
+};
@@ -0,0 +1,272 @@
+#include "catch.hpp"
+#include "render_scene.hpp"
+#include "world.hpp"
+#include "shapes.hpp"
+#include "transform.hpp"
+#include "camera.hpp"
+
+using namespace ls;
+
+namespace {
+    world_ptr mixed_world()
+    {
+        auto w = world::create_default();
+
+        auto floor = plane::create();
+        floor->set_transform( transform::translation( 0.f, -2.f, 0.f ) );
+        w->add_object( floor );
+
+        auto grp = group::create();
+        grp->set_transform( transform::translation( 2.f, 0.f, 1.f ) * transform::rotation_y( pi_over_4 ) );
+        auto box = cube::create();
+        box->set_transform( transform::scale( 0.5f, 0.5f, 0.5f ) );
+        grp->add_child( box );
+        auto tube = cylinder::create( -1.f, 1.f );
+        tube->set_closed( true );
+        tube->set_transform( transform::translation( 0.f, 0.f, 3.f ) );
+        grp->add_child( tube );
+        auto nested = group::create();
+        nested->set_transform( transform::translation( -4.f, 1.f, 0.f ) );
+        auto tip = cone::create( -1.f, 0.f );
+        tip->set_closed( true );
+        nested->add_child( tip );
+        nested->add_child( triangle::create( f_point( 0, 1, 2 ), f_point( -1, 0, 2 ), f_point( 1, 0, 2 ) ) );
+        grp->add_child( nested );
+        w->add_object( grp );
+        return w;
+    }
+}
+
+TEST_CASE( "Render scene processing", "[render_scene]" )
+{
+    SECTION( "Compiling a world flattens groups into primitives" )
+    {
+        auto w = mixed_world();
+        auto scene = w->compile();
+
+        REQUIRE( scene == w->scene() );
+        REQUIRE( scene->primitive_count() == 7 );
+        REQUIRE( scene->node_count() > 0 );
+    }
+
+    SECTION( "Primitives sharing a material share a table entry" )
+    {
+        auto mat = phong_material::create();
+        auto s1 = sphere::create();
+        auto s2 = sphere::create();
+        auto s3 = sphere::create();
+        s1->set_material( mat );
+        s2->set_material( mat );
+        auto scene = render_scene::compile( { s1, s2, s3 } );
+
+        REQUIRE( scene->primitive_count() == 3 );
+        REQUIRE( scene->material_count() == 2 );
+        REQUIRE( scene->material( 0 ) == mat );
+        REQUIRE( scene->material( 1 ) == mat );
+    }
+
+    SECTION( "Group transforms are baked into the primitives" )
+    {
+        auto g1 = group::create();
+        g1->set_transform( transform::rotation_y( pi_over_2 ) );
+        auto g2 = group::create();
+        g2->set_transform( transform::scale( 2.f, 2.f, 2.f ) );
+        g1->add_child( g2 );
+        auto s = sphere::create();
+        s->set_transform( transform::translation( 5.f, 0.f, 0.f ) );
+        g2->add_child( s );
+        auto scene = render_scene::compile( { g1 } );
+
+        auto r = ray( f_point( 0, 0, -20 ), f_vector( 0, 0, 1 ) );
+        auto itrs = scene->intersect( r );
+        auto expected = intersect( g1, r );
+
+        REQUIRE( itrs.size() == expected.size() );
+        for ( std::size_t i = 0; i < itrs.size(); i++ )
+        {
+            REQUIRE( itrs[i] == expected[i] );
+        }
+    }
+
+    SECTION( "Closest hits match the hit among every intersection" )
+    {
+        auto w = mixed_world();
+        auto scene = w->compile();
+
+        for ( int x = -6; x <= 6; x++ )
+        {
+            for ( int y = -3; y <= 3; y++ )
+            {
+                auto r = ray( f_point( 0.f, 0.5f, -8.f ), ( f_vector( x * 0.5f, y * 0.5f, 8.f ) ).normalized() );
+                auto expected = hit( intersect( w, r ) );
+                render_scene::hit_record record;
+                auto found = scene->closest_hit( r, record );
+
+                REQUIRE( found == ( expected != intersection::none ) );
+                if ( found )
+                {
+                    REQUIRE( approx( record.time, expected.time() ) );
+                    REQUIRE( scene->object( record.primitive ) == expected.object() );
+                }
+            }
+        }
+    }
+
+    SECTION( "Occlusion only counts hits before the maximum time" )
+    {
+        auto scene = render_scene::compile( { sphere::create() } );
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+
+        REQUIRE( scene->occluded( r, 10.f ) );
+        REQUIRE( !scene->occluded( r, 3.f ) );
+        REQUIRE( !scene->occluded( ray( f_point( 0, 0, 5 ), f_vector( 0, 0, 1 ) ), 10.f ) );
+    }
+
+    SECTION( "Intersections behind the ray origin are kept for refraction" )
+    {
+        auto scene = render_scene::compile( { sphere::create() } );
+        auto itrs = scene->intersect( ray( f_point( 0, 0, 0 ), f_vector( 0, 0, 1 ) ) );
+
+        REQUIRE( itrs.size() == 2 );
+        REQUIRE( approx( itrs[0].time(), -1.f ) );
+        REQUIRE( approx( itrs[1].time(), 1.f ) );
+    }
+
+    SECTION( "Tracing a compiled world matches tracing its objects" )
+    {
+        auto w = mixed_world();
+        auto glass = sphere::create_glassy();
+        glass->set_transform( transform::translation( -1.f, 0.f, -2.f ) );
+        w->add_object( glass );
+        auto r = ray( f_point( -1.f, 0.2f, -6.f ), f_vector( 0.05f, 0, 1 ).normalized() );
+
+        auto expected = w->color_at( r );
+        w->compile();
+        auto col = w->color_at( r );
+
+        REQUIRE( w->scene() );
+        REQUIRE( col == expected );
+    }
+
+    SECTION( "Editing the world's objects discards the compiled scene" )
+    {
+        auto w = world::create_default();
+        w->compile();
+        w->add_object( sphere::create() );
+
+        REQUIRE( !w->scene() );
+    }
+
+    SECTION( "Preparing a world compiles it again only once its shapes were edited" )
+    {
+        auto w = world::create_default();
+        auto scene = w->prepare();
+        REQUIRE( w->scene_current() );
+        REQUIRE( w->prepare() == scene );
+
+        auto s = std::static_pointer_cast<sphere>( w->objects()[1] );
+        s->set_transform( transform::translation( 0.f, 0.f, 5.f ) * transform::scale( 0.5f, 0.5f, 0.5f ) );
+        REQUIRE( !w->scene_current() );
+        auto edited = w->prepare();
+        REQUIRE( edited != scene );
+        render_scene::hit_record record;
+        REQUIRE( edited->closest_hit( ray( f_point( 0, 0, 10 ), f_vector( 0, 0, -1 ) ), record ) );
+        REQUIRE( approx( record.time, 4.5f ) );
+
+        auto cyl = cylinder::create();
+        w->add_object( cyl );
+        w->prepare();
+        cyl->set_max_extent( 2.f );
+        REQUIRE( !w->scene_current() );
+    }
+
+    SECTION( "Only edits to a world's own shapes make its scene out of date" )
+    {
+        auto w = world::create_default();
+        auto other = world::create_default();
+        w->prepare();
+        other->objects()[0]->set_transform( transform::translation( 0.f, 1.f, 0.f ) );
+        sphere::create()->set_material( phong_material::create() );
+        auto copy = sphere::create( *std::static_pointer_cast<sphere>( w->objects()[0] ) );
+        copy->set_transform( transform::translation( 0.f, 1.f, 0.f ) );
+        REQUIRE( w->scene_current() );
+
+        // A shape shared with another world counts its edits against both
+        auto shared = sphere::create();
+        other->add_object( shared );
+        w->add_object( shared );
+        w->prepare();
+        other->prepare();
+        shared->set_transform( transform::translation( 0.f, 2.f, 0.f ) );
+        REQUIRE( !w->scene_current() );
+        REQUIRE( !other->scene_current() );
+    }
+
+    SECTION( "Tracing a world whose shapes were edited since it was compiled follows the edits" )
+    {
+        auto w = world::create_default();
+        auto cam = camera::create( 11, 11, pi_over_2 );
+        cam->set_transform( transform::view( f_point( 0, 0, -5 ), f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) ) );
+        cam->render( w );
+        w->objects()[0]->set_transform( transform::translation( 0.f, 100.f, 0.f ) );
+        w->objects()[1]->set_transform( transform::translation( 0.f, 100.f, 0.f ) );
+
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+        REQUIRE( w->color_at( r ) == f_color( 0, 0, 0 ) );
+        REQUIRE( !w->in_shadow( f_point( 0, 0, 0 ) ) );
+        w->prepare();
+        REQUIRE( w->color_at( r ) == f_color( 0, 0, 0 ) );
+    }
+
+    SECTION( "Quantized mesh triangles are decoded from their mesh" )
+    {
+        auto m = mesh::create();
+        for ( int z = 0; z <= 4; z++ )
+        {
+            for ( int x = 0; x <= 4; x++ )
+            {
+                m->positions.emplace_back( x - 2.f, 0.3f * std::sin( x + z * 0.5f ), z - 2.f );
+            }
+        }
+        for ( uint32_t z = 0; z < 4; z++ )
+        {
+            for ( uint32_t x = 0; x < 4; x++ )
+            {
+                auto i = z * 5 + x;
+                for ( auto c : { i, i + 1, i + 6, i, i + 6, i + 5 } )
+                {
+                    m->corners.push_back( mesh::corner{ c, mesh::missing, mesh::missing } );
+                }
+            }
+        }
+        m->quantize();
+        auto w = world::create_default();
+        auto grp = group::create();
+        grp->set_transform( transform::translation( 0.f, -0.5f, 1.f ) * transform::rotation_x( 0.3f ) );
+        for ( uint32_t t = 0; t < m->triangle_count(); t++ )
+        {
+            grp->add_child( mesh_triangle::create( m, t ) );
+        }
+        w->add_object( grp );
+        auto scene = w->compile();
+
+        REQUIRE( scene->primitive_count() == 2 + 32 );
+        for ( int x = -6; x <= 6; x++ )
+        {
+            for ( int z = -6; z <= 6; z++ )
+            {
+                auto r = ray( f_point( x * 0.3f, 4.f, z * 0.3f ), f_vector( 0.1f, -1.f, 0.05f ).normalized() );
+                auto expected = hit( intersect( w, r ) );
+                render_scene::hit_record record;
+                auto found = scene->closest_hit( r, record );
+
+                REQUIRE( found == ( expected != intersection::none ) );
+                if ( found )
+                {
+                    REQUIRE( approx( record.time, expected.time() ) );
+                    REQUIRE( scene->object( record.primitive ) == expected.object() );
+                }
+            }
+        }
+    }
+};
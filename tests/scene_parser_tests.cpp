@@ -0,0 +1,172 @@
+#include "catch.hpp"
+#include "scene_parser.hpp"
+#include "geometry_proxy.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "materials.hpp"
+#include "patterns.hpp"
+#include "world.hpp"
+#include "camera.hpp"
+
+using namespace ls;
+
+TEST_CASE( "Scene parser", "[scene_parser]" )
+{
+    SECTION( "Loading a scene file" )
+    {
+        auto result = scene_parser::load( "simple.scene" );
+        REQUIRE( result.status == scene_parse_status::SUCCESS );
+        REQUIRE( result.error == nullptr );
+
+        REQUIRE( result.camera->width() == 100 );
+        REQUIRE( result.camera->height() == 50 );
+        REQUIRE( approx( result.camera->field_of_view(), pi / 3 ) );
+        REQUIRE( result.camera->transform() == transform::view( f_point( 0, 1.5f, -5 ), f_point( 0, 1, 0 ), f_vector( 0, 1, 0 ) ) );
+
+        const auto& w = result.world;
+        REQUIRE( w->lights().size() == 2 );
+        REQUIRE( w->lights()[0]->position() == f_point( -10, 10, -7 ) );
+        auto area = std::dynamic_pointer_cast<rectangle_light>( w->lights()[1] );
+        REQUIRE( area != nullptr );
+        REQUIRE( area->samples() == 16 );
+        REQUIRE( !area->jitter() );
+
+        const auto& objects = w->objects();
+        REQUIRE( objects.size() == 4 );
+
+        auto floor = std::dynamic_pointer_cast<plane>( objects[0] );
+        REQUIRE( floor != nullptr );
+        REQUIRE( floor->transform() == transform::scale( 10.f, 0.01f, 10.f ) );
+        REQUIRE( std::dynamic_pointer_cast<checker_pattern>( floor->material()->surface_pattern ) != nullptr );
+        REQUIRE( floor->material()->surface_pattern->transform() == transform::scale( 0.5f, 0.5f, 0.5f ) );
+        REQUIRE( approx( floor->material()->specular, 0.5f ) );
+        REQUIRE( approx( floor->material()->reflectivity, 0.8f ) );
+        REQUIRE( approx( floor->material()->transparency, 0.8f ) );
+
+        auto spheres = std::dynamic_pointer_cast<group>( objects[1] );
+        REQUIRE( spheres != nullptr );
+        REQUIRE( spheres->name() == "spheres" );
+        REQUIRE( spheres->children().size() == 4 );
+        const auto& middle = spheres->children()[0];
+        REQUIRE( middle->parent() == spheres );
+        REQUIRE( middle->transform() == transform::translation( -0.5f, 1.5f, 0.5f ) );
+        REQUIRE( approx( middle->material()->diffuse, 0.7f ) );
+        REQUIRE( approx( middle->material()->refractive_index, 1.2f ) );
+        REQUIRE( middle->material()->surface_pattern->color_at( f_point( 0, 0, 0 ) ) == f_color( 0.1f, 1, 0.5f ) );
+        REQUIRE( spheres->children()[1]->transform() == transform::scale( 0.5f, 0.5f, 0.5f ) * transform::translation( 1.5f, 0.75f, -0.5f ) );
+
+        auto cyl = std::dynamic_pointer_cast<cylinder>( objects[2] );
+        REQUIRE( cyl != nullptr );
+        REQUIRE( cyl->closed() );
+        REQUIRE( approx( cyl->max_extent(), 1.f ) );
+
+        auto model = std::dynamic_pointer_cast<group>( objects[3] );
+        REQUIRE( model != nullptr );
+        REQUIRE( model->transform() == transform::translation( 0.f, 0.f, 3.f ) );
+        auto part = std::dynamic_pointer_cast<group>( model->children()[0] );
+        REQUIRE( part->children().size() == 2 );
+        REQUIRE( part->children()[0]->material() == part->children()[1]->material() );
+        REQUIRE( approx( part->children()[0]->material()->diffuse, 0.7f ) );
+
+        // Sharing resolves the same values to the same material and pattern
+        REQUIRE( spheres->children()[1]->material() == spheres->children()[3]->material() );
+        REQUIRE( spheres->children()[0]->material() != spheres->children()[1]->material() );
+        REQUIRE( middle->material()->surface_pattern != spheres->children()[1]->material()->surface_pattern );
+
+        auto image = result.camera->render( w );
+        REQUIRE( image.width() == 100 );
+    }
+
+    SECTION( "Shapes without a material share a default one" )
+    {
+        auto result = scene_parser::parse( "camera 10 10 1 from 0 0 -5 to 0 0 0 up 0 1 0\n"
+                                           "sphere\n"
+                                           "cube translate 1 2 3\n"
+                                           "cone -1 0 color 1 1 1\n" );
+        REQUIRE( result.status == scene_parse_status::SUCCESS );
+        const auto& objects = result.world->objects();
+        REQUIRE( objects.size() == 3 );
+        REQUIRE( objects[0]->material() == objects[1]->material() );
+        REQUIRE( objects[0]->material() == objects[2]->material() );
+        REQUIRE( *objects[0]->material() == phong_material() );
+        REQUIRE( objects[1]->transform() == transform::translation( 1.f, 2.f, 3.f ) );
+    }
+
+    SECTION( "Transforms apply in the order they are listed" )
+    {
+        auto result = scene_parser::parse( "camera 10 10 1 from 0 0 -5 to 0 0 0 up 0 1 0\n"
+                                           "group rotate_x 1.5 # a comment\n"
+                                           "  triangle 0 1 0 -1 0 0 1 0 0 rotate_z 0.5 shear 1 0 0 0 0 0 translate 1 0 0\n"
+                                           "end\n" );
+        REQUIRE( result.status == scene_parse_status::SUCCESS );
+        auto grp = std::dynamic_pointer_cast<group>( result.world->objects()[0] );
+        REQUIRE( grp->transform() == transform::rotation_x( 1.5f ) );
+        REQUIRE( grp->children()[0]->transform() ==
+                 transform::translation( 1.f, 0.f, 0.f ) * transform::shear( 1.f, 0.f, 0.f, 0.f, 0.f, 0.f ) * transform::rotation_z( 0.5f ) );
+    }
+
+    SECTION( "Proxies share a cache with the scene's budget" )
+    {
+        auto result = scene_parser::parse( "camera 10 10 1 from 0 0 -5 to 0 0 0 up 0 1 0\n"
+                                           "proxy_budget 0.5\n"
+                                           "proxy triangles.obj -1 0 0 1 1 0 quantize color 1 0 0 translate 0 0 2\n"
+                                           "proxy quad.ply -1 -1 0 1 1 0\n" );
+        REQUIRE( result.status == scene_parse_status::SUCCESS );
+        const auto& objects = result.world->objects();
+        auto first = std::dynamic_pointer_cast<geometry_proxy>( objects[0] );
+        auto second = std::dynamic_pointer_cast<geometry_proxy>( objects[1] );
+        REQUIRE( first != nullptr );
+        REQUIRE( first->file() == "./triangles.obj" );
+        REQUIRE( first->bounds().max == f_point( 1, 1, 0 ) );
+        REQUIRE( first->transform() == transform::translation( 0.f, 0.f, 2.f ) );
+        REQUIRE( first->cache() == second->cache() );
+        REQUIRE( first->cache()->budget() == 1 << 19 );
+        REQUIRE( !first->loaded() );
+    }
+
+    SECTION( "Invalid scenes fail at the offending line" )
+    {
+        const char* camera = "camera 10 10 1 from 0 0 -5 to 0 0 0 up 0 1 0\n";
+        struct invalid_scene
+        {
+            std::string text;
+            unsigned int line;
+            std::string message;
+        };
+        std::vector<invalid_scene> cases{
+            { "sphere\n", 1, "Scene has no camera" },
+            { std::string( camera ) + "teapot\n", 2, "Unknown statement 'teapot'" },
+            { std::string( camera ) + "sphere material glass\n", 2, "Unknown material 'glass'" },
+            { std::string( camera ) + "sphere color 1 1\n", 2, "Expected a color" },
+            { std::string( camera ) + "sphere shininess\n", 2, "Expected a shininess" },
+            { std::string( camera ) + "sphere glow 1\n", 2, "Unknown option 'glow'" },
+            { std::string( camera ) + "light point 1 1 1 0 0 0 nojitter\n", 2, "Unexpected 'nojitter'" },
+            { std::string( camera ) + "pattern p zigzag 1 1 1\n", 2, "Unknown pattern type 'zigzag'" },
+            { std::string( camera ) + "material m pattern p\n", 2, "Unknown pattern 'p'" },
+            { std::string( camera ) + "cylinder 0\n", 2, "Expected a maximum" },
+            { std::string( camera ) + "end\n", 2, "'end' without a group" },
+            { std::string( camera ) + "group\nsphere\n", 2, "Group is not closed with 'end'" },
+            { std::string( camera ) + "light sphere 1 1 1 0 0 0 1 -4 4\n", 2, "Expected a number of rings" },
+            { std::string( camera ) + "obj missing.obj\n", 2, "Could not load ./missing.obj: " },
+            { std::string( camera ) + "proxy missing.obj 0 0 0\n", 2, "Expected a maximum corner" },
+            { std::string( camera ) + "proxy_budget -1\n", 2, "Expected a budget in megabytes" },
+            { std::string( camera ) + "sphere scale 0 1 1\n", 2, "Singular transform" },
+            { std::string( camera ) + "group scale 1 0 1\nend\n", 2, "Singular transform" },
+            { "sphere\ncamera 10 10 1 from 0 0 -5 to 0 0 -5 up 0 1 0\n", 2, "Singular transform" },
+        };
+        for ( const auto& c : cases )
+        {
+            auto result = scene_parser::parse( c.text );
+            INFO( c.text );
+            REQUIRE( result.status == scene_parse_status::FAIL );
+            REQUIRE( result.world == nullptr );
+            REQUIRE( result.error->line_number == c.line );
+            // Errors passed on from the OBJ parser end with the system's own message
+            REQUIRE( result.error->message.compare( 0, c.message.size(), c.message ) == 0 );
+        }
+
+        auto missing = scene_parser::load( "missing.scene" );
+        REQUIRE( missing.status == scene_parse_status::FAIL );
+        REQUIRE( missing.error->line_number == 0 );
+    }
+}
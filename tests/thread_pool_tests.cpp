@@ -0,0 +1,84 @@
+#include "catch.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace ls;
+
+TEST_CASE( "Thread pool processing", "[thread pool]" )
+{
+    SECTION( "A pool with no thread count uses the hardware threads" )
+    {
+        auto pool = thread_pool();
+
+        REQUIRE( pool.threads() == thread_pool::hardware_threads() );
+        REQUIRE( pool.threads() >= 1 );
+    }
+
+    SECTION( "Every job is run exactly once" )
+    {
+        auto pool = thread_pool( 8 );
+        std::vector<std::atomic_int> runs( 1000 );
+        pool.run( runs.size(), [&runs] ( std::size_t job ) {
+            ++runs[job];
+        } );
+
+        bool once = true;
+        for ( const auto& r : runs )
+        {
+            once = once && r == 1;
+        }
+
+        REQUIRE( once );
+    }
+
+    SECTION( "Running fewer jobs than threads" )
+    {
+        auto pool = thread_pool( 8 );
+        std::atomic_int runs{ 0 };
+        pool.run( 3, [&runs] ( std::size_t ) {
+            ++runs;
+        } );
+
+        REQUIRE( runs == 3 );
+    }
+
+    SECTION( "Batches run one after another reuse the pool's threads" )
+    {
+        auto pool = thread_pool( 4 );
+        std::mutex lock;
+        std::set<std::thread::id> ids;
+        std::atomic_int runs{ 0 };
+        for ( int batch = 0; batch < 200; batch++ )
+        {
+            pool.run( batch % 7, [&] ( std::size_t ) {
+                ++runs;
+                std::lock_guard<std::mutex> guard( lock );
+                ids.insert( std::this_thread::get_id() );
+            } );
+        }
+
+        REQUIRE( runs == 594 );
+        REQUIRE( ids.size() <= 4 );
+    }
+
+    SECTION( "An exception thrown by a job is rethrown after every thread finishes" )
+    {
+        auto pool = thread_pool( 4 );
+        std::atomic_int runs{ 0 };
+        auto run = [&] () {
+            pool.run( 64, [&runs] ( std::size_t job ) {
+                ++runs;
+                if ( job == 10 )
+                {
+                    throw method_not_supported();
+                }
+            } );
+        };
+
+        REQUIRE_THROWS_AS( run(), method_not_supported );
+        REQUIRE( runs == 64 );
+    }
+};
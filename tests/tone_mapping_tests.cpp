@@ -0,0 +1,117 @@
+#include "catch.hpp"
+#include "tone_mapping.hpp"
+#include "image_writer.hpp"
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+using namespace ls;
+
+TEST_CASE( "Tone mapping processing", "[tone_mapping]" )
+{
+    SECTION( "The default mapper matches the historical quantization" )
+    {
+        std::vector<rgba_pixel> pixels;
+        for ( int i = -20; i < 300; i++ )
+        {
+            auto v = i / 256.f;
+            pixels.push_back( rgba_pixel{ v, v * 0.5f + 0.001f, 1.f - v, 1.f } );
+        }
+        std::vector<uint8_t> rgb( 3 * pixels.size() );
+        tone_mapper().map_row( pixels.data(), pixels.size(), rgb.data() );
+
+        bool identical = true;
+        for ( std::size_t i = 0; i < pixels.size(); i++ )
+        {
+            identical = identical && rgb[3 * i] == static_cast<uint8_t>( clamp( pixels[i].r * 256.f, 0.f, 255.f ) ) &&
+                rgb[3 * i + 1] == static_cast<uint8_t>( clamp( pixels[i].g * 256.f, 0.f, 255.f ) ) &&
+                rgb[3 * i + 2] == static_cast<uint8_t>( clamp( pixels[i].b * 256.f, 0.f, 255.f ) );
+        }
+
+        REQUIRE( identical );
+    }
+
+    SECTION( "Exposure and tone curves" )
+    {
+        rgba_pixel pixels[2] = { rgba_pixel{ 0.25f, 1.f, 100.f, 1.f }, rgba_pixel{ 0.f, -1.f, std::numeric_limits<float>::quiet_NaN(), 1.f } };
+        uint8_t rgb[6];
+
+        tone_mapper( 2.f ).map_row( pixels, 2, rgb );
+        REQUIRE( rgb[0] == 128 );
+        REQUIRE( rgb[1] == 255 );
+
+        tone_mapper( 1.f, tone_curve::reinhard ).map_row( pixels, 2, rgb );
+        REQUIRE( rgb[0] == 51 );
+        REQUIRE( rgb[1] == 128 );
+        REQUIRE( rgb[2] == 253 );
+        REQUIRE( rgb[3] == 0 );
+        REQUIRE( rgb[4] == 0 );
+        REQUIRE( rgb[5] == 0 );
+
+        tone_mapper( 1.f, tone_curve::aces ).map_row( pixels, 2, rgb );
+        REQUIRE( rgb[1] == 205 );
+        REQUIRE( rgb[2] == 255 );
+        REQUIRE( rgb[3] == 0 );
+    }
+
+    SECTION( "sRGB encoding through the lookup table" )
+    {
+        std::vector<rgba_pixel> pixels;
+        for ( int i = 0; i <= 1000; i++ )
+        {
+            auto v = i / 1000.f;
+            pixels.push_back( rgba_pixel{ v, v, v, 1.f } );
+        }
+        std::vector<uint8_t> rgb( 3 * pixels.size() );
+        tone_mapper( 1.f, tone_curve::clamp, color_encoding::srgb ).map_row( pixels.data(), pixels.size(), rgb.data() );
+
+        int worst = 0;
+        for ( std::size_t i = 0; i < pixels.size(); i++ )
+        {
+            double v = pixels[i].r;
+            auto exact = std::lround( 255 * ( v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow( v, 1 / 2.4 ) - 0.055 ) );
+            worst = std::max( worst, static_cast<int>( std::abs( exact - rgb[3 * i] ) ) );
+        }
+
+        REQUIRE( rgb[0] == 0 );
+        REQUIRE( rgb[3 * 500] == 188 );
+        REQUIRE( rgb[3 * 1000] == 255 );
+        REQUIRE( worst <= 1 );
+    }
+
+    SECTION( "Mapping rows on many threads matches mapping them one at a time" )
+    {
+        auto image = canvas( 300, 700 );
+        for ( uint16_t y = 0; y < image.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < image.width(); x++ )
+            {
+                image.draw_pixel( x, y, f_color( x / 100.f, y / 350.f, 0.3f ) );
+            }
+        }
+        auto mapper = tone_mapper( 1.5f, tone_curve::aces, color_encoding::srgb );
+        mapper.set_threads( 4 );
+        auto parallel = mapper.map( image );
+
+        std::vector<uint8_t> serial( parallel.size() );
+        for ( uint16_t y = 0; y < image.height(); y++ )
+        {
+            mapper.map_row( image.row( y ), image.width(), serial.data() + 3 * y * image.width() );
+        }
+
+        REQUIRE( parallel == serial );
+    }
+
+    SECTION( "Writing a PPM through a tone mapper" )
+    {
+        auto image = canvas( 2, 1 );
+        image.draw_pixel( 0, 0, f_color( 1, 0.5f, 0 ) );
+        image.draw_pixel( 1, 0, f_color( 3, 0.05f, 0 ) );
+        std::ostringstream out;
+        ppm_writer writer( out, 2, 1, ppm_format::binary, tone_mapper( 1.f, tone_curve::clamp, color_encoding::srgb ) );
+        writer.write( image );
+        writer.finish();
+
+        REQUIRE( out.str() == std::string( "P6\n2 1\n255\n" ) + std::string( "\xff\xbc\x00\xff\x3f\x00", 6 ) );
+    }
+};
@@ -1,5 +1,6 @@
 #include "catch.hpp"
 #include "shapes.hpp"
+#include "transform.hpp"
 
 using namespace ls;
 
@@ -77,4 +78,117 @@ TEST_CASE( "Triangle processing", "[triangles]" )
         REQUIRE( itrs.size() == 1 );
         REQUIRE( approx( itrs[0].time(), 2.f ) );
     }
-};
\ No newline at end of file
+
+    SECTION( "Intersecting a transformed triangle through a shape pointer" )
+    {
+        shape_ptr t = triangle::create( f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ) );
+        t->set_transform( transform::translation( 0.f, 0.f, 3.f ) );
+        auto r = ray( f_point( 0, 0.5f, -2 ), f_vector( 0, 0, 1 ) );
+        auto itrs = intersect( t, r );
+
+        REQUIRE( itrs.size() == 1 );
+        REQUIRE( approx( itrs[0].time(), 5.f ) );
+    }
+
+    SECTION( "Mesh triangles interpolate the normals of their corners" )
+    {
+        auto m = mesh::create();
+        m->positions = { f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ) };
+        m->normals = { f_vector( 0, 1, 0 ), f_vector( -1, 0, 0 ), f_vector( 1, 0, 0 ) };
+        m->uvs = { texture_uv{ 0.5f, 1 }, texture_uv{ 0, 0 }, texture_uv{ 1, 0 } };
+        m->corners = { { 0, 0, 0 }, { 1, 1, 1 }, { 2, 2, 2 } };
+        auto t = mesh_triangle::create( m, 0 );
+        fpnum u, v;
+        t->barycentric( f_point( -0.2f, 0.3f, 0 ), u, v );
+
+        REQUIRE( t->p1() == f_point( 0, 1, 0 ) );
+        REQUIRE( t->p3() == f_point( 1, 0, 0 ) );
+        REQUIRE( approx( u, 0.45f ) );
+        REQUIRE( approx( v, 0.25f ) );
+        REQUIRE( t->normal( 0, 1, 0 ) == f_vector( 0, 1, 0 ) );
+        REQUIRE( t->normal( -1, 0, 0 ) == f_vector( -1, 0, 0 ) );
+        REQUIRE( t->normal( -0.2f, 0.3f, 0 ) == f_vector( -0.5547f, 0.83205f, 0 ) );
+        REQUIRE( t->uv_at( f_point( -0.2f, 0.3f, 0 ) ) == texture_uv{ 0.4f, 0.3f } );
+    }
+
+    SECTION( "Mesh triangles without corner normals are flat" )
+    {
+        auto m = mesh::create();
+        m->positions = { f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ) };
+        m->normals = { f_vector( 0, 1, 0 ) };
+        m->corners = { { 0, mesh::missing, 0 }, { 1, mesh::missing, mesh::missing }, { 2, mesh::missing, 0 } };
+        auto t = mesh_triangle::create( m, 0 );
+
+        REQUIRE( t->normal( -0.2f, 0.3f, 0 ) == f_vector( 0, 0, -1 ) );
+        REQUIRE( t->uv_at( f_point( -0.2f, 0.3f, 0 ) ) == texture_uv() );
+    }
+
+    SECTION( "Mesh triangles decode their corners from a quantized mesh" )
+    {
+        auto m = mesh::create();
+        m->positions = { f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ) };
+        m->corners = { { 0, mesh::missing, mesh::missing }, { 1, mesh::missing, mesh::missing }, { 2, mesh::missing, mesh::missing } };
+        auto t = mesh_triangle::create( m, 0 );
+        m->quantize();
+
+        REQUIRE( m->positions.empty() );
+        REQUIRE( t->p1() == m->position( 0 ) );
+        REQUIRE( std::abs( t->p2().x + 1.f ) <= m->quantization_step.x );
+        REQUIRE( t->normal() == f_vector( 0, 0, -1 ) );
+        REQUIRE( sizeof( mesh_triangle ) < sizeof( triangle ) );
+
+        auto itrs = intersect( std::static_pointer_cast<shape>( t ), ray( f_point( 0, 0.5f, -2 ), f_vector( 0, 0, 1 ) ) );
+        REQUIRE( itrs.size() == 1 );
+        REQUIRE( approx( itrs[0].time(), 2.f ) );
+    }
+
+    SECTION( "Welding duplicated mesh vertices" )
+    {
+        auto m = mesh::create();
+        m->positions = { f_point( 0, 1, 0 ), f_point( -1, 0, 0 ), f_point( 1, 0, 0 ), f_point( 1, 0, 0 ), f_point( -0.f, 1, 0 ),
+            f_point( 1.001f, 0, 0 ), f_point( 2, 2, 2 ) };
+        m->corners = { { 0, 0, 0 }, { 1, 1, 1 }, { 2, 2, 2 }, { 3, 3, 3 }, { 4, 4, 4 }, { 5, 5, 5 }, { 6, 6, 6 }, { 5, 5, 5 }, { 1, 1, 1 } };
+
+        REQUIRE( m->weld() == 2 );
+        REQUIRE( m->positions.size() == 5 );
+        REQUIRE( m->corners[3].position == 2 );
+        REQUIRE( m->corners[4].position == 0 );
+        REQUIRE( m->corners[5].position == 3 );
+        REQUIRE( m->corners[6].position == 4 );
+        REQUIRE( m->corners[5].uv == 5 );
+
+        REQUIRE( m->weld( 0.01f ) == 1 );
+        REQUIRE( m->positions.size() == 4 );
+        REQUIRE( m->positions[3] == f_point( 2, 2, 2 ) );
+        REQUIRE( m->corners[5].position == 2 );
+        REQUIRE( m->corners[6].position == 3 );
+    }
+
+    SECTION( "Quantized mesh positions are decoded within a step of the originals" )
+    {
+        auto m = mesh::create();
+        for ( int i = 0; i < 100; i++ )
+        {
+            m->positions.emplace_back( i * 0.37f - 10, std::sin( i * 0.1f ), 3 );
+        }
+        auto originals = m->positions;
+        m->corners = { { 0, mesh::missing, mesh::missing }, { 50, mesh::missing, mesh::missing }, { 99, mesh::missing, mesh::missing } };
+        m->quantize();
+
+        REQUIRE( m->quantized() );
+        REQUIRE( m->positions.empty() );
+        REQUIRE( m->vertex_count() == 100 );
+        REQUIRE( m->quantization_origin.x == -10 );
+        REQUIRE( m->quantization_step.z == 0 );
+        for ( std::size_t i = 0; i < originals.size(); i++ )
+        {
+            auto p = m->position( i );
+            REQUIRE( std::abs( p.x - originals[i].x ) <= m->quantization_step.x );
+            REQUIRE( std::abs( p.y - originals[i].y ) <= m->quantization_step.y );
+            REQUIRE( p.z == 3 );
+        }
+        auto t = mesh_triangle::create( m, 0 );
+        REQUIRE( t->p2() == m->position( 50 ) );
+        REQUIRE( m->weld() == 0 );
+    }
+};
@@ -0,0 +1,158 @@
+#include "catch.hpp"
+#include "world_snapshot.hpp"
+#include "scene_parser.hpp"
+#include "model_parser.hpp"
+#include "shapes.hpp"
+#include "lights.hpp"
+#include "materials.hpp"
+#include "world.hpp"
+#include "camera.hpp"
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+using namespace ls;
+
+namespace {
+    bool same_image( const canvas& c1, const canvas& c2 )
+    {
+        if ( c1.width() != c2.width() || c1.height() != c2.height() )
+        {
+            return false;
+        }
+        for ( uint16_t y = 0; y < c1.height(); y++ )
+        {
+            for ( uint16_t x = 0; x < c1.width(); x++ )
+            {
+                if ( !( c1.pixel_at( x, y ) == c2.pixel_at( x, y ) ) )
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+TEST_CASE( "World snapshots", "[world_snapshot]" )
+{
+    SECTION( "A restored world renders the same image without compiling again" )
+    {
+        auto parsed = scene_parser::load( "simple.scene" );
+        REQUIRE( parsed.status == scene_parse_status::SUCCESS );
+        auto original = parsed.camera->render( parsed.world );
+        world_snapshot::write( "simple.lsworld", parsed.world, parsed.camera );
+
+        auto restored = world_snapshot::load( "simple.lsworld" );
+        const auto& w = restored.world;
+        const auto& scene = w->scene();
+        REQUIRE( scene != nullptr );
+        REQUIRE( scene->primitive_count() == parsed.world->scene()->primitive_count() );
+        REQUIRE( scene->node_count() == parsed.world->scene()->node_count() );
+        REQUIRE( scene->material_count() == parsed.world->scene()->material_count() );
+
+        REQUIRE( restored.camera->width() == 100 );
+        REQUIRE( restored.camera->transform() == parsed.camera->transform() );
+        REQUIRE( same_image( restored.camera->render( w ), original ) );
+        REQUIRE( w->scene() == scene );
+
+        REQUIRE( w->lights().size() == 2 );
+        auto area = std::dynamic_pointer_cast<rectangle_light>( w->lights()[1] );
+        REQUIRE( area != nullptr );
+        REQUIRE( !area->jitter() );
+        REQUIRE( approx( area->linear_falloff(), 0.1f ) );
+
+        REQUIRE( w->objects().size() == 4 );
+        auto spheres = std::dynamic_pointer_cast<group>( w->objects()[1] );
+        REQUIRE( spheres != nullptr );
+        REQUIRE( spheres->name() == "spheres" );
+        REQUIRE( spheres->children().size() == 4 );
+        REQUIRE( spheres->children()[0]->parent() == spheres );
+        REQUIRE( spheres->children()[1]->transform() == transform::scale( 0.5f, 0.5f, 0.5f ) * transform::translation( 1.5f, 0.75f, -0.5f ) );
+
+        // Materials shared before the snapshot stay shared
+        REQUIRE( spheres->children()[1]->material() == spheres->children()[3]->material() );
+        auto parsed_spheres = std::static_pointer_cast<group>( parsed.world->objects()[1] );
+        REQUIRE( *spheres->children()[1]->material() == *parsed_spheres->children()[1]->material() );
+        std::remove( "simple.lsworld" );
+    }
+
+    SECTION( "Quantized mesh triangles are restored against their mesh" )
+    {
+        mesh_import_options options;
+        options.quantize = true;
+        auto a = std::make_shared<arena>();
+        auto parsed = model_parser::obj( "triangles.obj", a, 1, options );
+        REQUIRE( parsed.status == model_parse_status::SUCCESS );
+
+        auto w = world::create();
+        w->add_object( parsed.to_shape_group() );
+        w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( 0, 5, -5 ) ) );
+        auto cam = camera::create( 40, 20, pi_over_3 );
+        cam->set_transform( transform::view( f_point( 0, 0.5f, -3 ), f_point( 0, 0.5f, 0 ), f_vector( 0, 1, 0 ) ) );
+        auto original = cam->render( w );
+        world_snapshot::write( "quantized.lsworld", w, cam );
+
+        auto restored = world_snapshot::load( "quantized.lsworld", 2 );
+        auto root = std::dynamic_pointer_cast<group>( restored.world->objects()[0] );
+        auto part = std::dynamic_pointer_cast<group>( root->children()[0] );
+        auto tr = std::dynamic_pointer_cast<mesh_triangle>( part->children()[1] );
+        REQUIRE( tr != nullptr );
+        REQUIRE( tr->index() == 1 );
+        REQUIRE( tr->source_mesh()->quantized() );
+        REQUIRE( tr->source_mesh() == std::dynamic_pointer_cast<mesh_triangle>( part->children()[0] )->source_mesh() );
+        REQUIRE( same_image( restored.camera->render( restored.world ), original ) );
+        std::remove( "quantized.lsworld" );
+    }
+
+    SECTION( "Changing the objects of a restored world compiles it again" )
+    {
+        auto w = world::create_default();
+        world_snapshot::write( "default.lsworld", w );
+        auto restored = world_snapshot::load( "default.lsworld" );
+        REQUIRE( restored.camera == nullptr );
+        REQUIRE( !std::ifstream( "default.lsworld.partial" ) );
+        auto scene = restored.world->scene();
+        REQUIRE( restored.world->prepare() == scene );
+
+        restored.world->add_object( sphere::create() );
+        REQUIRE( restored.world->scene() == nullptr );
+        REQUIRE( restored.world->prepare()->primitive_count() == 3 );
+        std::remove( "default.lsworld" );
+    }
+
+    SECTION( "A snapshot stores the shapes as they were edited after compiling" )
+    {
+        auto w = world::create_default();
+        w->compile();
+        w->objects()[1]->set_transform( transform::translation( 0.f, 5.f, 0.f ) * transform::scale( 0.5f, 0.5f, 0.5f ) );
+        world_snapshot::write( "edited.lsworld", w );
+        auto restored = world_snapshot::load( "edited.lsworld" );
+        std::remove( "edited.lsworld" );
+
+        render_scene::hit_record record;
+        REQUIRE( restored.world->scene()->closest_hit( ray( f_point( 0, 5, -5 ), f_vector( 0, 0, 1 ) ), record ) );
+        REQUIRE( approx( record.time, 4.5f ) );
+    }
+
+    SECTION( "Only snapshots of this build are restored" )
+    {
+        REQUIRE_THROWS_AS( world_snapshot::load( "triangles.obj" ), std::runtime_error );
+
+        world_snapshot::write( "truncated.lsworld", world::create_default() );
+        std::string bytes;
+        {
+            std::ifstream in( "truncated.lsworld", std::ios::binary );
+            bytes.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+        }
+        std::ofstream( "truncated.lsworld", std::ios::binary | std::ios::trunc ).write( bytes.data(), bytes.size() / 2 );
+        REQUIRE_THROWS_WITH( world_snapshot::load( "truncated.lsworld" ), "Not a world snapshot" );
+        std::remove( "truncated.lsworld" );
+
+        auto w = world::create();
+        w->add_object( shape::create() );
+        REQUIRE_THROWS_WITH( world_snapshot::write( "custom.lsworld", w ), "World snapshots cannot store custom shapes" );
+
+        REQUIRE_THROWS_AS( world_snapshot::write( "missing_directory/default.lsworld", world::create_default() ), std::system_error );
+    }
+}
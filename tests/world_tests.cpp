@@ -32,6 +32,47 @@ TEST_CASE( "World processing", "[world]" )
         REQUIRE( w->contains( s2 ) );
     }
 
+    SECTION( "Adding objects in bulk skips duplicates" )
+    {
+        auto w = world::create();
+        auto s1 = sphere::create();
+        auto s2 = cube::create();
+        w->add_object( s1 );
+        w->add_objects( std::vector<shape_ptr>{ s1, s2, s2 } );
+
+        REQUIRE( w->objects().size() == 2 );
+        REQUIRE( w->objects()[1] == s2 );
+        REQUIRE( w->has_object( s2 ) );
+    }
+
+    SECTION( "Removing an object" )
+    {
+        auto w = world::create();
+        auto s1 = sphere::create();
+        auto s2 = sphere::create();
+        w->add_objects( std::vector<shape_ptr>{ s1, s2 } );
+        w->remove_object( s1 );
+        w->remove_object( s1 );
+
+        REQUIRE( w->objects().size() == 1 );
+        REQUIRE( !w->has_object( s1 ) );
+        REQUIRE( w->has_object( s2 ) );
+
+        w->add_object( s1 );
+        REQUIRE( w->objects().size() == 2 );
+
+        // A copy of a shape is a shape of its own, even though it shares the original's id
+        auto copy = sphere::create( *s2 );
+        copy->set_transform( transform::translation( 0.f, 2.f, 0.f ) );
+        w->remove_object( copy );
+        REQUIRE( w->objects().size() == 2 );
+        w->add_object( copy );
+        REQUIRE( w->objects().size() == 3 );
+        w->remove_object( copy );
+        REQUIRE( w->objects().size() == 2 );
+        REQUIRE( w->has_object( s2 ) );
+    }
+
     SECTION( "Intersect a world with a ray" )
     {
         auto w = world::create_default();
@@ -359,4 +400,179 @@ TEST_CASE( "World processing", "[world]" )
         
         REQUIRE( c == f_color( 0.93391f, 0.69643f, 0.69243f ) );
     }
+    
+    SECTION( "The default world tracing settings" )
+    {
+        auto w = world::create_default();
+
+        REQUIRE( w->max_depth() == default_ray_depth );
+        REQUIRE( w->min_throughput() == default_min_throughput );
+    }
+    
+    SECTION( "The reflected color is culled below the minimum throughput" )
+    {
+        auto w = world::create_default();
+        w->set_min_throughput( 0.6f );
+        auto pl = plane::create();
+        pl->material()->reflectivity = 0.5f;
+        pl->set_transform( transform::translation( 0.f, -1.f, 0.f ) );
+        w->add_object( pl );
+        auto r = ray( f_point( 0, 0, -3 ), f_vector( 0, -0.7071067f, 0.7071067f ) );
+        auto i = intersection( 1.414214f, pl );
+        auto state = prepare_intersection_state( i, r );
+        auto colr = w->reflected_color( state );
+        
+        REQUIRE( colr == f_color( 0, 0, 0 ) );
+    }
+    
+    SECTION( "shade_hit with a reflective material honors the world maximum depth" )
+    {
+        auto w = world::create_default();
+        auto pl = plane::create();
+        pl->material()->reflectivity = 0.5f;
+        pl->set_transform( transform::translation( 0.f, -1.f, 0.f ) );
+        w->add_object( pl );
+        auto r = ray( f_point( 0, 0, -3 ), f_vector( 0, -0.7071067f, 0.7071067f ) );
+        auto i = intersection( 1.414214f, pl );
+        auto state = prepare_intersection_state( i, r );
+        auto full = w->shade_hit( state );
+        w->set_max_depth( 0 );
+        auto surface = w->shade_hit( state );
+        
+        REQUIRE( full == f_color( 0.87675f, 0.92434f, 0.82917f ) );
+        REQUIRE( surface == full - f_color( 0.19033f, 0.23791f, 0.14274f ) );
+    }
+    
+    SECTION( "Culling mutually reflective surfaces by throughput" )
+    {
+        auto w = world::create();
+        w->set_light( point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, 0 ) ) );
+        w->set_max_depth( 255 );
+        w->set_min_throughput( 0.01f );
+        auto pl_lower = plane::create();
+        pl_lower->material()->reflectivity = 0.5f;
+        pl_lower->set_transform( transform::translation( 0.f, -1.f, 0.f ) );
+        w->add_object( pl_lower );
+        auto pl_upper = plane::create();
+        pl_upper->material()->reflectivity = 0.5f;
+        pl_upper->set_transform( transform::translation( 0.f, 1.f, 0.f ) );
+        w->add_object( pl_upper );
+        auto r = ray( f_point( 0, 0, 0 ), f_vector( 0, 1, 0 ) );
+        auto culled = w->color_at( r );
+        auto bounded = w->color_at( r, 6 );
+        
+        REQUIRE( culled == bounded );
+    }
+    
+    SECTION( "Setting the light replaces every light in the world" )
+    {
+        auto w = world::create_default();
+        w->add_light( point_light::create( f_color( 1, 1, 1 ), f_point( 10, 10, -10 ) ) );
+        auto l = point_light::create( f_color( 0.5f, 0.5f, 0.5f ), f_point( 0, 10, -10 ) );
+        w->set_light( l );
+        
+        REQUIRE( w->lights().size() == 1 );
+        REQUIRE( w->light() == l );
+    }
+    
+    SECTION( "Shading an intersection sums the contribution of every light" )
+    {
+        auto w = world::create_default();
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+        auto s = w->objects()[0];
+        auto i = intersection( 4, s );
+        auto state = prepare_intersection_state( i, r );
+        w->add_light( point_light::create( f_color( 1, 1, 1 ), f_point( -10, 10, -10 ) ) );
+        auto c = w->shade_hit( state );
+
+        REQUIRE( c == f_color( 0.38066f, 0.47583f, 0.2855f ) * 2.f );
+    }
+    
+    SECTION( "A light behind the surface only contributes ambient light" )
+    {
+        auto w = world::create_default();
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+        auto s = w->objects()[0];
+        auto i = intersection( 4, s );
+        auto state = prepare_intersection_state( i, r );
+        w->add_light( point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, 10 ) ) );
+        auto c = w->shade_hit( state );
+
+        REQUIRE( c == f_color( 0.38066f, 0.47583f, 0.2855f ) + f_color( 0.08f, 0.1f, 0.06f ) );
+    }
+    
+    SECTION( "A light attenuated below the minimum throughput is culled" )
+    {
+        auto w = world::create_default();
+        auto r = ray( f_point( 0, 0, -5 ), f_vector( 0, 0, 1 ) );
+        auto s = w->objects()[0];
+        auto i = intersection( 4, s );
+        auto state = prepare_intersection_state( i, r );
+        auto far_light = point_light::create( f_color( 1, 1, 1 ), f_point( 0, 0, -1000 ) );
+        far_light->set_falloff( 1.f, 0.f, 1.f );
+        w->add_light( far_light );
+        auto c = w->shade_hit( state );
+
+        REQUIRE( c == f_color( 0.38066f, 0.47583f, 0.2855f ) );
+    }
+    
+    SECTION( "A point light is either fully visible or fully occluded" )
+    {
+        auto w = world::create_default();
+
+        REQUIRE( w->light_visibility( f_point( 0, 10, 0 ), w->light() ) == 1.f );
+        REQUIRE( w->light_visibility( f_point( 10, -10, 10 ), w->light() ) == 0.f );
+    }
+    
+    SECTION( "A partially occluded area light is sampled across every stratum" )
+    {
+        auto w = world::create();
+        auto l = rectangle_light::create( f_color( 1, 1, 1 ), f_point( -1, 10, -0.5f ), f_vector( 2, 0, 0 ), 4, f_vector( 0, 0, 1 ), 1 );
+        l->set_jitter( false );
+        w->set_light( l );
+        auto blocker = sphere::create();
+        blocker->set_transform( transform::translation( -0.375f, 5.f, 0.f ) * transform::scale( 0.2f, 0.2f, 0.2f ) );
+        w->add_object( blocker );
+        
+        REQUIRE( approx( w->light_visibility( f_point( 0, 0, 0 ), l ), 0.75f ) );
+    }
+    
+    SECTION( "Interior area light samples are skipped when the outer strata agree" )
+    {
+        auto w = world::create();
+        auto l = rectangle_light::create( f_color( 1, 1, 1 ), f_point( -1, 10, -0.5f ), f_vector( 2, 0, 0 ), 4, f_vector( 0, 0, 1 ), 1 );
+        l->set_jitter( false );
+        w->set_light( l );
+        auto blocker = sphere::create();
+        blocker->set_transform( transform::translation( -0.125f, 5.f, 0.f ) * transform::scale( 0.1f, 0.1f, 0.1f ) );
+        w->add_object( blocker );
+        
+        REQUIRE( w->light_visibility( f_point( 0, 0, 0 ), l ) == 1.f );
+    }
+    
+    SECTION( "A sphere light half behind an occluder is probed on opposite sides of its disk" )
+    {
+        auto w = world::create();
+        auto l = sphere_light::create( f_color( 1, 1, 1 ), f_point( 0, 10, 0 ), 1.f, 2, 4 );
+        l->set_jitter( false );
+        w->set_light( l );
+        auto blocker = cube::create();
+        blocker->set_transform( transform::translation( 0.f, 5.f, 1.5f ) * transform::scale( 3.f, 0.5f, 1.5f ) );
+        w->add_object( blocker );
+
+        REQUIRE( l->rim_samples() == std::make_pair( 1u, 5u ) );
+        REQUIRE( approx( w->light_visibility( f_point( 0, 0, 0 ), l ), 0.5f ) );
+    }
+    
+    SECTION( "An area light fully behind an occluder is not visible" )
+    {
+        auto w = world::create();
+        auto l = sphere_light::create( f_color( 1, 1, 1 ), f_point( 0, 10, 0 ), 0.5f, 2, 4 );
+        w->set_light( l );
+        auto blocker = sphere::create();
+        blocker->set_transform( transform::translation( 0.f, 5.f, 0.f ) );
+        w->add_object( blocker );
+        
+        REQUIRE( w->light_visibility( f_point( 0, 0, 0 ), l ) == 0.f );
+    }
 };